@@ -346,6 +346,22 @@ typedef struct _decor_color {
 #define IN_EVENT_WINDOW      (1 << 0)
 #define PRESSED_EVENT_WINDOW (1 << 1)
 
+/* everything a rendered decoration depends on */
+typedef struct _decor_key {
+    void	      (*draw) (struct _decor *d);
+    guint	      serial;
+    gint	      width;
+    gint	      height;
+    gint	      client_width;
+    gint	      client_height;
+    gboolean	      active;
+    WnckWindowState   state;
+    WnckWindowActions actions;
+    guint	      button_states[BUTTON_NUM];
+    guint	      title_hash;
+    guint	      icon_hash;
+} decor_key_t;
+
 typedef struct _decor {
     Window	      event_windows[3][3];
     Window	      button_windows[BUTTON_NUM];
@@ -374,8 +390,29 @@ typedef struct _decor {
     XID		      prop_xid;
     GtkWidget	      *force_quit_dialog;
     void	      (*draw) (struct _decor *d);
+    Window	      xid;
+    guint	      icon_hash;
+    long	      *prop_data;
+    int		      prop_size;
+    long	      *blur_data;
+    int		      blur_size;
+    cairo_surface_t   *frame_surface;
+    decor_key_t	      frame_key;
+    struct _decor_cache_entry *cache_entry;
 } decor_t;
 
+/* rendered decoration that windows with equal keys share */
+typedef struct _decor_cache_entry {
+    decor_key_t     key;
+    gchar	    *name;
+    cairo_surface_t *surface;
+    long	    *prop_data;
+    int		    prop_size;
+    long	    *blur_data;
+    int		    blur_size;
+    gint	    users;
+} decor_cache_entry_t;
+
 void     (*theme_draw_window_decoration)    (decor_t *d);
 gboolean (*theme_calc_decoration_size)      (decor_t *d,
 					     int     client_width,
@@ -423,6 +460,9 @@ static gint	     tooltip_timer_tag = 0;
 static GSList *draw_list = NULL;
 static guint  draw_idle_id = 0;
 
+static GHashTable *decor_cache = NULL;
+static guint	  decor_cache_serial = 0;
+
 static PangoFontDescription *titlebar_font = NULL;
 static gboolean		    use_system_font = FALSE;
 static gint		    text_height;
@@ -439,6 +479,54 @@ static Window    switcher_selected_window = None;
 
 static XRenderPictFormat *xformat;
 
+/* keeps a copy of property data last set on a window so that it can be
+   handed to windows sharing the decoration */
+static void
+decor_save_property (long **data_return,
+		     int  *size_return,
+		     long *data,
+		     int  size)
+{
+    g_free (*data_return);
+
+    *data_return = NULL;
+    *size_return = 0;
+
+    if (data)
+    {
+	*data_return = g_malloc (sizeof (long) * size);
+	*size_return = size;
+
+	memcpy (*data_return, data, sizeof (long) * size);
+    }
+}
+
+static void
+decor_get_key (decor_t	   *d,
+	       decor_key_t *key,
+	       gboolean	   title)
+{
+    memset (key, 0, sizeof (decor_key_t));
+
+    key->draw	       = d->draw;
+    key->serial	       = decor_cache_serial;
+    key->width	       = d->width;
+    key->height	       = d->height;
+    key->client_width  = d->client_width;
+    key->client_height = d->client_height;
+    key->active	       = d->active;
+    key->state	       = d->state;
+    key->actions       = d->actions;
+
+    memcpy (key->button_states, d->button_states, sizeof (d->button_states));
+
+    if (title)
+    {
+	key->title_hash = d->name ? g_str_hash (d->name) : 0;
+	key->icon_hash  = d->icon_hash;
+    }
+}
+
 static void
 decor_update_blur_property (decor_t *d,
 			    int     width,
@@ -499,6 +587,8 @@ decor_update_blur_property (decor_t *d,
 	gdk_error_trap_pop ();
 #endif
 
+	decor_save_property (&d->blur_data, &d->blur_size, data, 2 + size * 6);
+
 	g_free (data);
     }
     else
@@ -511,6 +601,8 @@ decor_update_blur_property (decor_t *d,
 #else
 	gdk_error_trap_pop ();
 #endif
+
+	decor_save_property (&d->blur_data, &d->blur_size, NULL, 0);
     }
 }
 
@@ -565,6 +657,10 @@ decor_update_window_property (decor_t *d)
     gdk_error_trap_pop ();
 #endif
 
+    decor_save_property (&d->prop_data, &d->prop_size, data,
+			 PROP_HEADER_SIZE + BASE_PROP_SIZE +
+			 QUAD_PROP_SIZE * N_QUADS_MAX);
+
     top.rects = &top.extents;
     top.numRects = top.size = 1;
 
@@ -675,6 +771,28 @@ new_surface_from_pixbuf (GdkPixbuf *src)
     return surface;
 }
 
+static guint
+pixbuf_hash (GdkPixbuf *pixbuf)
+{
+    const guchar *pixels;
+    guint	 hash = 2166136261u;
+    int		 x, y, width, height, stride;
+
+    if (!pixbuf)
+	return 0;
+
+    pixels = gdk_pixbuf_get_pixels (pixbuf);
+    stride = gdk_pixbuf_get_rowstride (pixbuf);
+    height = gdk_pixbuf_get_height (pixbuf);
+    width  = gdk_pixbuf_get_width (pixbuf) * gdk_pixbuf_get_n_channels (pixbuf);
+
+    for (y = 0; y < height; y++)
+	for (x = 0; x < width; x++)
+	    hash = (hash ^ pixels[y * stride + x]) * 16777619u;
+
+    return hash;
+}
+
 static gboolean
 destroy_surface_idled (gpointer data)
 {
@@ -995,16 +1113,15 @@ copy_to_front_buffer (decor_t *d)
 }
 
 static void
-draw_window_decoration (decor_t *d)
+draw_window_frame (decor_t *d,
+		   cairo_t *cr)
 {
-    cairo_t         *cr;
 #if GTK_CHECK_VERSION (3, 0, 0)
     GtkStyleContext *context;
     GdkRGBA	    bg, fg;
 #else
     GtkStyle	    *style;
 #endif
-    cairo_surface_t *surface;
     decor_color_t   color;
     double          alpha;
     double          x1, y1, x2, y2, x, y, h;
@@ -1012,9 +1129,6 @@ draw_window_decoration (decor_t *d)
     int		    top;
     int		    button_x;
 
-    if (!d->surface)
-	return;
-
 #if GTK_CHECK_VERSION (3, 0, 0)
     context = gtk_widget_get_style_context (style_window);
 
@@ -1041,15 +1155,6 @@ draw_window_decoration (decor_t *d)
     color.b = style->bg[GTK_STATE_NORMAL].blue  / 65535.0;
 #endif
 
-    if (d->buffer_surface)
-	surface = d->buffer_surface;
-    else
-	surface = d->surface;
-
-    cr = cairo_create (surface);
-    if (!cr)
-	return;
-
     cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
 
     top = _win_extents.top + titlebar_height;
@@ -1404,6 +1509,85 @@ draw_window_decoration (decor_t *d)
 	    cairo_fill (cr);
 	}
     }
+}
+
+static void
+draw_window_decoration (decor_t *d)
+{
+    cairo_t         *cr;
+#if GTK_CHECK_VERSION (3, 0, 0)
+    GtkStyleContext *context;
+    GdkRGBA	    fg;
+#else
+    GtkStyle	    *style;
+#endif
+    cairo_surface_t *surface;
+    decor_key_t     frame_key;
+    double          alpha, y1;
+
+    if (!d->surface)
+	return;
+
+#if GTK_CHECK_VERSION (3, 0, 0)
+    context = gtk_widget_get_style_context (style_window);
+
+    gtk_style_context_save (context);
+    gtk_style_context_set_state (context, GTK_STATE_FLAG_NORMAL);
+    gtk_style_context_get_color (context, gtk_style_context_get_state (context), &fg);
+    gtk_style_context_restore (context);
+#else
+    style = gtk_widget_get_style (style_window);
+#endif
+
+    if (d->buffer_surface)
+	surface = d->buffer_surface;
+    else
+	surface = d->surface;
+
+    /* the frame is kept in its own layer so that a new title or icon
+       is drawn on top of it without redrawing the frame */
+    if (!d->frame_surface)
+    {
+	d->frame_surface = create_surface (d->width, d->height);
+	memset (&d->frame_key, 0, sizeof (decor_key_t));
+    }
+
+    decor_get_key (d, &frame_key, FALSE);
+
+    if (d->frame_surface &&
+	memcmp (&frame_key, &d->frame_key, sizeof (decor_key_t)) != 0)
+    {
+	cr = cairo_create (d->frame_surface);
+	draw_window_frame (d, cr);
+	cairo_destroy (cr);
+
+	d->frame_key = frame_key;
+    }
+
+    cr = cairo_create (surface);
+    if (!cr)
+	return;
+
+    if (d->frame_surface)
+    {
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface (cr, d->frame_surface, 0, 0);
+	cairo_paint (cr);
+    }
+    else
+    {
+	draw_window_frame (d, cr);
+    }
+
+    cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+    cairo_set_line_width (cr, 2.0);
+
+    if (d->active)
+	alpha = decoration_alpha + 0.3;
+    else
+	alpha = decoration_alpha;
+
+    y1 = d->context->top_space - _win_extents.top - titlebar_height;
 
     if (d->layout)
     {
@@ -1558,6 +1742,10 @@ decor_update_meta_window_property (decor_t	  *d,
     gdk_error_trap_pop ();
 #endif
 
+    decor_save_property (&d->prop_data, &d->prop_size, data,
+			 PROP_HEADER_SIZE + BASE_PROP_SIZE +
+			 QUAD_PROP_SIZE * N_QUADS_MAX);
+
     decor_update_blur_property (d,
 				w, lh,
 				top, top_stretch_offset,
@@ -2766,6 +2954,199 @@ draw_switcher_decoration (decor_t *d)
     draw_switcher_foreground (d);
 }
 
+static guint
+decor_cache_hash (gconstpointer key)
+{
+    const decor_cache_entry_t *entry = key;
+    const guchar	      *p = (const guchar *) &entry->key;
+    guint		      hash = 2166136261u;
+    gsize		      i;
+
+    for (i = 0; i < sizeof (decor_key_t); i++)
+	hash = (hash ^ p[i]) * 16777619u;
+
+    return hash;
+}
+
+static gboolean
+decor_cache_equal (gconstpointer a,
+		   gconstpointer b)
+{
+    const decor_cache_entry_t *ea = a;
+    const decor_cache_entry_t *eb = b;
+
+    return memcmp (&ea->key, &eb->key, sizeof (decor_key_t)) == 0 &&
+	g_strcmp0 (ea->name, eb->name) == 0;
+}
+
+static void
+decor_cache_release (decor_t *d)
+{
+    decor_cache_entry_t *entry = d->cache_entry;
+
+    if (!entry)
+	return;
+
+    d->cache_entry = NULL;
+
+    entry->users--;
+    if (entry->users)
+	return;
+
+    g_hash_table_remove (decor_cache, entry);
+
+    /* the decoration plugin might still be using it */
+    g_timeout_add_seconds (1, destroy_surface_idled, entry->surface);
+
+    g_free (entry->name);
+    g_free (entry->prop_data);
+    g_free (entry->blur_data);
+    g_free (entry);
+}
+
+static void
+decor_cache_insert (decor_t *d)
+{
+    decor_cache_entry_t *entry;
+
+    /* only decorations that have their property set can be shared */
+    if (!d->prop_data)
+	return;
+
+    entry = g_malloc0 (sizeof (decor_cache_entry_t));
+
+    decor_get_key (d, &entry->key, TRUE);
+
+    entry->name	   = g_strdup (d->name);
+    entry->surface = cairo_surface_reference (d->surface);
+    entry->users   = 1;
+
+    decor_save_property (&entry->prop_data, &entry->prop_size,
+			 d->prop_data, d->prop_size);
+    decor_save_property (&entry->blur_data, &entry->blur_size,
+			 d->blur_data, d->blur_size);
+
+    g_hash_table_insert (decor_cache, entry, entry);
+
+    d->cache_entry = entry;
+}
+
+/* Points the window at the pixmap of a decoration that another window
+   has already rendered */
+static void
+decor_cache_use (decor_t	     *d,
+		 decor_cache_entry_t *entry)
+{
+    Display *xdisplay = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
+
+    if (d->cache_entry != entry)
+    {
+	decor_cache_release (d);
+
+	g_timeout_add_seconds (1, destroy_surface_idled, d->surface);
+
+	if (d->cr)
+	    cairo_destroy (d->cr);
+
+	d->surface = cairo_surface_reference (entry->surface);
+	d->cr	   = cairo_create (d->surface);
+
+	entry->users++;
+	d->cache_entry = entry;
+    }
+    else if (!d->prop_xid)
+    {
+	return;
+    }
+
+    gdk_error_trap_push ();
+    XChangeProperty (xdisplay, d->xid,
+		     win_decor_atom,
+		     XA_INTEGER,
+		     32, PropModeReplace, (guchar *) entry->prop_data,
+		     entry->prop_size);
+    if (entry->blur_data)
+	XChangeProperty (xdisplay, d->xid,
+			 win_blur_decor_atom,
+			 XA_INTEGER,
+			 32, PropModeReplace, (guchar *) entry->blur_data,
+			 entry->blur_size);
+    else
+	XDeleteProperty (xdisplay, d->xid, win_blur_decor_atom);
+    gdk_display_sync (gdk_display_get_default ());
+#if GTK_CHECK_VERSION (3, 0, 0)
+    gdk_error_trap_pop_ignored ();
+#else
+    gdk_error_trap_pop ();
+#endif
+
+    decor_save_property (&d->prop_data, &d->prop_size,
+			 entry->prop_data, entry->prop_size);
+    decor_save_property (&d->blur_data, &d->blur_size,
+			 entry->blur_data, entry->blur_size);
+
+    d->prop_xid = 0;
+}
+
+static void
+draw_decor (decor_t *d)
+{
+    decor_cache_entry_t *entry, lookup;
+
+    if (!d->decorated || !d->surface || !d->picture)
+    {
+	(*d->draw) (d);
+	return;
+    }
+
+    if (!decor_cache)
+	decor_cache = g_hash_table_new (decor_cache_hash, decor_cache_equal);
+
+    decor_get_key (d, &lookup.key, TRUE);
+    lookup.name = d->name;
+
+    entry = g_hash_table_lookup (decor_cache, &lookup);
+    if (entry)
+    {
+	decor_cache_use (d, entry);
+	return;
+    }
+
+    if (d->cache_entry)
+    {
+	/* other windows still show the shared pixmap, this window needs
+	   a pixmap of its own before it can draw */
+	if (d->cache_entry->users > 1)
+	{
+	    cairo_surface_t *surface;
+
+	    surface = create_surface (d->width, d->height);
+	    if (!surface)
+		return;
+
+	    decor_cache_release (d);
+
+	    cairo_surface_destroy (d->surface);
+
+	    if (d->cr)
+		cairo_destroy (d->cr);
+
+	    d->surface = surface;
+	    d->cr      = cairo_create (surface);
+
+	    d->prop_xid = d->xid;
+	}
+	else
+	{
+	    decor_cache_release (d);
+	}
+    }
+
+    (*d->draw) (d);
+
+    decor_cache_insert (d);
+}
+
 static gboolean
 draw_decor_list (void *data)
 {
@@ -2777,7 +3158,7 @@ draw_decor_list (void *data)
     for (list = draw_list; list; list = list->next)
     {
 	d = (decor_t *) list->data;
-	(*d->draw) (d);
+	draw_decor (d);
     }
 
     g_slist_free (draw_list);
@@ -3684,6 +4065,9 @@ update_window_decoration_icon (WnckWindow *win)
     d->icon_pixbuf = gdk_pixbuf_scale_simple (d->icon_pixbuf, icon_width * scale,
                                               icon_height * scale, GDK_INTERP_BILINEAR);
 
+    /* identical icons keep decorations shareable */
+    d->icon_hash = pixbuf_hash (d->icon_pixbuf);
+
     if (d->icon_pixbuf)
     {
 	cairo_t	*cr;
@@ -3896,6 +4280,8 @@ update_window_decoration_size (WnckWindow *win)
     picture = XRenderCreatePicture (xdisplay, cairo_xlib_surface_get_drawable (buffer_surface),
 				    xformat, 0, NULL);
 
+    decor_cache_release (d);
+
     /* wait until old surfaces are not used for sure,
        one second should be enough */
     if (d->surface)
@@ -3904,6 +4290,12 @@ update_window_decoration_size (WnckWindow *win)
     if (d->buffer_surface)
 	cairo_surface_destroy (d->buffer_surface);
 
+    if (d->frame_surface)
+    {
+	cairo_surface_destroy (d->frame_surface);
+	d->frame_surface = NULL;
+    }
+
     if (d->picture)
 	XRenderFreePicture (xdisplay, d->picture);
 
@@ -4160,12 +4552,28 @@ remove_frame_window (WnckWindow *win)
 
     xdisplay = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
 
+    decor_cache_release (d);
+
     if (d->surface)
     {
 	cairo_surface_destroy (d->surface);
 	d->surface = NULL;
     }
 
+    if (d->frame_surface)
+    {
+	cairo_surface_destroy (d->frame_surface);
+	d->frame_surface = NULL;
+    }
+
+    g_free (d->prop_data);
+    d->prop_data = NULL;
+    d->prop_size = 0;
+
+    g_free (d->blur_data);
+    d->blur_data = NULL;
+    d->blur_size = 0;
+
     if (d->buffer_surface)
     {
 	cairo_surface_destroy (d->buffer_surface);
@@ -4386,6 +4794,8 @@ window_opened (WnckScreen *screen,
 
     xid = wnck_window_get_xid (win);
 
+    d->xid = xid;
+
     if (get_window_prop (xid, select_window_atom, &window))
     {
 	d->prop_xid = wnck_window_get_xid (win);
@@ -6090,6 +6500,8 @@ static int
 update_shadow (void)
 {
     decor_shadow_options_t opt;
+    decor_shadow_t	   *old_no_border_shadow;
+    decor_shadow_t	   *old_switcher_shadow;
     GdkDisplay		   *display  = gdk_display_get_default ();
     Display		   *xdisplay = GDK_DISPLAY_XDISPLAY (display);
     GdkScreen		   *screen   = gdk_display_get_default_screen (display);
@@ -6102,24 +6514,25 @@ update_shadow (void)
     opt.shadow_offset_x = shadow_offset_x;
     opt.shadow_offset_y = shadow_offset_y;
 
-    if (no_border_shadow)
-    {
-	decor_shadow_destroy (xdisplay, no_border_shadow);
-	no_border_shadow = NULL;
-    }
-
-    no_border_shadow = decor_shadow_create (xdisplay,
-					    gdk_x11_screen_get_xscreen (screen),
-					    1, 1,
-					    0,
-					    0,
-					    0,
-					    0,
-					    0, 0, 0, 0,
-					    &opt,
-					    &shadow_context,
-					    decor_draw_simple,
-					    0);
+    /* shadows drawn with decor_draw_simple only depend on the options
+       and are released after creating the new ones so that unchanged
+       shadows are reused from the libdecoration shadow cache */
+    old_no_border_shadow = no_border_shadow;
+    old_switcher_shadow  = switcher_shadow;
+
+    no_border_shadow =
+	decor_shadow_create_cached (xdisplay,
+				    gdk_x11_screen_get_xscreen (screen),
+				    1, 1,
+				    0,
+				    0,
+				    0,
+				    0,
+				    0, 0, 0, 0,
+				    &opt,
+				    &shadow_context,
+				    decor_draw_simple,
+				    0);
 
     if (border_shadow)
     {
@@ -6171,31 +6584,32 @@ update_shadow (void)
 			     draw_border_shape,
 			     (void *) 1);
 
-    if (switcher_shadow)
-    {
-	decor_shadow_destroy (xdisplay, switcher_shadow);
-	switcher_shadow = NULL;
-    }
-
-    switcher_shadow = decor_shadow_create (xdisplay,
-					   gdk_x11_screen_get_xscreen (screen),
-					   1, 1,
-					   _switcher_extents.left,
-					   _switcher_extents.right,
-					   _switcher_extents.top,
-					   _switcher_extents.bottom,
-					   _switcher_extents.left -
-					   TRANSLUCENT_CORNER_SIZE,
-					   _switcher_extents.right -
-					   TRANSLUCENT_CORNER_SIZE,
-					   _switcher_extents.top -
-					   TRANSLUCENT_CORNER_SIZE,
-					   _switcher_extents.bottom -
-					   TRANSLUCENT_CORNER_SIZE,
-					   &opt,
-					   &switcher_context,
-					   decor_draw_simple,
-					   0);
+    switcher_shadow =
+	decor_shadow_create_cached (xdisplay,
+				    gdk_x11_screen_get_xscreen (screen),
+				    1, 1,
+				    _switcher_extents.left,
+				    _switcher_extents.right,
+				    _switcher_extents.top,
+				    _switcher_extents.bottom,
+				    _switcher_extents.left -
+				    TRANSLUCENT_CORNER_SIZE,
+				    _switcher_extents.right -
+				    TRANSLUCENT_CORNER_SIZE,
+				    _switcher_extents.top -
+				    TRANSLUCENT_CORNER_SIZE,
+				    _switcher_extents.bottom -
+				    TRANSLUCENT_CORNER_SIZE,
+				    &opt,
+				    &switcher_context,
+				    decor_draw_simple,
+				    0);
+
+    if (old_no_border_shadow)
+	decor_shadow_destroy (xdisplay, old_no_border_shadow);
+
+    if (old_switcher_shadow)
+	decor_shadow_destroy (xdisplay, old_switcher_shadow);
 
     return 1;
 }
@@ -6701,6 +7115,9 @@ decorations_changed (WnckScreen *screen)
     gdkdisplay = gdk_display_get_default ();
     gdkscreen  = gdk_display_get_default_screen (gdkdisplay);
 
+    /* decorations rendered with the old settings can't be shared */
+    decor_cache_serial++;
+
     update_titlebar_font ();
     (*theme_update_border_extents) (text_height);
     update_shadow ();
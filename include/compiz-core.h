@@ -29,7 +29,7 @@
 #include <compiz-plugin.h>
 #include <dlfcn.h>
 
-#define CORE_ABIVERSION 20180927
+#define CORE_ABIVERSION 20261026
 
 #include <stdio.h>
 #include <sys/time.h>
@@ -79,6 +79,12 @@ typedef struct _CompFunctionData  CompFunctionData;
 typedef struct _FragmentAttrib    FragmentAttrib;
 typedef struct _CompCursor	  CompCursor;
 typedef struct _CompMatch	  CompMatch;
+typedef struct _CompMatchInst	  CompMatchInst;
+typedef struct _CompWindowThumbnail CompWindowThumbnail;
+typedef struct _CompMetadataIndex   CompMetadataIndex;
+typedef struct _CompPluginPrefetch  CompPluginPrefetch;
+typedef struct _CompIconCache	    CompIconCache;
+typedef struct _CompImageCache	    CompImageCache;
 typedef struct _CompOutput        CompOutput;
 typedef struct _CompWalker        CompWalker;
 
@@ -223,6 +229,8 @@ extern Bool       noDetection;
 extern Bool       useDesktopHints;
 extern Bool       onlyCurrentScreen;
 extern Bool       noFBO;
+extern Bool       startupBench;
+extern Bool       startupComplete;
 
 extern char	**initialPlugins;
 extern int 	nInitialPlugins;
@@ -466,6 +474,11 @@ struct _CompMatch {
     CompDisplay *display;
     CompMatchOp *op;
     int		nOp;
+
+    /* flattened form of op, built by matchUpdate */
+    CompMatchInst *inst;
+    int		  nInst;
+    unsigned int  serial;
 };
 
 typedef struct {
@@ -788,11 +801,16 @@ removeFileWatch (CompFileWatchHandle handle);
 #define COMP_DISPLAY_OPTION_EDGE_DELAY                       33
 #define COMP_DISPLAY_OPTION_CURSOR_THEME                     34
 #define COMP_DISPLAY_OPTION_CURSOR_SIZE                      35
-#define COMP_DISPLAY_OPTION_NUM                              36
+#define COMP_DISPLAY_OPTION_IMAGE_CACHE_SIZE                 36
+#define COMP_DISPLAY_OPTION_NUM                              37
 
 typedef void (*HandleEventProc) (CompDisplay *display,
 				 XEvent	     *event);
 
+typedef void (*WindowPropertiesChangedProc) (CompWindow *window,
+					     Atom	*property,
+					     int	nProperty);
+
 typedef void (*HandleCompizEventProc) (CompDisplay *display,
 				       const char  *pluginName,
 				       const char  *eventName,
@@ -872,6 +890,13 @@ typedef void (*MatchInitExpProc) (CompDisplay  *display,
 
 typedef void (*MatchExpHandlerChangedProc) (CompDisplay *display);
 
+/*
+  Results of matchEval are cached per window until a window property
+  that match expressions can depend on changes. Wrappers of this hook
+  may evaluate matches before calling down, so it must not be called
+  directly: windowMatchPropertyChanged invalidates the cached results
+  of the window and then calls it.
+*/
 typedef void (*MatchPropertyChangedProc) (CompDisplay *display,
 					  CompWindow  *window);
 
@@ -1085,6 +1110,14 @@ struct _CompDisplay {
     Bool grabbed;
 
     void *reserved;
+
+    /* window properties changed by the PropertyNotify events of the
+       current event batch, handled once the batch is processed */
+    WindowPropertiesChangedProc windowPropertiesChanged;
+    Bool			dirtyWindowProperties;
+
+    /* decoded images shared by all readers of the same file */
+    CompImageCache *imageCache;
 };
 
 #define GET_CORE_DISPLAY(object) ((CompDisplay *) (object))
@@ -1144,6 +1177,13 @@ logMessage (const char   *componentName,
 const char *
 logLevelToString (CompLogLevel level);
 
+void
+startupTrace (const char *format,
+	      ...);
+
+void
+finishStartup (void);
+
 void
 launchFallbackWM (void);
 
@@ -1223,6 +1263,17 @@ readImageFromFile (CompDisplay *display,
 		   int	       *height,
 		   void	       **data);
 
+Bool
+acquireImageData (CompDisplay *display,
+		  const char  *name,
+		  int	      *width,
+		  int	      *height,
+		  const void  **data);
+
+void
+releaseImageData (CompDisplay *display,
+		  const void  *data);
+
 Bool
 writeImageToFile (CompDisplay *display,
 		  const char  *path,
@@ -1282,6 +1333,18 @@ handleCompizEvent (CompDisplay *display,
 void
 handleSyncAlarm (CompWindow *w);
 
+void
+windowPropertiesChanged (CompWindow *w,
+			 Atom	    *property,
+			 int	    nProperty);
+
+void
+setWindowPropertyDirty (CompWindow *w,
+			Atom	   property);
+
+void
+handleWindowPropertyChanges (CompDisplay *d);
+
 Bool
 eventMatches (CompDisplay *display,
 	      XEvent      *event,
@@ -1600,6 +1663,37 @@ paintCursor (CompCursor		 *cursor,
 	     Region		 region,
 	     unsigned int	 mask);
 
+/* downscaled copy of a window's contents, including the input
+   extents, rendered into a texture through a framebuffer object */
+struct _CompWindowThumbnail {
+    CompTexture	      *texture;
+    int		      width, height;
+    int		      sourceWidth, sourceHeight;
+    Bool	      damaged;
+    struct timeval    lastUpdate;
+    CompTimeoutHandle timeoutHandle;
+};
+
+/* minimum time in ms between two renders of a damaged thumbnail */
+#define WINDOW_THUMBNAIL_UPDATE_INTERVAL 50
+
+CompWindowThumbnail *
+getWindowThumbnail (CompWindow *w,
+		    int	       width,
+		    int	       height);
+
+void
+drawWindowThumbnail (CompWindow		  *w,
+		     CompWindowThumbnail  *thumb,
+		     const FragmentAttrib *fragment,
+		     unsigned int	  mask);
+
+void
+damageWindowThumbnail (CompWindow *w);
+
+void
+freeWindowThumbnail (CompWindow *w);
+
 /* texture.c */
 
 #define POWER_OF_TWO(v) ((v & (v - 1)) == 0)
@@ -1637,6 +1731,10 @@ void
 destroyTexture (CompScreen  *screen,
 		CompTexture *texture);
 
+void
+premultiplyImageData (char	   *data,
+		      unsigned int nPixel);
+
 Bool
 imageBufferToTexture (CompScreen   *screen,
 		      CompTexture  *texture,
@@ -1901,6 +1999,10 @@ typedef void (*WindowUngrabNotifyProc) (CompWindow *window);
 typedef void (*WindowStateChangeNotifyProc) (CompWindow   *window,
 					     unsigned int lastState);
 
+/* server side geometry or frame extents of a window changed, called
+   when a configure request is sent, before the server confirms it */
+typedef void (*WindowServerGeometryNotifyProc) (CompWindow *window);
+
 typedef void (*OutputChangeNotifyProc) (CompScreen *screen);
 
 typedef unsigned int (*AddSupportedAtomsProc) (CompScreen   *s,
@@ -2226,12 +2328,19 @@ struct _CompScreen {
 
     WindowStateChangeNotifyProc windowStateChangeNotify;
 
+    WindowServerGeometryNotifyProc windowServerGeometryNotify;
+
     OutputChangeNotifyProc outputChangeNotify;
     AddSupportedAtomsProc  addSupportedAtoms;
 
     InitWindowWalkerProc initWindowWalker;
 
     void *reserved;
+
+    GLuint thumbnailFbo;
+
+    /* window icons shared by all windows with identical icon data */
+    CompIconCache *iconCache;
 };
 
 #define GET_CORE_SCREEN(object) ((CompScreen *) (object))
@@ -2575,6 +2684,14 @@ typedef struct _CompStruts {
     XRectangle bottom;
 } CompStruts;
 
+#define MATCH_CACHE_SIZE 16
+
+typedef struct _CompMatchCacheEntry {
+    unsigned int serial;
+    unsigned int generation;
+    Bool	 result;
+} CompMatchCacheEntry;
+
 struct _CompWindow {
     CompObject base;
 
@@ -2714,6 +2831,15 @@ struct _CompWindow {
     CompWindowExtents clientFrame;
     CompWindowExtents frameInput;
     unsigned int  syncWaitHandle;
+
+    unsigned int	matchGeneration;
+    CompMatchCacheEntry matchCache[MATCH_CACHE_SIZE];
+
+    CompWindowThumbnail *thumbnail;
+
+    Atom *dirtyProperty;
+    int  nDirtyProperty;
+    int  dirtyPropertySize;
 };
 
 #define GET_CORE_WINDOW(object) ((CompWindow *) (object))
@@ -2880,6 +3006,14 @@ updateWindowRegion (CompWindow *w);
 Bool
 updateWindowStruts (CompWindow *w);
 
+void
+prefetchWindowProperties (CompDisplay *display,
+			  Window      *id,
+			  int	      nId);
+
+void
+finiWindowPropertyPrefetch (CompDisplay *display);
+
 void
 addWindow (CompScreen *screen,
 	   Window     id,
@@ -3029,6 +3163,9 @@ void
 windowStateChangeNotify (CompWindow   *w,
 			 unsigned int lastState);
 
+void
+windowServerGeometryNotify (CompWindow *w);
+
 void
 moveInputFocusToWindow (CompWindow *w);
 
@@ -3179,6 +3316,17 @@ findActivePlugin (const char *name);
 CompPlugin *
 loadPlugin (const char *plugin);
 
+CompPluginPrefetch *
+prefetchPlugins (char **name,
+		 int  nName);
+
+CompPlugin *
+loadPrefetchedPlugin (CompPluginPrefetch *prefetch,
+		      const char	 *name);
+
+void
+finiPluginPrefetch (CompPluginPrefetch *prefetch);
+
 void
 unloadPlugin (CompPlugin *p);
 
@@ -3418,6 +3566,12 @@ void
 matchPropertyChanged (CompDisplay *display,
 		      CompWindow  *window);
 
+void
+invalidateWindowMatchCache (CompWindow *window);
+
+void
+windowMatchPropertyChanged (CompWindow *window);
+
 
 /* metadata.c */
 
@@ -3444,6 +3598,9 @@ struct _CompMetadata {
     char   *path;
     xmlDoc **doc;
     int    nDoc;
+
+    /* option elements sorted by name, built on first use */
+    CompMetadataIndex *index;
 };
 
 Bool
@@ -3536,6 +3693,12 @@ compReadXmlChunkFromMetadataOptionInfo (const CompMetadataOptionInfo *info,
 					char			     *buffer,
 					int			     length);
 
+void
+compPrefetchMetadataFromFile (const char *file);
+
+void
+compFlushPrefetchedMetadata (void);
+
 
 COMPIZ_END_DECLS
 
@@ -30,7 +30,7 @@
 
 COMPIZ_BEGIN_DECLS
 
-#define SCALE_ABIVERSION 20081007
+#define SCALE_ABIVERSION 20261018
 
 #define SCALE_STATE_NONE 0
 #define SCALE_STATE_OUT  1
@@ -111,6 +111,8 @@ typedef enum {
     ScaleTypeAll
 } ScaleType;
 
+typedef struct _ScaleLayoutCache ScaleLayoutCache;
+
 typedef Bool (*ScaleLayoutSlotsAndAssignWindowsProc) (CompScreen *s);
 
 typedef Bool (*ScaleSetScaledPaintAttributesProc) (CompWindow        *w,
@@ -156,7 +158,7 @@ typedef struct _ScaleScreen {
     int        slotsSize;
     int        nSlots;
 
-    /* only used for sorting */
+    /* windows taking part in the layout, top most window first */
     CompWindow **windows;
     int        windowsSize;
     int        nWindows;
@@ -169,6 +171,9 @@ typedef struct _ScaleScreen {
 
     CompMatch match;
     CompMatch *currentMatch;
+
+    /* slot search tree and result of the last layout */
+    ScaleLayoutCache *layoutCache;
 } ScaleScreen;
 
 typedef struct _ScaleWindow {
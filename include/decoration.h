@@ -382,6 +382,24 @@ decor_shadow_create (Display		    *xdisplay,
 		     decor_draw_func_t      draw,
 		     void		    *closure);
 
+decor_shadow_t *
+decor_shadow_create_cached (Display		   *xdisplay,
+			    Screen		   *screen,
+			    int			   width,
+			    int			   height,
+			    int			   left,
+			    int			   right,
+			    int			   top,
+			    int			   bottom,
+			    int			   solid_left,
+			    int			   solid_right,
+			    int			   solid_top,
+			    int			   solid_bottom,
+			    decor_shadow_options_t *opt,
+			    decor_context_t	   *context,
+			    decor_draw_func_t	   draw,
+			    void		   *closure);
+
 void
 decor_shadow_destroy (Display	     *xdisplay,
 		      decor_shadow_t *shadow);
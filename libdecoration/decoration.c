@@ -1598,14 +1598,154 @@ decor_shadow_create (Display		    *xdisplay,
     return shadow;
 }
 
+/* shadows created with decor_shadow_create_cached that are still
+   referenced, along with everything that went into rendering them */
+typedef struct _decor_shadow_cache {
+    struct _decor_shadow_cache *next;
+    Display		       *xdisplay;
+    Screen		       *screen;
+    int			       width;
+    int			       height;
+    int			       left;
+    int			       right;
+    int			       top;
+    int			       bottom;
+    int			       solid_left;
+    int			       solid_right;
+    int			       solid_top;
+    int			       solid_bottom;
+    decor_shadow_options_t     opt;
+    decor_context_t	       context;
+    decor_draw_func_t	       draw;
+    void		       *closure;
+    decor_shadow_t	       *shadow;
+} decor_shadow_cache_t;
+
+static decor_shadow_cache_t *shadow_cache = NULL;
+
+static int
+shadow_options_equal (decor_shadow_options_t *a,
+		      decor_shadow_options_t *b)
+{
+    return a->shadow_radius   == b->shadow_radius   &&
+	   a->shadow_opacity  == b->shadow_opacity  &&
+	   a->shadow_color[0] == b->shadow_color[0] &&
+	   a->shadow_color[1] == b->shadow_color[1] &&
+	   a->shadow_color[2] == b->shadow_color[2] &&
+	   a->shadow_offset_x == b->shadow_offset_x &&
+	   a->shadow_offset_y == b->shadow_offset_y;
+}
+
+/* Like decor_shadow_create but returns a new reference to an equal
+   shadow created by an earlier call if it is still referenced, instead
+   of rendering it again. Only suitable when draw produces the same shape
+   for the same closure every time. The cache is global and not locked,
+   so this must not be called from more than one thread. */
+decor_shadow_t *
+decor_shadow_create_cached (Display		   *xdisplay,
+			    Screen		   *screen,
+			    int			   width,
+			    int			   height,
+			    int			   left,
+			    int			   right,
+			    int			   top,
+			    int			   bottom,
+			    int			   solid_left,
+			    int			   solid_right,
+			    int			   solid_top,
+			    int			   solid_bottom,
+			    decor_shadow_options_t *opt,
+			    decor_context_t	   *c,
+			    decor_draw_func_t	   draw,
+			    void		   *closure)
+{
+    decor_shadow_cache_t *cache;
+    decor_shadow_t	 *shadow;
+
+    for (cache = shadow_cache; cache; cache = cache->next)
+    {
+	if (cache->xdisplay     == xdisplay &&
+	    cache->screen       == screen &&
+	    cache->width        == width &&
+	    cache->height       == height &&
+	    cache->left         == left &&
+	    cache->right        == right &&
+	    cache->top          == top &&
+	    cache->bottom       == bottom &&
+	    cache->solid_left   == solid_left &&
+	    cache->solid_right  == solid_right &&
+	    cache->solid_top    == solid_top &&
+	    cache->solid_bottom == solid_bottom &&
+	    cache->draw         == draw &&
+	    cache->closure      == closure &&
+	    shadow_options_equal (&cache->opt, opt))
+	{
+	    *c = cache->context;
+
+	    decor_shadow_reference (cache->shadow);
+
+	    return cache->shadow;
+	}
+    }
+
+    shadow = decor_shadow_create (xdisplay, screen, width, height,
+				  left, right, top, bottom,
+				  solid_left, solid_right,
+				  solid_top, solid_bottom,
+				  opt, c, draw, closure);
+    if (!shadow)
+	return NULL;
+
+    /* not being able to cache the shadow is not an error */
+    cache = malloc (sizeof (decor_shadow_cache_t));
+    if (cache)
+    {
+	cache->xdisplay     = xdisplay;
+	cache->screen       = screen;
+	cache->width        = width;
+	cache->height       = height;
+	cache->left         = left;
+	cache->right        = right;
+	cache->top          = top;
+	cache->bottom       = bottom;
+	cache->solid_left   = solid_left;
+	cache->solid_right  = solid_right;
+	cache->solid_top    = solid_top;
+	cache->solid_bottom = solid_bottom;
+	cache->opt          = *opt;
+	cache->context      = *c;
+	cache->draw         = draw;
+	cache->closure      = closure;
+	cache->shadow       = shadow;
+
+	cache->next  = shadow_cache;
+	shadow_cache = cache;
+    }
+
+    return shadow;
+}
+
 void
 decor_shadow_destroy (Display	     *xdisplay,
 		      decor_shadow_t *shadow)
 {
+    decor_shadow_cache_t **prev, *cache;
+
     shadow->ref_count--;
     if (shadow->ref_count)
 	return;
 
+    for (prev = &shadow_cache; *prev; prev = &(*prev)->next)
+    {
+	cache = *prev;
+	if (cache->shadow == shadow)
+	{
+	    *prev = cache->next;
+	    free (cache);
+	    break;
+	}
+    }
+
     if (shadow->picture)
 	XRenderFreePicture (xdisplay, shadow->picture);
 
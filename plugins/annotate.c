@@ -26,7 +26,8 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
-#include <cairo-xlib-xrender.h>
+#include <stdint.h>
+#include <cairo.h>
 
 #include <compiz-core.h>
 
@@ -82,18 +83,32 @@ typedef struct _AnnoDisplay {
 	CompOption      opt[ANNO_DISPLAY_OPTION_NUM];
 } AnnoDisplay;
 
+/* the annotation layer is split into square tiles of this size */
+#define ANNO_TILE_SIZE 256
+
+typedef struct _AnnoTile {
+	cairo_surface_t *surface;
+	cairo_t         *cairo;
+	GLuint          texture;
+	Box             dirty;
+	Bool            erased;
+} AnnoTile;
+
 typedef struct _AnnoScreen {
 	PaintOutputProc paintOutput;
 	int             grabIndex;
 
-	Pixmap          pixmap;
-	CompTexture     texture;
-	cairo_surface_t *surface;
-	cairo_t         *cairo;
+	/* tiles of the annotation layer, NULL where nothing is drawn */
+	AnnoTile        **tiles;
+	int             nTileX;
+	int             nTileY;
+
+	GLfloat         *vertices;
+	int             vertexSize;
+
 	Bool            content;
 	Bool            drawFromCenter;
 
-	Damage          damage;
 	AnnoToolType    drawMode;
 	Ellipse         ellipse;
 	Point           lineEndPoint;
@@ -101,6 +116,32 @@ typedef struct _AnnoScreen {
 	Box             lastRectangle;
 } AnnoScreen;
 
+typedef enum _AnnoShapeType {
+	LineShape,
+	RectangleShape,
+	EllipseShape,
+	TextShape
+} AnnoShapeType;
+
+/* shape drawn into every tile it touches */
+typedef struct _AnnoShape {
+	AnnoShapeType  type;
+
+	/* line end points, rectangle position and size, ellipse center
+	   and radii or text position */
+	double         x1, y1, x2, y2;
+
+	char           *text;
+	char           *fontFamily;
+	double         fontSize;
+	int            fontSlant;
+	int            fontWeight;
+
+	unsigned short *fillColor;
+	unsigned short *strokeColor;
+	double         strokeWidth;
+} AnnoShape;
+
 #define GET_ANNO_DISPLAY(d)					  \
     ((AnnoDisplay *) (d)->base.privates[displayPrivateIndex].ptr)
 
@@ -118,65 +159,90 @@ typedef struct _AnnoScreen {
 
 #define NUM_TOOLS (sizeof (tools) / sizeof (tools[0]))
 
-static void
-annoCairoClear (CompScreen *s,
-                cairo_t    *cr)
+static AnnoTile *
+annoCreateTile (void)
 {
-	ANNO_SCREEN (s);
+	AnnoTile *tile;
 
-	cairo_save (cr);
-	cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
-	cairo_paint (cr);
-	cairo_restore (cr);
+	tile = malloc (sizeof (AnnoTile));
+	if (!tile)
+		return NULL;
 
-	as->content = FALSE;
+	/* image surfaces start out cleared */
+	tile->surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+	                                            ANNO_TILE_SIZE,
+	                                            ANNO_TILE_SIZE);
+	if (cairo_surface_status (tile->surface) != CAIRO_STATUS_SUCCESS)
+	{
+		cairo_surface_destroy (tile->surface);
+		free (tile);
+		return NULL;
+	}
+
+	tile->cairo = cairo_create (tile->surface);
+	cairo_set_line_cap (tile->cairo, CAIRO_LINE_CAP_ROUND);
+
+	tile->texture  = 0;
+	tile->dirty.x1 = tile->dirty.x2 = 0;
+	tile->dirty.y1 = tile->dirty.y2 = 0;
+	tile->erased   = FALSE;
+
+	return tile;
 }
 
-static cairo_t *
-annoCairoContext (CompScreen *s)
+static void
+annoDestroyTile (AnnoTile *tile)
 {
-	ANNO_SCREEN (s);
+	if (tile->texture)
+		glDeleteTextures (1, &tile->texture);
 
-	if (!as->cairo)
-	{
-		XRenderPictFormat *format;
-		Screen            *screen;
-		int               w, h;
+	cairo_destroy (tile->cairo);
+	cairo_surface_destroy (tile->surface);
 
-		screen = ScreenOfDisplay (s->display->display, s->screenNum);
+	free (tile);
+}
 
-		w = s->width;
-		h = s->height;
+static void
+annoCairoClear (CompScreen *s)
+{
+	int i;
 
-		format = XRenderFindStandardFormat (s->display->display,
-		                    PictStandardARGB32);
+	ANNO_SCREEN (s);
 
-		as->pixmap = XCreatePixmap (s->display->display, s->root, w, h, 32);
+	if (as->tiles)
+	{
+		makeScreenCurrent (s);
 
-		if (!bindPixmapToTexture (s, &as->texture, as->pixmap, w, h, 32))
+		for (i = 0; i < as->nTileX * as->nTileY; i++)
 		{
-			compLogMessage ("annotate", CompLogLevelError,
-			                "Couldn't bind pixmap 0x%x to texture",
-			                (int) as->pixmap);
-
-			XFreePixmap (s->display->display, as->pixmap);
-
-			return NULL;
+			if (as->tiles[i])
+			{
+				annoDestroyTile (as->tiles[i]);
+				as->tiles[i] = NULL;
+			}
 		}
+	}
 
-		as->damage = XDamageCreate(s->display->display, as->pixmap, XDamageReportRawRectangles);
+	as->content = FALSE;
+}
 
-		as->surface =
-		    cairo_xlib_surface_create_with_xrender_format (s->display->display,
-		                           as->pixmap, screen,
-		                           format, w, h);
+static Bool
+annoInitTiles (CompScreen *s)
+{
+	ANNO_SCREEN (s);
 
-		as->cairo = cairo_create (as->surface);
+	if (!as->tiles)
+	{
+		as->nTileX = (s->width  + ANNO_TILE_SIZE - 1) / ANNO_TILE_SIZE;
+		as->nTileY = (s->height + ANNO_TILE_SIZE - 1) / ANNO_TILE_SIZE;
 
-		annoCairoClear (s, as->cairo);
+		as->tiles = calloc (as->nTileX * as->nTileY,
+		                    sizeof (AnnoTile *));
+		if (!as->tiles)
+			return FALSE;
 	}
 
-	return as->cairo;
+	return TRUE;
 }
 
 static void
@@ -191,45 +257,240 @@ annoSetSourceColor (cairo_t        *cr,
 }
 
 static void
-annoDrawEllipse (CompScreen     *s,
-                 double         xc,
-                 double         yc,
-                 double         radiusX,
-                 double         radiusY,
-                 unsigned short *fillColor,
-                 unsigned short *strokeColor,
-                 double         strokeWidth)
+annoPaintShape (cairo_t   *cr,
+                AnnoShape *shape)
 {
-	cairo_t *cr;
+	switch (shape->type) {
+		case LineShape:
+			cairo_set_line_width (cr, shape->strokeWidth);
+			cairo_move_to (cr, shape->x1, shape->y1);
+			cairo_line_to (cr, shape->x2, shape->y2);
+			cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+			annoSetSourceColor (cr, shape->strokeColor);
+			cairo_stroke (cr);
+			break;
 
-	ANNO_SCREEN (s);
+		case RectangleShape:
+			annoSetSourceColor (cr, shape->fillColor);
+			cairo_rectangle (cr, shape->x1, shape->y1,
+			                 shape->x2, shape->y2);
+			cairo_fill_preserve (cr);
+			cairo_set_line_width (cr, shape->strokeWidth);
+			annoSetSourceColor (cr, shape->strokeColor);
+			cairo_stroke (cr);
+			break;
 
-	cr = annoCairoContext (s);
-	if (cr)
-	{
-		annoSetSourceColor (cr, fillColor);
-		cairo_save(cr);
-		cairo_translate(cr, xc, yc);
+		case EllipseShape:
+			annoSetSourceColor (cr, shape->fillColor);
+			cairo_translate (cr, shape->x1, shape->y1);
+
+			if (shape->x2 > shape->y2)
+			{
+				cairo_scale (cr, 1.0, shape->y2 / shape->x2);
+				cairo_arc (cr, 0, 0, shape->x2, 0, 2 * M_PI);
+			}
+			else
+			{
+				cairo_scale (cr, shape->x2 / shape->y2, 1.0);
+				cairo_arc (cr, 0, 0, shape->y2, 0, 2 * M_PI);
+			}
+
+			cairo_fill_preserve (cr);
+			cairo_set_line_width (cr, shape->strokeWidth);
+			annoSetSourceColor (cr, shape->strokeColor);
+			cairo_stroke (cr);
+			break;
 
-		if (radiusX > radiusY)
+		case TextShape:
+			cairo_set_line_width (cr, shape->strokeWidth);
+			annoSetSourceColor (cr, shape->fillColor);
+			cairo_select_font_face (cr, shape->fontFamily,
+			                        shape->fontSlant,
+			                        shape->fontWeight);
+			cairo_set_font_size (cr, shape->fontSize);
+			cairo_move_to (cr, shape->x1, shape->y1);
+			cairo_text_path (cr, shape->text);
+			cairo_fill_preserve (cr);
+			annoSetSourceColor (cr, shape->strokeColor);
+			cairo_stroke (cr);
+			break;
+	}
+}
+
+/* Returns the screen area a shape can touch */
+static void
+annoShapeExtents (AnnoShape *shape,
+                  Box       *box)
+{
+	double x1, y1, x2, y2;
+	double border = shape->strokeWidth / 2 + 1;
+
+	switch (shape->type) {
+		case LineShape:
+			x1 = MIN (shape->x1, shape->x2);
+			y1 = MIN (shape->y1, shape->y2);
+			x2 = MAX (shape->x1, shape->x2);
+			y2 = MAX (shape->y1, shape->y2);
+			break;
+
+		case RectangleShape:
+			x1 = MIN (shape->x1, shape->x1 + shape->x2);
+			y1 = MIN (shape->y1, shape->y1 + shape->y2);
+			x2 = MAX (shape->x1, shape->x1 + shape->x2);
+			y2 = MAX (shape->y1, shape->y1 + shape->y2);
+			break;
+
+		case EllipseShape:
+			x1 = shape->x1 - shape->x2;
+			y1 = shape->y1 - shape->y2;
+			x2 = shape->x1 + shape->x2;
+			y2 = shape->y1 + shape->y2;
+			break;
+
+		case TextShape:
+		default:
 		{
-			cairo_scale (cr, 1.0, radiusY/radiusX);
-			cairo_arc (cr, 0, 0, radiusX, 0, 2 * M_PI);
-		}
-		else
+			cairo_surface_t *image;
+			cairo_t         *cr;
+
+			/* measure the text on a scratch surface */
+			image = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+			                                    1, 1);
+			cr = cairo_create (image);
+
+			cairo_set_line_width (cr, shape->strokeWidth);
+			cairo_select_font_face (cr, shape->fontFamily,
+			                        shape->fontSlant,
+			                        shape->fontWeight);
+			cairo_set_font_size (cr, shape->fontSize);
+			cairo_move_to (cr, shape->x1, shape->y1);
+			cairo_text_path (cr, shape->text);
+			cairo_stroke_extents (cr, &x1, &y1, &x2, &y2);
+
+			cairo_destroy (cr);
+			cairo_surface_destroy (image);
+		} break;
+	}
+
+	box->x1 = floor (x1 - border);
+	box->y1 = floor (y1 - border);
+	box->x2 = ceil (x2 + border);
+	box->y2 = ceil (y2 + border);
+}
+
+/* Draws a shape into the tiles it touches, tiles are only created
+   where something is drawn */
+static void
+annoDrawShape (CompScreen *s,
+               AnnoShape  *shape)
+{
+	AnnoTile *tile;
+	Box      box;
+	REGION   reg;
+	Bool     erase;
+	int      tx, ty, tx1, ty1, tx2, ty2, x, y;
+
+	ANNO_SCREEN (s);
+
+	if (!annoInitTiles (s))
+		return;
+
+	annoShapeExtents (shape, &box);
+
+	box.x1 = MAX (box.x1, 0);
+	box.y1 = MAX (box.y1, 0);
+	box.x2 = MIN (box.x2, as->nTileX * ANNO_TILE_SIZE);
+	box.y2 = MIN (box.y2, as->nTileY * ANNO_TILE_SIZE);
+
+	if (box.x1 >= box.x2 || box.y1 >= box.y2)
+		return;
+
+	/* transparent lines replace what is below them */
+	erase = shape->type == LineShape && shape->strokeColor[3] == 0;
+
+	tx1 = box.x1 / ANNO_TILE_SIZE;
+	ty1 = box.y1 / ANNO_TILE_SIZE;
+	tx2 = (box.x2 - 1) / ANNO_TILE_SIZE;
+	ty2 = (box.y2 - 1) / ANNO_TILE_SIZE;
+
+	for (ty = ty1; ty <= ty2; ty++)
+	{
+		for (tx = tx1; tx <= tx2; tx++)
 		{
-			cairo_scale (cr,  radiusX/radiusY, 1.0);
-			cairo_arc (cr, 0, 0, radiusY, 0, 2 * M_PI);
-		}
+			tile = as->tiles[ty * as->nTileX + tx];
+			if (!tile)
+			{
+				if (erase)
+					continue;
+
+				tile = annoCreateTile ();
+				if (!tile)
+					continue;
 
-		cairo_fill_preserve (cr);
-		cairo_set_line_width (cr, strokeWidth);
-		annoSetSourceColor (cr, strokeColor);
-		cairo_stroke (cr);
-		cairo_restore (cr);
+				as->tiles[ty * as->nTileX + tx] = tile;
+			}
+
+			x = tx * ANNO_TILE_SIZE;
+			y = ty * ANNO_TILE_SIZE;
 
-		as->content = TRUE;
+			cairo_save (tile->cairo);
+			cairo_translate (tile->cairo, -x, -y);
+			annoPaintShape (tile->cairo, shape);
+			cairo_restore (tile->cairo);
+
+			if (tile->dirty.x1 >= tile->dirty.x2)
+			{
+				tile->dirty.x1 = ANNO_TILE_SIZE;
+				tile->dirty.y1 = ANNO_TILE_SIZE;
+				tile->dirty.x2 = 0;
+				tile->dirty.y2 = 0;
+			}
+
+			tile->dirty.x1 = MIN (tile->dirty.x1,
+			                      MAX (box.x1 - x, 0));
+			tile->dirty.y1 = MIN (tile->dirty.y1,
+			                      MAX (box.y1 - y, 0));
+			tile->dirty.x2 = MAX (tile->dirty.x2,
+			                      MIN (box.x2 - x, ANNO_TILE_SIZE));
+			tile->dirty.y2 = MAX (tile->dirty.y2,
+			                      MIN (box.y2 - y, ANNO_TILE_SIZE));
+
+			if (erase)
+				tile->erased = TRUE;
+		}
 	}
+
+	as->content = TRUE;
+
+	reg.rects    = &reg.extents;
+	reg.numRects = 1;
+	reg.extents  = box;
+
+	damageScreenRegion (s, &reg);
+}
+
+static void
+annoDrawEllipse (CompScreen     *s,
+                 double         xc,
+                 double         yc,
+                 double         radiusX,
+                 double         radiusY,
+                 unsigned short *fillColor,
+                 unsigned short *strokeColor,
+                 double         strokeWidth)
+{
+	AnnoShape shape;
+
+	shape.type        = EllipseShape;
+	shape.x1          = xc;
+	shape.y1          = yc;
+	shape.x2          = radiusX;
+	shape.y2          = radiusY;
+	shape.fillColor   = fillColor;
+	shape.strokeColor = strokeColor;
+	shape.strokeWidth = strokeWidth;
+
+	annoDrawShape (s, &shape);
 }
 
 static void
@@ -242,24 +503,18 @@ annoDrawRectangle (CompScreen     *s,
                    unsigned short *strokeColor,
                    double         strokeWidth)
 {
-	cairo_t *cr;
-
-	ANNO_SCREEN (s);
-
-	cr = annoCairoContext (s);
-	if (cr)
-	{
-		cairo_save(cr);
-		annoSetSourceColor (cr, fillColor);
-		cairo_rectangle (cr, x, y, w, h);
-		cairo_fill_preserve (cr);
-		cairo_set_line_width (cr, strokeWidth);
-		annoSetSourceColor (cr, strokeColor);
-		cairo_stroke (cr);
-		cairo_restore(cr);
-
-		as->content = TRUE;
-	}
+	AnnoShape shape;
+
+	shape.type        = RectangleShape;
+	shape.x1          = x;
+	shape.y1          = y;
+	shape.x2          = w;
+	shape.y2          = h;
+	shape.fillColor   = fillColor;
+	shape.strokeColor = strokeColor;
+	shape.strokeWidth = strokeWidth;
+
+	annoDrawShape (s, &shape);
 }
 
 static void
@@ -271,24 +526,17 @@ annoDrawLine (CompScreen     *s,
               double         width,
               unsigned short *color)
 {
-	cairo_t *cr;
+	AnnoShape shape;
 
-	ANNO_SCREEN (s);
+	shape.type        = LineShape;
+	shape.x1          = x1;
+	shape.y1          = y1;
+	shape.x2          = x2;
+	shape.y2          = y2;
+	shape.strokeColor = color;
+	shape.strokeWidth = width;
 
-	cr = annoCairoContext (s);
-	if (cr)
-	{
-		cairo_save(cr);
-		cairo_set_line_width (cr, width);
-		cairo_move_to (cr, x1, y1);
-		cairo_line_to (cr, x2, y2);
-		cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
-		annoSetSourceColor (cr, color);
-		cairo_stroke (cr);
-		cairo_restore(cr);
-
-		as->content = TRUE;
-	}
+	annoDrawShape (s, &shape);
 }
 
 static void
@@ -304,27 +552,214 @@ annoDrawText (CompScreen     *s,
               unsigned short *strokeColor,
               double         strokeWidth)
 {
-	cairo_t *cr;
+	AnnoShape shape;
+
+	shape.type        = TextShape;
+	shape.x1          = x;
+	shape.y1          = y;
+	shape.text        = text;
+	shape.fontFamily  = fontFamily;
+	shape.fontSize    = fontSize;
+	shape.fontSlant   = fontSlant;
+	shape.fontWeight  = fontWeight;
+	shape.fillColor   = fillColor;
+	shape.strokeColor = strokeColor;
+	shape.strokeWidth = strokeWidth;
+
+	annoDrawShape (s, &shape);
+}
+
+static Bool
+annoTileEmpty (AnnoTile *tile)
+{
+	unsigned char *data = cairo_image_surface_get_data (tile->surface);
+	int           stride = cairo_image_surface_get_stride (tile->surface);
+	int           x, y;
+
+	for (y = 0; y < ANNO_TILE_SIZE; y++)
+	{
+		uint32_t *row = (uint32_t *) (data + y * stride);
+
+		for (x = 0; x < ANNO_TILE_SIZE; x++)
+			if (row[x])
+				return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Uploads the parts of tiles changed since they were last painted and
+   drops tiles that have been erased completely */
+static void
+annoUploadTiles (CompScreen *s)
+{
+	AnnoTile      *tile;
+	unsigned char *data;
+	int           i, stride;
 
 	ANNO_SCREEN (s);
 
-	cr = annoCairoContext (s);
-	if (cr)
+	for (i = 0; i < as->nTileX * as->nTileY; i++)
 	{
-		cairo_save(cr);
-		cairo_set_line_width (cr, strokeWidth);
-		annoSetSourceColor (cr, fillColor);
-		cairo_select_font_face (cr, fontFamily, fontSlant, fontWeight);
-		cairo_set_font_size (cr, fontSize);
-		cairo_move_to (cr, x, y);
-		cairo_text_path (cr, text);
-		cairo_fill_preserve (cr);
-		annoSetSourceColor (cr, strokeColor);
-		cairo_stroke (cr);
-		cairo_restore (cr);
-
-		as->content = TRUE;
+		tile = as->tiles[i];
+		if (!tile || (tile->texture && tile->dirty.x1 >= tile->dirty.x2))
+			continue;
+
+		cairo_surface_flush (tile->surface);
+
+		if (tile->erased)
+		{
+			tile->erased = FALSE;
+
+			if (annoTileEmpty (tile))
+			{
+				annoDestroyTile (tile);
+				as->tiles[i] = NULL;
+				continue;
+			}
+		}
+
+		data   = cairo_image_surface_get_data (tile->surface);
+		stride = cairo_image_surface_get_stride (tile->surface);
+
+		glPixelStorei (GL_UNPACK_ROW_LENGTH, stride / 4);
+
+		if (!tile->texture)
+		{
+			glGenTextures (1, &tile->texture);
+			glBindTexture (GL_TEXTURE_2D, tile->texture);
+
+			glTexParameteri (GL_TEXTURE_2D,
+			                 GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri (GL_TEXTURE_2D,
+			                 GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri (GL_TEXTURE_2D,
+			                 GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri (GL_TEXTURE_2D,
+			                 GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+			glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA,
+			              ANNO_TILE_SIZE, ANNO_TILE_SIZE, 0,
+			              GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV,
+			              data);
+		}
+		else
+		{
+			glBindTexture (GL_TEXTURE_2D, tile->texture);
+
+			glTexSubImage2D (GL_TEXTURE_2D, 0,
+			                 tile->dirty.x1, tile->dirty.y1,
+			                 tile->dirty.x2 - tile->dirty.x1,
+			                 tile->dirty.y2 - tile->dirty.y1,
+			                 GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV,
+			                 data + tile->dirty.y1 * stride +
+			                 tile->dirty.x1 * 4);
+		}
+
+		glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+
+		tile->dirty.x1 = tile->dirty.x2 = 0;
+		tile->dirty.y1 = tile->dirty.y2 = 0;
 	}
+
+	glBindTexture (GL_TEXTURE_2D, 0);
+}
+
+/* Paints the tiles that intersect region, each with a single vertex
+   array draw */
+static void
+annoPaintTiles (CompScreen *s,
+                Region     region)
+{
+	AnnoTile *tile;
+	BoxPtr   pBox;
+	GLfloat  *v;
+	int      tx, ty, tx1, ty1, tx2, ty2;
+	int      x1, y1, x2, y2, nBox, n;
+
+	ANNO_SCREEN (s);
+
+	if (!as->tiles)
+		return;
+
+	annoUploadTiles (s);
+
+	if (region->numRects * 16 > as->vertexSize)
+	{
+		v = realloc (as->vertices,
+		             sizeof (GLfloat) * region->numRects * 16);
+		if (!v)
+			return;
+
+		as->vertices   = v;
+		as->vertexSize = region->numRects * 16;
+	}
+
+	tx1 = MAX (region->extents.x1, 0) / ANNO_TILE_SIZE;
+	ty1 = MAX (region->extents.y1, 0) / ANNO_TILE_SIZE;
+	tx2 = MIN ((region->extents.x2 - 1) / ANNO_TILE_SIZE, as->nTileX - 1);
+	ty2 = MIN ((region->extents.y2 - 1) / ANNO_TILE_SIZE, as->nTileY - 1);
+
+	glEnable (GL_TEXTURE_2D);
+
+	for (ty = ty1; ty <= ty2; ty++)
+	{
+		for (tx = tx1; tx <= tx2; tx++)
+		{
+			tile = as->tiles[ty * as->nTileX + tx];
+			if (!tile || !tile->texture)
+				continue;
+
+			v = as->vertices;
+			n = 0;
+
+			pBox = region->rects;
+			nBox = region->numRects;
+
+			for (; nBox--; pBox++)
+			{
+				x1 = MAX (pBox->x1, tx * ANNO_TILE_SIZE);
+				y1 = MAX (pBox->y1, ty * ANNO_TILE_SIZE);
+				x2 = MIN (pBox->x2, (tx + 1) * ANNO_TILE_SIZE);
+				y2 = MIN (pBox->y2, (ty + 1) * ANNO_TILE_SIZE);
+
+				if (x1 >= x2 || y1 >= y2)
+					continue;
+
+#define ANNO_VERTEX(x, y)					\
+				*v++ = (GLfloat) ((x) - tx * ANNO_TILE_SIZE) /	\
+				       ANNO_TILE_SIZE;				\
+				*v++ = (GLfloat) ((y) - ty * ANNO_TILE_SIZE) /	\
+				       ANNO_TILE_SIZE;				\
+				*v++ = (x);					\
+				*v++ = (y)
+
+				ANNO_VERTEX (x1, y2);
+				ANNO_VERTEX (x2, y2);
+				ANNO_VERTEX (x2, y1);
+				ANNO_VERTEX (x1, y1);
+
+#undef ANNO_VERTEX
+
+				n += 4;
+			}
+
+			if (!n)
+				continue;
+
+			glBindTexture (GL_TEXTURE_2D, tile->texture);
+
+			glTexCoordPointer (2, GL_FLOAT, 4 * sizeof (GLfloat),
+			                   as->vertices);
+			glVertexPointer (2, GL_FLOAT, 4 * sizeof (GLfloat),
+			                 as->vertices + 2);
+
+			glDrawArrays (GL_QUADS, 0, n);
+		}
+	}
+
+	glBindTexture (GL_TEXTURE_2D, 0);
+	glDisable (GL_TEXTURE_2D);
 }
 
 static Bool
@@ -342,100 +777,91 @@ annoDraw (CompDisplay     *d,
 	s = findScreenAtDisplay (d, xid);
 	if (s)
 	{
-		cairo_t *cr;
-
-		cr = annoCairoContext (s);
-		if (cr)
-		{
-			char           *tool;
-			unsigned short *fillColor, *strokeColor;
-			double         strokeWidth;
-
-			ANNO_DISPLAY (d);
+		char           *tool;
+		unsigned short *fillColor, *strokeColor;
+		double         strokeWidth;
 
-			tool = getStringOptionNamed (option, nOption, "tool", "line");
+		ANNO_DISPLAY (d);
 
-			cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
-			cairo_set_line_cap (cr, CAIRO_LINE_CAP_ROUND);
+		tool = getStringOptionNamed (option, nOption, "tool", "line");
 
-			fillColor = ad->opt[ANNO_DISPLAY_OPTION_FILL_COLOR].value.c;
-			fillColor = getColorOptionNamed (option, nOption, "fill_color",
-			                 fillColor);
+		fillColor = ad->opt[ANNO_DISPLAY_OPTION_FILL_COLOR].value.c;
+		fillColor = getColorOptionNamed (option, nOption, "fill_color",
+		                 fillColor);
 
-			strokeColor = ad->opt[ANNO_DISPLAY_OPTION_STROKE_COLOR].value.c;
-			strokeColor = getColorOptionNamed (option, nOption,
-			                   "stroke_color", strokeColor);
+		strokeColor = ad->opt[ANNO_DISPLAY_OPTION_STROKE_COLOR].value.c;
+		strokeColor = getColorOptionNamed (option, nOption,
+		                   "stroke_color", strokeColor);
 
-			strokeWidth = ad->opt[ANNO_DISPLAY_OPTION_STROKE_WIDTH].value.f;
-			strokeWidth = getFloatOptionNamed (option, nOption, "stroke_width",
-			                   strokeWidth);
+		strokeWidth = ad->opt[ANNO_DISPLAY_OPTION_STROKE_WIDTH].value.f;
+		strokeWidth = getFloatOptionNamed (option, nOption, "stroke_width",
+		                   strokeWidth);
 
-			if (strcasecmp (tool, "rectangle") == 0)
-			{
-				double x, y, w, h;
+		if (strcasecmp (tool, "rectangle") == 0)
+		{
+			double x, y, w, h;
 
-				x = getFloatOptionNamed (option, nOption, "x", 0);
-				y = getFloatOptionNamed (option, nOption, "y", 0);
-				w = getFloatOptionNamed (option, nOption, "w", 100);
-				h = getFloatOptionNamed (option, nOption, "h", 100);
+			x = getFloatOptionNamed (option, nOption, "x", 0);
+			y = getFloatOptionNamed (option, nOption, "y", 0);
+			w = getFloatOptionNamed (option, nOption, "w", 100);
+			h = getFloatOptionNamed (option, nOption, "h", 100);
 
-				annoDrawRectangle (s, x, y, w, h, fillColor, strokeColor,
-				           strokeWidth);
-			}
-			else if (strcasecmp (tool, "ellipse") == 0)
-			{
-				double xc, yc, xr, yr;
+			annoDrawRectangle (s, x, y, w, h, fillColor, strokeColor,
+			           strokeWidth);
+		}
+		else if (strcasecmp (tool, "ellipse") == 0)
+		{
+			double xc, yc, xr, yr;
 
-				xc = getFloatOptionNamed (option, nOption, "xc", 0);
-				yc = getFloatOptionNamed (option, nOption, "yc", 0);
-				xr = getFloatOptionNamed (option, nOption, "radiusX", 100);
-				yr = getFloatOptionNamed (option, nOption, "radiusY", 100);
+			xc = getFloatOptionNamed (option, nOption, "xc", 0);
+			yc = getFloatOptionNamed (option, nOption, "yc", 0);
+			xr = getFloatOptionNamed (option, nOption, "radiusX", 100);
+			yr = getFloatOptionNamed (option, nOption, "radiusY", 100);
 
-				annoDrawEllipse (s, xc, yc, xr, yr, fillColor, strokeColor,
-				        strokeWidth);
-			}
-			else if (strcasecmp (tool, "line") == 0)
-			{
-				double x1, y1, x2, y2;
+			annoDrawEllipse (s, xc, yc, xr, yr, fillColor, strokeColor,
+			        strokeWidth);
+		}
+		else if (strcasecmp (tool, "line") == 0)
+		{
+			double x1, y1, x2, y2;
 
-				x1 = getFloatOptionNamed (option, nOption, "x1", 0);
-				y1 = getFloatOptionNamed (option, nOption, "y1", 0);
-				x2 = getFloatOptionNamed (option, nOption, "x2", 100);
-				y2 = getFloatOptionNamed (option, nOption, "y2", 100);
+			x1 = getFloatOptionNamed (option, nOption, "x1", 0);
+			y1 = getFloatOptionNamed (option, nOption, "y1", 0);
+			x2 = getFloatOptionNamed (option, nOption, "x2", 100);
+			y2 = getFloatOptionNamed (option, nOption, "y2", 100);
 
-				annoDrawLine (s, x1, y1, x2, y2, strokeWidth, strokeColor);
-			}
-			else if (strcasecmp (tool, "text") == 0)
-			{
-				double       x, y, size;
-				char         *text, *family;
-				unsigned int slant, weight;
-				char         *str;
-
-				str = getStringOptionNamed (option, nOption, "slant", "");
-				if (strcasecmp (str, "oblique") == 0)
-				    slant = CAIRO_FONT_SLANT_OBLIQUE;
-				else if (strcasecmp (str, "italic") == 0)
-				    slant = CAIRO_FONT_SLANT_ITALIC;
-				else
-				    slant = CAIRO_FONT_SLANT_NORMAL;
-
-				str = getStringOptionNamed (option, nOption, "weight", "");
-				if (strcasecmp (str, "bold") == 0)
-				    weight = CAIRO_FONT_WEIGHT_BOLD;
-				else
-				    weight = CAIRO_FONT_WEIGHT_NORMAL;
-
-				x      = getFloatOptionNamed (option, nOption, "x", 0);
-				y      = getFloatOptionNamed (option, nOption, "y", 0);
-				text   = getStringOptionNamed (option, nOption, "text", "");
-				family = getStringOptionNamed (option, nOption, "family",
-				                   "Sans");
-				size   = getFloatOptionNamed (option, nOption, "size", 36.0);
-
-				annoDrawText (s, x, y, text, family, size, slant, weight,
-				          fillColor, strokeColor, strokeWidth);
-			}
+			annoDrawLine (s, x1, y1, x2, y2, strokeWidth, strokeColor);
+		}
+		else if (strcasecmp (tool, "text") == 0)
+		{
+			double       x, y, size;
+			char         *text, *family;
+			unsigned int slant, weight;
+			char         *str;
+
+			str = getStringOptionNamed (option, nOption, "slant", "");
+			if (strcasecmp (str, "oblique") == 0)
+			    slant = CAIRO_FONT_SLANT_OBLIQUE;
+			else if (strcasecmp (str, "italic") == 0)
+			    slant = CAIRO_FONT_SLANT_ITALIC;
+			else
+			    slant = CAIRO_FONT_SLANT_NORMAL;
+
+			str = getStringOptionNamed (option, nOption, "weight", "");
+			if (strcasecmp (str, "bold") == 0)
+			    weight = CAIRO_FONT_WEIGHT_BOLD;
+			else
+			    weight = CAIRO_FONT_WEIGHT_NORMAL;
+
+			x      = getFloatOptionNamed (option, nOption, "x", 0);
+			y      = getFloatOptionNamed (option, nOption, "y", 0);
+			text   = getStringOptionNamed (option, nOption, "text", "");
+			family = getStringOptionNamed (option, nOption, "family",
+			                   "Sans");
+			size   = getFloatOptionNamed (option, nOption, "size", 36.0);
+
+			annoDrawText (s, x, y, text, family, size, slant, weight,
+			          fillColor, strokeColor, strokeWidth);
 		}
     }
 
@@ -731,11 +1157,7 @@ annoClear (CompDisplay     *d,
 
 		if (as->content)
 		{
-			cairo_t *cr;
-
-			cr = annoCairoContext (s);
-			if (cr)
-				annoCairoClear (s, as->cairo);
+			annoCairoClear (s);
 
 			damageScreen (s);
 		}
@@ -788,45 +1210,16 @@ annoPaintOutput (CompScreen              *s,
 
 	if (status && as->content && region->numRects)
 	{
-		BoxPtr pBox;
-		int    nBox;
-
 		glPushMatrix ();
 
 		prepareXCoords (s, output, -DEFAULT_Z_CAMERA);
 
-		glDisableClientState (GL_TEXTURE_COORD_ARRAY);
 		glEnable (GL_BLEND);
 		glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-		enableTexture (s, &as->texture, COMP_TEXTURE_FILTER_FAST);
-
-		pBox = region->rects;
-		nBox = region->numRects;
+		annoPaintTiles (s, region);
 
-		glBegin (GL_QUADS);
-
-		while (nBox--)
-		{
-			glTexCoord2f (COMP_TEX_COORD_X (&as->texture.matrix, pBox->x1),
-			      COMP_TEX_COORD_Y (&as->texture.matrix, pBox->y2));
-			glVertex2i (pBox->x1, pBox->y2);
-			glTexCoord2f (COMP_TEX_COORD_X (&as->texture.matrix, pBox->x2),
-			      COMP_TEX_COORD_Y (&as->texture.matrix, pBox->y2));
-			glVertex2i (pBox->x2, pBox->y2);
-			glTexCoord2f (COMP_TEX_COORD_X (&as->texture.matrix, pBox->x2),
-			      COMP_TEX_COORD_Y (&as->texture.matrix, pBox->y1));
-			glVertex2i (pBox->x2, pBox->y1);
-			glTexCoord2f (COMP_TEX_COORD_X (&as->texture.matrix, pBox->x1),
-			      COMP_TEX_COORD_Y (&as->texture.matrix, pBox->y1));
-			glVertex2i (pBox->x1, pBox->y1);
-
-			pBox++;
-		}
-
-		glEnd ();
-
-		disableTexture (s, &as->texture);
+		glDisableClientState (GL_TEXTURE_COORD_ARRAY);
 
 		unsigned short *fillColor, *strokeColor;
 		double strokeWidth, offset;
@@ -940,8 +1333,6 @@ annoHandleMotionEvent (CompScreen *s,
 
 	if (as->grabIndex)
 	{
-		cairo_t *cr;
-
 		if (as->drawMode == EraseMode)
 		{
 			static unsigned short color[] = { 0, 0, 0, 0 };
@@ -973,12 +1364,7 @@ annoHandleMotionEvent (CompScreen *s,
 			damageReg.extents.x2 = damageReg.extents.x1 + abs(as->lineEndPoint.x - annoInitialPointerX);
 			damageReg.extents.y2 = damageReg.extents.y1 + abs(as->lineEndPoint.y - annoInitialPointerY);
 
-			if (!as->content) {
-				cr = annoCairoContext(s);
-				if (cr) {
-					as->content = TRUE;
-				}
-			}
+			as->content = TRUE;
 		}
 		else if (as->drawMode == RectangleMode)
 		{
@@ -1003,12 +1389,7 @@ annoHandleMotionEvent (CompScreen *s,
 			damageReg.numRects = 1;
 			damageReg.extents = as->rectangle;
 
-			if (!as->content) {
-				cr = annoCairoContext(s);
-				if (cr) {
-					as->content = TRUE;
-				}
-			}
+			as->content = TRUE;
 		}
 		else if (as->drawMode == EllipseMode)
 		{
@@ -1033,12 +1414,7 @@ annoHandleMotionEvent (CompScreen *s,
 			damageReg.extents.x2 = damageReg.extents.x1 + as->ellipse.radiusX * 2;
 			damageReg.extents.y2 = damageReg.extents.y1 + as->ellipse.radiusY * 2;
 
-			if (!as->content) {
-				cr = annoCairoContext(s);
-				if (cr) {
-					as->content = TRUE;
-				}
-			}
+			as->content = TRUE;
 		}
 
 		if (s && (as->drawMode == LineMode ||
@@ -1091,37 +1467,6 @@ annoHandleEvent (CompDisplay *d,
 				annoHandleMotionEvent (s, pointerX, pointerY);
 			break;
 		default:
-			if (event->type == d->damageEvent + XDamageNotify)
-			{
-				XDamageNotifyEvent *de = (XDamageNotifyEvent *) event;
-				int i, firstScreen, lastScreen;
-				if (onlyCurrentScreen) {
-					firstScreen = DefaultScreen (d->display);
-					lastScreen  = DefaultScreen (d->display);
-				}
-				else
-				{
-					firstScreen = 0;
-					lastScreen  = ScreenCount (d->display) - 1;
-				}
-
-				for (i = firstScreen; i <= lastScreen; i++)
-				{
-					s = findScreenAtDisplay (d, XRootWindow (d->display, i));
-					ANNO_SCREEN(s);
-					if (as->pixmap == de->drawable) {
-						REGION reg;
-						reg.rects    = &reg.extents;
-						reg.numRects = 1;
-						reg.extents.x1 = de->area.x;
-						reg.extents.y1 = de->area.y;
-						reg.extents.x2 = de->area.x + de->area.width;
-						reg.extents.y2 = de->area.y + de->area.height;
-
-						damageScreenRegion(s, &reg);
-					}
-				}
-			}
 			break;
 	}
 
@@ -1238,13 +1583,13 @@ annoInitScreen (CompPlugin *p,
 	if (!as)
 		return FALSE;
 
-	as->grabIndex = 0;
-	as->surface   = NULL;
-	as->pixmap    = None;
-	as->cairo     = NULL;
-	as->content   = FALSE;
-
-	initTexture (s, &as->texture);
+	as->grabIndex  = 0;
+	as->tiles      = NULL;
+	as->nTileX     = 0;
+	as->nTileY     = 0;
+	as->vertices   = NULL;
+	as->vertexSize = 0;
+	as->content    = FALSE;
 
 	WRAP (as, s, paintOutput, annoPaintOutput);
 
@@ -1259,19 +1604,13 @@ annoFiniScreen (CompPlugin *p,
 {
 	ANNO_SCREEN (s);
 
-	if (as->cairo)
-		cairo_destroy (as->cairo);
-
-	if (as->surface)
-		cairo_surface_destroy (as->surface);
-
-	finiTexture (s, &as->texture);
+	annoCairoClear (s);
 
-	if (as->pixmap)
-		XFreePixmap (s->display->display, as->pixmap);
+	if (as->tiles)
+		free (as->tiles);
 
-	if (as->damage)
-		XDamageDestroy(s->display->display, as->damage);
+	if (as->vertices)
+		free (as->vertices);
 
 	UNWRAP (as, s, paintOutput);
 
@@ -47,6 +47,8 @@ static CompMetadata dbusMetadata;
 #define COMPIZ_DBUS_LIST_MEMBER_NAME		    "list"
 #define COMPIZ_DBUS_GET_PLUGINS_MEMBER_NAME	    "getPlugins"
 #define COMPIZ_DBUS_GET_PLUGIN_METADATA_MEMBER_NAME "getPluginMetadata"
+#define COMPIZ_DBUS_GET_ALL_MEMBER_NAME		    "getAll"
+#define COMPIZ_DBUS_SET_MANY_MEMBER_NAME	    "setMany"
 
 #define COMPIZ_DBUS_CHANGED_SIGNAL_NAME		    "changed"
 #define COMPIZ_DBUS_PLUGINS_CHANGED_SIGNAL_NAME	    "pluginsChanged"
@@ -56,15 +58,46 @@ static CompMetadata dbusMetadata;
 #define DBUS_FILE_WATCH_HOME    2
 #define DBUS_FILE_WATCH_NUM     3
 
+#define DBUS_DISPLAY_OPTION_COALESCE_CHANGE_SIGNALS 0
+#define DBUS_DISPLAY_OPTION_NUM                     1
+
+#define DBUS_REPLY_CACHE_SIZE 64
+#define DBUS_SIGNAL_HASH_SIZE 64
+
 static int corePrivateIndex;
 static int displayPrivateIndex;
 
+/* change signal waiting to be sent, the value is read when it is sent */
+typedef struct _DbusPendingSignal {
+    struct _DbusPendingSignal *next;
+    struct _DbusPendingSignal *hashNext;
+
+    char	   *path;
+    char	   *plugin;
+    char	   *option;
+    CompObjectType type;
+    char	   *name;
+} DbusPendingSignal;
+
+typedef struct _DbusCachedReply {
+    struct _DbusCachedReply *next;
+
+    char	*key;
+    DBusMessage *reply;
+} DbusCachedReply;
+
 typedef struct _DbusCore {
     DBusConnection    *connection;
     CompWatchFdHandle watchFdHandle;
 
     CompFileWatchHandle fileWatch[DBUS_FILE_WATCH_NUM];
 
+    DbusPendingSignal *pendingSignals;
+    DbusPendingSignal *pendingHash[DBUS_SIGNAL_HASH_SIZE];
+    CompTimeoutHandle signalHandle;
+
+    DbusCachedReply *replyCache[DBUS_REPLY_CACHE_SIZE];
+
     InitPluginForObjectProc initPluginForObject;
     SetOptionForPluginProc  setOptionForPlugin;
 } DbusCore;
@@ -72,8 +105,14 @@ typedef struct _DbusCore {
 typedef struct _DbusDisplay {
     char         **pluginList;
     unsigned int nPlugins;
+
+    CompOption opt[DBUS_DISPLAY_OPTION_NUM];
 } DbusDisplay;
 
+static const CompMetadataOptionInfo dbusDisplayOptionInfo[] = {
+    { "coalesce_change_signals", "bool", 0, 0, 0 }
+};
+
 static DBusHandlerResult dbusHandleMessage (DBusConnection *,
 					    DBusMessage *,
 					    void *);
@@ -95,6 +134,8 @@ static DBusObjectPathVTable dbusMessagesVTable = {
 #define DBUS_DISPLAY(d)                    \
     DbusDisplay *dd = GET_DBUS_DISPLAY (d)
 
+#define NUM_OPTIONS(s) (sizeof ((s)->opt) / sizeof (CompOption))
+
 static void
 dbusUpdatePluginList (CompDisplay *d)
 {
@@ -170,6 +211,160 @@ dbusGetOptionsFromPath (char	     **path,
     return (*p->vTable->getObjectOptions) (p, object, nOption);
 }
 
+/* reply cache for introspection and metadata messages, these
+   replies only change when the plugin list changes */
+static char *
+dbusGetReplyCacheKey (DBusMessage *message)
+{
+    DBusMessageIter iter;
+    const char	    *path, *member, *arg = "";
+    char	    *key;
+    int		    len;
+
+    path   = dbus_message_get_path (message);
+    member = dbus_message_get_member (message);
+    if (!path || !member)
+	return NULL;
+
+    if (dbus_message_iter_init (message, &iter) &&
+	dbus_message_iter_get_arg_type (&iter) == DBUS_TYPE_STRING)
+	dbus_message_iter_get_basic (&iter, &arg);
+
+    len = strlen (path) + strlen (member) + strlen (arg) + 3;
+
+    key = malloc (len);
+    if (key)
+	sprintf (key, "%s %s %s", path, member, arg);
+
+    return key;
+}
+
+static unsigned int
+dbusHashString (const char *str)
+{
+    unsigned int hash = 5381;
+
+    while (*str)
+	hash = hash * 33 + (unsigned char) *str++;
+
+    return hash;
+}
+
+/* Sends the cached reply for message, returns FALSE if there is none */
+static Bool
+dbusSendCachedReply (DBusConnection *connection,
+		     DBusMessage    *message)
+{
+    DbusCachedReply *cr;
+    DBusMessage	    *reply;
+    DBusMessageIter from, to;
+    DBusBasicValue  v;
+    char	    *key;
+    int		    type;
+
+    DBUS_CORE (&core);
+
+    key = dbusGetReplyCacheKey (message);
+    if (!key)
+	return FALSE;
+
+    for (cr = dc->replyCache[dbusHashString (key) % DBUS_REPLY_CACHE_SIZE]; cr; cr = cr->next)
+	if (strcmp (cr->key, key) == 0)
+	    break;
+
+    free (key);
+
+    if (!cr)
+	return FALSE;
+
+    reply = dbus_message_new_method_return (message);
+    if (!reply)
+	return FALSE;
+
+    /* cached replies only contain basic arguments */
+    dbus_message_iter_init_append (reply, &to);
+    if (dbus_message_iter_init (cr->reply, &from))
+    {
+	do
+	{
+	    type = dbus_message_iter_get_arg_type (&from);
+
+	    dbus_message_iter_get_basic (&from, &v);
+	    dbus_message_iter_append_basic (&to, type, &v);
+	} while (dbus_message_iter_next (&from));
+    }
+
+    dbus_connection_send (connection, reply, NULL);
+    dbus_connection_flush (connection);
+
+    dbus_message_unref (reply);
+
+    return TRUE;
+}
+
+/* Keeps reply to be sent again for messages equal to message */
+static void
+dbusCacheReply (DBusMessage *message,
+		DBusMessage *reply)
+{
+    DbusCachedReply *cr;
+    DBusMessageIter iter;
+    unsigned int    hash;
+    char	    *key;
+
+    DBUS_CORE (&core);
+
+    if (dbus_message_iter_init (reply, &iter))
+    {
+	do
+	{
+	    if (!dbus_type_is_basic (dbus_message_iter_get_arg_type (&iter)))
+		return;
+	} while (dbus_message_iter_next (&iter));
+    }
+
+    key = dbusGetReplyCacheKey (message);
+    if (!key)
+	return;
+
+    cr = malloc (sizeof (DbusCachedReply));
+    if (!cr)
+    {
+	free (key);
+	return;
+    }
+
+    hash = dbusHashString (key) % DBUS_REPLY_CACHE_SIZE;
+
+    cr->key   = key;
+    cr->reply = dbus_message_ref (reply);
+    cr->next  = dc->replyCache[hash];
+
+    dc->replyCache[hash] = cr;
+}
+
+static void
+dbusInvalidateReplyCache (void)
+{
+    DbusCachedReply *cr;
+    int		    i;
+
+    DBUS_CORE (&core);
+
+    for (i = 0; i < DBUS_REPLY_CACHE_SIZE; i++)
+    {
+	while (dc->replyCache[i])
+	{
+	    cr = dc->replyCache[i];
+	    dc->replyCache[i] = cr->next;
+
+	    dbus_message_unref (cr->reply);
+	    free (cr->key);
+	    free (cr);
+	}
+    }
+}
+
 /* functions to create introspection XML */
 static void
 dbusIntrospectStartInterface (xmlTextWriterPtr writer)
@@ -347,6 +542,8 @@ dbusHandleRootIntrospectMessage (DBusConnection *connection,
 
     xmlBufferFree (buf);
 
+    dbusCacheReply (message, reply);
+
     if (!dbus_connection_send (connection, reply, NULL))
     {
 	return FALSE;
@@ -410,6 +607,8 @@ dbusHandlePluginIntrospectMessage (DBusConnection *connection,
 
     xmlBufferFree (buf);
 
+    dbusCacheReply (message, reply);
+
     if (!dbus_connection_send (connection, reply, NULL))
     {
 	return FALSE;
@@ -440,6 +639,10 @@ dbusHandleScreenIntrospectMessage (DBusConnection *connection,
 
     dbusIntrospectAddMethod (writer, COMPIZ_DBUS_LIST_MEMBER_NAME, 1,
 			     "as", "out");
+    dbusIntrospectAddMethod (writer, COMPIZ_DBUS_GET_ALL_MEMBER_NAME, 1,
+			     "a{sv}", "out");
+    dbusIntrospectAddMethod (writer, COMPIZ_DBUS_SET_MANY_MEMBER_NAME, 2,
+			     "a{sv}", "in", "as", "out");
 
     dbusIntrospectEndInterface (writer);
 
@@ -476,6 +679,8 @@ dbusHandleScreenIntrospectMessage (DBusConnection *connection,
 
     xmlBufferFree (buf);
 
+    dbusCacheReply (message, reply);
+
     if (!dbus_connection_send (connection, reply, NULL))
     {
 	return FALSE;
@@ -636,6 +841,8 @@ dbusHandleOptionIntrospectMessage (DBusConnection *connection,
 
     xmlBufferFree (buf);
 
+    dbusCacheReply (message, reply);
+
     if (!dbus_connection_send (connection, reply, NULL))
     {
 	return FALSE;
@@ -1036,6 +1243,49 @@ dbusGetOptionValue (CompObject	    *object,
     return FALSE;
 }
 
+/* Reads the value for option at iter, lists are expected as array */
+static Bool
+dbusReadOptionValue (CompObject	     *object,
+		     CompOption	     *option,
+		     DBusMessageIter *iter,
+		     CompOptionValue *value)
+{
+    DBusMessageIter aiter;
+    CompOptionValue tmpValue;
+
+    if (option->type != CompOptionTypeList)
+	return dbusGetOptionValue (object, iter, option->type, value);
+
+    if (dbus_message_iter_get_arg_type (iter) != DBUS_TYPE_ARRAY)
+	return FALSE;
+
+    dbus_message_iter_recurse (iter, &aiter);
+
+    do
+    {
+	memset (&tmpValue, 0, sizeof (tmpValue));
+
+	if (dbusGetOptionValue (object,
+				&aiter,
+				option->value.list.type,
+				&tmpValue))
+	{
+	    CompOptionValue *v;
+
+	    v = realloc (value->list.value,
+			 sizeof (CompOptionValue) *
+			 (value->list.nValue + 1));
+	    if (v)
+	    {
+		v[value->list.nValue++] = tmpValue;
+		value->list.value = v;
+	    }
+	}
+    } while (dbus_message_iter_next (&aiter));
+
+    return TRUE;
+}
+
 /*
  * 'Set' can be used to change any existing option. Argument
  * should be the new value for the option.
@@ -1088,49 +1338,14 @@ dbusHandleSetOptionMessage (DBusConnection *connection,
     {
 	if (strcmp (option->name, path[2]) == 0)
 	{
-	    DBusMessageIter iter, aiter;
-	    CompOptionValue value, tmpValue;
+	    DBusMessageIter iter;
+	    CompOptionValue value;
 	    Bool	    status = FALSE;
 
 	    memset (&value, 0, sizeof (value));
 
-	    if (option->type == CompOptionTypeList)
-	    {
-		if (dbus_message_iter_init (message, &iter) &&
-		    dbus_message_iter_get_arg_type (&iter) == DBUS_TYPE_ARRAY)
-		{
-		    dbus_message_iter_recurse (&iter, &aiter);
-
-		    do
-		    {
-			memset (&tmpValue, 0, sizeof (tmpValue));
-
-			if (dbusGetOptionValue (object,
-						&aiter,
-						option->value.list.type,
-						&tmpValue))
-			{
-			    CompOptionValue *v;
-
-			    v = realloc (value.list.value,
-					 sizeof (CompOptionValue) *
-					 (value.list.nValue + 1));
-			    if (v)
-			    {
-				v[value.list.nValue++] = tmpValue;
-				value.list.value = v;
-			    }
-			}
-		    } while (dbus_message_iter_next (&aiter));
-
-		    status = TRUE;
-		}
-	    }
-	    else if (dbus_message_iter_init (message, &iter))
-	    {
-		status = dbusGetOptionValue (object, &iter, option->type,
-					     &value);
-	    }
+	    if (dbus_message_iter_init (message, &iter))
+		status = dbusReadOptionValue (object, option, &iter, &value);
 
 	    if (status)
 	    {
@@ -1165,9 +1380,28 @@ dbusHandleSetOptionMessage (DBusConnection *connection,
     return FALSE;
 }
 
+/* D-Bus type used for values of a simple option type */
+static char
+dbusOptionTypeToSignature (CompOptionType type)
+{
+    switch (type) {
+    case CompOptionTypeInt:
+	return DBUS_TYPE_INT32;
+    case CompOptionTypeFloat:
+	return DBUS_TYPE_DOUBLE;
+    case CompOptionTypeBool:
+    case CompOptionTypeBell:
+	return DBUS_TYPE_BOOLEAN;
+    default:
+	break;
+    }
+
+    return DBUS_TYPE_STRING;
+}
+
 static void
 dbusAppendSimpleOptionValue (CompObject      *object,
-			     DBusMessage     *message,
+			     DBusMessageIter *iter,
 			     CompOptionType  type,
 			     CompOptionValue *value)
 {
@@ -1176,35 +1410,25 @@ dbusAppendSimpleOptionValue (CompObject      *object,
     switch (type) {
     case CompOptionTypeBool:
 	v.bool_val = value->b;
-	dbus_message_append_args (message,
-				  DBUS_TYPE_BOOLEAN, &v,
-				  DBUS_TYPE_INVALID);
+	dbus_message_iter_append_basic (iter, DBUS_TYPE_BOOLEAN, &v);
 	break;
     case CompOptionTypeInt:
 	v.i32 = value->i;
-	dbus_message_append_args (message,
-				  DBUS_TYPE_INT32, &v,
-				  DBUS_TYPE_INVALID);
+	dbus_message_iter_append_basic (iter, DBUS_TYPE_INT32, &v);
 	break;
     case CompOptionTypeFloat:
 	v.dbl = value->f;
 
-	dbus_message_append_args (message,
-				  DBUS_TYPE_DOUBLE, &v,
-				  DBUS_TYPE_INVALID);
+	dbus_message_iter_append_basic (iter, DBUS_TYPE_DOUBLE, &v);
 	break;
     case CompOptionTypeString:
-	dbus_message_append_args (message,
-				  DBUS_TYPE_STRING, &value->s,
-				  DBUS_TYPE_INVALID);
+	dbus_message_iter_append_basic (iter, DBUS_TYPE_STRING, &value->s);
 	break;
     case CompOptionTypeColor:
 	v.str = colorToString (value->c);
 	if (v.str)
 	{
-	    dbus_message_append_args (message,
-				      DBUS_TYPE_STRING, &v,
-				      DBUS_TYPE_INVALID);
+	    dbus_message_iter_append_basic (iter, DBUS_TYPE_STRING, &v);
 	    free (v.str);
 	}
 	break;
@@ -1212,9 +1436,7 @@ dbusAppendSimpleOptionValue (CompObject      *object,
 	v.str = keyActionToString ((CompDisplay *) object, &value->action);
 	if (v.str)
 	{
-	    dbus_message_append_args (message,
-				      DBUS_TYPE_STRING, &v,
-				      DBUS_TYPE_INVALID);
+	    dbus_message_iter_append_basic (iter, DBUS_TYPE_STRING, &v);
 	    free (v.str);
 	}
 	break;
@@ -1222,9 +1444,7 @@ dbusAppendSimpleOptionValue (CompObject      *object,
 	v.str = buttonActionToString ((CompDisplay *) object, &value->action);
 	if (v.str)
 	{
-	    dbus_message_append_args (message,
-				      DBUS_TYPE_STRING, &v,
-				      DBUS_TYPE_INVALID);
+	    dbus_message_iter_append_basic (iter, DBUS_TYPE_STRING, &v);
 	    free (v.str);
 	}
 	break;
@@ -1232,25 +1452,19 @@ dbusAppendSimpleOptionValue (CompObject      *object,
 	v.str = edgeMaskToString (value->action.edgeMask);
 	if (v.str)
 	{
-	    dbus_message_append_args (message,
-				      DBUS_TYPE_STRING, &v,
-				      DBUS_TYPE_INVALID);
+	    dbus_message_iter_append_basic (iter, DBUS_TYPE_STRING, &v);
 	    free (v.str);
 	}
 	break;
     case CompOptionTypeBell:
 	v.bool_val = value->action.bell;
-	dbus_message_append_args (message,
-				  DBUS_TYPE_BOOLEAN, &v,
-				  DBUS_TYPE_INVALID);
+	dbus_message_iter_append_basic (iter, DBUS_TYPE_BOOLEAN, &v);
 	break;
     case CompOptionTypeMatch:
 	v.str = matchToString (&value->match);
 	if (v.str)
 	{
-	    dbus_message_append_args (message,
-				      DBUS_TYPE_STRING, &v,
-				      DBUS_TYPE_INVALID);
+	    dbus_message_iter_append_basic (iter, DBUS_TYPE_STRING, &v);
 	    free (v.str);
 	}
     default:
@@ -1260,35 +1474,18 @@ dbusAppendSimpleOptionValue (CompObject      *object,
 
 static void
 dbusAppendListOptionValue (CompObject      *object,
-			   DBusMessage     *message,
+			   DBusMessageIter *iter,
 			   CompOptionType  type,
 			   CompOptionValue *value)
 {
-    DBusMessageIter iter;
     DBusMessageIter listIter;
     char	    sig[2];
     int		    i;
 
-    switch (value->list.type) {
-    case CompOptionTypeInt:
-	sig[0] = DBUS_TYPE_INT32;
-	break;
-    case CompOptionTypeFloat:
-	sig[0] = DBUS_TYPE_DOUBLE;
-	break;
-    case CompOptionTypeBool:
-    case CompOptionTypeBell:
-	sig[0] = DBUS_TYPE_BOOLEAN;
-	break;
-    default:
-	sig[0] = DBUS_TYPE_STRING;
-	break;
-    }
+    sig[0] = dbusOptionTypeToSignature (value->list.type);
     sig[1] = '\0';
 
-    dbus_message_iter_init_append (message, &iter);
-
-    if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+    if (!dbus_message_iter_open_container (iter, DBUS_TYPE_ARRAY,
 					   sig, &listIter))
 	return;
 
@@ -1365,25 +1562,38 @@ dbusAppendListOptionValue (CompObject      *object,
 	}
     }
 
-    dbus_message_iter_close_container (&iter, &listIter);
+    dbus_message_iter_close_container (iter, &listIter);
 }
 
 static void
-dbusAppendOptionValue (CompObject      *object,
-		       DBusMessage     *message,
-		       CompOptionType  type,
-		       CompOptionValue *value)
+dbusAppendOptionValueToIter (CompObject      *object,
+			     DBusMessageIter *iter,
+			     CompOptionType  type,
+			     CompOptionValue *value)
 {
     if (type == CompOptionTypeList)
     {
-	dbusAppendListOptionValue (object, message, type, value);
+	dbusAppendListOptionValue (object, iter, type, value);
     }
     else
     {
-	dbusAppendSimpleOptionValue (object, message, type, value);
+	dbusAppendSimpleOptionValue (object, iter, type, value);
     }
 }
 
+static void
+dbusAppendOptionValue (CompObject      *object,
+		       DBusMessage     *message,
+		       CompOptionType  type,
+		       CompOptionValue *value)
+{
+    DBusMessageIter iter;
+
+    dbus_message_iter_init_append (message, &iter);
+
+    dbusAppendOptionValueToIter (object, &iter, type, value);
+}
+
 /*
  * 'Get' can be used to retrieve the value of any existing option.
  *
@@ -1472,6 +1682,213 @@ dbusHandleListMessage (DBusConnection *connection,
     return TRUE;
 }
 
+static Bool
+dbusSendErrorReply (DBusConnection *connection,
+		    DBusMessage    *message,
+		    const char	   *text)
+{
+    DBusMessage *reply;
+
+    if (dbus_message_get_no_reply (message))
+	return TRUE;
+
+    reply = dbus_message_new_error (message, DBUS_ERROR_FAILED, text);
+    if (!reply)
+	return FALSE;
+
+    dbus_connection_send (connection, reply, NULL);
+    dbus_connection_flush (connection);
+
+    dbus_message_unref (reply);
+
+    return TRUE;
+}
+
+/*
+ * 'GetAll' can be used to retrieve the values of all options of a
+ * plugin at once. The reply is a dictionary mapping option names to
+ * their values, in the same form as returned by 'Get'.
+ *
+ * Example:
+ *
+ * dbus-send --print-reply --type=method_call \
+ * --dest=org.freedesktop.compiz	      \
+ * /org/freedesktop/compiz/core/allscreens    \
+ * org.freedesktop.compiz.getAll
+ */
+static Bool
+dbusHandleGetAllMessage (DBusConnection *connection,
+			 DBusMessage    *message,
+			 char	        **path)
+{
+    CompObject      *object;
+    CompOption      *option;
+    int	            nOption = 0;
+    DBusMessage     *reply;
+    DBusMessageIter iter, dictIter, entryIter, variantIter;
+    char	    sig[3];
+
+    option = dbusGetOptionsFromPath (path, &object, NULL, &nOption);
+    if (!option)
+	return dbusSendErrorReply (connection, message,
+				   "No such plugin or object");
+
+    reply = dbus_message_new_method_return (message);
+    if (!reply)
+	return FALSE;
+
+    dbus_message_iter_init_append (reply, &iter);
+    dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "{sv}",
+				      &dictIter);
+
+    while (nOption--)
+    {
+	if (option->type == CompOptionTypeAction)
+	{
+	    option++;
+	    continue;
+	}
+
+	if (option->type == CompOptionTypeList)
+	{
+	    sig[0] = DBUS_TYPE_ARRAY;
+	    sig[1] = dbusOptionTypeToSignature (option->value.list.type);
+	    sig[2] = '\0';
+	}
+	else
+	{
+	    sig[0] = dbusOptionTypeToSignature (option->type);
+	    sig[1] = '\0';
+	}
+
+	dbus_message_iter_open_container (&dictIter, DBUS_TYPE_DICT_ENTRY,
+					  NULL, &entryIter);
+	dbus_message_iter_append_basic (&entryIter, DBUS_TYPE_STRING,
+					&option->name);
+	dbus_message_iter_open_container (&entryIter, DBUS_TYPE_VARIANT,
+					  sig, &variantIter);
+
+	dbusAppendOptionValueToIter (object, &variantIter, option->type,
+				     &option->value);
+
+	dbus_message_iter_close_container (&entryIter, &variantIter);
+	dbus_message_iter_close_container (&dictIter, &entryIter);
+
+	option++;
+    }
+
+    dbus_message_iter_close_container (&iter, &dictIter);
+
+    dbus_connection_send (connection, reply, NULL);
+    dbus_connection_flush (connection);
+
+    dbus_message_unref (reply);
+
+    return TRUE;
+}
+
+/*
+ * 'SetMany' can be used to change several options of a plugin with
+ * one message. Argument should be a dictionary mapping option names
+ * to their new values, in the same form as accepted by 'Set'. The
+ * reply lists the options that could not be changed.
+ *
+ * Example (will set command0 and command1 options):
+ *
+ * dbus-send --print-reply --type=method_call		\
+ * --dest=org.freedesktop.compiz			\
+ * /org/freedesktop/compiz/commands/allscreens		\
+ * org.freedesktop.compiz.setMany			\
+ * dict:string:string:'command0','firefox','command1','xterm'
+ */
+static Bool
+dbusHandleSetManyMessage (DBusConnection *connection,
+			  DBusMessage    *message,
+			  char	         **path)
+{
+    CompObject      *object;
+    CompOption      *option, *o;
+    int	            nOption = 0;
+    DBusMessage     *reply;
+    DBusMessageIter iter, dictIter, entryIter, valueIter;
+    DBusMessageIter replyIter, failedIter;
+    CompOptionValue value;
+    char	    *name;
+    Bool	    status;
+
+    option = dbusGetOptionsFromPath (path, &object, NULL, &nOption);
+    if (!option)
+	return dbusSendErrorReply (connection, message,
+				   "No such plugin or object");
+
+    if (!dbus_message_iter_init (message, &iter) ||
+	dbus_message_iter_get_arg_type (&iter) != DBUS_TYPE_ARRAY)
+	return dbusSendErrorReply (connection, message,
+				   "Expected a dictionary of option values");
+
+    reply = dbus_message_new_method_return (message);
+    if (!reply)
+	return FALSE;
+
+    dbus_message_iter_init_append (reply, &replyIter);
+    dbus_message_iter_open_container (&replyIter, DBUS_TYPE_ARRAY,
+				      DBUS_TYPE_STRING_AS_STRING,
+				      &failedIter);
+
+    dbus_message_iter_recurse (&iter, &dictIter);
+
+    while (dbus_message_iter_get_arg_type (&dictIter) ==
+	   DBUS_TYPE_DICT_ENTRY)
+    {
+	dbus_message_iter_recurse (&dictIter, &entryIter);
+
+	if (dbus_message_iter_get_arg_type (&entryIter) != DBUS_TYPE_STRING)
+	{
+	    dbus_message_iter_next (&dictIter);
+	    continue;
+	}
+
+	dbus_message_iter_get_basic (&entryIter, &name);
+	dbus_message_iter_next (&entryIter);
+
+	/* values may be sent as variants or directly */
+	if (dbus_message_iter_get_arg_type (&entryIter) == DBUS_TYPE_VARIANT)
+	    dbus_message_iter_recurse (&entryIter, &valueIter);
+	else
+	    valueIter = entryIter;
+
+	memset (&value, 0, sizeof (value));
+
+	o = compFindOption (option, nOption, name, 0);
+
+	status = o && dbusReadOptionValue (object, o, &valueIter, &value);
+	if (status)
+	    status = (*core.setOptionForPlugin) (object, path[0], o->name,
+						 &value);
+
+	if (o && o->type == CompOptionTypeList && value.list.value)
+	    free (value.list.value);
+
+	if (!status)
+	    dbus_message_iter_append_basic (&failedIter, DBUS_TYPE_STRING,
+					    &name);
+
+	dbus_message_iter_next (&dictIter);
+    }
+
+    dbus_message_iter_close_container (&replyIter, &failedIter);
+
+    if (!dbus_message_get_no_reply (message))
+    {
+	dbus_connection_send (connection, reply, NULL);
+	dbus_connection_flush (connection);
+    }
+
+    dbus_message_unref (reply);
+
+    return TRUE;
+}
+
 /*
  * 'GetMetadata' can be used to retrieve metadata for an option.
  *
@@ -1595,7 +2012,9 @@ dbusHandleGetMetadataMessage (DBusConnection *connection,
 	option++;
     }
 
-    if (!reply)
+    if (reply)
+	dbusCacheReply (message, reply);
+    else
 	reply = dbus_message_new_error (message,
 					DBUS_ERROR_FAILED,
 					"No such option");
@@ -1747,6 +2166,8 @@ dbusHandleGetPluginMetadataMessage (DBusConnection *connection,
 
 	if (loadedPlugin && initializedPlugin)
 	    (*p->vTable->fini) (p);
+
+	dbusCacheReply (message, reply);
     }
     else
     {
@@ -1793,6 +2214,19 @@ dbusHandleMessage (DBusConnection *connection,
 	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     }
 
+    if ((dbus_message_is_method_call (message,
+				      DBUS_INTERFACE_INTROSPECTABLE,
+				      "Introspect")			      ||
+	 dbus_message_is_method_call (message, COMPIZ_DBUS_INTERFACE,
+				      COMPIZ_DBUS_GET_METADATA_MEMBER_NAME) ||
+	 dbus_message_is_method_call (message, COMPIZ_DBUS_INTERFACE,
+				COMPIZ_DBUS_GET_PLUGIN_METADATA_MEMBER_NAME)) &&
+	dbusSendCachedReply (connection, message))
+    {
+	dbus_free_string_array (path);
+	return DBUS_HANDLER_RESULT_HANDLED;
+    }
+
     /* root messages */
     if (!path[3])
     {
@@ -1869,6 +2303,24 @@ dbusHandleMessage (DBusConnection *connection,
 		return DBUS_HANDLER_RESULT_HANDLED;
 	    }
 	}
+	else if (dbus_message_is_method_call (message, COMPIZ_DBUS_INTERFACE,
+					      COMPIZ_DBUS_GET_ALL_MEMBER_NAME))
+	{
+	    if (dbusHandleGetAllMessage (connection, message, &path[3]))
+	    {
+		dbus_free_string_array (path);
+		return DBUS_HANDLER_RESULT_HANDLED;
+	    }
+	}
+	else if (dbus_message_is_method_call (message, COMPIZ_DBUS_INTERFACE,
+					      COMPIZ_DBUS_SET_MANY_MEMBER_NAME))
+	{
+	    if (dbusHandleSetManyMessage (connection, message, &path[3]))
+	    {
+		dbus_free_string_array (path);
+		return DBUS_HANDLER_RESULT_HANDLED;
+	    }
+	}
 
 	dbus_free_string_array (path);
 	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
@@ -1932,13 +2384,182 @@ dbusProcessMessages (void *data)
     return TRUE;
 }
 
+static void
+dbusEmitChangeSignal (CompObject *object,
+		      CompOption *o,
+		      const char *path)
+{
+    DBusMessage *signal;
+
+    DBUS_CORE (&core);
+
+    signal = dbus_message_new_signal (path,
+				      COMPIZ_DBUS_SERVICE_NAME,
+				      COMPIZ_DBUS_CHANGED_SIGNAL_NAME);
+    if (!signal)
+	return;
+
+    dbusAppendOptionValue (object, signal, o->type, &o->value);
+
+    dbus_connection_send (dc->connection, signal, NULL);
+
+    dbus_message_unref (signal);
+}
+
+static void
+dbusFreePendingSignal (DbusPendingSignal *ps)
+{
+    free (ps->path);
+    free (ps->plugin);
+    free (ps->option);
+    if (ps->name)
+	free (ps->name);
+    free (ps);
+}
+
+static CompObject *
+dbusFindObject (CompObjectType type,
+		const char     *name)
+{
+    CompObject *object;
+
+    if (type == COMP_OBJECT_TYPE_CORE)
+	return &core.base;
+
+    object = compObjectFind (&core.base, COMP_OBJECT_TYPE_DISPLAY, NULL);
+    if (object && type == COMP_OBJECT_TYPE_SCREEN)
+	object = compObjectFind (object, COMP_OBJECT_TYPE_SCREEN, name);
+
+    return object;
+}
+
+/* Sends the queued change signals with the current option values */
+static Bool
+dbusFlushChangeSignals (void *closure)
+{
+    DbusPendingSignal *ps, *next, *list = NULL;
+    CompObject	      *object;
+    CompPlugin	      *p;
+    CompOption	      *option, *o;
+    int		      nOption;
+
+    DBUS_CORE (&core);
+
+    /* signals are queued in reverse order */
+    for (ps = dc->pendingSignals; ps; ps = next)
+    {
+	next = ps->next;
+	ps->next = list;
+	list = ps;
+    }
+
+    dc->pendingSignals = NULL;
+    dc->signalHandle   = 0;
+
+    memset (dc->pendingHash, 0, sizeof (dc->pendingHash));
+
+    for (ps = list; ps; ps = next)
+    {
+	next = ps->next;
+
+	object = dbusFindObject (ps->type, ps->name);
+	p = findActivePlugin (ps->plugin);
+
+	if (object && p && p->vTable->getObjectOptions)
+	{
+	    option = (*p->vTable->getObjectOptions) (p, object, &nOption);
+
+	    o = compFindOption (option, nOption, ps->option, 0);
+	    if (o)
+		dbusEmitChangeSignal (object, o, ps->path);
+	}
+
+	dbusFreePendingSignal (ps);
+    }
+
+    if (list)
+	dbus_connection_flush (dc->connection);
+
+    return FALSE;
+}
+
+/* Queues a change signal for path, later changes of the same option
+   before the queue is flushed only result in one signal. */
+static void
+dbusQueueChangeSignal (CompObject *object,
+		       CompOption *o,
+		       const char *plugin,
+		       const char *path)
+{
+    DbusPendingSignal *ps;
+    unsigned int      hash;
+
+    DBUS_CORE (&core);
+
+    hash = dbusHashString (path) % DBUS_SIGNAL_HASH_SIZE;
+
+    for (ps = dc->pendingHash[hash]; ps; ps = ps->hashNext)
+	if (strcmp (ps->path, path) == 0)
+	    return;
+
+    ps = malloc (sizeof (DbusPendingSignal));
+    if (!ps)
+	return;
+
+    ps->path   = strdup (path);
+    ps->plugin = strdup (plugin);
+    ps->option = strdup (o->name);
+    ps->type   = object->type;
+    ps->name   = compObjectName (object);
+
+    if (!ps->path || !ps->plugin || !ps->option)
+    {
+	if (ps->path)
+	    free (ps->path);
+	if (ps->plugin)
+	    free (ps->plugin);
+	if (ps->option)
+	    free (ps->option);
+	if (ps->name)
+	    free (ps->name);
+	free (ps);
+
+	return;
+    }
+
+    ps->next = dc->pendingSignals;
+    dc->pendingSignals = ps;
+
+    ps->hashNext = dc->pendingHash[hash];
+    dc->pendingHash[hash] = ps;
+
+    if (!dc->signalHandle)
+	dc->signalHandle = compAddTimeout (0, 0, dbusFlushChangeSignals, 0);
+}
+
+static Bool
+dbusCoalesceChangeSignals (CompObject *object)
+{
+    while (object && object->type != COMP_OBJECT_TYPE_DISPLAY)
+	object = object->parent;
+
+    if (!object)
+	return FALSE;
+
+    DBUS_DISPLAY (GET_CORE_DISPLAY (object));
+
+    if (!dd)
+	return FALSE;
+
+    return dd->opt[DBUS_DISPLAY_OPTION_COALESCE_CHANGE_SIGNALS].value.b;
+}
+
 static void
 dbusSendChangeSignalForOption (CompObject *object,
 			       CompOption *o,
 			       const char *plugin)
 {
-    DBusMessage *signal;
-    char	*name, path[256];
+    char *name, path[256];
 
     DBUS_CORE (&core);
 
@@ -1957,16 +2578,15 @@ dbusSendChangeSignalForOption (CompObject *object,
 	sprintf (path, "%s/%s/%s/%s", COMPIZ_DBUS_ROOT_PATH,
 		 plugin, compObjectTypeName (object->type), o->name);
 
-    signal = dbus_message_new_signal (path,
-				      COMPIZ_DBUS_SERVICE_NAME,
-				      COMPIZ_DBUS_CHANGED_SIGNAL_NAME);
-
-    dbusAppendOptionValue (object, signal, o->type, &o->value);
-
-    dbus_connection_send (dc->connection, signal, NULL);
-    dbus_connection_flush (dc->connection);
-
-    dbus_message_unref (signal);
+    if (dbusCoalesceChangeSignals (object))
+    {
+	dbusQueueChangeSignal (object, o, plugin, path);
+    }
+    else
+    {
+	dbusEmitChangeSignal (object, o, path);
+	dbus_connection_flush (dc->connection);
+    }
 }
 
 static Bool
@@ -2049,6 +2669,9 @@ dbusRegisterOptions (DBusConnection *connection,
     char       **path;
     int        count;
 
+    /* introspection of the tree changes */
+    dbusInvalidateReplyCache ();
+
     dbusGetPathDecomposed (screenPath, &path, &count);
 
     option = dbusGetOptionsFromPath (&path[3], NULL, NULL, &nOptions);
@@ -2082,6 +2705,9 @@ dbusUnregisterOptions (DBusConnection *connection,
     char       **path;
     int        count;
 
+    /* introspection of the tree changes */
+    dbusInvalidateReplyCache ();
+
     dbusGetPathDecomposed (screenPath, &path, &count);
 
     option = dbusGetOptionsFromPath (&path[3], NULL, NULL, &nOptions);
@@ -2346,6 +2972,8 @@ dbusSendPluginsChangedSignal (const char *name,
 
     DBUS_CORE (&core);
 
+    dbusInvalidateReplyCache ();
+
     signal = dbus_message_new_signal (COMPIZ_DBUS_ROOT_PATH,
 				      COMPIZ_DBUS_SERVICE_NAME,
 				      COMPIZ_DBUS_PLUGINS_CHANGED_SIGNAL_NAME);
@@ -2474,6 +3102,12 @@ dbusInitCore (CompPlugin *p,
 	}
     }
 
+    dc->pendingSignals = NULL;
+    dc->signalHandle   = 0;
+
+    memset (dc->pendingHash, 0, sizeof (dc->pendingHash));
+    memset (dc->replyCache, 0, sizeof (dc->replyCache));
+
     WRAP (dc, c, initPluginForObject, dbusInitPluginForObject);
     WRAP (dc, c, setOptionForPlugin, dbusSetOptionForPlugin);
 
@@ -2491,10 +3125,24 @@ static void
 dbusFiniCore (CompPlugin *p,
 	      CompCore   *c)
 {
-    int i;
+    DbusPendingSignal *ps;
+    int		      i;
 
     DBUS_CORE (c);
 
+    if (dc->signalHandle)
+	compRemoveTimeout (dc->signalHandle);
+
+    while (dc->pendingSignals)
+    {
+	ps = dc->pendingSignals;
+	dc->pendingSignals = ps->next;
+
+	dbusFreePendingSignal (ps);
+    }
+
+    dbusInvalidateReplyCache ();
+
     for (i = 0; i < DBUS_FILE_WATCH_NUM; i++)
 	removeFileWatch (dc->fileWatch[i]);
 
@@ -2529,6 +3177,16 @@ dbusInitDisplay (CompPlugin  *p,
     if (!dd)
 	return FALSE;
 
+    if (!compInitDisplayOptionsFromMetadata (d,
+					     &dbusMetadata,
+					     dbusDisplayOptionInfo,
+					     dd->opt,
+					     DBUS_DISPLAY_OPTION_NUM))
+    {
+	free (dd);
+	return FALSE;
+    }
+
     dd->pluginList = NULL;
     dd->nPlugins   = 0;
 
@@ -2547,6 +3205,13 @@ dbusFiniDisplay (CompPlugin  *p,
     DBUS_CORE (&core);
     DBUS_DISPLAY (d);
 
+    /* send queued signals while their objects still exist */
+    if (dc->signalHandle)
+    {
+	compRemoveTimeout (dc->signalHandle);
+	dbusFlushChangeSignals (0);
+    }
+
     dbusUnregisterPluginsForDisplay (dc->connection, d);
 
     if (dd->pluginList)
@@ -2558,9 +3223,41 @@ dbusFiniDisplay (CompPlugin  *p,
 	free (dd->pluginList);
     }
 
+    compFiniDisplayOptions (d, dd->opt, DBUS_DISPLAY_OPTION_NUM);
+
+    d->base.privates[displayPrivateIndex].ptr = NULL;
+
     free (dd);
 }
 
+static CompOption *
+dbusGetDisplayOptions (CompPlugin  *p,
+		       CompDisplay *d,
+		       int	   *count)
+{
+    DBUS_DISPLAY (d);
+
+    *count = NUM_OPTIONS (dd);
+    return dd->opt;
+}
+
+static CompBool
+dbusSetDisplayOption (CompPlugin      *p,
+		      CompDisplay     *d,
+		      const char      *name,
+		      CompOptionValue *value)
+{
+    CompOption *o;
+
+    DBUS_DISPLAY (d);
+
+    o = compFindOption (dd->opt, NUM_OPTIONS (dd), name, NULL);
+    if (!o)
+	return FALSE;
+
+    return compSetDisplayOption (d, o, value);
+}
+
 static Bool
 dbusInitScreen (CompPlugin *p,
 		CompScreen *s)
@@ -2581,6 +3278,36 @@ dbusFiniScreen (CompPlugin *p,
     dbusUnregisterPluginsForScreen (dc->connection, s);
 }
 
+static CompOption *
+dbusGetObjectOptions (CompPlugin *p,
+		      CompObject *o,
+		      int	 *count)
+{
+    static GetPluginObjectOptionsProc dispTab[] = {
+	(GetPluginObjectOptionsProc) 0, /* GetCoreOptions */
+	(GetPluginObjectOptionsProc) dbusGetDisplayOptions
+    };
+
+    *count = 0;
+    RETURN_DISPATCH (o, dispTab, ARRAY_SIZE (dispTab),
+		     (void *) count, (p, o, count));
+}
+
+static CompBool
+dbusSetObjectOption (CompPlugin      *p,
+		     CompObject      *o,
+		     const char      *name,
+		     CompOptionValue *value)
+{
+    static SetPluginObjectOptionProc dispTab[] = {
+	(SetPluginObjectOptionProc) 0, /* SetCoreOption */
+	(SetPluginObjectOptionProc) dbusSetDisplayOption
+    };
+
+    RETURN_DISPATCH (o, dispTab, ARRAY_SIZE (dispTab), FALSE,
+		     (p, o, name, value));
+}
+
 static CompBool
 dbusInitObject (CompPlugin *p,
 		CompObject *o)
@@ -2611,7 +3338,8 @@ static Bool
 dbusInit (CompPlugin *p)
 {
     if (!compInitPluginMetadataFromInfo (&dbusMetadata, p->vTable->name,
-					 0, 0, 0, 0))
+					 dbusDisplayOptionInfo,
+					 DBUS_DISPLAY_OPTION_NUM, 0, 0))
 	return FALSE;
 
     corePrivateIndex = allocateCorePrivateIndex ();
@@ -2621,6 +3349,8 @@ dbusInit (CompPlugin *p)
 	return FALSE;
     }
 
+    compAddMetadataFromFile (&dbusMetadata, p->vTable->name);
+
     return TRUE;
 }
 
@@ -2644,8 +3374,8 @@ CompPluginVTable dbusVTable = {
     dbusFini,
     dbusInitObject,
     dbusFiniObject,
-    0, /* GetObjectOptions */
-    0  /* SetObjectOption */
+    dbusGetObjectOptions,
+    dbusSetObjectOption
 };
 
 CompPluginVTable *
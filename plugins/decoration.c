@@ -53,12 +53,51 @@ typedef struct _Vector {
 #define DECOR_ACTIVE 1
 #define DECOR_NUM    2
 
+#define DECOR_ATLAS_SIZE 1024
+
+typedef struct _DecorAtlasSlot {
+    struct _DecorAtlasSlot *next;
+    int			   x, y;
+    int			   width, height;
+    Bool		   used;
+} DecorAtlasSlot;
+
+/* shared texture that decoration pixmaps are copied into, filled
+   shelf by shelf from the top */
+typedef struct _DecorAtlas {
+    struct _DecorAtlas *next;
+    CompScreen	       *screen;
+    CompTexture	       texture;
+    int		       size;
+    int		       shelfX;
+    int		       shelfY;
+    int		       shelfHeight;
+    DecorAtlasSlot     *slots;
+    int		       nUsed;
+} DecorAtlas;
+
+#define DECOR_TEXTURE_HASH_SIZE 64
+
+#define DECOR_TEXTURE_HASH(id) \
+    (((id) ^ ((id) >> 6)) & (DECOR_TEXTURE_HASH_SIZE - 1))
+
 typedef struct _DecorTexture {
     struct _DecorTexture *next;
+    struct _DecorTexture *damageNext;
     int			 refCount;
     Pixmap		 pixmap;
     Damage		 damage;
     CompTexture		 texture;
+    int			 width;
+    int			 height;
+    int			 depth;
+    CompMatrix		 matrix;
+    DecorAtlas		 *atlas;
+    DecorAtlasSlot	 *slot;
+    BoxRec		 dirty;
+
+    /* window decorations drawn with this texture */
+    struct _WindowDecoration *windows;
 } DecorTexture;
 
 typedef struct _Decoration {
@@ -86,9 +125,12 @@ typedef struct _ScaledQuad {
 } ScaledQuad;
 
 typedef struct _WindowDecoration {
-    Decoration *decor;
-    ScaledQuad *quad;
-    int	       nQuad;
+    struct _WindowDecoration *prev;
+    struct _WindowDecoration *next;
+    CompWindow		     *window;
+    Decoration		     *decor;
+    ScaledQuad		     *quad;
+    int			     nQuad;
 } WindowDecoration;
 
 static int corePrivateIndex;
@@ -107,7 +149,8 @@ typedef struct _DecorCore {
 #define DECOR_DISPLAY_OPTION_MIPMAP          6
 #define DECOR_DISPLAY_OPTION_DECOR_MATCH     7
 #define DECOR_DISPLAY_OPTION_SHADOW_MATCH    8
-#define DECOR_DISPLAY_OPTION_NUM             9
+#define DECOR_DISPLAY_OPTION_TEXTURE_ATLAS   9
+#define DECOR_DISPLAY_OPTION_NUM             10
 
 static int displayPrivateIndex;
 
@@ -115,7 +158,11 @@ typedef struct _DecorDisplay {
     int			     screenPrivateIndex;
     HandleEventProc	     handleEvent;
     MatchPropertyChangedProc matchPropertyChanged;
-    DecorTexture	     *textures;
+
+    /* textures hashed by pixmap and by damage handle */
+    DecorTexture	     *textures[DECOR_TEXTURE_HASH_SIZE];
+    DecorTexture	     *damages[DECOR_TEXTURE_HASH_SIZE];
+
     Atom		     supportingDmCheckAtom;
     Atom		     winDecorAtom;
     Atom		     requestFrameExtentsAtom;
@@ -133,6 +180,8 @@ typedef struct _DecorScreen {
     Decoration   **decors[DECOR_NUM];
     unsigned int decorNum[DECOR_NUM];
 
+    DecorAtlas *atlases;
+
     DrawWindowProc		  drawWindow;
     DamageWindowRectProc	  damageWindowRect;
     GetOutputExtentsForWindowProc getOutputExtentsForWindow;
@@ -184,6 +233,377 @@ typedef struct _DecorWindow {
 
 #define NUM_OPTIONS(d) (sizeof ((d)->opt) / sizeof (CompOption))
 
+static DecorAtlas *
+decorCreateAtlas (CompScreen *screen)
+{
+    DecorAtlas *atlas;
+
+    atlas = malloc (sizeof (DecorAtlas));
+    if (!atlas)
+	return NULL;
+
+    initTexture (screen, &atlas->texture);
+
+    atlas->size	       = MIN (DECOR_ATLAS_SIZE, screen->maxTextureSize);
+    atlas->shelfX      = 0;
+    atlas->shelfY      = 0;
+    atlas->shelfHeight = 0;
+    atlas->slots       = NULL;
+    atlas->nUsed       = 0;
+    atlas->screen      = screen;
+    atlas->next	       = NULL;
+
+    makeScreenCurrent (screen);
+
+    glGenTextures (1, &atlas->texture.name);
+    glBindTexture (GL_TEXTURE_2D, atlas->texture.name);
+
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, atlas->size, atlas->size, 0,
+		  GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+
+    glBindTexture (GL_TEXTURE_2D, 0);
+
+    return atlas;
+}
+
+static void
+decorDestroyAtlas (CompScreen *screen,
+		   DecorAtlas *atlas)
+{
+    DecorAtlasSlot *slot;
+
+    while (atlas->slots)
+    {
+	slot = atlas->slots;
+	atlas->slots = slot->next;
+	free (slot);
+    }
+
+    finiTexture (screen, &atlas->texture);
+    free (atlas);
+}
+
+static DecorAtlasSlot *
+decorAtlasAllocSlot (DecorAtlas *atlas,
+		     int	width,
+		     int	height)
+{
+    DecorAtlasSlot *slot, *best = NULL;
+
+    /* reuse the smallest released slot that is large enough */
+    for (slot = atlas->slots; slot; slot = slot->next)
+    {
+	if (slot->used || slot->width < width || slot->height < height)
+	    continue;
+
+	if (!best || slot->width * slot->height < best->width * best->height)
+	    best = slot;
+    }
+
+    if (best)
+    {
+	best->used = TRUE;
+	atlas->nUsed++;
+
+	return best;
+    }
+
+    if (width > atlas->size)
+	return NULL;
+
+    if (atlas->shelfX + width > atlas->size)
+    {
+	atlas->shelfY	   += atlas->shelfHeight;
+	atlas->shelfX	    = 0;
+	atlas->shelfHeight  = 0;
+    }
+
+    if (atlas->shelfY + height > atlas->size)
+	return NULL;
+
+    slot = malloc (sizeof (DecorAtlasSlot));
+    if (!slot)
+	return NULL;
+
+    slot->x	 = atlas->shelfX;
+    slot->y	 = atlas->shelfY;
+    slot->width	 = width;
+    slot->height = height;
+    slot->used	 = TRUE;
+    slot->next	 = atlas->slots;
+
+    atlas->slots = slot;
+    atlas->nUsed++;
+
+    atlas->shelfX += width;
+    if (height > atlas->shelfHeight)
+	atlas->shelfHeight = height;
+
+    return slot;
+}
+
+/* Places a pixmap of the given size into an atlas. Slots keep a one
+   pixel border of repeated edge pixels so that filtering never picks
+   up neighbouring decorations. */
+static Bool
+decorAtlasAdd (CompScreen   *screen,
+	       DecorTexture *texture)
+{
+    DecorAtlas	   *atlas;
+    DecorAtlasSlot *slot = NULL;
+    int		   width = texture->width + 2;
+    int		   height = texture->height + 2;
+
+    DECOR_SCREEN (screen);
+
+    if (width > MIN (DECOR_ATLAS_SIZE, screen->maxTextureSize) ||
+	height > MIN (DECOR_ATLAS_SIZE, screen->maxTextureSize))
+	return FALSE;
+
+    for (atlas = ds->atlases; atlas; atlas = atlas->next)
+    {
+	slot = decorAtlasAllocSlot (atlas, width, height);
+	if (slot)
+	    break;
+    }
+
+    if (!slot)
+    {
+	atlas = decorCreateAtlas (screen);
+	if (!atlas)
+	    return FALSE;
+
+	slot = decorAtlasAllocSlot (atlas, width, height);
+	if (!slot)
+	{
+	    decorDestroyAtlas (screen, atlas);
+	    return FALSE;
+	}
+
+	atlas->next  = ds->atlases;
+	ds->atlases = atlas;
+    }
+
+    texture->atlas = atlas;
+    texture->slot  = slot;
+
+    texture->matrix.xx = 1.0f / atlas->size;
+    texture->matrix.yx = 0.0f;
+    texture->matrix.xy = 0.0f;
+    texture->matrix.yy = 1.0f / atlas->size;
+    texture->matrix.x0 = (float) (slot->x + 1) / atlas->size;
+    texture->matrix.y0 = (float) (slot->y + 1) / atlas->size;
+
+    /* everything needs to be copied once */
+    texture->dirty.x1 = 0;
+    texture->dirty.y1 = 0;
+    texture->dirty.x2 = texture->width;
+    texture->dirty.y2 = texture->height;
+
+    return TRUE;
+}
+
+static void
+decorAtlasRemove (CompScreen   *screen,
+		  DecorTexture *texture)
+{
+    DecorAtlas *atlas = texture->atlas;
+
+    DECOR_SCREEN (screen);
+
+    texture->slot->used = FALSE;
+    texture->atlas	= NULL;
+    texture->slot	= NULL;
+
+    atlas->nUsed--;
+    if (atlas->nUsed)
+	return;
+
+    if (atlas == ds->atlases)
+    {
+	ds->atlases = atlas->next;
+    }
+    else
+    {
+	DecorAtlas *a;
+
+	for (a = ds->atlases; a; a = a->next)
+	{
+	    if (a->next == atlas)
+	    {
+		a->next = atlas->next;
+		break;
+	    }
+	}
+    }
+
+    decorDestroyAtlas (screen, atlas);
+}
+
+static void
+decorAddTextureDamage (DecorTexture *texture,
+		       int	    x,
+		       int	    y,
+		       int	    width,
+		       int	    height)
+{
+    int x1 = MAX (x, 0);
+    int y1 = MAX (y, 0);
+    int x2 = MIN (x + width, texture->width);
+    int y2 = MIN (y + height, texture->height);
+
+    if (x1 >= x2 || y1 >= y2)
+	return;
+
+    if (texture->dirty.x1 < texture->dirty.x2)
+    {
+	x1 = MIN (x1, texture->dirty.x1);
+	y1 = MIN (y1, texture->dirty.y1);
+	x2 = MAX (x2, texture->dirty.x2);
+	y2 = MAX (y2, texture->dirty.y2);
+    }
+
+    texture->dirty.x1 = x1;
+    texture->dirty.y1 = y1;
+    texture->dirty.x2 = x2;
+    texture->dirty.y2 = y2;
+}
+
+static int
+decorHostByteOrder (void)
+{
+    static const unsigned int one = 1;
+
+    return *((const char *) &one) ? LSBFirst : MSBFirst;
+}
+
+/* Copies the damaged part of a decoration pixmap into its atlas slot */
+static void
+decorUpdateAtlasTexture (CompScreen   *screen,
+			 DecorTexture *texture)
+{
+    XImage	 *image;
+    unsigned int *data, alpha = 0;
+    GLenum	 type;
+    BoxRec	 box = texture->dirty;
+    int		 left, right, top, bottom;
+    int		 width, height, x, y, sx, sy;
+
+    if (box.x1 >= box.x2 || box.y1 >= box.y2)
+	return;
+
+    texture->dirty.x1 = texture->dirty.x2 = 0;
+    texture->dirty.y1 = texture->dirty.y2 = 0;
+
+    image = XGetImage (screen->display->display, texture->pixmap,
+		       box.x1, box.y1, box.x2 - box.x1, box.y2 - box.y1,
+		       AllPlanes, ZPixmap);
+    if (!image)
+	return;
+
+    if (image->bits_per_pixel != 32)
+    {
+	XDestroyImage (image);
+	return;
+    }
+
+    /* pixels are copied as they are, only the upload type follows the
+       byte order of the image */
+    if (image->byte_order == decorHostByteOrder ())
+	type = GL_UNSIGNED_INT_8_8_8_8_REV;
+    else
+	type = GL_UNSIGNED_INT_8_8_8_8;
+
+    if (texture->depth != 32)
+	alpha = (type == GL_UNSIGNED_INT_8_8_8_8_REV) ? 0xff000000 : 0xff;
+
+    /* repeat edge pixels into the slot border */
+    left   = box.x1 == 0;
+    top	   = box.y1 == 0;
+    right  = box.x2 == texture->width;
+    bottom = box.y2 == texture->height;
+
+    width  = box.x2 - box.x1 + left + right;
+    height = box.y2 - box.y1 + top + bottom;
+
+    data = malloc (width * height * 4);
+    if (!data)
+    {
+	XDestroyImage (image);
+	return;
+    }
+
+    for (y = 0; y < height; y++)
+    {
+	unsigned int *src, *dst = data + y * width;
+
+	sy = MIN (MAX (y - top, 0), image->height - 1);
+	src = (unsigned int *) (image->data + sy * image->bytes_per_line);
+
+	for (x = 0; x < width; x++)
+	{
+	    sx = MIN (MAX (x - left, 0), image->width - 1);
+	    dst[x] = src[sx] | alpha;
+	}
+    }
+
+    makeScreenCurrent (screen);
+
+    glBindTexture (GL_TEXTURE_2D, texture->atlas->texture.name);
+    glTexSubImage2D (GL_TEXTURE_2D, 0,
+		     texture->slot->x + 1 + box.x1 - left,
+		     texture->slot->y + 1 + box.y1 - top,
+		     width, height, GL_BGRA, type, data);
+    glBindTexture (GL_TEXTURE_2D, 0);
+
+    free (data);
+    XDestroyImage (image);
+}
+
+/* Returns the texture decoration quads of this pixmap are drawn with.
+   Atlas slots are filled when the pixmap is damaged, never here. */
+static CompTexture *
+decorPaintTexture (CompScreen   *screen,
+		   DecorTexture *texture)
+{
+    if (!texture->atlas)
+	return &texture->texture;
+
+    return &texture->atlas->texture;
+}
+
+/* Moves the geometry of window to the end of the geometry of batch so
+   that both are drawn with one call. Fails if the vertex formats differ
+   or batch cannot hold the vertices, window is left untouched then. */
+static Bool
+decorAppendGeometry (CompWindow *batch,
+		     CompWindow *window)
+{
+    int vSize, n;
+
+    if (window->texUnits != batch->texUnits)
+	return FALSE;
+
+    vSize = 3 + window->texUnits * 2;
+    n	  = (batch->vCount + window->vCount) * vSize;
+
+    if (n > batch->vertexSize && !moreWindowVertices (batch, n))
+	return FALSE;
+
+    memcpy (batch->vertices + batch->vCount * vSize, window->vertices,
+	    window->vCount * vSize * sizeof (GLfloat));
+
+    batch->vCount += window->vCount;
+    window->vCount = 0;
+
+    return TRUE;
+}
+
 static Bool
 decorDrawWindow (CompWindow	      *w,
 		 const CompTransform  *transform,
@@ -236,16 +656,21 @@ decorDrawWindow (CompWindow	      *w,
 	}
 
 	if (w->vCount)
-	    (*w->screen->drawWindowTexture) (w,
-					     &wd->decor->texture->texture,
-					     attrib, mask);
+	{
+	    CompTexture *texture;
+
+	    texture = decorPaintTexture (w->screen, wd->decor->texture);
+	    (*w->screen->drawWindowTexture) (w, texture, attrib, mask);
+	}
     }
 
     if (w->type & CompWindowTypeDesktopMask)
     {
 	/* we only want to draw on the lowest desktop window, find it and see
 	   if we the window we have is it */
-	CompWindow *window = w->screen->windows;
+	CompWindow  *window = w->screen->windows;
+	CompWindow  *batch = NULL;
+	CompTexture *batchTexture = NULL;
 	for (window = w->screen->windows; window; window = window->next)
 	{
 	    if (window->type & CompWindowTypeDesktopMask)
@@ -257,7 +682,8 @@ decorDrawWindow (CompWindow	      *w,
 	    }
 	}
 
-	/* drawing dock shadows now */
+	/* drawing dock shadows now, consecutive docks that share an
+	   atlas texture are drawn with a single call */
 	for (window = w->screen->windows; window; window = window->next)
 	{
 	    if (window->type & CompWindowTypeDockMask && !window->destroyed && !window->invisible)
@@ -292,12 +718,31 @@ decorDrawWindow (CompWindow	      *w,
 		    }
 
 		    if (window->vCount)
-			(*window->screen->drawWindowTexture) (window,
-							      &wd->decor->texture->texture,
-							      attrib, mask);
+		    {
+			CompTexture *texture;
+
+			texture = decorPaintTexture (window->screen,
+						     wd->decor->texture);
+
+			if (batch && texture == batchTexture &&
+			    decorAppendGeometry (batch, window))
+			    continue;
+
+			if (batch)
+			    (*batch->screen->drawWindowTexture) (batch,
+								 batchTexture,
+								 attrib, mask);
+
+			batch	     = window;
+			batchTexture = texture;
+		    }
 		}
 	    }
 	}
+
+	if (batch)
+	    (*batch->screen->drawWindowTexture) (batch, batchTexture,
+						 attrib, mask);
     }
     return status;
 }
@@ -313,7 +758,9 @@ decorGetTexture (CompScreen *screen,
 
     DECOR_DISPLAY (screen->display);
 
-    for (texture = dd->textures; texture; texture = texture->next)
+    for (texture = dd->textures[DECOR_TEXTURE_HASH (pixmap)];
+	 texture;
+	 texture = texture->next)
     {
 	if (texture->pixmap == pixmap)
 	{
@@ -336,25 +783,44 @@ decorGetTexture (CompScreen *screen,
 	return NULL;
     }
 
-    if (!bindPixmapToTexture (screen, &texture->texture, pixmap,
-			      width, height, depth))
+    texture->pixmap  = pixmap;
+    texture->width   = width;
+    texture->height  = height;
+    texture->depth   = depth;
+    texture->atlas   = NULL;
+    texture->slot    = NULL;
+    texture->windows = NULL;
+
+    if (!dd->opt[DECOR_DISPLAY_OPTION_TEXTURE_ATLAS].value.b ||
+	!decorAtlasAdd (screen, texture))
     {
-	finiTexture (screen, &texture->texture);
-	free (texture);
-	return NULL;
-    }
+	if (!bindPixmapToTexture (screen, &texture->texture, pixmap,
+				  width, height, depth))
+	{
+	    finiTexture (screen, &texture->texture);
+	    free (texture);
+	    return NULL;
+	}
 
-    if (!dd->opt[DECOR_DISPLAY_OPTION_MIPMAP].value.b)
-	texture->texture.mipmap = FALSE;
+	if (!dd->opt[DECOR_DISPLAY_OPTION_MIPMAP].value.b)
+	    texture->texture.mipmap = FALSE;
+
+	texture->matrix = texture->texture.matrix;
+    }
 
     texture->damage = XDamageCreate (screen->display->display, pixmap,
 				     XDamageReportRawRectangles);
 
+    if (texture->atlas)
+	decorUpdateAtlasTexture (screen, texture);
+
     texture->refCount = 1;
-    texture->pixmap   = pixmap;
-    texture->next     = dd->textures;
 
-    dd->textures = texture;
+    texture->next = dd->textures[DECOR_TEXTURE_HASH (pixmap)];
+    dd->textures[DECOR_TEXTURE_HASH (pixmap)] = texture;
+
+    texture->damageNext = dd->damages[DECOR_TEXTURE_HASH (texture->damage)];
+    dd->damages[DECOR_TEXTURE_HASH (texture->damage)] = texture;
 
     return texture;
 }
@@ -363,30 +829,39 @@ static void
 decorReleaseTexture (CompScreen   *screen,
 		     DecorTexture *texture)
 {
+    DecorTexture **t;
+
     DECOR_DISPLAY (screen->display);
 
     texture->refCount--;
     if (texture->refCount)
 	return;
 
-    if (texture == dd->textures)
+    for (t = &dd->textures[DECOR_TEXTURE_HASH (texture->pixmap)];
+	 *t;
+	 t = &(*t)->next)
     {
-	dd->textures = texture->next;
+	if (*t == texture)
+	{
+	    *t = texture->next;
+	    break;
+	}
     }
-    else
-    {
-	DecorTexture *t;
 
-	for (t = dd->textures; t; t = t->next)
+    for (t = &dd->damages[DECOR_TEXTURE_HASH (texture->damage)];
+	 *t;
+	 t = &(*t)->damageNext)
+    {
+	if (*t == texture)
 	{
-	    if (t->next == texture)
-	    {
-		t->next = texture->next;
-		break;
-	    }
+	    *t = texture->damageNext;
+	    break;
 	}
     }
 
+    if (texture->atlas)
+	decorAtlasRemove (screen, texture);
+
     finiTexture (screen, &texture->texture);
     free (texture);
 }
@@ -759,7 +1234,8 @@ decorWindowUpdateDecoration (CompWindow *w)
 }
 
 static WindowDecoration *
-createWindowDecoration (Decoration *d)
+createWindowDecoration (CompWindow *w,
+			Decoration *d)
 {
     WindowDecoration *wd;
 
@@ -770,9 +1246,17 @@ createWindowDecoration (Decoration *d)
 
     d->refCount++;
 
-    wd->decor = d;
-    wd->quad  = (ScaledQuad *) (wd + 1);
-    wd->nQuad = d->nQuad;
+    wd->window = w;
+    wd->decor  = d;
+    wd->quad   = (ScaledQuad *) (wd + 1);
+    wd->nQuad  = d->nQuad;
+
+    wd->prev = NULL;
+    wd->next = d->texture->windows;
+    if (wd->next)
+	wd->next->prev = wd;
+
+    d->texture->windows = wd;
 
     return wd;
 }
@@ -781,6 +1265,14 @@ static void
 destroyWindowDecoration (CompScreen	  *screen,
 			 WindowDecoration *wd)
 {
+    if (wd->prev)
+	wd->prev->next = wd->next;
+    else
+	wd->decor->texture->windows = wd->next;
+
+    if (wd->next)
+	wd->next->prev = wd->prev;
+
     decorReleaseDecoration (screen, wd->decor);
     free (wd);
 }
@@ -803,7 +1295,7 @@ setDecorationMatrices (CompWindow *w)
 
     for (i = 0; i < wd->nQuad; i++)
     {
-	wd->quad[i].matrix = wd->decor->texture->texture.matrix;
+	wd->quad[i].matrix = wd->decor->texture->matrix;
 
 	x0 = wd->decor->quad[i].m.x0;
 	y0 = wd->decor->quad[i].m.y0;
@@ -1288,13 +1780,14 @@ decorWindowUpdate (CompWindow *w,
 	return FALSE;
 
     damageWindowOutputExtents (w);
+    damageWindowThumbnail (w);
 
     if (old)
 	destroyWindowDecoration (w->screen, wd);
 
     if (decoration)
     {
-	dw->wd = createWindowDecoration (decoration);
+	dw->wd = createWindowDecoration (w, decoration);
 	if (!dw->wd)
 	    return FALSE;
 
@@ -1476,30 +1969,37 @@ decorHandleEvent (CompDisplay *d,
 	    XDamageNotifyEvent *de = (XDamageNotifyEvent *) event;
 	    DecorTexture       *t;
 
-	    for (t = dd->textures; t; t = t->next)
+	    for (t = dd->damages[DECOR_TEXTURE_HASH (de->damage)];
+		 t;
+		 t = t->damageNext)
 	    {
-		if (t->pixmap == de->drawable)
+		if (t->damage == de->damage)
 		{
-		    DecorWindow *dw;
-		    DecorScreen *ds;
-		    CompScreen  *s;
+		    WindowDecoration *wd;
 
 		    t->texture.oldMipmaps = TRUE;
 
-		    for (s = d->screens; s; s = s->next)
+		    /* copy into the atlas once the last rectangle of this
+		       round of damage has arrived */
+		    if (t->atlas)
 		    {
-			ds = GET_DECOR_SCREEN (s, dd);
+			decorAddTextureDamage (t, de->area.x, de->area.y,
+					       de->area.width,
+					       de->area.height);
 
-			for (w = s->windows; w; w = w->next)
-			{
-			    if (w->shaded || w->mapNum)
-			    {
-				dw = GET_DECOR_WINDOW (w, ds);
+			if (!de->more)
+			    decorUpdateAtlasTexture (t->atlas->screen, t);
+		    }
 
-				if (dw->wd && dw->wd->decor->texture == t)
-				    damageWindowOutputExtents (w);
-			    }
-			}
+		    for (wd = t->windows; wd; wd = wd->next)
+		    {
+			w = wd->window;
+
+			if (w->shaded || w->mapNum)
+			    damageWindowOutputExtents (w);
+
+			/* thumbnails include the decoration */
+			damageWindowThumbnail (w);
 		    }
 		    return;
 		}
@@ -2036,7 +2536,8 @@ static const CompMetadataOptionInfo decorDisplayOptionInfo[] = {
     { "command", "string", 0, 0, 0 },
     { "mipmap", "bool", 0, 0, 0 },
     { "decoration_match", "match", 0, 0, 0 },
-    { "shadow_match", "match", 0, 0, 0 }
+    { "shadow_match", "match", 0, 0, 0 },
+    { "texture_atlas", "bool", 0, 0, 0 }
 };
 
 static Bool
@@ -2044,6 +2545,7 @@ decorInitDisplay (CompPlugin  *p,
 		  CompDisplay *d)
 {
     DecorDisplay *dd;
+    int		 i;
 
     dd = malloc (sizeof (DecorDisplay));
     if (!dd)
@@ -2067,7 +2569,11 @@ decorInitDisplay (CompPlugin  *p,
 	return FALSE;
     }
 
-    dd->textures = 0;
+    for (i = 0; i < DECOR_TEXTURE_HASH_SIZE; i++)
+    {
+	dd->textures[i] = NULL;
+	dd->damages[i]  = NULL;
+    }
 
     dd->supportingDmCheckAtom =
 	XInternAtom (d->display, DECOR_SUPPORTING_DM_CHECK_ATOM_NAME, 0);
@@ -2132,6 +2638,8 @@ decorInitScreen (CompPlugin *p,
 	ds->decorNum[i] = 0;
     }
 
+    ds->atlases = NULL;
+
     ds->dmWin		     = None;
     ds->decoratorStartHandle = 0;
 
@@ -2169,6 +2677,14 @@ decorFiniScreen (CompPlugin *p,
 	    decorReleaseDecorations (s, ds->decors[i], &ds->decorNum[i]);
     }
 
+    while (ds->atlases)
+    {
+	DecorAtlas *atlas = ds->atlases;
+
+	ds->atlases = atlas->next;
+	decorDestroyAtlas (s, atlas);
+    }
+
     if (ds->decoratorStartHandle)
 	compRemoveTimeout (ds->decoratorStartHandle);
 
@@ -30,6 +30,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <compiz-core.h>
 
@@ -39,6 +42,8 @@
 #define HOME_OPTIONDIR     ".compiz/options"
 #define CORE_NAME           "general"
 #define FILE_SUFFIX         ".conf"
+#define FILE_HASH_SIZE      64
+#define SAVE_DELAY          250 /* ms to coalesce option changes */
 
 #define GET_INI_CORE(c) \
 	((IniCore *) (c)->base.privates[corePrivateIndex].ptr)
@@ -54,6 +59,25 @@ static CompMetadata iniMetadata;
 static Bool iniSaveOptions (CompObject  *object,
 			    const char  *plugin);
 
+/*
+ * IniOptionEntry: option name and value string as found in a file
+ */
+typedef struct _IniOptionEntry {
+    char *name;
+    char *value;
+} IniOptionEntry;
+
+/*
+ * IniFileStamp: identity of a file as last loaded or written by us
+ */
+typedef struct _IniFileStamp {
+    Bool	    valid;
+    dev_t	    dev;
+    ino_t	    ino;
+    off_t	    size;
+    struct timespec mtime;
+} IniFileStamp;
+
 /*
  * IniFileData
  */
@@ -64,24 +88,161 @@ struct _IniFileData {
     int			 screen;
 
     Bool		 blockWrites;
-    Bool		 blockReads;
+
+    /* serialized options waiting for the save timeout */
+    char		 *pendingData;
+    size_t		 pendingLength;
+
+    /* the file as last loaded or written, a change notification for
+       it is the echo of our own save and a file that doesn't match it
+       was changed by someone else; protected by the writer mutex */
+    IniFileStamp	 stamp;
+
+    /* bumped on every load, writes queued before it are outdated;
+       protected by the writer mutex */
+    unsigned int	 loadSerial;
+
+    /* values last applied from or written to the file, sorted by
+       name, so that a reload only sets options that changed */
+    IniOptionEntry	 *snapshot;
+    int			 nSnapshot;
 
     IniFileData		 *next;
-    IniFileData		 *prev;
 };
 
+/*
+ * IniWriteJob: file contents to be written by the writer thread
+ */
+typedef struct _IniWriteJob {
+    struct _IniWriteJob *next;
+
+    IniFileData  *fileData;
+    unsigned int loadSerial;
+    char	 *directory;
+    char	 *data;
+    size_t	 length;
+} IniWriteJob;
+
+/*
+ * IniWriter: background thread writing option files
+ */
+typedef struct _IniWriter {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    pthread_t	    thread;
+
+    IniWriteJob *jobs;
+    IniWriteJob *failed;
+    int		nActive;
+    Bool	quit;
+} IniWriter;
+
 /*
  * IniCore
  */
 typedef struct _IniCore {
     CompFileWatchHandle	directoryWatch;
 
-    IniFileData	*fileData;
+    IniFileData	*fileData[FILE_HASH_SIZE];
+
+    IniWriter	      writer;
+    CompTimeoutHandle saveHandle;
 
     InitPluginForObjectProc initPluginForObject;
     SetOptionForPluginProc  setOptionForPlugin;
 } IniCore;
 
+static unsigned int
+iniHashFilename (const char *filename)
+{
+    unsigned int hash = 5381;
+
+    while (*filename)
+	hash = hash * 33 + (unsigned char) *filename++;
+
+    return hash % FILE_HASH_SIZE;
+}
+
+static void
+iniFreeSnapshot (IniOptionEntry *snapshot,
+		 int		nSnapshot)
+{
+    int i;
+
+    for (i = 0; i < nSnapshot; i++)
+    {
+	free (snapshot[i].name);
+	free (snapshot[i].value);
+    }
+
+    if (snapshot)
+	free (snapshot);
+}
+
+static void
+iniSetSnapshot (IniFileData    *fd,
+		IniOptionEntry *snapshot,
+		int	       nSnapshot)
+{
+    iniFreeSnapshot (fd->snapshot, fd->nSnapshot);
+
+    fd->snapshot  = snapshot;
+    fd->nSnapshot = nSnapshot;
+}
+
+static int
+iniCompareOptionEntries (const void *e1,
+			 const void *e2)
+{
+    const IniOptionEntry *o1 = e1;
+    const IniOptionEntry *o2 = e2;
+
+    return strcmp (o1->name, o2->name);
+}
+
+static const char *
+iniFindSnapshotValue (IniFileData *fd,
+		      const char  *name)
+{
+    IniOptionEntry key, *entry;
+
+    if (!fd->nSnapshot)
+	return NULL;
+
+    key.name = (char *) name;
+
+    entry = bsearch (&key, fd->snapshot, fd->nSnapshot,
+		     sizeof (IniOptionEntry), iniCompareOptionEntries);
+
+    return entry ? entry->value : NULL;
+}
+
+/* takes ownership of name and value */
+static Bool
+iniAddOptionEntry (IniOptionEntry **entries,
+		   int		  *nEntry,
+		   char		  *name,
+		   char		  *value)
+{
+    IniOptionEntry *e;
+
+    e = realloc (*entries, sizeof (IniOptionEntry) * (*nEntry + 1));
+    if (!e)
+    {
+	free (name);
+	free (value);
+	return FALSE;
+    }
+
+    e[*nEntry].name  = name;
+    e[*nEntry].value = value;
+
+    *entries = e;
+    (*nEntry)++;
+
+    return TRUE;
+}
+
 static IniFileData *
 iniGetFileDataFromFilename (const char *filename)
 {
@@ -89,6 +250,7 @@ iniGetFileDataFromFilename (const char *filename)
     int pluginSep = 0, screenSep = 0;
     char *pluginStr, *screenStr;
     IniFileData *fd;
+    unsigned int hash;
 
     INI_CORE (&core);
 
@@ -103,7 +265,9 @@ iniGetFileDataFromFilename (const char *filename)
     if ((filename[0]=='.') || (filename[len-1]=='~'))
 	return NULL;
 
-    for (fd = ic->fileData; fd; fd = fd->next)
+    hash = iniHashFilename (filename);
+
+    for (fd = ic->fileData[hash]; fd; fd = fd->next)
 	if (strcmp (fd->filename, filename) == 0)
 	    return fd;
 
@@ -128,23 +292,6 @@ iniGetFileDataFromFilename (const char *filename)
     if (!pluginSep || !screenSep)
 	return NULL;
 
-    /* If we get here then there is no fd in the display variable */
-    IniFileData *newFd = malloc (sizeof (IniFileData));
-    if (!newFd)
-	return NULL;
-
-    /* fd is NULL here, see condition "fd" in first for-loop */
-    /* if (fd)
-	fd->next = newFd;
-    else
-    */
-	ic->fileData = newFd;
-
-    newFd->prev = fd;
-    newFd->next = NULL;
-
-    newFd->filename = strdup (filename);
-
     pluginStr = calloc (1, sizeof (char) * pluginSep + 2);
     if (!pluginStr)
 	return NULL;
@@ -155,6 +302,29 @@ iniGetFileDataFromFilename (const char *filename)
 	return NULL;
     }
 
+    /* If we get here then there is no fd for this file yet */
+    IniFileData *newFd = malloc (sizeof (IniFileData));
+    if (!newFd)
+    {
+	free (pluginStr);
+	free (screenStr);
+	return NULL;
+    }
+
+    newFd->filename = strdup (filename);
+
+    newFd->snapshot  = NULL;
+    newFd->nSnapshot = 0;
+
+    newFd->pendingData   = NULL;
+    newFd->pendingLength = 0;
+
+    newFd->stamp.valid = FALSE;
+    newFd->loadSerial  = 0;
+
+    newFd->next = ic->fileData[hash];
+    ic->fileData[hash] = newFd;
+
     strncpy (pluginStr, filename, pluginSep + 1);
     strncpy (screenStr, &filename[pluginSep+2], (screenSep - pluginSep) - 1);
 
@@ -168,7 +338,6 @@ iniGetFileDataFromFilename (const char *filename)
     else
 	newFd->screen = atoi (&screenStr[6]);
 
-    newFd->blockReads  = FALSE;
     newFd->blockWrites = FALSE;
 
     free (pluginStr);
@@ -446,18 +615,22 @@ iniMakeDirectories (void)
 }
 
 static Bool
-iniLoadOptionsFromFile (FILE       *optionFile,
-			CompObject *object,
-			const char *plugin,
-			Bool       *reSave)
+iniLoadOptionsFromFile (FILE        *optionFile,
+			CompObject  *object,
+			const char  *plugin,
+			IniFileData *fileData,
+			Bool        *reSave)
 {
     CompOption      *option = NULL, *o;
     CompPlugin      *p = NULL;
     CompOptionValue value;
     char            *optionName = NULL, *optionValue = NULL;
     char            tmp[MAX_OPTION_LENGTH];
+    const char      *applied;
     int             nOption, nOptionRead = 0;
     Bool            status = FALSE, hasValue = FALSE;
+    IniOptionEntry  *snapshot = NULL;
+    int             nSnapshot = 0;
 
     if (plugin)
     {
@@ -492,7 +665,18 @@ iniLoadOptionsFromFile (FILE       *optionFile,
 	if (option)
 	{
 	    o = compFindOption (option, nOption, optionName, 0);
-	    if (o)
+	    applied = iniFindSnapshotValue (fileData, optionName);
+
+	    /* unchanged since it was last applied */
+	    if (o && applied && strcmp (applied, optionValue) == 0)
+	    {
+		iniAddOptionEntry (&snapshot, &nSnapshot,
+				   optionName, optionValue);
+		optionName = optionValue = NULL;
+
+		nOptionRead++;
+	    }
+	    else if (o)
 	    {
 		value = o->value;
 
@@ -563,6 +747,13 @@ iniLoadOptionsFromFile (FILE       *optionFile,
 		    {
 			matchFini (&value.match);
 		    }
+
+		    if (status)
+		    {
+			iniAddOptionEntry (&snapshot, &nSnapshot,
+					   optionName, optionValue);
+			optionName = optionValue = NULL;
+		    }
 		}
 
 		nOptionRead++;
@@ -574,8 +765,14 @@ iniLoadOptionsFromFile (FILE       *optionFile,
 	    free (optionName);
 	if (optionValue)
 	    free (optionValue);
+
+	optionName = optionValue = NULL;
     }
 
+    qsort (snapshot, nSnapshot, sizeof (IniOptionEntry),
+	   iniCompareOptionEntries);
+    iniSetSnapshot (fileData, snapshot, nSnapshot);
+
     if (nOption != nOptionRead)
     {
 	*reSave = TRUE;
@@ -584,13 +781,446 @@ iniLoadOptionsFromFile (FILE       *optionFile,
     return TRUE;
 }
 
+static void
+iniFreeWriteJob (IniWriteJob *job)
+{
+    free (job->directory);
+    free (job->data);
+    free (job);
+}
+
+static void
+iniSetFileStamp (IniFileStamp *stamp,
+		 struct stat  *st)
+{
+    stamp->valid = TRUE;
+    stamp->dev   = st->st_dev;
+    stamp->ino   = st->st_ino;
+    stamp->size  = st->st_size;
+    stamp->mtime = st->st_mtim;
+}
+
+static Bool
+iniFileStampMatches (IniFileStamp *stamp,
+		     struct stat  *st)
+{
+    return stamp->valid			&&
+	stamp->dev   == st->st_dev	&&
+	stamp->ino   == st->st_ino	&&
+	stamp->size  == st->st_size	&&
+	stamp->mtime.tv_sec  == st->st_mtim.tv_sec &&
+	stamp->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/* Writes the job to a temporary file next to the option file at path,
+   the option file is then replaced by renaming it. The temporary file
+   gets the mode of the option file, mkstemp creates it as 0600. */
+static Bool
+iniWriteTempFile (IniWriteJob  *job,
+		  const char   *path,
+		  char	       **tmpPath,
+		  IniFileStamp *stamp)
+{
+    struct stat st;
+    mode_t	mode = 0644;
+    size_t	done = 0;
+    ssize_t	n;
+    int		fd;
+
+    if (!stat (path, &st))
+	mode = st.st_mode & 07777;
+
+    if (asprintf (tmpPath, "%s/.%s.XXXXXX",
+		  job->directory, job->fileData->filename) < 0)
+	return FALSE;
+
+    fd = mkstemp (*tmpPath);
+    if (fd < 0 && errno == ENOENT && mkdir (job->directory, 0700) == 0)
+	fd = mkstemp (*tmpPath);
+
+    if (fd < 0)
+    {
+	free (*tmpPath);
+	return FALSE;
+    }
+
+    if (fchmod (fd, mode))
+    {
+	close (fd);
+	unlink (*tmpPath);
+	free (*tmpPath);
+	return FALSE;
+    }
+
+    while (done < job->length)
+    {
+	n = write (fd, job->data + done, job->length - done);
+	if (n < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+
+	    break;
+	}
+
+	done += n;
+    }
+
+    if (done < job->length || fsync (fd) || fstat (fd, &st))
+    {
+	close (fd);
+	unlink (*tmpPath);
+	free (*tmpPath);
+	return FALSE;
+    }
+
+    close (fd);
+
+    iniSetFileStamp (stamp, &st);
+
+    return TRUE;
+}
+
+static void *
+iniWriterThread (void *closure)
+{
+    IniWriter	 *w = (IniWriter *) closure;
+    IniWriteJob	 *job;
+    IniFileData	 *fd;
+    IniFileStamp stamp, prevStamp;
+    struct stat	 st;
+    char	 *tmpPath, *path;
+    Bool	 status, exists;
+
+    pthread_mutex_lock (&w->mutex);
+
+    for (;;)
+    {
+	while (!w->jobs && !w->quit)
+	    pthread_cond_wait (&w->cond, &w->mutex);
+
+	/* pending jobs are written before quitting */
+	job = w->jobs;
+	if (!job)
+	    break;
+
+	w->jobs = job->next;
+	fd	= job->fileData;
+
+	pthread_mutex_unlock (&w->mutex);
+
+	if (asprintf (&path, "%s/%s", job->directory, fd->filename) < 0)
+	    path = NULL;
+
+	status = path && iniWriteTempFile (job, path, &tmpPath, &stamp);
+	exists = status && !stat (path, &st);
+
+	pthread_mutex_lock (&w->mutex);
+
+	if (status)
+	{
+	    /* a file that changed on disk since it was last loaded or
+	       written, or a reload since the job was queued, means the
+	       job is outdated; the file is loaded on the change
+	       notification instead of being overwritten */
+	    if (job->loadSerial != fd->loadSerial ||
+		(exists && !iniFileStampMatches (&fd->stamp, &st)))
+	    {
+		unlink (tmpPath);
+	    }
+	    else
+	    {
+		/* the stamp must be in place before the rename is seen */
+		prevStamp = fd->stamp;
+		fd->stamp = stamp;
+
+		pthread_mutex_unlock (&w->mutex);
+
+		status = !rename (tmpPath, path);
+		if (!status)
+		    unlink (tmpPath);
+
+		pthread_mutex_lock (&w->mutex);
+
+		if (!status)
+		    fd->stamp = prevStamp;
+	    }
+
+	    free (tmpPath);
+	}
+
+	if (path)
+	    free (path);
+
+	if (status)
+	{
+	    iniFreeWriteJob (job);
+	}
+	else
+	{
+	    job->next = w->failed;
+	    w->failed = job;
+	}
+
+	w->nActive--;
+
+	pthread_cond_broadcast (&w->cond);
+    }
+
+    pthread_mutex_unlock (&w->mutex);
+
+    return NULL;
+}
+
+static Bool
+iniInitWriter (IniWriter *w)
+{
+    w->jobs    = NULL;
+    w->failed  = NULL;
+    w->nActive = 0;
+    w->quit    = FALSE;
+
+    pthread_mutex_init (&w->mutex, NULL);
+    pthread_cond_init (&w->cond, NULL);
+
+    if (pthread_create (&w->thread, NULL, iniWriterThread, w))
+    {
+	pthread_cond_destroy (&w->cond);
+	pthread_mutex_destroy (&w->mutex);
+
+	return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+iniReportWriteFailures (IniWriter *w)
+{
+    IniWriteJob *job, *next;
+
+    pthread_mutex_lock (&w->mutex);
+    job = w->failed;
+    w->failed = NULL;
+    pthread_mutex_unlock (&w->mutex);
+
+    for (; job; job = next)
+    {
+	next = job->next;
+
+	compLogMessage ("ini", CompLogLevelError,
+			"Failed to write to %s/%s, check you " \
+			"have the correct permissions",
+			job->directory, job->fileData->filename);
+
+	iniFreeWriteJob (job);
+    }
+}
+
+static void
+iniFiniWriter (IniWriter *w)
+{
+    pthread_mutex_lock (&w->mutex);
+    w->quit = TRUE;
+    pthread_cond_broadcast (&w->cond);
+    pthread_mutex_unlock (&w->mutex);
+
+    pthread_join (w->thread, NULL);
+
+    iniReportWriteFailures (w);
+
+    pthread_cond_destroy (&w->cond);
+    pthread_mutex_destroy (&w->mutex);
+}
+
+/* Hands the file contents over to the writer thread, a write of the
+   same file that didn't start yet is replaced. Takes ownership of
+   data. */
+static Bool
+iniQueueWrite (IniFileData *fileData,
+	       char	   *data,
+	       size_t	   length)
+{
+    IniWriteJob	**job;
+    char	*directory;
+
+    INI_CORE (&core);
+
+    if (!iniGetHomeDir (&directory))
+    {
+	free (data);
+	return FALSE;
+    }
+
+    pthread_mutex_lock (&ic->writer.mutex);
+
+    for (job = &ic->writer.jobs; *job; job = &(*job)->next)
+    {
+	if ((*job)->fileData == fileData)
+	{
+	    free ((*job)->data);
+
+	    (*job)->loadSerial = fileData->loadSerial;
+	    (*job)->data       = data;
+	    (*job)->length     = length;
+
+	    pthread_mutex_unlock (&ic->writer.mutex);
+
+	    free (directory);
+
+	    return TRUE;
+	}
+    }
+
+    *job = malloc (sizeof (IniWriteJob));
+    if (!*job)
+    {
+	pthread_mutex_unlock (&ic->writer.mutex);
+
+	free (directory);
+	free (data);
+
+	return FALSE;
+    }
+
+    (*job)->next       = NULL;
+    (*job)->fileData   = fileData;
+    (*job)->loadSerial = fileData->loadSerial;
+    (*job)->directory  = directory;
+    (*job)->data       = data;
+    (*job)->length     = length;
+
+    ic->writer.nActive++;
+
+    pthread_cond_broadcast (&ic->writer.cond);
+    pthread_mutex_unlock (&ic->writer.mutex);
+
+    return TRUE;
+}
+
+static void
+iniQueuePendingSaves (void)
+{
+    IniFileData *fd;
+    int		i;
+
+    INI_CORE (&core);
+
+    for (i = 0; i < FILE_HASH_SIZE; i++)
+    {
+	for (fd = ic->fileData[i]; fd; fd = fd->next)
+	{
+	    if (!fd->pendingData)
+		continue;
+
+	    iniQueueWrite (fd, fd->pendingData, fd->pendingLength);
+
+	    fd->pendingData   = NULL;
+	    fd->pendingLength = 0;
+	}
+    }
+}
+
+static Bool
+iniSaveTimeout (void *closure)
+{
+    Bool active;
+
+    INI_CORE (&core);
+
+    iniQueuePendingSaves ();
+    iniReportWriteFailures (&ic->writer);
+
+    pthread_mutex_lock (&ic->writer.mutex);
+    active = ic->writer.nActive > 0 || ic->writer.failed;
+    pthread_mutex_unlock (&ic->writer.mutex);
+
+    /* keep running until the writes finished to report failures */
+    if (!active)
+	ic->saveHandle = 0;
+
+    return active;
+}
+
+/* Writes all pending saves and waits for them to finish */
+static void
+iniSyncSaves (void)
+{
+    INI_CORE (&core);
+
+    iniQueuePendingSaves ();
+
+    pthread_mutex_lock (&ic->writer.mutex);
+    while (ic->writer.nActive)
+	pthread_cond_wait (&ic->writer.cond, &ic->writer.mutex);
+    pthread_mutex_unlock (&ic->writer.mutex);
+
+    iniReportWriteFailures (&ic->writer);
+}
+
+/* Returns TRUE if the file at path is the one last loaded or written
+   by us */
+static Bool
+iniIsKnownFile (IniFileData *fileData,
+		const char  *path)
+{
+    struct stat st;
+    Bool	status;
+
+    INI_CORE (&core);
+
+    if (stat (path, &st))
+	return FALSE;
+
+    pthread_mutex_lock (&ic->writer.mutex);
+    status = iniFileStampMatches (&fileData->stamp, &st);
+    pthread_mutex_unlock (&ic->writer.mutex);
+
+    return status;
+}
+
+static void
+iniWriteOption (FILE	       *optionFile,
+		IniOptionEntry **snapshot,
+		int	       *nSnapshot,
+		const char     *name,
+		const char     *value)
+{
+    char *n, *v;
+
+    fprintf (optionFile, "%s=%s\n", name, value);
+
+    n = strdup (name);
+    v = strdup (value);
+
+    if (n && v)
+    {
+	iniAddOptionEntry (snapshot, nSnapshot, n, v);
+    }
+    else
+    {
+	if (n)
+	    free (n);
+	if (v)
+	    free (v);
+    }
+}
+
+/* Serializes the options of plugin for object. The file is written
+   by the writer thread once no further changes arrived for SAVE_DELAY
+   ms, use iniSyncSaves to write it immediately. */
 static Bool
 iniSaveOptions (CompObject *object,
 		const char *plugin)
 {
-    CompOption *option = NULL;
-    int	       nOption = 0;
-    char       *filename, *directory, *fullPath, *strVal = NULL;
+    CompOption     *option = NULL;
+    int		   nOption = 0;
+    char	   *filename, *strVal = NULL, *data = NULL;
+    size_t	   length = 0;
+    IniOptionEntry *snapshot = NULL;
+    int		   nSnapshot = 0;
+
+    INI_CORE (&core);
 
     if (plugin)
     {
@@ -621,36 +1251,12 @@ iniSaveOptions (CompObject *object,
 	return FALSE;
     }
 
-    if (!iniGetHomeDir (&directory))
-	return FALSE;
-
-    fullPath = malloc (sizeof (char) * (strlen (filename) + strlen (directory) + 2));
-    if (!fullPath)
-    {
-	free (filename);
-	free (directory);
-	return FALSE;
-    }
-
-    sprintf (fullPath, "%s/%s", directory, filename);
-
-    FILE *optionFile = fopen (fullPath, "w");
+    free (filename);
 
-    if (!optionFile && iniMakeDirectories ())
-	optionFile = fopen (fullPath, "w");
+    FILE *optionFile = open_memstream (&data, &length);
 
     if (!optionFile)
-    {
-	compLogMessage ("ini", CompLogLevelError,
-			"Failed to write to %s, check you " \
-			"have the correct permissions", fullPath);
-	free (filename);
-	free (directory);
-	free (fullPath);
 	return FALSE;
-    }
-
-    fileData->blockReads = TRUE;
 
     Bool firstInList;
     while (nOption--)
@@ -673,11 +1279,13 @@ iniSaveOptions (CompObject *object,
 					     &option->value, option->type);
 		if (strVal)
 		{
-		    fprintf (optionFile, "%s=%s\n", option->name, strVal);
+		    iniWriteOption (optionFile, &snapshot, &nSnapshot,
+				    option->name, strVal);
 		    free (strVal);
 		}
 		else
-		    fprintf (optionFile, "%s=\n", option->name);
+		    iniWriteOption (optionFile, &snapshot, &nSnapshot,
+				    option->name, "");
 		break;
 	case CompOptionTypeList:
 	    firstInList = TRUE;
@@ -696,7 +1304,8 @@ iniSaveOptions (CompObject *object,
 		strVal = malloc (sizeof(char) * stringLen);
 		if (!strVal) {
 		    fclose(optionFile);
-		    free(fullPath);
+		    free(data);
+		    iniFreeSnapshot (snapshot, nSnapshot);
 		    return FALSE;
 		}
 		strcpy (strVal, "");
@@ -719,7 +1328,8 @@ iniSaveOptions (CompObject *object,
 		    }
 		}
 
-		fprintf (optionFile, "%s=%s\n", option->name, strVal);
+		iniWriteOption (optionFile, &snapshot, &nSnapshot,
+				option->name, strVal);
 		free (strVal);
 		break;
 	    }
@@ -738,25 +1348,50 @@ iniSaveOptions (CompObject *object,
 	option++;
     }
 
-    fileData->blockReads = FALSE;
+    if (fclose (optionFile))
+    {
+	free (data);
+	iniFreeSnapshot (snapshot, nSnapshot);
+	return FALSE;
+    }
 
-    fclose (optionFile);
+    if (fileData->pendingData)
+	free (fileData->pendingData);
 
-    free (filename);
-    free (directory);
-    free (fullPath);
+    fileData->pendingData   = data;
+    fileData->pendingLength = length;
+
+    /* restart the delay on every change */
+    if (ic->saveHandle)
+	compRemoveTimeout (ic->saveHandle);
+
+    ic->saveHandle = compAddTimeout (SAVE_DELAY, SAVE_DELAY * 2,
+				     iniSaveTimeout, NULL);
+
+    /* what was just serialized is what is applied, reading it back
+       doesn't need to set any option */
+    qsort (snapshot, nSnapshot, sizeof (IniOptionEntry),
+	   iniCompareOptionEntries);
+    iniSetSnapshot (fileData, snapshot, nSnapshot);
 
     return TRUE;
 }
 
+/* Loads the option file of plugin for object. A reload only sets the
+   options whose values differ from the ones last applied, otherwise
+   all options of the file are set. */
 static Bool
 iniLoadOptions (CompObject *object,
-		const char *plugin)
+		const char *plugin,
+		Bool	   reload)
 {
     char         *filename, *directory, *fullPath;
     FILE         *optionFile;
     Bool         loadRes, reSave = FALSE;
     IniFileData *fileData;
+    struct stat  st;
+
+    INI_CORE (&core);
 
     filename = directory = fullPath = NULL;
     optionFile = NULL;
@@ -766,12 +1401,16 @@ iniLoadOptions (CompObject *object,
 	return FALSE;
 
     fileData = iniGetFileDataFromFilename (filename);
-    if (!fileData || (fileData && fileData->blockReads))
+    if (!fileData)
     {
 	free(filename);
 	return FALSE;
     }
 
+    /* option values of newly initialized objects are the defaults */
+    if (!reload)
+	iniSetSnapshot (fileData, NULL, 0);
+
     if (!iniGetHomeDir (&directory))
     {
 	free (filename);
@@ -834,6 +1473,7 @@ iniLoadOptions (CompObject *object,
 	    fileData->blockWrites = FALSE;
 
 	    iniSaveOptions (object, plugin);
+	    iniSyncSaves ();
 
 	    fileData->blockWrites = TRUE;
 
@@ -857,6 +1497,7 @@ iniLoadOptions (CompObject *object,
 	    fileData->blockWrites = FALSE;
 
 	    iniSaveOptions (object, plugin);
+	    iniSyncSaves ();
 
 	    fileData->blockWrites = TRUE;
 
@@ -873,18 +1514,34 @@ iniLoadOptions (CompObject *object,
 
     fileData->blockWrites = TRUE;
 
-    loadRes = iniLoadOptionsFromFile (optionFile, object, plugin, &reSave);
+    /* options now match the file, pending and queued saves are
+       outdated */
+    if (fileData->pendingData)
+    {
+	free (fileData->pendingData);
+	fileData->pendingData = NULL;
+    }
+
+    pthread_mutex_lock (&ic->writer.mutex);
+
+    fileData->loadSerial++;
+
+    if (!fstat (fileno (optionFile), &st))
+	iniSetFileStamp (&fileData->stamp, &st);
+    else
+	fileData->stamp.valid = FALSE;
+
+    pthread_mutex_unlock (&ic->writer.mutex);
+
+    loadRes = iniLoadOptionsFromFile (optionFile, object, plugin,
+				      fileData, &reSave);
 
     fileData->blockWrites = FALSE;
 
     fclose (optionFile);
 
     if (loadRes && reSave)
-    {
-	fileData->blockReads = TRUE;
 	iniSaveOptions (object, plugin);
-	fileData->blockReads = FALSE;
-    }
 
     free (filename);
     free (directory);
@@ -900,13 +1557,34 @@ iniFileModified (const char *name,
 		 void       *closure)
 {
     IniFileData *fd;
+    char	*directory, *path;
+    Bool	known = FALSE;
 
     fd = iniGetFileDataFromFilename (name);
-    if (fd && core.displays)
+    if (!fd)
+	return;
+
+    if (iniGetHomeDir (&directory))
+    {
+	if (asprintf (&path, "%s/%s", directory, name) >= 0)
+	{
+	    known = iniIsKnownFile (fd, path);
+	    free (path);
+	}
+
+	free (directory);
+    }
+
+    /* notification caused by our own save, or for what was already
+       loaded */
+    if (known)
+	return;
+
+    if (core.displays)
     {
 	if (fd->screen < 0)
 	{
-	    iniLoadOptions (&core.displays->base, fd->plugin);
+	    iniLoadOptions (&core.displays->base, fd->plugin, TRUE);
 	}
 	else
 	{
@@ -917,7 +1595,7 @@ iniFileModified (const char *name,
 		    break;
 
 	    if (s)
-		iniLoadOptions (&s->base, fd->plugin);
+		iniLoadOptions (&s->base, fd->plugin, TRUE);
 	}
     }
 }
@@ -926,16 +1604,27 @@ static void
 iniFreeFileData (void)
 {
     IniFileData *fd, *tmp;
+    int		i;
 
     INI_CORE (&core);
 
-    fd = ic->fileData;
-
-    while (fd)
+    for (i = 0; i < FILE_HASH_SIZE; i++)
     {
-        tmp = fd;
-        fd = fd->next;
-        free (tmp);
+	fd = ic->fileData[i];
+
+	while (fd)
+	{
+	    tmp = fd;
+	    fd = fd->next;
+
+	    iniFreeSnapshot (tmp->snapshot, tmp->nSnapshot);
+	    if (tmp->pendingData)
+		free (tmp->pendingData);
+	    free (tmp->filename);
+	    if (tmp->plugin)
+		free (tmp->plugin);
+	    free (tmp);
+	}
     }
 }
 
@@ -947,7 +1636,7 @@ static Bool
 iniInitPluginForDisplay (CompPlugin  *p,
 			 CompDisplay *d)
 {
-    iniLoadOptions (&d->base, p->vTable->name);
+    iniLoadOptions (&d->base, p->vTable->name, FALSE);
 
     return TRUE;
 }
@@ -956,7 +1645,7 @@ static Bool
 iniInitPluginForScreen (CompPlugin *p,
 			CompScreen *s)
 {
-    iniLoadOptions (&s->base, p->vTable->name);
+    iniLoadOptions (&s->base, p->vTable->name, FALSE);
 
     return TRUE;
 }
@@ -1027,14 +1716,22 @@ iniInitCore (CompPlugin *p,
     if (!ic)
 	return FALSE;
 
-    ic->fileData = NULL;
+    memset (ic->fileData, 0, sizeof (ic->fileData));
     ic->directoryWatch = 0;
+    ic->saveHandle     = 0;
+
+    if (!iniInitWriter (&ic->writer))
+    {
+	free (ic);
+	return FALSE;
+    }
 
     if (iniGetHomeDir (&homeDir))
     {
 	ic->directoryWatch = addFileWatch (homeDir,
 					   NOTIFY_DELETE_MASK |
 					   NOTIFY_CREATE_MASK |
+					   NOTIFY_MOVE_MASK   |
 					   NOTIFY_MODIFY_MASK,
 					   iniFileModified, 0);
 	free (homeDir);
@@ -1060,6 +1757,12 @@ iniFiniCore (CompPlugin *p,
     if (ic->directoryWatch)
 	removeFileWatch (ic->directoryWatch);
 
+    if (ic->saveHandle)
+	compRemoveTimeout (ic->saveHandle);
+
+    iniSyncSaves ();
+    iniFiniWriter (&ic->writer);
+
     iniFreeFileData ();
 
     free (ic);
@@ -1068,7 +1771,7 @@ iniFiniCore (CompPlugin *p,
 static Bool
 iniInitDisplay (CompPlugin *p, CompDisplay *d)
 {
-    iniLoadOptions (&d->base, NULL);
+    iniLoadOptions (&d->base, NULL, FALSE);
 
     return TRUE;
 }
@@ -1076,7 +1779,7 @@ iniInitDisplay (CompPlugin *p, CompDisplay *d)
 static Bool
 iniInitScreen (CompPlugin *p, CompScreen *s)
 {
-    iniLoadOptions (&s->base, NULL);
+    iniLoadOptions (&s->base, NULL, FALSE);
 
     return TRUE;
 }
@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2026 compiz contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * Places windows one after the other the way the smart placement mode
+ * of the place plugin does, once looking at every window for each
+ * candidate position and once through the spatial index of
+ * place_index.c, and compares the results and the time taken.
+ *
+ *   make -C plugins bench && plugins/place-bench [windows] [runs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xregion.h>
+
+#include "place_index.h"
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#define SCREEN_WIDTH  3840
+#define SCREEN_HEIGHT 2160
+
+#define NONE    0
+#define H_WRONG -1
+#define W_WRONG -2
+
+typedef struct _BenchWindow {
+    int		    x1, y1, x2, y2;
+    PlaceIndexEntry entry;
+} BenchWindow;
+
+typedef struct _Bench {
+    BenchWindow *windows;
+    int		nWindow;
+    PlaceIndex  index;
+    Bool	useIndex;
+} Bench;
+
+/* windows intersecting x1,y1 - x2,y2, either from the index or from a
+   walk over all windows */
+static int
+benchQuery (Bench	*b,
+	    BenchWindow **result,
+	    int		x1,
+	    int		y1,
+	    int		x2,
+	    int		y2)
+{
+    int i, n = 0;
+
+    if (b->useIndex)
+    {
+	n = placeIndexQuery (&b->index, x1, y1, x2, y2);
+	for (i = 0; i < n; i++)
+	    result[i] = b->index.result[i]->closure;
+
+	return n;
+    }
+
+    for (i = 0; i < b->nWindow; i++)
+    {
+	BenchWindow *w = &b->windows[i];
+
+	if (x1 < w->x2 && x2 > w->x1 && y1 < w->y2 && y2 > w->y1)
+	    result[n++] = w;
+    }
+
+    return n;
+}
+
+/* same loop as placeSmart in place.c */
+static void
+benchPlaceSmart (Bench	     *b,
+		 BenchWindow **result,
+		 int	     cw,
+		 int	     ch,
+		 int	     *x,
+		 int	     *y)
+{
+    int overlap = 0, minOverlap = 0;
+    int xOptimal = 0, yOptimal = 0;
+    int xTmp = 0, yTmp = 0;
+    int possible, basket;
+    int xl, xr, yt, yb;
+    int i, n;
+    Bool firstPass = TRUE;
+
+    do
+    {
+	if (yTmp + ch > SCREEN_HEIGHT && ch < SCREEN_HEIGHT)
+	    overlap = H_WRONG;
+	else if (xTmp + cw > SCREEN_WIDTH)
+	    overlap = W_WRONG;
+	else
+	{
+	    overlap = NONE;
+
+	    n = benchQuery (b, result, xTmp, yTmp, xTmp + cw, yTmp + ch);
+	    for (i = 0; i < n; i++)
+	    {
+		xl = MAX (xTmp, result[i]->x1);
+		yt = MAX (yTmp, result[i]->y1);
+		xr = MIN (xTmp + cw, result[i]->x2);
+		yb = MIN (yTmp + ch, result[i]->y2);
+
+		overlap += (xr - xl) * (yb - yt);
+	    }
+	}
+
+	if (overlap == NONE)
+	{
+	    xOptimal = xTmp;
+	    yOptimal = yTmp;
+	    break;
+	}
+
+	if (firstPass)
+	{
+	    firstPass  = FALSE;
+	    minOverlap = overlap;
+	}
+	else if (overlap >= NONE && overlap < minOverlap)
+	{
+	    minOverlap = overlap;
+	    xOptimal = xTmp;
+	    yOptimal = yTmp;
+	}
+
+	if (overlap > NONE)
+	{
+	    possible = SCREEN_WIDTH;
+	    if (possible - cw > xTmp)
+		possible -= cw;
+
+	    n = benchQuery (b, result, MINSHORT, yTmp, MAXSHORT, ch + yTmp);
+	    for (i = 0; i < n; i++)
+	    {
+		if (result[i]->x2 > xTmp && possible > result[i]->x2)
+		    possible = result[i]->x2;
+
+		basket = result[i]->x1 - cw;
+		if (basket > xTmp && possible > basket)
+		    possible = basket;
+	    }
+	    xTmp = possible;
+	}
+	else if (overlap == W_WRONG)
+	{
+	    xTmp     = 0;
+	    possible = SCREEN_HEIGHT;
+	    if (possible - ch > yTmp)
+		possible -= ch;
+
+	    n = benchQuery (b, result, MINSHORT, yTmp, MAXSHORT, MAXSHORT);
+	    for (i = 0; i < n; i++)
+	    {
+		if (result[i]->y2 > yTmp && possible > result[i]->y2)
+		    possible = result[i]->y2;
+
+		basket = result[i]->y1 - ch;
+		if (basket > yTmp && possible > basket)
+		    possible = basket;
+	    }
+	    yTmp = possible;
+	}
+    }
+    while (overlap != NONE && overlap != H_WRONG && yTmp < SCREEN_HEIGHT);
+
+    *x = xOptimal;
+    *y = yOptimal;
+}
+
+static double
+benchTime (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* places nWindow windows of random sizes, each window is added before
+   the next one is placed, returns the time taken in microseconds */
+static double
+benchRun (Bench	      *b,
+	  BenchWindow **result,
+	  int	      *positions,
+	  int	      nWindow)
+{
+    double start;
+    int    i, x, y, w, h;
+
+    srand (1);
+
+    placeIndexInit (&b->index, SCREEN_WIDTH, SCREEN_HEIGHT);
+    b->nWindow = 0;
+
+    start = benchTime ();
+
+    for (i = 0; i < nWindow; i++)
+    {
+	BenchWindow *bw = &b->windows[i];
+
+	w = 80 + rand () % 120;
+	h = 60 + rand () % 90;
+
+	benchPlaceSmart (b, result, w, h, &x, &y);
+
+	bw->x1 = x;
+	bw->y1 = y;
+	bw->x2 = x + w;
+	bw->y2 = y + h;
+
+	memset (&bw->entry, 0, sizeof (PlaceIndexEntry));
+	bw->entry.closure = bw;
+
+	if (b->useIndex &&
+	    !placeIndexUpdate (&b->index, &bw->entry,
+			       bw->x1, bw->y1, bw->x2, bw->y2))
+	{
+	    fprintf (stderr, "place-bench: out of memory\n");
+	    exit (1);
+	}
+
+	b->nWindow++;
+
+	positions[i * 2]     = x;
+	positions[i * 2 + 1] = y;
+    }
+
+    start = benchTime () - start;
+
+    placeIndexFini (&b->index);
+
+    return start;
+}
+
+int
+main (int  argc,
+      char **argv)
+{
+    Bench	b;
+    BenchWindow **result;
+    int		*scanPositions, *indexPositions;
+    double	scanTime = 0.0, indexTime = 0.0;
+    int		nWindow = 200, runs = 5, i;
+
+    if (argc > 1)
+	nWindow = MAX (1, atoi (argv[1]));
+
+    if (argc > 2)
+	runs = MAX (1, atoi (argv[2]));
+
+    b.windows      = calloc (nWindow, sizeof (BenchWindow));
+    result	   = calloc (nWindow, sizeof (BenchWindow *));
+    scanPositions  = calloc (nWindow * 2, sizeof (int));
+    indexPositions = calloc (nWindow * 2, sizeof (int));
+
+    if (!b.windows || !result || !scanPositions || !indexPositions)
+    {
+	fprintf (stderr, "place-bench: out of memory\n");
+	return 1;
+    }
+
+    for (i = 0; i < runs; i++)
+    {
+	b.useIndex = FALSE;
+	scanTime  += benchRun (&b, result, scanPositions, nWindow);
+
+	b.useIndex = TRUE;
+	indexTime += benchRun (&b, result, indexPositions, nWindow);
+
+	if (memcmp (scanPositions, indexPositions,
+		    nWindow * 2 * sizeof (int)))
+	{
+	    fprintf (stderr, "place-bench: index and scan placements "
+		     "differ\n");
+	    return 1;
+	}
+    }
+
+    printf ("placing %d windows on %dx%d, mean of %d runs\n",
+	    nWindow, SCREEN_WIDTH, SCREEN_HEIGHT, runs);
+    printf ("  scan:  %10.1f us\n", scanTime / runs);
+    printf ("  index: %10.1f us\n", indexTime / runs);
+
+    free (b.windows);
+    free (result);
+    free (scanPositions);
+    free (indexPositions);
+
+    return 0;
+}
@@ -26,6 +26,8 @@
 
 #include <compiz-core.h>
 
+#include "place_index.h"
+
 static CompMetadata placeMetadata;
 
 static int displayPrivateIndex;
@@ -76,6 +78,11 @@ typedef struct _PlaceScreen {
     PlaceWindowProc                 placeWindow;
     ValidateWindowResizeRequestProc validateWindowResizeRequest;
     WindowGrabNotifyProc            windowGrabNotify;
+    WindowMoveNotifyProc            windowMoveNotify;
+    WindowResizeNotifyProc          windowResizeNotify;
+    WindowServerGeometryNotifyProc  windowServerGeometryNotify;
+
+    PlaceIndex index;
 
     int               prevWidth;
     int               prevHeight;
@@ -89,6 +96,8 @@ typedef struct _PlaceWindow {
                                  relative to viewport */
     int        prevServerX;
     int        prevServerY;
+
+    PlaceIndexEntry entry; /* frame rectangle in ps->index */
 } PlaceWindow;
 
 #define GET_PLACE_DISPLAY(d)					   \
@@ -324,79 +333,123 @@ placeGetPointerPosition (CompScreen *s,
 			  &iDummy, &iDummy, &uiDummy);
 }
 
+static void
+getWindowExtentsRect (CompWindow *w,
+		      XRectangle *rect)
+{
+    rect->x      = WIN_FULL_X (w);
+    rect->y      = WIN_FULL_Y (w);
+    rect->width  = WIN_FULL_W (w);
+    rect->height = WIN_FULL_H (w);
+}
+
+static void
+placeIndexRemoveWindow (CompWindow *w)
+{
+    PLACE_SCREEN (w->screen);
+    PLACE_WINDOW (w);
+
+    placeIndexRemove (&ps->index, &pw->entry);
+}
+
+/* Keeps the index entry of a window in sync with its server side frame
+   rectangle. Called from the add, move, resize and server geometry
+   hooks, so placements never have to look at windows that did not
+   change. */
+static void
+placeIndexUpdateWindow (CompWindow *w)
+{
+    int x1, y1;
+
+    PLACE_SCREEN (w->screen);
+    PLACE_WINDOW (w);
+
+    x1 = WIN_FULL_X (w);
+    y1 = WIN_FULL_Y (w);
+
+    /* on failure the window is missing from the index until its next
+       geometry change, which only makes placement ignore it */
+    placeIndexUpdate (&ps->index, &pw->entry,
+		      x1, y1, x1 + WIN_FULL_W (w), y1 + WIN_FULL_H (w));
+}
+
+/* stores all windows intersecting x1,y1 - x2,y2 in ps->index.result,
+   where the entry closures are the windows, and returns their number */
+static int
+placeIndexQueryWindows (CompScreen *s,
+			int        x1,
+			int        y1,
+			int        x2,
+			int        y2)
+{
+    PLACE_SCREEN (s);
+
+    placeIndexResize (&ps->index, s->width, s->height);
+
+    return placeIndexQuery (&ps->index, x1, y1, x2, y2);
+}
+
+/* only windows marked by placeCascadeFindFirstFit are avoided */
 static Bool
-rectangleIntersect (XRectangle *src1,
-		    XRectangle *src2,
-		    XRectangle *dest)
+rectOverlapsWindow (CompScreen *s,
+		    XRectangle *rect)
 {
-    int destX, destY;
-    int destW, destH;
+    PLACE_SCREEN (s);
 
-    destX = MAX (src1->x, src2->x);
-    destY = MAX (src1->y, src2->y);
-    destW = MIN (src1->x + src1->width, src2->x + src2->width) - destX;
-    destH = MIN (src1->y + src1->height, src2->y + src2->height) - destY;
+    return placeIndexFindMarked (&ps->index, rect->x, rect->y,
+				 rect->x + rect->width,
+				 rect->y + rect->height) != NULL;
+}
 
-    if (destW <= 0 || destH <= 0)
-    {
-	dest->width  = 0;
-	dest->height = 0;
-	return FALSE;
-    }
+static void
+placeWindowMoveNotify (CompWindow *w,
+		       int        dx,
+		       int        dy,
+		       Bool       immediate)
+{
+    CompScreen *s = w->screen;
 
-    dest->x = destX;
-    dest->y = destY;
-    dest->width = destW;
-    dest->height = destH;
+    PLACE_SCREEN (s);
 
-    return TRUE;
+    placeIndexUpdateWindow (w);
+
+    UNWRAP (ps, s, windowMoveNotify);
+    (*s->windowMoveNotify) (w, dx, dy, immediate);
+    WRAP (ps, s, windowMoveNotify, placeWindowMoveNotify);
 }
 
 static void
-getWindowExtentsRect (CompWindow *w,
-		      XRectangle *rect)
+placeWindowResizeNotify (CompWindow *w,
+			 int        dx,
+			 int        dy,
+			 int        dwidth,
+			 int        dheight)
 {
-    rect->x      = WIN_FULL_X (w);
-    rect->y      = WIN_FULL_Y (w);
-    rect->width  = WIN_FULL_W (w);
-    rect->height = WIN_FULL_H (w);
+    CompScreen *s = w->screen;
+
+    PLACE_SCREEN (s);
+
+    placeIndexUpdateWindow (w);
+
+    UNWRAP (ps, s, windowResizeNotify);
+    (*s->windowResizeNotify) (w, dx, dy, dwidth, dheight);
+    WRAP (ps, s, windowResizeNotify, placeWindowResizeNotify);
 }
 
-static Bool
-rectOverlapsWindow (XRectangle   *rect,
-		    CompWindow   **windows,
-		    unsigned int winCount)
+/* configure requests that were sent but not confirmed yet, windows
+   placed in the meantime have to avoid the requested geometry */
+static void
+placeWindowServerGeometryNotify (CompWindow *w)
 {
-    unsigned int i;
-    XRectangle   dest;
+    CompScreen *s = w->screen;
 
-    for (i = 0; i < winCount; i++)
-    {
-	CompWindow *other = windows[i];
-	XRectangle otherRect;
-
-	switch (other->type) {
-	case CompWindowTypeDockMask:
-	case CompWindowTypeSplashMask:
-	case CompWindowTypeDesktopMask:
-	case CompWindowTypeDialogMask:
-	case CompWindowTypeModalDialogMask:
-	case CompWindowTypeFullscreenMask:
-	case CompWindowTypeUnknownMask:
-	    break;
-	case CompWindowTypeNormalMask:
-	case CompWindowTypeUtilMask:
-	case CompWindowTypeToolbarMask:
-	case CompWindowTypeMenuMask:
-	    getWindowExtentsRect (other, &otherRect);
+    PLACE_SCREEN (s);
 
-	    if (rectangleIntersect (rect, &otherRect, &dest))
-		return TRUE;
-	    break;
-	}
-    }
+    placeIndexUpdateWindow (w);
 
-    return FALSE;
+    UNWRAP (ps, s, windowServerGeometryNotify);
+    (*s->windowServerGeometryNotify) (w);
+    WRAP (ps, s, windowServerGeometryNotify, placeWindowServerGeometryNotify);
 }
 
 static int
@@ -533,6 +586,30 @@ placeCascadeFindFirstFit (CompWindow   *w,
     CompWindow   **belowSorted, **rightSorted;
     XRectangle   rect;
 
+    unsigned int mark;
+
+    PLACE_SCREEN (w->screen);
+
+    placeIndexResize (&ps->index, w->screen->width, w->screen->height);
+
+    /* mark the windows to avoid, rectOverlapsWindow skips all others */
+    mark = placeIndexNewMark (&ps->index);
+
+    /* only these window types are avoided */
+    for (i = 0; i < winCount; i++)
+    {
+	switch (windows[i]->type) {
+	case CompWindowTypeNormalMask:
+	case CompWindowTypeUtilMask:
+	case CompWindowTypeToolbarMask:
+	case CompWindowTypeMenuMask:
+	    GET_PLACE_WINDOW (windows[i], ps)->entry.mark = mark;
+	    break;
+	default:
+	    break;
+	}
+    }
+
     belowSorted = malloc (allocSize);
     if (!belowSorted)
 	return FALSE;
@@ -559,7 +636,7 @@ placeCascadeFindFirstFit (CompWindow   *w,
     centerTileRectInArea (&rect, workArea);
 
     if (rectFitsInWorkarea (workArea, &rect) &&
-	!rectOverlapsWindow (&rect, windows, winCount))
+	!rectOverlapsWindow (w->screen, &rect))
     {
 	*newX = rect.x + w->input.left;
 	*newY = rect.y + w->input.top;
@@ -580,7 +657,7 @@ placeCascadeFindFirstFit (CompWindow   *w,
 	    rect.y = outerRect.y + outerRect.height;
 
 	    if (rectFitsInWorkarea (workArea, &rect) &&
-		!rectOverlapsWindow (&rect, belowSorted, winCount))
+		!rectOverlapsWindow (w->screen, &rect))
 	    {
 		*newX = rect.x + w->input.left;
 		*newY = rect.y + w->input.top;
@@ -602,7 +679,7 @@ placeCascadeFindFirstFit (CompWindow   *w,
 	    rect.y = outerRect.y;
 
 	    if (rectFitsInWorkarea (workArea, &rect) &&
-		!rectOverlapsWindow (&rect, rightSorted, winCount))
+		!rectOverlapsWindow (w->screen, &rect))
 	    {
 		*newX = rect.x + w->input.left;
 		*newY = rect.y + w->input.top;
@@ -855,6 +932,7 @@ placeSmart (CompWindow *w,
      * adapted for Compiz by Bellegarde Cedric (gnumdk(at)gmail.com)
      */
     CompWindow *wi;
+    int        i, n;
     int        overlap, minOverlap = 0;
     int        xOptimal, yOptimal;
     int        possible;
@@ -876,6 +954,8 @@ placeSmart (CompWindow *w,
     int cw = WIN_FULL_W (w) - 1;
     int ch = WIN_FULL_H (w) - 1;
 
+    PLACE_SCREEN (w->screen);
+
     xOptimal = xTmp;
     yOptimal = yTmp;
 
@@ -896,31 +976,27 @@ placeSmart (CompWindow *w,
 	    cyt = yTmp;
 	    cyb = yTmp + ch;
 
-	    for (wi = w->screen->windows; wi; wi = wi->next)
+	    /* all windows returned by the query overlap */
+	    n = placeIndexQueryWindows (w->screen, cxl, cyt, cxr, cyb);
+	    for (i = 0; i < n; i++)
 	    {
+		wi = ps->index.result[i]->closure;
+
 		if (!IS_PLACE_RELEVANT (wi, w))
 		    continue;
 
-		xl = WIN_FULL_X (wi);
-		yt = WIN_FULL_Y (wi);
-		xr = WIN_FULL_X (wi) + WIN_FULL_W (wi);
-		yb = WIN_FULL_Y (wi) + WIN_FULL_H (wi);
+		/* calc the overall overlapping */
+		xl = MAX (cxl, WIN_FULL_X (wi));
+		yt = MAX (cyt, WIN_FULL_Y (wi));
+		xr = MIN (cxr, WIN_FULL_X (wi) + WIN_FULL_W (wi));
+		yb = MIN (cyb, WIN_FULL_Y (wi) + WIN_FULL_H (wi));
 
-		/* if windows overlap, calc the overall overlapping */
-		if (cxl < xr && cxr > xl && cyt < yb && cyb > yt)
-		{
-		    xl = MAX (cxl, xl);
-		    xr = MIN (cxr, xr);
-		    yt = MAX (cyt, yt);
-		    yb = MIN (cyb, yb);
-
-		    if (wi->state & CompWindowStateAboveMask)
-			overlap += 16 * (xr - xl) * (yb - yt);
-		    else if (wi->state & CompWindowStateBelowMask)
-			overlap += 0;
-		    else
-			overlap += (xr - xl) * (yb - yt);
-		}
+		if (wi->state & CompWindowStateAboveMask)
+		    overlap += 16 * (xr - xl) * (yb - yt);
+		else if (wi->state & CompWindowStateBelowMask)
+		    overlap += 0;
+		else
+		    overlap += (xr - xl) * (yb - yt);
 	    }
 	}
 
@@ -953,29 +1029,28 @@ placeSmart (CompWindow *w,
 	    if (possible - cw > xTmp)
 		possible -= cw;
 
-	    /* compare to the position of each client on the same desk */
-	    for (wi = w->screen->windows; wi; wi = wi->next)
+	    /* compare to the position of each client on the same desk
+	     * that is not above or under the current client, to determine
+	     * the first non-overlapped x position
+	     */
+	    n = placeIndexQueryWindows (w->screen, MINSHORT, yTmp,
+					MAXSHORT, ch + yTmp);
+	    for (i = 0; i < n; i++)
 	    {
+		wi = ps->index.result[i]->closure;
+
 		if (!IS_PLACE_RELEVANT (wi, w))
 		    continue;
 
 		xl = WIN_FULL_X (wi);
-		yt = WIN_FULL_Y (wi);
 		xr = WIN_FULL_X (wi) + WIN_FULL_W (wi);
-		yb = WIN_FULL_X (wi) + WIN_FULL_H (wi);
 
-		/* if not enough room above or under the current
-		 * client determine the first non-overlapped x position
-		 */
-		if (yTmp < yb && yt < ch + yTmp)
-		{
-		    if (xr > xTmp && possible > xr)
-			possible = xr;
+		if (xr > xTmp && possible > xr)
+		    possible = xr;
 
-		    basket = xl - cw;
-		    if (basket > xTmp && possible > basket)
-			possible = basket;
-		}
+		basket = xl - cw;
+		if (basket > xTmp && possible > basket)
+		    possible = basket;
 	    }
 	    xTmp = possible;
 	}
@@ -988,16 +1063,20 @@ placeSmart (CompWindow *w,
 	    if (possible - ch > yTmp)
 		possible -= ch;
 
-	    /* test the position of each window on the desk */
-	    for (wi = w->screen->windows; wi; wi = wi->next)
+	    /* test the position of each window on the desk that ends
+	     * below yTmp, the others can't move it
+	     */
+	    n = placeIndexQueryWindows (w->screen, MINSHORT, yTmp,
+					MAXSHORT, MAXSHORT);
+	    for (i = 0; i < n; i++)
 	    {
+		wi = ps->index.result[i]->closure;
+
 		if (!IS_PLACE_RELEVANT (wi, w))
 		    continue;
 
-		xl = WIN_FULL_X (wi);
 		yt = WIN_FULL_Y (wi);
-		xr = WIN_FULL_X (wi) + WIN_FULL_W (wi);
-		yb = WIN_FULL_X (wi) + WIN_FULL_H (wi);
+		yb = WIN_FULL_Y (wi) + WIN_FULL_H (wi);
 
 		/* if not enough room to the left or right of the current
 		 * client determine the first non-overlapped y position
@@ -2094,11 +2173,16 @@ placeInitScreen (CompPlugin *p,
     ps->strutWindowCount = 0;
     ps->resChangeFallbackHandle = 0;
 
+    placeIndexInit (&ps->index, s->width, s->height);
+
     WRAP (ps, s, placeWindow, placePlaceWindow);
     WRAP (ps, s, validateWindowResizeRequest,
 	  placeValidateWindowResizeRequest);
     WRAP (ps, s, addSupportedAtoms, placeAddSupportedAtoms);
     WRAP (ps, s, windowGrabNotify, placeWindowGrabNotify);
+    WRAP (ps, s, windowMoveNotify, placeWindowMoveNotify);
+    WRAP (ps, s, windowResizeNotify, placeWindowResizeNotify);
+    WRAP (ps, s, windowServerGeometryNotify, placeWindowServerGeometryNotify);
 
     s->base.privates[pd->screenPrivateIndex].ptr = ps;
 
@@ -2120,6 +2204,11 @@ placeFiniScreen (CompPlugin *p,
     UNWRAP (ps, s, validateWindowResizeRequest);
     UNWRAP (ps, s, addSupportedAtoms);
     UNWRAP (ps, s, windowGrabNotify);
+    UNWRAP (ps, s, windowMoveNotify);
+    UNWRAP (ps, s, windowResizeNotify);
+    UNWRAP (ps, s, windowServerGeometryNotify);
+
+    placeIndexFini (&ps->index);
 
     setSupportedWmHints (s);
 
@@ -2142,8 +2231,13 @@ placeInitWindow (CompPlugin *p,
 
     pw->savedOriginal = FALSE;
 
+    memset (&pw->entry, 0, sizeof (PlaceIndexEntry));
+    pw->entry.closure = w;
+
     w->base.privates[ps->windowPrivateIndex].ptr = pw;
 
+    placeIndexUpdateWindow (w);
+
     return TRUE;
 }
 
@@ -2153,6 +2247,8 @@ placeFiniWindow (CompPlugin *p,
 {
     PLACE_WINDOW (w);
 
+    placeIndexRemoveWindow (w);
+
     free (pw);
 }
 
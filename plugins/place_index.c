@@ -0,0 +1,394 @@
+/*
+ * Copyright (C) 2026 compiz contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xregion.h>
+
+#include "place_index.h"
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+static void
+placeIndexCellRange (PlaceIndex *idx,
+		     int        x1,
+		     int        y1,
+		     int        x2,
+		     int        y2,
+		     int        *col1,
+		     int        *row1,
+		     int        *col2,
+		     int        *row2)
+{
+    /* empty rectangles still get the cell at their position */
+    x2 = MAX (x2 - 1, x1);
+    y2 = MAX (y2 - 1, y1);
+
+    /* long arithmetic, queries use MINSHORT/MAXSHORT for open bounds */
+    *col1 = MAX (0, MIN (PLACE_INDEX_SIZE - 1, (long) x1 / idx->cellWidth));
+    *row1 = MAX (0, MIN (PLACE_INDEX_SIZE - 1, (long) y1 / idx->cellHeight));
+    *col2 = MAX (0, MIN (PLACE_INDEX_SIZE - 1, (long) x2 / idx->cellWidth));
+    *row2 = MAX (0, MIN (PLACE_INDEX_SIZE - 1, (long) y2 / idx->cellHeight));
+}
+
+static Bool
+placeIndexCellAdd (PlaceIndexCell  *cell,
+		   PlaceIndexEntry *entry)
+{
+    if (cell->nEntry == cell->size)
+    {
+	PlaceIndexEntry **entries;
+
+	entries = realloc (cell->entries,
+			   sizeof (PlaceIndexEntry *) * (cell->size + 8));
+	if (!entries)
+	    return FALSE;
+
+	cell->entries = entries;
+	cell->size   += 8;
+    }
+
+    cell->entries[cell->nEntry++] = entry;
+
+    return TRUE;
+}
+
+static void
+placeIndexCellRemove (PlaceIndexCell  *cell,
+		      PlaceIndexEntry *entry)
+{
+    int i;
+
+    for (i = 0; i < cell->nEntry; i++)
+    {
+	if (cell->entries[i] == entry)
+	{
+	    cell->entries[i] = cell->entries[--cell->nEntry];
+	    break;
+	}
+    }
+}
+
+static void
+placeIndexLayout (PlaceIndex *idx,
+		  int        width,
+		  int        height)
+{
+    idx->width      = width;
+    idx->height     = height;
+    idx->cellWidth  = MAX (1, (width + PLACE_INDEX_SIZE - 1) /
+			   PLACE_INDEX_SIZE);
+    idx->cellHeight = MAX (1, (height + PLACE_INDEX_SIZE - 1) /
+			   PLACE_INDEX_SIZE);
+}
+
+static void
+placeIndexUnlink (PlaceIndex	  *idx,
+		  PlaceIndexEntry *entry)
+{
+    int r, c, col1, row1, col2, row2;
+
+    placeIndexCellRange (idx, entry->x1, entry->y1, entry->x2, entry->y2,
+			 &col1, &row1, &col2, &row2);
+
+    for (r = row1; r <= row2; r++)
+	for (c = col1; c <= col2; c++)
+	    placeIndexCellRemove (&idx->cells[r * PLACE_INDEX_SIZE + c],
+				  entry);
+
+    entry->indexed = FALSE;
+}
+
+/* adds an entry that is not in any cell yet to the cells its
+   rectangle touches */
+static Bool
+placeIndexInsert (PlaceIndex	  *idx,
+		  PlaceIndexEntry *entry)
+{
+    int r, c, col1, row1, col2, row2;
+
+    placeIndexCellRange (idx, entry->x1, entry->y1, entry->x2, entry->y2,
+			 &col1, &row1, &col2, &row2);
+
+    for (r = row1; r <= row2; r++)
+    {
+	for (c = col1; c <= col2; c++)
+	{
+	    if (!placeIndexCellAdd (&idx->cells[r * PLACE_INDEX_SIZE + c],
+				    entry))
+	    {
+		placeIndexUnlink (idx, entry);
+		return FALSE;
+	    }
+	}
+    }
+
+    entry->indexed = TRUE;
+
+    return TRUE;
+}
+
+void
+placeIndexInit (PlaceIndex *idx,
+		int	   width,
+		int	   height)
+{
+    memset (idx, 0, sizeof (PlaceIndex));
+    placeIndexLayout (idx, width, height);
+}
+
+void
+placeIndexFini (PlaceIndex *idx)
+{
+    int i;
+
+    for (i = 0; i < PLACE_INDEX_SIZE * PLACE_INDEX_SIZE; i++)
+	if (idx->cells[i].entries)
+	    free (idx->cells[i].entries);
+
+    if (idx->result)
+	free (idx->result);
+
+    memset (idx, 0, sizeof (PlaceIndex));
+}
+
+/* Lays the grid out for a new screen size. Only then are all entries
+   visited, they are collected from the cells and inserted again. */
+void
+placeIndexResize (PlaceIndex *idx,
+		  int	     width,
+		  int	     height)
+{
+    PlaceIndexEntry **entries;
+    int		    i, j, n;
+
+    if (idx->width == width && idx->height == height)
+	return;
+
+    n = placeIndexQuery (idx, MINSHORT, MINSHORT, MAXSHORT, MAXSHORT);
+
+    entries = malloc (sizeof (PlaceIndexEntry *) * (n ? n : 1));
+
+    if (entries)
+	memcpy (entries, idx->result, sizeof (PlaceIndexEntry *) * n);
+
+    for (i = 0; i < PLACE_INDEX_SIZE * PLACE_INDEX_SIZE; i++)
+	idx->cells[i].nEntry = 0;
+
+    placeIndexLayout (idx, width, height);
+
+    if (!entries)
+    {
+	/* entries come back with their next update */
+	for (i = 0; i < n; i++)
+	    idx->result[i]->indexed = FALSE;
+
+	idx->nEntry -= n;
+	return;
+    }
+
+    for (i = 0, j = 0; i < n; i++)
+    {
+	entries[i]->indexed = FALSE;
+
+	if (placeIndexInsert (idx, entries[i]))
+	    j++;
+    }
+
+    idx->nEntry = j;
+
+    free (entries);
+}
+
+/* Moves entry to the cells of the given rectangle, adding it to the
+   index if it is not in it yet. Fails only if memory runs out, the
+   entry is not in the index then. */
+Bool
+placeIndexUpdate (PlaceIndex	  *idx,
+		  PlaceIndexEntry *entry,
+		  int		  x1,
+		  int		  y1,
+		  int		  x2,
+		  int		  y2)
+{
+    if (entry->indexed &&
+	entry->x1 == x1 && entry->y1 == y1 &&
+	entry->x2 == x2 && entry->y2 == y2)
+	return TRUE;
+
+    placeIndexRemove (idx, entry);
+
+    /* every entry fits into the result of a query */
+    if (idx->nEntry + 1 > idx->resultSize)
+    {
+	PlaceIndexEntry **result;
+	int		size = MAX (32, idx->resultSize * 2);
+
+	result = realloc (idx->result, sizeof (PlaceIndexEntry *) * size);
+	if (!result)
+	    return FALSE;
+
+	idx->result     = result;
+	idx->resultSize = size;
+    }
+
+    entry->x1 = x1;
+    entry->y1 = y1;
+    entry->x2 = x2;
+    entry->y2 = y2;
+
+    if (!placeIndexInsert (idx, entry))
+	return FALSE;
+
+    idx->nEntry++;
+
+    return TRUE;
+}
+
+void
+placeIndexRemove (PlaceIndex	  *idx,
+		  PlaceIndexEntry *entry)
+{
+    if (!entry->indexed)
+	return;
+
+    placeIndexUnlink (idx, entry);
+    idx->nEntry--;
+}
+
+/* stamps mark entries already seen by a query, as they can be in
+   several cells */
+static unsigned int
+placeIndexNewQuery (PlaceIndex *idx)
+{
+    int i, j;
+
+    if (!++idx->query)
+    {
+	for (i = 0; i < PLACE_INDEX_SIZE * PLACE_INDEX_SIZE; i++)
+	    for (j = 0; j < idx->cells[i].nEntry; j++)
+		idx->cells[i].entries[j]->query = 0;
+
+	idx->query = 1;
+    }
+
+    return idx->query;
+}
+
+/* stores all entries intersecting x1,y1 - x2,y2 in idx->result and
+   returns their number */
+int
+placeIndexQuery (PlaceIndex *idx,
+		 int	    x1,
+		 int	    y1,
+		 int	    x2,
+		 int	    y2)
+{
+    unsigned int query = placeIndexNewQuery (idx);
+    int		 i, c, r, col1, row1, col2, row2, n = 0;
+
+    placeIndexCellRange (idx, x1, y1, x2, y2, &col1, &row1, &col2, &row2);
+
+    for (r = row1; r <= row2; r++)
+    {
+	for (c = col1; c <= col2; c++)
+	{
+	    PlaceIndexCell *cell = &idx->cells[r * PLACE_INDEX_SIZE + c];
+
+	    for (i = 0; i < cell->nEntry; i++)
+	    {
+		PlaceIndexEntry *e = cell->entries[i];
+
+		if (e->query == query)
+		    continue;
+
+		e->query = query;
+
+		if (x1 < e->x2 && x2 > e->x1 && y1 < e->y2 && y2 > e->y1 &&
+		    n < idx->resultSize)
+		    idx->result[n++] = e;
+	    }
+	}
+    }
+
+    return n;
+}
+
+/* Returns a mark that no entry carries yet, callers set it on the
+   entries placeIndexFindMarked should consider */
+unsigned int
+placeIndexNewMark (PlaceIndex *idx)
+{
+    int i, j;
+
+    if (!++idx->mark)
+    {
+	for (i = 0; i < PLACE_INDEX_SIZE * PLACE_INDEX_SIZE; i++)
+	    for (j = 0; j < idx->cells[i].nEntry; j++)
+		idx->cells[i].entries[j]->mark = 0;
+
+	idx->mark = 1;
+    }
+
+    return idx->mark;
+}
+
+/* Returns the first entry with the current mark that intersects
+   x1,y1 - x2,y2. Walks the cells directly as most candidate rectangles
+   overlap some entry and the first one found is enough. */
+PlaceIndexEntry *
+placeIndexFindMarked (PlaceIndex *idx,
+		      int	 x1,
+		      int	 y1,
+		      int	 x2,
+		      int	 y2)
+{
+    int i, c, r, col1, row1, col2, row2;
+
+    placeIndexCellRange (idx, x1, y1, x2, y2, &col1, &row1, &col2, &row2);
+
+    for (r = row1; r <= row2; r++)
+    {
+	for (c = col1; c <= col2; c++)
+	{
+	    PlaceIndexCell *cell = &idx->cells[r * PLACE_INDEX_SIZE + c];
+
+	    for (i = 0; i < cell->nEntry; i++)
+	    {
+		PlaceIndexEntry *e = cell->entries[i];
+
+		if (e->mark != idx->mark)
+		    continue;
+
+		if (x1 < e->x2 && x2 > e->x1 && y1 < e->y2 && y2 > e->y1)
+		    return e;
+	    }
+	}
+    }
+
+    return NULL;
+}
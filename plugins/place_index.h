@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2026 compiz contributors
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+#ifndef _PLACE_INDEX_H
+#define _PLACE_INDEX_H
+
+#include <X11/Xlib.h>
+
+/*
+ * Spatial index over the frame rectangles of all windows on a screen.
+ * Entries are bucketed into a uniform grid laid over the screen (entries
+ * outside of it end up in the border cells) and are moved between cells
+ * when their rectangle is updated, so overlap queries only look at the
+ * entries near the queried rectangle. The index knows nothing about
+ * windows, whether an entry matters for a placement is decided by the
+ * caller.
+ */
+#define PLACE_INDEX_SIZE 16
+
+typedef struct _PlaceIndexEntry {
+    void	 *closure;	  /* owner of the entry */
+    Bool	 indexed;
+    int		 x1, y1, x2, y2;  /* rectangle in the index */
+    unsigned int query;
+    unsigned int mark;
+} PlaceIndexEntry;
+
+typedef struct _PlaceIndexCell {
+    PlaceIndexEntry **entries;
+    int		    nEntry;
+    int		    size;
+} PlaceIndexCell;
+
+typedef struct _PlaceIndex {
+    PlaceIndexCell  cells[PLACE_INDEX_SIZE * PLACE_INDEX_SIZE];
+    int		    width, height;
+    int		    cellWidth, cellHeight;
+    int		    nEntry;
+    unsigned int    query;
+    unsigned int    mark;
+    PlaceIndexEntry **result;
+    int		    resultSize;
+} PlaceIndex;
+
+void
+placeIndexInit (PlaceIndex *idx,
+		int	   width,
+		int	   height);
+
+void
+placeIndexFini (PlaceIndex *idx);
+
+void
+placeIndexResize (PlaceIndex *idx,
+		  int	     width,
+		  int	     height);
+
+Bool
+placeIndexUpdate (PlaceIndex	  *idx,
+		  PlaceIndexEntry *entry,
+		  int		  x1,
+		  int		  y1,
+		  int		  x2,
+		  int		  y2);
+
+void
+placeIndexRemove (PlaceIndex	  *idx,
+		  PlaceIndexEntry *entry);
+
+int
+placeIndexQuery (PlaceIndex *idx,
+		 int	    x1,
+		 int	    y1,
+		 int	    x2,
+		 int	    y2);
+
+unsigned int
+placeIndexNewMark (PlaceIndex *idx);
+
+PlaceIndexEntry *
+placeIndexFindMarked (PlaceIndex *idx,
+		      int	 x1,
+		      int	 y1,
+		      int	 x2,
+		      int	 y2);
+
+#endif
@@ -49,31 +49,6 @@ typedef struct _PngDisplay {
     PngDisplay *pd = GET_PNG_DISPLAY (d)
 
 
-static void
-premultiplyData (png_structp   png,
-		 png_row_infop row_info,
-		 png_bytep     data)
-{
-    unsigned int i;
-
-    for (i = 0; i < row_info->rowbytes; i += 4)
-    {
-	unsigned char *base = &data[i];
-	unsigned char blue  = base[0];
-	unsigned char green = base[1];
-	unsigned char red   = base[2];
-	unsigned char alpha = base[3];
-	int	      p;
-
-	red   = (unsigned) red   * (unsigned) alpha / 255;
-	green = (unsigned) green * (unsigned) alpha / 255;
-	blue  = (unsigned) blue  * (unsigned) alpha / 255;
-
-	p = (alpha << 24) | (red << 16) | (green << 8) | (blue << 0);
-	memcpy (base, &p, sizeof (int));
-    }
-}
-
 static Bool
 readPngData (png_struct	*png,
 	     png_info	*info,
@@ -125,8 +100,6 @@ readPngData (png_struct	*png,
     png_set_bgr (png);
     png_set_filler (png, 0xff, PNG_FILLER_AFTER);
 
-    png_set_read_user_transform_fn (png, premultiplyData);
-
     png_read_update_info (png, info);
 
     pixel_size = 4;
@@ -151,6 +124,9 @@ readPngData (png_struct	*png,
 
     free (row_pointers);
 
+    /* premultiply the whole image in one pass instead of per row */
+    premultiplyImageData (d, png_width * png_height);
+
     return TRUE;
 }
 
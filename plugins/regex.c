@@ -37,22 +37,68 @@ static CompMetadata regexMetadata;
 
 static int displayPrivateIndex;
 
+#define REGEX_FIELD_TITLE 0
+#define REGEX_FIELD_ROLE  1
+#define REGEX_FIELD_CLASS 2
+#define REGEX_FIELD_NAME  3
+#define REGEX_FIELD_NUM   4
+
+#define REGEX_EXP_HASH_SIZE 64
+
+/*
+  Expressions are shared between all matches that use the same
+  pattern on the same field and each of them owns a bit in the
+  per window result caches. Expressions are freed with the last
+  match using them and their bit is handed to the next expression
+  registered for the field.
+*/
+typedef struct _RegexExp {
+    struct _RegexExp *next;
+    char	     *value;
+    unsigned int     hash;
+    int		     field;
+    int		     flags;
+    int		     index;
+    int		     refCount;
+    regex_t	     preg;
+} RegexExp;
+
 typedef struct _RegexDisplay {
     int		     screenPrivateIndex;
-    HandleEventProc  handleEvent;
-    MatchInitExpProc matchInitExp;
+    WindowPropertiesChangedProc windowPropertiesChanged;
+    MatchInitExpProc		matchInitExp;
     Atom	     roleAtom;
     Atom             visibleNameAtom;
     CompTimeoutHandle timeoutHandle;
+
+    RegexExp *exps[REGEX_EXP_HASH_SIZE];
+
+    /* bits in use and bits of freed expressions per field */
+    int		 nExp[REGEX_FIELD_NUM];
+    int		 *freeIndex[REGEX_FIELD_NUM];
+    int		 nFreeIndex[REGEX_FIELD_NUM];
+
+    /* changes when a bit is handed to another expression */
+    unsigned int serial[REGEX_FIELD_NUM];
 } RegexDisplay;
 
 typedef struct _RegexScreen {
     int	windowPrivateIndex;
 } RegexScreen;
 
+/* bit sets of evaluated and matching expressions for one field */
+typedef struct _RegexMatchCache {
+    unsigned int *evaluated;
+    unsigned int *matched;
+    int		 nWord;
+    unsigned int serial;
+} RegexMatchCache;
+
 typedef struct _RegexWindow {
     char *title;
     char *role;
+
+    RegexMatchCache cache[REGEX_FIELD_NUM];
 } RegexWindow;
 
 #define GET_REGEX_DISPLAY(d)					   \
@@ -75,105 +121,276 @@ typedef struct _RegexWindow {
 		      GET_REGEX_SCREEN  (w->screen,	       \
 		      GET_REGEX_DISPLAY (w->screen->display)))
 
-static void
-regexMatchExpFini (CompDisplay *d,
-		   CompPrivate private)
+#define REGEX_WORD_BITS (sizeof (unsigned int) * 8)
+
+static unsigned int
+regexHashExp (const char *value,
+	      int	 field,
+	      int	 flags)
+{
+    unsigned int hash = 5381;
+
+    while (*value)
+	hash = hash * 33 + (unsigned char) *value++;
+
+    return hash ^ (field << 24) ^ flags;
+}
+
+static RegexExp *
+regexAddExp (CompDisplay *d,
+	     const char  *value,
+	     int	 field,
+	     int	 flags)
 {
-    regex_t *preg = (regex_t *) private.ptr;
+    RegexExp	 *re;
+    unsigned int hash;
+    int		 status;
+
+    REGEX_DISPLAY (d);
+
+    hash = regexHashExp (value, field, flags);
 
-    if (preg)
+    for (re = rd->exps[hash % REGEX_EXP_HASH_SIZE]; re; re = re->next)
     {
-	regfree (preg);
-	free (preg);
+	if (re->hash == hash && re->field == field && re->flags == flags &&
+	    strcmp (re->value, value) == 0)
+	{
+	    re->refCount++;
+	    return re;
+	}
+    }
+
+    re = malloc (sizeof (RegexExp));
+    if (!re)
+	return NULL;
+
+    status = regcomp (&re->preg, value, REG_NOSUB | flags);
+    if (status)
+    {
+	char errMsg[1024];
+
+	regerror (status, &re->preg, errMsg, sizeof (errMsg));
+
+	compLogMessage ("regex", CompLogLevelWarn,
+			"%s = %s", errMsg, value);
+
+	regfree (&re->preg);
+	free (re);
+
+	return NULL;
+    }
+
+    re->value = strdup (value);
+    if (!re->value)
+    {
+	regfree (&re->preg);
+	free (re);
+	return NULL;
     }
+
+    re->hash     = hash;
+    re->field    = field;
+    re->flags    = flags;
+    re->refCount = 1;
+
+    /* windows might have results of the previous owner of a reused
+       bit cached, the serial makes them drop their results */
+    if (rd->nFreeIndex[field])
+    {
+	re->index = rd->freeIndex[field][--rd->nFreeIndex[field]];
+	rd->serial[field]++;
+    }
+    else
+    {
+	re->index = rd->nExp[field]++;
+    }
+
+    re->next = rd->exps[hash % REGEX_EXP_HASH_SIZE];
+    rd->exps[hash % REGEX_EXP_HASH_SIZE] = re;
+
+    return re;
 }
 
-static Bool
-regexMatchExpEvalTitle (CompDisplay *d,
-			CompWindow  *w,
-			CompPrivate private)
+static void
+regexFreeExp (RegexExp *re)
 {
-    regex_t *preg = (regex_t *) private.ptr;
-    int	    status;
+    regfree (&re->preg);
+    free (re->value);
+    free (re);
+}
 
-    REGEX_WINDOW (w);
+static void
+regexFreeExps (CompDisplay *d)
+{
+    RegexExp *re;
+    int	     i;
 
-    if (!preg)
-	return FALSE;
+    REGEX_DISPLAY (d);
 
-    if (!rw->title)
-	return FALSE;
+    for (i = 0; i < REGEX_EXP_HASH_SIZE; i++)
+    {
+	while (rd->exps[i])
+	{
+	    re = rd->exps[i];
+	    rd->exps[i] = re->next;
 
-    status = regexec (preg, rw->title, 0, NULL, 0);
-    if (status)
-	return FALSE;
+	    regexFreeExp (re);
+	}
+    }
 
-    return TRUE;
+    for (i = 0; i < REGEX_FIELD_NUM; i++)
+	if (rd->freeIndex[i])
+	    free (rd->freeIndex[i]);
 }
 
-static Bool
-regexMatchExpEvalRole (CompDisplay *d,
-		       CompWindow  *w,
-		       CompPrivate private)
+static void
+regexMatchExpFini (CompDisplay *d,
+		   CompPrivate private)
 {
-    regex_t *preg = (regex_t *) private.ptr;
-    int	    status;
+    RegexExp *re = (RegexExp *) private.ptr;
+    RegexExp **prev;
+    int	     *freeIndex;
 
-    REGEX_WINDOW (w);
+    REGEX_DISPLAY (d);
 
-    if (!preg)
-	return FALSE;
+    if (!re || --re->refCount)
+	return;
 
-    if (!rw->role)
-	return FALSE;
+    for (prev = &rd->exps[re->hash % REGEX_EXP_HASH_SIZE]; *prev;
+	 prev = &(*prev)->next)
+    {
+	if (*prev == re)
+	{
+	    *prev = re->next;
+	    break;
+	}
+    }
 
-    status = regexec (preg, rw->role, 0, NULL, 0);
-    if (status)
-	return FALSE;
+    /* the bit is lost if the free list can't grow, which only makes
+       the bit sets a bit larger than needed */
+    freeIndex = realloc (rd->freeIndex[re->field],
+			 sizeof (int) * (rd->nFreeIndex[re->field] + 1));
+    if (freeIndex)
+    {
+	freeIndex[rd->nFreeIndex[re->field]++] = re->index;
+	rd->freeIndex[re->field] = freeIndex;
+    }
 
-    return TRUE;
+    regexFreeExp (re);
+}
+
+static char *
+regexGetFieldValue (CompWindow  *w,
+		    RegexWindow *rw,
+		    int		field)
+{
+    switch (field) {
+    case REGEX_FIELD_TITLE:
+	return rw->title;
+    case REGEX_FIELD_ROLE:
+	return rw->role;
+    case REGEX_FIELD_CLASS:
+	return w->resClass;
+    case REGEX_FIELD_NAME:
+    default:
+	return w->resName;
+    }
 }
 
 static Bool
-regexMatchExpEvalClass (CompDisplay *d,
-			CompWindow  *w,
-			CompPrivate private)
+regexResizeMatchCache (RegexMatchCache *cache,
+		       int	       nWord)
 {
-    regex_t *preg = (regex_t *) private.ptr;
-    int	    status;
+    unsigned int *evaluated, *matched;
 
-    if (!preg)
+    evaluated = realloc (cache->evaluated, sizeof (unsigned int) * nWord);
+    if (!evaluated)
 	return FALSE;
 
-    if (!w->resClass)
-	return FALSE;
+    cache->evaluated = evaluated;
 
-    status = regexec (preg, w->resClass, 0, NULL, 0);
-    if (status)
+    matched = realloc (cache->matched, sizeof (unsigned int) * nWord);
+    if (!matched)
 	return FALSE;
 
+    cache->matched = matched;
+
+    memset (cache->evaluated + cache->nWord, 0,
+	    sizeof (unsigned int) * (nWord - cache->nWord));
+    memset (cache->matched + cache->nWord, 0,
+	    sizeof (unsigned int) * (nWord - cache->nWord));
+
+    cache->nWord = nWord;
+
     return TRUE;
 }
 
+static void
+regexClearMatchCache (RegexMatchCache *cache)
+{
+    if (cache->nWord)
+	memset (cache->evaluated, 0, sizeof (unsigned int) * cache->nWord);
+}
+
+static void
+regexFiniMatchCache (RegexMatchCache *cache)
+{
+    if (cache->evaluated)
+	free (cache->evaluated);
+
+    if (cache->matched)
+	free (cache->matched);
+}
+
 static Bool
-regexMatchExpEvalName (CompDisplay *d,
-		       CompWindow  *w,
-		       CompPrivate private)
+regexMatchExpEval (CompDisplay *d,
+		   CompWindow  *w,
+		   CompPrivate private)
 {
-    regex_t *preg = (regex_t *) private.ptr;
-    int	    status;
+    RegexExp	    *re = (RegexExp *) private.ptr;
+    RegexMatchCache *cache;
+    unsigned int    bit;
+    int		    word;
+    char	    *value;
+    Bool	    result;
 
-    if (!preg)
-	return FALSE;
+    REGEX_WINDOW (w);
 
-    if (!w->resName)
-	return FALSE;
+    REGEX_DISPLAY (d);
 
-    status = regexec (preg, w->resName, 0, NULL, 0);
-    if (status)
+    if (!re)
 	return FALSE;
 
-    return TRUE;
+    cache = &rw->cache[re->field];
+
+    if (cache->serial != rd->serial[re->field])
+    {
+	regexClearMatchCache (cache);
+	cache->serial = rd->serial[re->field];
+    }
+    word  = re->index / REGEX_WORD_BITS;
+    bit	  = 1u << (re->index % REGEX_WORD_BITS);
+
+    if (word < cache->nWord && (cache->evaluated[word] & bit))
+	return (cache->matched[word] & bit) != 0;
+
+    value = regexGetFieldValue (w, rw, re->field);
+    if (!value)
+	result = FALSE;
+    else
+	result = (regexec (&re->preg, value, 0, NULL, 0) == 0);
+
+    if (word < cache->nWord || regexResizeMatchCache (cache, word + 1))
+    {
+	cache->evaluated[word] |= bit;
+
+	if (result)
+	    cache->matched[word] |= bit;
+	else
+	    cache->matched[word] &= ~bit;
+    }
+
+    return result;
 }
 
 static void
@@ -182,19 +399,19 @@ regexMatchInitExp (CompDisplay  *d,
 		   const char	*value)
 {
     static struct _Prefix {
-	char		     *s;
-	int		     len;
-	CompMatchExpEvalProc eval;
-	unsigned int         flags;
+	char	     *s;
+	int	     len;
+	int	     field;
+	unsigned int flags;
     } prefix[] = {
-	{ "title=", 6, regexMatchExpEvalTitle, 0 },
-	{ "role=",  5, regexMatchExpEvalRole, 0  },
-	{ "class=", 6, regexMatchExpEvalClass, 0 },
-	{ "name=",  5, regexMatchExpEvalName, 0  },
-	{ "ititle=", 7, regexMatchExpEvalTitle, REG_ICASE },
-	{ "irole=",  6, regexMatchExpEvalRole, REG_ICASE  },
-	{ "iclass=", 7, regexMatchExpEvalClass, REG_ICASE },
-	{ "iname=",  6, regexMatchExpEvalName, REG_ICASE  },
+	{ "title=", 6, REGEX_FIELD_TITLE, 0 },
+	{ "role=",  5, REGEX_FIELD_ROLE, 0  },
+	{ "class=", 6, REGEX_FIELD_CLASS, 0 },
+	{ "name=",  5, REGEX_FIELD_NAME, 0  },
+	{ "ititle=", 7, REGEX_FIELD_TITLE, REG_ICASE },
+	{ "irole=",  6, REGEX_FIELD_ROLE, REG_ICASE  },
+	{ "iclass=", 7, REGEX_FIELD_CLASS, REG_ICASE },
+	{ "iname=",  6, REGEX_FIELD_NAME, REG_ICASE  },
     };
     int	i;
 
@@ -206,34 +423,10 @@ regexMatchInitExp (CompDisplay  *d,
 
     if (i < sizeof (prefix) / sizeof (prefix[0]))
     {
-	regex_t *preg;
-
-	preg = malloc (sizeof (regex_t));
-	if (preg)
-	{
-	    int status;
-
-	    value += prefix[i].len;
-
-	    status = regcomp (preg, value, REG_NOSUB | prefix[i].flags);
-	    if (status)
-	    {
-		char errMsg[1024];
-
-		regerror (status, preg, errMsg, sizeof (errMsg));
-
-		compLogMessage ("regex", CompLogLevelWarn,
-				"%s = %s", errMsg, value);
-
-		regfree (preg);
-		free (preg);
-		preg = NULL;
-	    }
-	}
-
 	exp->fini     = regexMatchExpFini;
-	exp->eval     = prefix[i].eval;
-	exp->priv.ptr = preg;
+	exp->eval     = regexMatchExpEval;
+	exp->priv.ptr = regexAddExp (d, value + prefix[i].len,
+				     prefix[i].field, prefix[i].flags);
     }
     else
     {
@@ -295,57 +488,77 @@ regexGetWindowTitle (CompWindow *w)
     return regexGetStringProperty (w, XA_WM_NAME, XA_STRING);
 }
 
+/* takes ownership of value, returns TRUE if the string changed */
+static Bool
+regexUpdateString (char **str,
+		   char *value)
+{
+    if (*str && value && strcmp (*str, value) == 0)
+    {
+	free (value);
+	return FALSE;
+    }
+
+    if (!*str && !value)
+	return FALSE;
+
+    if (*str)
+	free (*str);
+
+    *str = value;
+
+    return TRUE;
+}
+
 static void
-regexHandleEvent (CompDisplay *d,
-		  XEvent      *event)
+regexWindowPropertiesChanged (CompWindow *w,
+			      Atom	 *property,
+			      int	 nProperty)
 {
+    CompDisplay *d = w->screen->display;
+    Bool	changed = FALSE;
+    int		i;
+
     REGEX_DISPLAY (d);
+    REGEX_WINDOW (w);
 
-    UNWRAP (rd, d, handleEvent);
-    (*d->handleEvent) (d, event);
-    WRAP (rd, d, handleEvent, regexHandleEvent);
+    UNWRAP (rd, d, windowPropertiesChanged);
+    (*d->windowPropertiesChanged) (w, property, nProperty);
+    WRAP (rd, d, windowPropertiesChanged, regexWindowPropertiesChanged);
 
-    if (event->type == PropertyNotify)
+    for (i = 0; i < nProperty; i++)
     {
-	CompWindow *w;
-
-	if (event->xproperty.atom == XA_WM_NAME)
+	if (property[i] == XA_WM_NAME)
 	{
-	    w = findWindowAtDisplay (d, event->xproperty.window);
-	    if (w)
+	    if (regexUpdateString (&rw->title, regexGetWindowTitle (w)))
 	    {
-		REGEX_WINDOW (w);
-
-		if (rw->title)
-		    free (rw->title);
-
-		rw->title = regexGetWindowTitle (w);
-
-		(*d->matchPropertyChanged) (d, w);
+		regexClearMatchCache (&rw->cache[REGEX_FIELD_TITLE]);
+		changed = TRUE;
 	    }
 	}
-	if (event->xproperty.atom == rd->roleAtom)
+	else if (property[i] == rd->roleAtom)
 	{
-	    w = findWindowAtDisplay (d, event->xproperty.window);
-	    if (w)
+	    if (regexUpdateString (&rw->role,
+				   regexGetStringProperty (w, rd->roleAtom,
+							   XA_STRING)))
 	    {
-		REGEX_WINDOW (w);
-
-		if (rw->role)
-		    free (rw->role);
-
-		rw->role = regexGetStringProperty (w, rd->roleAtom, XA_STRING);
-
-		(*d->matchPropertyChanged) (d, w);
+		regexClearMatchCache (&rw->cache[REGEX_FIELD_ROLE]);
+		changed = TRUE;
 	    }
 	}
-	else if (event->xproperty.atom == XA_WM_CLASS)
+	else if (property[i] == XA_WM_CLASS)
 	{
-	    w = findWindowAtDisplay (d, event->xproperty.window);
-	    if (w)
-		(*d->matchPropertyChanged) (d, w);
+	    regexClearMatchCache (&rw->cache[REGEX_FIELD_CLASS]);
+	    regexClearMatchCache (&rw->cache[REGEX_FIELD_NAME]);
+	    changed = TRUE;
 	}
     }
+
+    /* one re-evaluation for all changes of the batch */
+    if (changed)
+    {
+	windowMatchPropertyChanged (w);
+    }
 }
 
 static Bool
@@ -385,7 +598,13 @@ regexInitDisplay (CompPlugin  *p,
     rd->roleAtom        = XInternAtom (d->display, "WM_WINDOW_ROLE", 0);
     rd->visibleNameAtom = XInternAtom (d->display, "_NET_WM_VISIBLE_NAME", 0);
 
-    WRAP (rd, d, handleEvent, regexHandleEvent);
+    memset (rd->exps, 0, sizeof (rd->exps));
+    memset (rd->nExp, 0, sizeof (rd->nExp));
+    memset (rd->freeIndex, 0, sizeof (rd->freeIndex));
+    memset (rd->nFreeIndex, 0, sizeof (rd->nFreeIndex));
+    memset (rd->serial, 0, sizeof (rd->serial));
+
+    WRAP (rd, d, windowPropertiesChanged, regexWindowPropertiesChanged);
     WRAP (rd, d, matchInitExp, regexMatchInitExp);
 
     d->base.privates[displayPrivateIndex].ptr = rd;
@@ -409,12 +628,14 @@ regexFiniDisplay (CompPlugin  *p,
     if (rd->timeoutHandle)
 	compRemoveTimeout (rd->timeoutHandle);
 
-    UNWRAP (rd, d, handleEvent);
+    UNWRAP (rd, d, windowPropertiesChanged);
     UNWRAP (rd, d, matchInitExp);
 
     if (d->base.parent)
 	(*d->matchExpHandlerChanged) (d);
 
+    regexFreeExps (d);
+
     free (rd);
 }
 
@@ -458,6 +679,7 @@ regexInitWindow (CompPlugin *p,
 		 CompWindow *w)
 {
     RegexWindow *rw;
+    int		i;
 
     REGEX_DISPLAY (w->screen->display);
     REGEX_SCREEN (w->screen);
@@ -469,6 +691,14 @@ regexInitWindow (CompPlugin *p,
     rw->title = regexGetWindowTitle (w);
     rw->role  = regexGetStringProperty (w, rd->roleAtom, XA_STRING);
 
+    for (i = 0; i < REGEX_FIELD_NUM; i++)
+    {
+	rw->cache[i].evaluated = NULL;
+	rw->cache[i].matched   = NULL;
+	rw->cache[i].nWord     = 0;
+	rw->cache[i].serial    = rd->serial[i];
+    }
+
     w->base.privates[rs->windowPrivateIndex].ptr = rw;
 
     return TRUE;
@@ -478,8 +708,13 @@ static void
 regexFiniWindow (CompPlugin *p,
 		 CompWindow *w)
 {
+    int i;
+
     REGEX_WINDOW (w);
 
+    for (i = 0; i < REGEX_FIELD_NUM; i++)
+	regexFiniMatchCache (&rw->cache[i]);
+
     if (rw->title)
 	free (rw->title);
 
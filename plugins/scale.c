@@ -387,8 +387,9 @@ scalePaintWindow (CompWindow		  *w,
 
 	if (scaled)
 	{
-	    FragmentAttrib fragment;
-	    CompTransform  wTransform = *transform;
+	    FragmentAttrib	fragment;
+	    CompTransform	wTransform = *transform;
+	    CompWindowThumbnail *thumb = NULL;
 
 	    if (mask & PAINT_WINDOW_OCCLUSION_DETECTION_MASK)
 		return FALSE;
@@ -408,8 +409,25 @@ scalePaintWindow (CompWindow		  *w,
 	    glPushMatrix ();
 	    glLoadMatrixf (wTransform.m);
 
-	    (*s->drawWindow) (w, &wTransform, &fragment, region,
-			      mask | PAINT_WINDOW_TRANSFORMED_MASK);
+	    /* windows resting in their slot are drawn from a cached
+	       thumbnail, animated ones change size every frame */
+	    if (ss->state == SCALE_STATE_WAIT && !sw->adjust)
+	    {
+		int width, height;
+
+		width  = w->width  + w->input.left + w->input.right;
+		height = w->height + w->input.top  + w->input.bottom;
+
+		thumb = getWindowThumbnail (w, width  * sw->scale,
+					    height * sw->scale);
+	    }
+
+	    if (thumb)
+		drawWindowThumbnail (w, thumb, &fragment,
+				     mask | PAINT_WINDOW_TRANSFORMED_MASK);
+	    else
+		(*s->drawWindow) (w, &wTransform, &fragment, region,
+				  mask | PAINT_WINDOW_TRANSFORMED_MASK);
 
 	    glPopMatrix ();
 
@@ -426,20 +444,6 @@ scalePaintWindow (CompWindow		  *w,
     return status;
 }
 
-static int
-compareWindowsDistance (const void *elem1,
-			const void *elem2)
-{
-    CompWindow *w1 = *((CompWindow **) elem1);
-    CompWindow *w2 = *((CompWindow **) elem2);
-
-    SCALE_SCREEN (w1->screen);
-
-    return
-	GET_SCALE_WINDOW (w1, ss)->distance -
-	GET_SCALE_WINDOW (w2, ss)->distance;
-}
-
 static void
 layoutSlotsForArea (CompScreen *s,
 		    XRectangle workArea,
@@ -609,105 +613,486 @@ layoutSlots (CompScreen *s)
     }
 }
 
+typedef struct _ScaleLayoutKey {
+    Window            id;
+    int               x, y, width, height;
+    CompWindowExtents input;
+} ScaleLayoutKey;
+
+struct _ScaleLayoutCache {
+    /* implicit k-d tree over the slot centers; the node of the
+       subtree [lo, hi) is stored at (lo + hi) / 2 and alive holds the
+       number of free slots in that subtree */
+    int *tree;
+    int *pos;
+    int *alive;
+    int *cx, *cy;
+    int size;
+
+    /* slots of the grid before windows were fitted into them */
+    ScaleSlot *cells;
+
+    /* input and result of the last layout */
+    Bool           valid;
+    int            nWindows;
+    int            nSlots;
+    ScaleLayoutKey *keys;
+    int            *sid;
+    ScaleSlot      *slots;
+    int            spacing;
+    int            moMode;
+    int            currentOutputDev;
+    int            nOutputDev;
+    XRectangle     *workAreas;
+    int            workAreasSize;
+};
+
+static Bool
+scaleEnsureLayoutCache (ScaleLayoutCache *c,
+			int              size)
+{
+    if (c->size >= size)
+	return TRUE;
+
+    c->tree  = realloc (c->tree,  sizeof (int) * size);
+    c->pos   = realloc (c->pos,   sizeof (int) * size);
+    c->alive = realloc (c->alive, sizeof (int) * size);
+    c->cx    = realloc (c->cx,    sizeof (int) * size);
+    c->cy    = realloc (c->cy,    sizeof (int) * size);
+    c->keys  = realloc (c->keys,  sizeof (ScaleLayoutKey) * size);
+    c->sid   = realloc (c->sid,   sizeof (int) * size);
+    c->slots = realloc (c->slots, sizeof (ScaleSlot) * size);
+    c->cells = realloc (c->cells, sizeof (ScaleSlot) * size);
+
+    c->valid = FALSE;
+
+    if (!c->tree || !c->pos || !c->alive || !c->cx || !c->cy ||
+	!c->keys || !c->sid || !c->slots || !c->cells)
+    {
+	c->size = 0;
+	return FALSE;
+    }
+
+    c->size = size;
+
+    return TRUE;
+}
+
 static void
-findBestSlots (CompScreen *s)
+scaleFreeLayoutCache (ScaleLayoutCache *c)
 {
-    CompWindow *w;
-    int        i, j, d, d0 = 0;
-    float      sx, sy, cx, cy;
+    if (c->tree)
+	free (c->tree);
+    if (c->pos)
+	free (c->pos);
+    if (c->alive)
+	free (c->alive);
+    if (c->cx)
+	free (c->cx);
+    if (c->cy)
+	free (c->cy);
+    if (c->keys)
+	free (c->keys);
+    if (c->sid)
+	free (c->sid);
+    if (c->slots)
+	free (c->slots);
+    if (c->cells)
+	free (c->cells);
+    if (c->workAreas)
+	free (c->workAreas);
+
+    free (c);
+}
 
+static int
+scaleGetMultiOutputMode (CompScreen *s)
+{
     SCALE_SCREEN (s);
 
-    for (i = 0; i < ss->nWindows; i++)
+    /* if we have only one head, we don't need the
+       additional effort of the all outputs mode */
+    if (s->nOutputDev == 1)
+	return SCALE_MOMODE_CURRENT;
+
+    return ss->opt[SCALE_SCREEN_OPTION_MULTIOUTPUT_MODE].value.i;
+}
+
+static void
+scaleGetLayoutKey (CompWindow     *w,
+		   ScaleLayoutKey *key)
+{
+    key->id     = w->id;
+    key->x      = w->serverX;
+    key->y      = w->serverY;
+    key->width  = w->width;
+    key->height = w->height;
+    key->input  = w->input;
+}
+
+/* the grid and the assignment only depend on the window list, the
+   geometry of the listed windows and the work areas, so if none of
+   them changed the previous layout can be reused as is */
+static Bool
+scaleLayoutCacheValid (CompScreen *s)
+{
+    ScaleLayoutKey key;
+    int            i;
+
+    SCALE_SCREEN (s);
+
+    ScaleLayoutCache *c = ss->layoutCache;
+
+    if (!c->valid || c->nWindows != ss->nWindows)
+	return FALSE;
+
+    if (c->spacing != ss->opt[SCALE_SCREEN_OPTION_SPACING].value.i ||
+	c->moMode != scaleGetMultiOutputMode (s) ||
+	c->currentOutputDev != s->currentOutputDev ||
+	c->nOutputDev != s->nOutputDev)
+	return FALSE;
+
+    for (i = 0; i < s->nOutputDev; i++)
     {
-	w = ss->windows[i];
+	XRectangle *a = &c->workAreas[i];
+	XRectangle *b = &s->outputDev[i].workArea;
 
-	SCALE_WINDOW (w);
+	if (a->x != b->x || a->y != b->y ||
+	    a->width != b->width || a->height != b->height)
+	    return FALSE;
+    }
 
-	if (sw->slot)
-	    continue;
+    for (i = 0; i < ss->nWindows; i++)
+    {
+	scaleGetLayoutKey (ss->windows[i], &key);
+	if (memcmp (&key, &c->keys[i], sizeof (ScaleLayoutKey)))
+	    return FALSE;
+    }
 
-	sw->sid      = 0;
-	sw->distance = MAXSHORT;
+    return TRUE;
+}
 
-	for (j = 0; j < ss->nSlots; j++)
-	{
-	    if (!ss->slots[j].filled)
-	    {
-		sx = (ss->slots[j].x2 + ss->slots[j].x1) / 2;
-		sy = (ss->slots[j].y2 + ss->slots[j].y1) / 2;
+static void
+scaleStoreLayout (CompScreen *s)
+{
+    int i;
 
-		cx = w->serverX + w->width  / 2;
-		cy = w->serverY + w->height / 2;
+    SCALE_SCREEN (s);
 
-		cx -= sx;
-		cy -= sy;
+    ScaleLayoutCache *c = ss->layoutCache;
 
-		d = sqrt (cx * cx + cy * cy);
-		if (d0 + d < sw->distance)
-		{
-		    sw->sid      = j;
-		    sw->distance = d0 + d;
-		}
-	    }
+    c->valid = FALSE;
+
+    if (c->workAreasSize < s->nOutputDev)
+    {
+	c->workAreas = realloc (c->workAreas,
+				sizeof (XRectangle) * s->nOutputDev);
+	if (!c->workAreas)
+	{
+	    c->workAreasSize = 0;
+	    return;
 	}
 
-	d0 += sw->distance;
+	c->workAreasSize = s->nOutputDev;
+    }
+
+    for (i = 0; i < s->nOutputDev; i++)
+	c->workAreas[i] = s->outputDev[i].workArea;
+
+    for (i = 0; i < ss->nWindows; i++)
+    {
+	scaleGetLayoutKey (ss->windows[i], &c->keys[i]);
+	c->sid[i] = GET_SCALE_WINDOW (ss->windows[i], ss)->sid;
     }
+
+    memcpy (c->slots, ss->slots, sizeof (ScaleSlot) * ss->nSlots);
+
+    c->nWindows         = ss->nWindows;
+    c->nSlots           = ss->nSlots;
+    c->spacing          = ss->opt[SCALE_SCREEN_OPTION_SPACING].value.i;
+    c->moMode           = scaleGetMultiOutputMode (s);
+    c->currentOutputDev = s->currentOutputDev;
+    c->nOutputDev       = s->nOutputDev;
+    c->valid            = TRUE;
 }
 
-static Bool
-fillInWindows (CompScreen *s)
+static void
+scaleRestoreLayout (CompScreen *s)
 {
-    CompWindow *w;
-    int        i, width, height;
-    float      sx, sy, cx, cy;
+    int i;
 
     SCALE_SCREEN (s);
 
+    ScaleLayoutCache *c = ss->layoutCache;
+
+    memcpy (ss->slots, c->slots, sizeof (ScaleSlot) * c->nSlots);
+    ss->nSlots = c->nSlots;
+
     for (i = 0; i < ss->nWindows; i++)
     {
-	w = ss->windows[i];
+	SCALE_WINDOW (ss->windows[i]);
 
-	SCALE_WINDOW (w);
+	sw->sid  = c->sid[i];
+	sw->slot = &ss->slots[sw->sid];
 
-	if (!sw->slot)
+	sw->lastThumbOpacity = 0.0f;
+
+	sw->adjust = TRUE;
+    }
+}
+
+static inline int
+scaleSlotCoord (ScaleLayoutCache *c,
+		int              slot,
+		int              axis)
+{
+    return axis ? c->cy[slot] : c->cx[slot];
+}
+
+/* partially order tree[lo, hi) so that the slot at k has the median
+   coordinate along axis */
+static void
+scaleSelectSlot (ScaleLayoutCache *c,
+		 int              lo,
+		 int              hi,
+		 int              k,
+		 int              axis)
+{
+    int i, j, pivot, tmp;
+
+    hi--;
+
+    while (lo < hi)
+    {
+	pivot = scaleSlotCoord (c, c->tree[(lo + hi) / 2], axis);
+
+	i = lo;
+	j = hi;
+
+	while (i <= j)
 	{
-	    if (ss->slots[sw->sid].filled)
-		return TRUE;
+	    while (scaleSlotCoord (c, c->tree[i], axis) < pivot)
+		i++;
+	    while (scaleSlotCoord (c, c->tree[j], axis) > pivot)
+		j--;
 
-	    sw->slot = &ss->slots[sw->sid];
+	    if (i <= j)
+	    {
+		tmp = c->tree[i];
+		c->tree[i] = c->tree[j];
+		c->tree[j] = tmp;
 
-	    width  = w->width  + w->input.left + w->input.right;
-	    height = w->height + w->input.top  + w->input.bottom;
+		i++;
+		j--;
+	    }
+	}
 
-	    sx = (float) (sw->slot->x2 - sw->slot->x1) / width;
-	    sy = (float) (sw->slot->y2 - sw->slot->y1) / height;
+	if (k <= j)
+	    hi = j;
+	else if (k >= i)
+	    lo = i;
+	else
+	    break;
+    }
+}
 
-	    sw->slot->scale = MIN (MIN (sx, sy), 1.0f);
+static void
+scaleBuildSlotTree (ScaleLayoutCache *c,
+		    int              lo,
+		    int              hi,
+		    int              axis)
+{
+    int mid;
 
-	    sx = width  * sw->slot->scale;
-	    sy = height * sw->slot->scale;
-	    cx = (sw->slot->x1 + sw->slot->x2) / 2;
-	    cy = (sw->slot->y1 + sw->slot->y2) / 2;
+    if (lo >= hi)
+	return;
 
-	    cx += w->input.left * sw->slot->scale;
-	    cy += w->input.top  * sw->slot->scale;
+    mid = (lo + hi) / 2;
 
-	    sw->slot->x1 = cx - sx / 2;
-	    sw->slot->y1 = cy - sy / 2;
-	    sw->slot->x2 = cx + sx / 2;
-	    sw->slot->y2 = cy + sy / 2;
+    scaleSelectSlot (c, lo, hi, mid, axis);
 
-	    sw->slot->filled = TRUE;
+    c->alive[mid] = hi - lo;
 
-	    sw->lastThumbOpacity = 0.0f;
+    scaleBuildSlotTree (c, lo, mid, !axis);
+    scaleBuildSlotTree (c, mid + 1, hi, !axis);
+}
 
-	    sw->adjust = TRUE;
+static void
+scaleFindNearestSlot (ScaleScreen      *ss,
+		      int              lo,
+		      int              hi,
+		      int              axis,
+		      int              x,
+		      int              y,
+		      int              *best,
+		      int              *bestDistance)
+{
+    ScaleLayoutCache *c = ss->layoutCache;
+    int              mid, slot, d, diff;
+    float            dx, dy;
+
+    if (lo >= hi)
+	return;
+
+    mid = (lo + hi) / 2;
+    if (!c->alive[mid])
+	return;
+
+    slot = c->tree[mid];
+
+    if (!ss->slots[slot].filled)
+    {
+	dx = x - c->cx[slot];
+	dy = y - c->cy[slot];
+
+	d = sqrt (dx * dx + dy * dy);
+
+	/* prefer the lowest slot index on ties */
+	if (*best < 0 || d < *bestDistance ||
+	    (d == *bestDistance && slot < *best))
+	{
+	    *best         = slot;
+	    *bestDistance = d;
 	}
     }
 
-    return FALSE;
+    diff = (axis ? y : x) - scaleSlotCoord (c, slot, axis);
+
+    if (diff < 0)
+    {
+	scaleFindNearestSlot (ss, lo, mid, !axis, x, y, best, bestDistance);
+	if (*best < 0 || -diff <= *bestDistance)
+	    scaleFindNearestSlot (ss, mid + 1, hi, !axis, x, y,
+				  best, bestDistance);
+    }
+    else
+    {
+	scaleFindNearestSlot (ss, mid + 1, hi, !axis, x, y,
+			      best, bestDistance);
+	if (*best < 0 || diff <= *bestDistance)
+	    scaleFindNearestSlot (ss, lo, mid, !axis, x, y, best, bestDistance);
+    }
+}
+
+/* update the free slot counts on the path to slot */
+static void
+scaleCountSlot (ScaleLayoutCache *c,
+		int              nSlots,
+		int              slot,
+		int              count)
+{
+    int lo = 0, hi = nSlots, mid;
+    int i = c->pos[slot];
+
+    while (lo < hi)
+    {
+	mid = (lo + hi) / 2;
+
+	c->alive[mid] += count;
+
+	if (i == mid)
+	    break;
+	else if (i < mid)
+	    hi = mid;
+	else
+	    lo = mid + 1;
+    }
+}
+
+static void
+fillInWindow (CompWindow *w,
+	      ScaleSlot  *slot)
+{
+    int   width, height;
+    float sx, sy, cx, cy;
+
+    SCALE_WINDOW (w);
+
+    sw->slot = slot;
+
+    width  = w->width  + w->input.left + w->input.right;
+    height = w->height + w->input.top  + w->input.bottom;
+
+    sx = (float) (sw->slot->x2 - sw->slot->x1) / width;
+    sy = (float) (sw->slot->y2 - sw->slot->y1) / height;
+
+    sw->slot->scale = MIN (MIN (sx, sy), 1.0f);
+
+    sx = width  * sw->slot->scale;
+    sy = height * sw->slot->scale;
+    cx = (sw->slot->x1 + sw->slot->x2) / 2;
+    cy = (sw->slot->y1 + sw->slot->y2) / 2;
+
+    cx += w->input.left * sw->slot->scale;
+    cy += w->input.top  * sw->slot->scale;
+
+    sw->slot->x1 = cx - sx / 2;
+    sw->slot->y1 = cy - sy / 2;
+    sw->slot->x2 = cx + sx / 2;
+    sw->slot->y2 = cy + sy / 2;
+
+    sw->slot->filled = TRUE;
+
+    sw->lastThumbOpacity = 0.0f;
+
+    sw->adjust = TRUE;
+}
+
+/* give every window, top most first, the free slot closest to its
+   center; the nearest free slot is found through the k-d tree so the
+   whole assignment is O(n log n) for evenly spread slots */
+static void
+assignSlots (CompScreen *s)
+{
+    CompWindow *w;
+    int        i, best, bestDistance;
+
+    SCALE_SCREEN (s);
+
+    ScaleLayoutCache *c = ss->layoutCache;
+
+    if (!ss->nSlots)
+	return;
+
+    memcpy (c->cells, ss->slots, sizeof (ScaleSlot) * ss->nSlots);
+
+    for (i = 0; i < ss->nSlots; i++)
+    {
+	c->tree[i] = i;
+	c->cx[i]   = (ss->slots[i].x2 + ss->slots[i].x1) / 2;
+	c->cy[i]   = (ss->slots[i].y2 + ss->slots[i].y1) / 2;
+    }
+
+    scaleBuildSlotTree (c, 0, ss->nSlots, 0);
+
+    for (i = 0; i < ss->nSlots; i++)
+	c->pos[c->tree[i]] = i;
+
+    for (i = 0; i < ss->nWindows; i++)
+    {
+	w = ss->windows[i];
+
+	SCALE_WINDOW (w);
+
+	if (sw->slot)
+	    continue;
+
+	best = -1;
+	bestDistance = 0;
+
+	scaleFindNearestSlot (ss, 0, ss->nSlots, 0,
+			      w->serverX + w->width  / 2,
+			      w->serverY + w->height / 2,
+			      &best, &bestDistance);
+	if (best < 0)
+	    break;
+
+	sw->sid      = best;
+	sw->distance = bestDistance;
+
+	scaleCountSlot (c, ss->nSlots, best, -1);
+	fillInWindow (w, &ss->slots[best]);
+    }
 }
 
 static Bool
@@ -715,21 +1100,56 @@ layoutSlotsAndAssignWindows (CompScreen *s)
 {
     SCALE_SCREEN (s);
 
+    if (scaleLayoutCacheValid (s))
+    {
+	scaleRestoreLayout (s);
+	return TRUE;
+    }
+
+    if (!scaleEnsureLayoutCache (ss->layoutCache, ss->nWindows))
+	return FALSE;
+
     /* create a grid of slots */
     layoutSlots (s);
 
-    do
+    /* find most appropriate slots for windows */
+    assignSlots (s);
+
+    scaleStoreLayout (s);
+
+    return TRUE;
+}
+
+static Bool
+layoutWindows (CompScreen *s)
+{
+    int i;
+
+    SCALE_SCREEN (s);
+
+    for (i = 0; i < ss->nWindows; i++)
     {
-	/* find most appropriate slots for windows */
-	findBestSlots (s);
+	SCALE_WINDOW (ss->windows[i]);
 
-	/* sort windows, window with closest distance to a slot first */
-	qsort (ss->windows, ss->nWindows, sizeof (CompWindow *),
-	       compareWindowsDistance);
+	if (sw->slot)
+	    sw->adjust = TRUE;
 
-    } while (fillInWindows (s));
+	sw->slot = 0;
+    }
 
-    return TRUE;
+    if (ss->nWindows == 0)
+	return FALSE;
+
+    if (ss->slotsSize < ss->nWindows)
+    {
+	ss->slots = realloc (ss->slots, sizeof (ScaleSlot) * ss->nWindows);
+	if (!ss->slots)
+	    return FALSE;
+
+	ss->slotsSize = ss->nWindows;
+    }
+
+    return (*ss->layoutSlotsAndAssignWindows) (s);
 }
 
 static Bool
@@ -767,19 +1187,122 @@ layoutThumbs (CompScreen *s)
 	ss->windows[ss->nWindows++] = w;
     }
 
-    if (ss->nWindows == 0)
+    return layoutWindows (s);
+}
+
+/* windows can be added to or removed from the last layout of the
+   default implementation as long as it still describes the screen */
+static Bool
+layoutCanUpdate (CompScreen *s)
+{
+    SCALE_SCREEN (s);
+
+    if (ss->layoutSlotsAndAssignWindows != layoutSlotsAndAssignWindows)
 	return FALSE;
 
-    if (ss->slotsSize < ss->nWindows)
+    return ss->nSlots && scaleLayoutCacheValid (s);
+}
+
+/* add a newly mapped window to the current layout without walking
+   the whole stack and re-evaluating the window match, the window
+   takes the closest free slot if there is one */
+static Bool
+layoutAddWindow (CompWindow *w)
+{
+    CompWindow *above;
+    int        i, index = 0, best, bestDistance;
+    Bool       update;
+
+    SCALE_SCREEN (w->screen);
+    SCALE_WINDOW (w);
+
+    ScaleLayoutCache *c = ss->layoutCache;
+
+    for (i = 0; i < ss->nWindows; i++)
+	if (ss->windows[i] == w)
+	    return layoutWindows (w->screen);
+
+    update = layoutCanUpdate (w->screen) &&
+	c->alive[ss->nSlots / 2] > 0;
+
+    /* every window in the layout has a slot while scale is active */
+    for (above = w->next; above; above = above->next)
+	if (GET_SCALE_WINDOW (above, ss)->slot)
+	    index++;
+
+    if (ss->windowsSize <= ss->nWindows)
     {
-	ss->slots = realloc (ss->slots, sizeof (ScaleSlot) * ss->nWindows);
-	if (!ss->slots)
+	ss->windows = realloc (ss->windows,
+			       sizeof (CompWindow *) * (ss->nWindows + 32));
+	if (!ss->windows)
 	    return FALSE;
 
-	ss->slotsSize = ss->nWindows;
+	ss->windowsSize = ss->nWindows + 32;
     }
 
-    return (*ss->layoutSlotsAndAssignWindows) (s);
+    memmove (ss->windows + index + 1, ss->windows + index,
+	     sizeof (CompWindow *) * (ss->nWindows - index));
+    ss->windows[index] = w;
+    ss->nWindows++;
+
+    if (!update || !scaleEnsureLayoutCache (c, ss->nWindows))
+	return layoutWindows (w->screen);
+
+    best = -1;
+    bestDistance = 0;
+
+    scaleFindNearestSlot (ss, 0, ss->nSlots, 0,
+			  w->serverX + w->width  / 2,
+			  w->serverY + w->height / 2,
+			  &best, &bestDistance);
+    if (best < 0)
+	return layoutWindows (w->screen);
+
+    sw->sid      = best;
+    sw->distance = bestDistance;
+
+    scaleCountSlot (c, ss->nSlots, best, -1);
+    fillInWindow (w, &ss->slots[best]);
+
+    scaleStoreLayout (w->screen);
+
+    return TRUE;
+}
+
+/* remove a window from the current layout, the other windows keep
+   their slots and the slot of the window is free for the next one */
+static Bool
+layoutRemoveWindow (CompWindow *w,
+		    int        index)
+{
+    Bool update;
+
+    SCALE_SCREEN (w->screen);
+    SCALE_WINDOW (w);
+
+    ScaleLayoutCache *c = ss->layoutCache;
+
+    update = sw->slot && layoutCanUpdate (w->screen);
+
+    ss->nWindows--;
+    memmove (ss->windows + index, ss->windows + index + 1,
+	     sizeof (CompWindow *) * (ss->nWindows - index));
+
+    if (sw->slot)
+    {
+	sw->slot   = 0;
+	sw->adjust = TRUE;
+    }
+
+    if (!update || !ss->nWindows)
+	return layoutWindows (w->screen);
+
+    ss->slots[sw->sid] = c->cells[sw->sid];
+    scaleCountSlot (c, ss->nSlots, sw->sid, 1);
+
+    scaleStoreLayout (w->screen);
+
+    return TRUE;
 }
 
 static int
@@ -1554,7 +2077,7 @@ scaleWindowRemove (CompDisplay *d,
 	    {
 		if (ss->windows[i] == w)
 		{
-		    if (layoutThumbs (w->screen))
+		    if (layoutRemoveWindow (w, i))
 		    {
 			ss->state = SCALE_STATE_OUT;
 			damageScreen (w->screen);
@@ -1877,7 +2400,14 @@ scaleDamageWindowRect (CompWindow *w,
     {
 	if (ss->grab && isScaleWin (w))
 	{
-	    if (layoutThumbs (w->screen))
+	    Bool relayout;
+
+	    if (ss->state == SCALE_STATE_OUT || ss->state == SCALE_STATE_WAIT)
+		relayout = layoutAddWindow (w);
+	    else
+		relayout = layoutThumbs (w->screen);
+
+	    if (relayout)
 	    {
 		ss->state = SCALE_STATE_OUT;
 		damageScreen (w->screen);
@@ -2067,9 +2597,18 @@ scaleInitScreen (CompPlugin *p,
 	return FALSE;
     }
 
+    ss->layoutCache = calloc (1, sizeof (ScaleLayoutCache));
+    if (!ss->layoutCache)
+    {
+	compFiniScreenOptions (s, ss->opt, SCALE_SCREEN_OPTION_NUM);
+	free (ss);
+	return FALSE;
+    }
+
     ss->windowPrivateIndex = allocateWindowPrivateIndex (s);
     if (ss->windowPrivateIndex < 0)
     {
+	free (ss->layoutCache);
 	compFiniScreenOptions (s, ss->opt, SCALE_SCREEN_OPTION_NUM);
 	free (ss);
 	return FALSE;
@@ -2139,6 +2678,8 @@ scaleFiniScreen (CompPlugin *p,
     if (ss->windows)
 	free (ss->windows);
 
+    scaleFreeLayoutCache (ss->layoutCache);
+
     freeWindowPrivateIndex (s, ss->windowPrivateIndex);
 
     compFiniScreenOptions (s, ss->opt, SCALE_SCREEN_OPTION_NUM);
@@ -27,7 +27,19 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <png.h>
 
 #include <compiz-core.h>
 
@@ -38,15 +50,151 @@ static int displayPrivateIndex;
 #define SHOT_DISPLAY_OPTION_INITIATE_BUTTON 0
 #define SHOT_DISPLAY_OPTION_DIR             1
 #define SHOT_DISPLAY_OPTION_LAUNCH_APP      2
-#define SHOT_DISPLAY_OPTION_NUM             3
+#define SHOT_DISPLAY_OPTION_RECORD_KEY      3
+#define SHOT_DISPLAY_OPTION_RECORD_OUTPUTS  4
+#define SHOT_DISPLAY_OPTION_RECORD_INTERVAL 5
+#define SHOT_DISPLAY_OPTION_RECORD_TARGET   6
+#define SHOT_DISPLAY_OPTION_NUM             7
 
 #define MAX_LINE_LENGTH 1024
 
+/* ms between reading pixels into a buffer object and mapping it */
+#define SHOT_MAP_DELAY 10
+
+/* number of buffer objects recorded frames are read into */
+#define SHOT_RECORD_SLOTS 8
+
+/* ms to wait for the recorder thread to stream the remaining frames
+   when recording stops, a stalled socket reader is cut off after it */
+#define SHOT_RECORD_STOP_TIMEOUT 1000
+
+/* ns to wait for pending reads when recording stops */
+#define SHOT_RECORD_SYNC_TIMEOUT 100000000
+
+/* record target prefix for streaming to a local socket */
+#define SHOT_RECORD_SOCKET_PREFIX "unix:"
+
+#define SHOT_RECORD_OUTPUT_SCREEN 0xffffffff
+
+typedef void (*GLGenBuffersProc) (GLsizei n,
+				  GLuint  *buffers);
+typedef void (*GLDeleteBuffersProc) (GLsizei	  n,
+				     const GLuint *buffers);
+typedef void (*GLBindBufferProc) (GLenum target,
+				  GLuint buffer);
+typedef void (*GLBufferDataProc) (GLenum	 target,
+				  GLsizeiptr	 size,
+				  const GLvoid	 *data,
+				  GLenum	 usage);
+typedef GLvoid *(*GLMapBufferProc) (GLenum target,
+				    GLenum access);
+typedef GLboolean (*GLUnmapBufferProc) (GLenum target);
+typedef GLsync (*GLFenceSyncProc) (GLenum     condition,
+				   GLbitfield flags);
+typedef GLenum (*GLClientWaitSyncProc) (GLsync	   sync,
+					GLbitfield flags,
+					GLuint64   timeout);
+typedef void (*GLDeleteSyncProc) (GLsync sync);
+
+/* screenshot to be written by the writer thread, buffer is either
+   allocated or the mapped buffer object pbo, which is unmapped on the
+   compositor thread once the image was written */
+typedef struct _ShotImage {
+    struct _ShotImage *next;
+
+    int	    screenNum;
+    char    *dir;
+    char    *name;
+    char    *app;
+    int	    width;
+    int	    height;
+    GLuint  pbo;
+    GLubyte *buffer;
+    Bool    status;
+} ShotImage;
+
+typedef struct _ShotWriter {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    pthread_t	    thread;
+
+    ShotImage	*queue;
+    ShotImage	*done;
+    int		nActive;
+    Bool	quit;
+
+    CompTimeoutHandle handle;
+} ShotWriter;
+
+/* Header written in front of each recorded frame. It is followed by
+   width * height * 4 bytes of RGBA pixels, bottom row first. All fields
+   are in host byte order. */
+typedef struct _ShotFrameHeader {
+    char     magic[4];	/* "CSFR" */
+    uint32_t output;	/* output number or SHOT_RECORD_OUTPUT_SCREEN */
+    uint64_t time;	/* capture time in microseconds */
+    int32_t  x;
+    int32_t  y;
+    uint32_t width;
+    uint32_t height;
+    uint32_t sequence;	/* number of the captured frame */
+    uint32_t dropped;	/* frames dropped since recording started */
+} ShotFrameHeader;
+
+typedef enum {
+    ShotSlotFree = 0,
+    ShotSlotReading,
+    ShotSlotStreaming
+} ShotSlotState;
+
+/* Buffer object a recorded frame is read into. The buffer stays mapped
+   while the recorder thread streams it so the pixels are never copied
+   on the compositor thread. */
+typedef struct _ShotRecordSlot {
+    struct _ShotRecordSlot *next;
+
+    ShotSlotState   state;
+    GLuint	    pbo;
+    GLsync	    fence;
+    GLvoid	    *data;
+    ShotFrameHeader header;
+
+    /* set by the recorder thread once the frame has been streamed */
+    Bool written;
+} ShotRecordSlot;
+
+typedef struct _ShotRecorder {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    pthread_t	    thread;
+
+    int		   fd;
+    Bool	   socket;
+    ShotRecordSlot *queue;
+    Bool	   failed;
+    Bool	   quit;
+    Bool	   done;
+
+    ShotRecordSlot slot[SHOT_RECORD_SLOTS];
+
+    unsigned int frame;
+    unsigned int sequence;
+    unsigned int dropped;
+
+    CompTimeoutHandle handle;
+} ShotRecorder;
+
 typedef struct _ShotDisplay {
     int		    screenPrivateIndex;
     HandleEventProc handleEvent;
 
     CompOption opt[SHOT_DISPLAY_OPTION_NUM];
+
+    ShotWriter writer;
+
+    /* directory and highest screenshot number found in it */
+    char *lastDir;
+    int  lastNumber;
 } ShotDisplay;
 
 typedef struct _ShotScreen {
@@ -56,6 +204,26 @@ typedef struct _ShotScreen {
 
     int  x1, y1, x2, y2;
     Bool grab;
+
+    GLGenBuffersProc    genBuffers;
+    GLDeleteBuffersProc deleteBuffers;
+    GLBindBufferProc    bindBuffer;
+    GLBufferDataProc    bufferData;
+    GLMapBufferProc     mapBuffer;
+    GLUnmapBufferProc   unmapBuffer;
+
+    /* NULL if sync objects are not supported */
+    GLFenceSyncProc	 fenceSync;
+    GLClientWaitSyncProc clientWaitSync;
+    GLDeleteSyncProc	 deleteSync;
+
+    /* screenshots are read into pixel buffer objects if supported */
+    Bool	      pbo;
+    ShotImage	      *pendingImage;
+    CompTimeoutHandle mapHandle;
+
+    /* active recording, NULL when not recording */
+    ShotRecorder *recorder;
 } ShotScreen;
 
 #define GET_SHOT_DISPLAY(d)					  \
@@ -291,6 +459,1083 @@ shotGetXDGDesktopDir (void)
     return NULL;
 }
 
+/* Returns the directory screenshots are put in, the returned string
+   must be freed */
+static char *
+shotGetDirectory (CompDisplay *d)
+{
+    char *dir;
+
+    SHOT_DISPLAY (d);
+
+    dir = sd->opt[SHOT_DISPLAY_OPTION_DIR].value.s;
+    if (strlen (dir) == 0)
+    {
+	// If dir is empty, use user's desktop directory instead
+	dir = shotGetXDGDesktopDir ();
+	if (dir)
+	    return dir;
+
+	dir = "";
+    }
+
+    return strdup (dir);
+}
+
+static void
+shotFreeImage (ShotImage *image)
+{
+    if (image->buffer && !image->pbo)
+	free (image->buffer);
+
+    free (image->dir);
+    free (image->name);
+    free (image->app);
+    free (image);
+}
+
+/* Encodes the image with libpng instead of going through the
+   imageToFile hook chain, which must only be called from the
+   compositor thread. GL rows are bottom to top. */
+static Bool
+shotWritePng (ShotImage *image)
+{
+    png_struct	 *png;
+    png_info	 *info;
+    png_byte	 **rows;
+    char	 *path;
+    FILE	 *fp;
+    Bool	 status = FALSE;
+    int		 i;
+
+    if (asprintf (&path, "%s/%s", image->dir, image->name) < 0)
+	return FALSE;
+
+    fp = fopen (path, "wb");
+    free (path);
+    if (!fp)
+	return FALSE;
+
+    rows = malloc (image->height * sizeof (png_byte *));
+    if (!rows)
+    {
+	fclose (fp);
+	return FALSE;
+    }
+
+    for (i = 0; i < image->height; i++)
+	rows[image->height - i - 1] = image->buffer + i * image->width * 4;
+
+    png = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    info = png ? png_create_info_struct (png) : NULL;
+
+    if (info && !setjmp (png_jmpbuf (png)))
+    {
+	png_init_io (png, fp);
+
+	png_set_IHDR (png, info,
+		      image->width, image->height, 8,
+		      PNG_COLOR_TYPE_RGB_ALPHA,
+		      PNG_INTERLACE_NONE,
+		      PNG_COMPRESSION_TYPE_DEFAULT,
+		      PNG_FILTER_TYPE_DEFAULT);
+
+	png_write_info (png, info);
+	png_write_image (png, rows);
+	png_write_end (png, info);
+
+	status = TRUE;
+    }
+
+    if (png)
+	png_destroy_write_struct (&png, info ? &info : NULL);
+
+    free (rows);
+
+    if (fclose (fp))
+	status = FALSE;
+
+    return status;
+}
+
+static void *
+shotWriterThread (void *closure)
+{
+    ShotWriter *w = (ShotWriter *) closure;
+    ShotImage  *image;
+
+    pthread_mutex_lock (&w->mutex);
+
+    for (;;)
+    {
+	while (!w->queue && !w->quit)
+	    pthread_cond_wait (&w->cond, &w->mutex);
+
+	/* queued images are written before quitting */
+	image = w->queue;
+	if (!image)
+	    break;
+
+	w->queue = image->next;
+
+	pthread_mutex_unlock (&w->mutex);
+
+	image->status = shotWritePng (image);
+
+	pthread_mutex_lock (&w->mutex);
+
+	image->next = w->done;
+	w->done = image;
+
+	w->nActive--;
+
+	pthread_cond_broadcast (&w->cond);
+    }
+
+    pthread_mutex_unlock (&w->mutex);
+
+    return NULL;
+}
+
+/* Reports written screenshots and launches the viewer application */
+static void
+shotProcessWrittenImages (CompDisplay *d)
+{
+    ShotImage  *image, *next;
+    CompScreen *s;
+
+    SHOT_DISPLAY (d);
+
+    pthread_mutex_lock (&sd->writer.mutex);
+    image = sd->writer.done;
+    sd->writer.done = NULL;
+    pthread_mutex_unlock (&sd->writer.mutex);
+
+    for (; image; image = next)
+    {
+	next = image->next;
+
+	for (s = d->screens; s; s = s->next)
+	    if (s->screenNum == image->screenNum)
+		break;
+
+	if (s && image->pbo)
+	{
+	    SHOT_SCREEN (s);
+
+	    makeScreenCurrent (s);
+
+	    (*ss->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, image->pbo);
+	    (*ss->unmapBuffer) (GL_PIXEL_PACK_BUFFER_ARB);
+	    (*ss->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+	    (*ss->deleteBuffers) (1, &image->pbo);
+
+	    image->pbo	  = 0;
+	    image->buffer = NULL;
+	}
+
+	if (!image->status)
+	{
+	    compLogMessage ("screenshot", CompLogLevelError,
+			    "failed to write screenshot image");
+	}
+	else if (s && *image->app != '\0')
+	{
+	    char *command;
+
+	    command = malloc (strlen (image->app) +
+			      strlen (image->dir) +
+			      strlen (image->name) + 3);
+	    if (command)
+	    {
+		sprintf (command, "%s %s/%s",
+			 image->app, image->dir, image->name);
+
+		runCommand (s, command);
+
+		free (command);
+	    }
+	}
+
+	shotFreeImage (image);
+    }
+}
+
+static Bool
+shotWriterTimeout (void *closure)
+{
+    CompDisplay *d = (CompDisplay *) closure;
+    Bool	active;
+
+    SHOT_DISPLAY (d);
+
+    shotProcessWrittenImages (d);
+
+    pthread_mutex_lock (&sd->writer.mutex);
+    active = sd->writer.nActive > 0 || sd->writer.done;
+    pthread_mutex_unlock (&sd->writer.mutex);
+
+    if (!active)
+	sd->writer.handle = 0;
+
+    return active;
+}
+
+static void
+shotQueueImage (CompDisplay *d,
+		ShotImage   *image)
+{
+    ShotImage **last;
+
+    SHOT_DISPLAY (d);
+
+    image->next = NULL;
+
+    pthread_mutex_lock (&sd->writer.mutex);
+
+    for (last = &sd->writer.queue; *last; last = &(*last)->next);
+    *last = image;
+
+    sd->writer.nActive++;
+
+    pthread_cond_broadcast (&sd->writer.cond);
+    pthread_mutex_unlock (&sd->writer.mutex);
+
+    if (!sd->writer.handle)
+	sd->writer.handle = compAddTimeout (50, 100, shotWriterTimeout, d);
+}
+
+/* Waits for all queued screenshots to be written */
+static void
+shotSyncImages (CompDisplay *d)
+{
+    SHOT_DISPLAY (d);
+
+    pthread_mutex_lock (&sd->writer.mutex);
+    while (sd->writer.nActive)
+	pthread_cond_wait (&sd->writer.cond, &sd->writer.mutex);
+    pthread_mutex_unlock (&sd->writer.mutex);
+
+    shotProcessWrittenImages (d);
+}
+
+/* Returns the number for the next screenshot in dir, the directory is
+   only scanned when it changed since the last screenshot. */
+static int
+shotGetNextNumber (CompDisplay *d,
+		   const char  *dir)
+{
+    struct stat st;
+    char	*path;
+    int		exists;
+
+    SHOT_DISPLAY (d);
+
+    if (!sd->lastDir || strcmp (sd->lastDir, dir) != 0)
+    {
+	struct dirent **namelist;
+	int	      n, number = 0;
+
+	n = scandir (dir, &namelist, shotFilter, shotSort);
+	if (n < 0)
+	{
+	    perror (dir);
+	    return -1;
+	}
+
+	if (n > 0)
+	    sscanf (namelist[n - 1]->d_name, "screenshot%d.png", &number);
+
+	while (n--)
+	    free (namelist[n]);
+	free (namelist);
+
+	if (sd->lastDir)
+	    free (sd->lastDir);
+
+	sd->lastDir    = strdup (dir);
+	sd->lastNumber = number;
+    }
+
+    /* files might have been added behind our back */
+    do
+    {
+	sd->lastNumber++;
+
+	if (asprintf (&path, "%s/screenshot%d.png", dir, sd->lastNumber) < 0)
+	    return -1;
+
+	exists = stat (path, &st) == 0;
+
+	free (path);
+    } while (exists);
+
+    return sd->lastNumber;
+}
+
+static ShotImage *
+shotCreateImage (CompScreen *s,
+		 const char *dir,
+		 int	    width,
+		 int	    height)
+{
+    ShotImage *image;
+    int	      number;
+
+    SHOT_DISPLAY (s->display);
+
+    number = shotGetNextNumber (s->display, dir);
+    if (number < 0)
+	return NULL;
+
+    image = malloc (sizeof (ShotImage));
+    if (!image)
+	return NULL;
+
+    image->next      = NULL;
+    image->screenNum = s->screenNum;
+    image->width     = width;
+    image->height    = height;
+    image->pbo	     = 0;
+    image->buffer    = NULL;
+    image->status    = FALSE;
+    image->dir	     = strdup (dir);
+    image->app	     = strdup (sd->opt[SHOT_DISPLAY_OPTION_LAUNCH_APP].value.s);
+
+    if (asprintf (&image->name, "screenshot%d.png", number) < 0)
+	image->name = NULL;
+
+    if (!image->dir || !image->app || !image->name)
+    {
+	if (image->dir)
+	    free (image->dir);
+	if (image->app)
+	    free (image->app);
+	if (image->name)
+	    free (image->name);
+	free (image);
+
+	return NULL;
+    }
+
+    return image;
+}
+
+/* Maps the buffer object of the pending screenshot and hands it to the
+   writer thread, it stays mapped until the image has been written */
+static void
+shotMapPendingImage (CompScreen *s)
+{
+    ShotImage *image;
+
+    SHOT_SCREEN (s);
+
+    image = ss->pendingImage;
+    ss->pendingImage = NULL;
+
+    if (ss->mapHandle)
+    {
+	compRemoveTimeout (ss->mapHandle);
+	ss->mapHandle = 0;
+    }
+
+    if (!image)
+	return;
+
+    (*ss->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, image->pbo);
+    image->buffer = (*ss->mapBuffer) (GL_PIXEL_PACK_BUFFER_ARB,
+				      GL_READ_ONLY_ARB);
+    (*ss->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    if (image->buffer)
+    {
+	shotQueueImage (s->display, image);
+    }
+    else
+    {
+	compLogMessage ("screenshot", CompLogLevelError,
+			"failed to read screenshot image");
+
+	(*ss->deleteBuffers) (1, &image->pbo);
+	image->pbo = 0;
+
+	shotFreeImage (image);
+    }
+}
+
+static Bool
+shotMapTimeout (void *closure)
+{
+    CompScreen *s = (CompScreen *) closure;
+
+    SHOT_SCREEN (s);
+
+    ss->mapHandle = 0;
+
+    makeScreenCurrent (s);
+    shotMapPendingImage (s);
+
+    return FALSE;
+}
+
+/* Reads the screenshot pixels, into a buffer object when possible so
+   that the read doesn't stall until the buffer is mapped */
+static void
+shotReadImage (CompScreen *s,
+	       ShotImage  *image,
+	       int	  x,
+	       int	  y)
+{
+    SHOT_SCREEN (s);
+
+    if (ss->pbo)
+    {
+	if (ss->pendingImage)
+	    shotMapPendingImage (s);
+
+	/* a buffer object per screenshot, the previous one might
+	   still be mapped by the writer thread */
+	(*ss->genBuffers) (1, &image->pbo);
+
+	(*ss->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, image->pbo);
+	(*ss->bufferData) (GL_PIXEL_PACK_BUFFER_ARB,
+			   sizeof (GLubyte) * image->width * image->height * 4,
+			   NULL, GL_STREAM_READ_ARB);
+
+	glReadPixels (x, y, image->width, image->height,
+		      GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	(*ss->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+	ss->pendingImage = image;
+	ss->mapHandle	 = compAddTimeout (SHOT_MAP_DELAY, SHOT_MAP_DELAY * 2,
+					   shotMapTimeout, s);
+    }
+    else
+    {
+	image->buffer = malloc (sizeof (GLubyte) *
+				image->width * image->height * 4);
+	if (!image->buffer)
+	{
+	    shotFreeImage (image);
+	    return;
+	}
+
+	glReadPixels (x, y, image->width, image->height,
+		      GL_RGBA, GL_UNSIGNED_BYTE,
+		      (GLvoid *) image->buffer);
+
+	shotQueueImage (s->display, image);
+    }
+}
+
+/* Opens the file or local socket recorded frames are streamed to */
+static int
+shotOpenRecordTarget (CompDisplay *d,
+		      Bool	  *isSocket)
+{
+    const char *target;
+    char       *path;
+    size_t     prefixLength = strlen (SHOT_RECORD_SOCKET_PREFIX);
+    int	       fd;
+
+    SHOT_DISPLAY (d);
+
+    target = sd->opt[SHOT_DISPLAY_OPTION_RECORD_TARGET].value.s;
+
+    if (strncmp (target, SHOT_RECORD_SOCKET_PREFIX, prefixLength) == 0)
+    {
+	struct sockaddr_un addr;
+
+	*isSocket = TRUE;
+
+	target += prefixLength;
+	if (strlen (target) >= sizeof (addr.sun_path))
+	{
+	    compLogMessage ("screenshot", CompLogLevelError,
+			    "record socket path too long: %s", target);
+	    return -1;
+	}
+
+	fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+	    compLogMessage ("screenshot", CompLogLevelError,
+			    "failed to create record socket: %s",
+			    strerror (errno));
+	    return -1;
+	}
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strcpy (addr.sun_path, target);
+
+	if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0)
+	{
+	    compLogMessage ("screenshot", CompLogLevelError,
+			    "failed to connect to %s: %s",
+			    target, strerror (errno));
+	    close (fd);
+	    return -1;
+	}
+
+	return fd;
+    }
+
+    *isSocket = FALSE;
+
+    if (strlen (target))
+    {
+	path = strdup (target);
+    }
+    else
+    {
+	char *dir;
+
+	dir = shotGetDirectory (d);
+	if (!dir)
+	    return -1;
+
+	if (asprintf (&path, "%s/recording.raw", dir) < 0)
+	    path = NULL;
+
+	free (dir);
+    }
+
+    if (!path)
+	return -1;
+
+    fd = open (path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+	compLogMessage ("screenshot", CompLogLevelError,
+			"failed to open %s: %s", path, strerror (errno));
+
+    free (path);
+
+    return fd;
+}
+
+static Bool
+shotRecordWrite (ShotRecorder *r,
+		 const void   *data,
+		 size_t	      size)
+{
+    const char *p = (const char *) data;
+    ssize_t    n;
+
+    while (size)
+    {
+	/* a reader going away must not raise SIGPIPE */
+	if (r->socket)
+	    n = send (r->fd, p, size, MSG_NOSIGNAL);
+	else
+	    n = write (r->fd, p, size);
+
+	if (n < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+
+	    return FALSE;
+	}
+
+	p    += n;
+	size -= n;
+    }
+
+    return TRUE;
+}
+
+static void *
+shotRecorderThread (void *closure)
+{
+    ShotRecorder   *r = (ShotRecorder *) closure;
+    ShotRecordSlot *slot;
+    size_t	   size;
+    Bool	   failed = FALSE;
+
+    pthread_mutex_lock (&r->mutex);
+
+    for (;;)
+    {
+	while (!r->queue && !r->quit)
+	    pthread_cond_wait (&r->cond, &r->mutex);
+
+	/* queued frames are streamed before quitting */
+	slot = r->queue;
+	if (!slot)
+	    break;
+
+	r->queue = slot->next;
+
+	pthread_mutex_unlock (&r->mutex);
+
+	/* stream straight from the mapped buffer object */
+	if (!failed)
+	{
+	    size = (size_t) slot->header.width * slot->header.height * 4;
+
+	    failed = !shotRecordWrite (r, &slot->header,
+				       sizeof (ShotFrameHeader)) ||
+		     !shotRecordWrite (r, slot->data, size);
+	}
+
+	pthread_mutex_lock (&r->mutex);
+
+	slot->written = TRUE;
+
+	if (failed)
+	    r->failed = TRUE;
+    }
+
+    r->done = TRUE;
+
+    pthread_cond_broadcast (&r->cond);
+    pthread_mutex_unlock (&r->mutex);
+
+    return NULL;
+}
+
+/* Unmaps buffer objects the recorder thread is done with and hands
+   frames whose pixels have been read to it. Buffer objects are only
+   mapped once the fence after their read has signaled, so mapping never
+   stalls, unless wait is TRUE. Returns TRUE while frames are still in
+   flight. */
+static Bool
+shotProcessRecordSlots (CompScreen *s,
+			Bool	   wait)
+{
+    ShotRecorder   *r;
+    ShotRecordSlot *slot, *queue = NULL, **last = &queue;
+    Bool	   written[SHOT_RECORD_SLOTS];
+    Bool	   busy = FALSE;
+    int		   i;
+
+    SHOT_SCREEN (s);
+
+    r = ss->recorder;
+
+    pthread_mutex_lock (&r->mutex);
+    for (i = 0; i < SHOT_RECORD_SLOTS; i++)
+	written[i] = r->slot[i].state == ShotSlotStreaming &&
+		     r->slot[i].written;
+    pthread_mutex_unlock (&r->mutex);
+
+    for (i = 0; i < SHOT_RECORD_SLOTS; i++)
+    {
+	slot = &r->slot[i];
+
+	if (written[i])
+	{
+	    (*ss->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, slot->pbo);
+	    (*ss->unmapBuffer) (GL_PIXEL_PACK_BUFFER_ARB);
+
+	    slot->data  = NULL;
+	    slot->state = ShotSlotFree;
+	}
+    }
+
+    /* hand frames to the recorder thread in capture order */
+    for (;;)
+    {
+	slot = NULL;
+
+	for (i = 0; i < SHOT_RECORD_SLOTS; i++)
+	{
+	    if (r->slot[i].state != ShotSlotReading)
+		continue;
+
+	    if (!slot || (int) (r->slot[i].header.sequence -
+				slot->header.sequence) < 0)
+		slot = &r->slot[i];
+	}
+
+	if (!slot)
+	    break;
+
+	if (slot->fence)
+	{
+	    GLenum status;
+
+	    if (wait)
+		status = (*ss->clientWaitSync) (slot->fence,
+						GL_SYNC_FLUSH_COMMANDS_BIT,
+						SHOT_RECORD_SYNC_TIMEOUT);
+	    else
+		status = (*ss->clientWaitSync) (slot->fence, 0, 0);
+
+	    /* later frames are not handed over before this one */
+	    if (status == GL_TIMEOUT_EXPIRED)
+		break;
+
+	    (*ss->deleteSync) (slot->fence);
+	    slot->fence = NULL;
+
+	    if (status == GL_WAIT_FAILED)
+	    {
+		slot->state = ShotSlotFree;
+		r->dropped++;
+		continue;
+	    }
+	}
+
+	(*ss->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, slot->pbo);
+
+	slot->data = (*ss->mapBuffer) (GL_PIXEL_PACK_BUFFER_ARB,
+				       GL_READ_ONLY_ARB);
+	if (!slot->data)
+	{
+	    slot->state = ShotSlotFree;
+	    r->dropped++;
+	    continue;
+	}
+
+	slot->state   = ShotSlotStreaming;
+	slot->written = FALSE;
+	slot->next    = NULL;
+
+	*last = slot;
+	last  = &slot->next;
+    }
+
+    (*ss->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    if (queue)
+    {
+	pthread_mutex_lock (&r->mutex);
+
+	for (last = &r->queue; *last; last = &(*last)->next);
+	*last = queue;
+
+	pthread_cond_broadcast (&r->cond);
+	pthread_mutex_unlock (&r->mutex);
+    }
+
+    for (i = 0; i < SHOT_RECORD_SLOTS; i++)
+	if (r->slot[i].state != ShotSlotFree)
+	    busy = TRUE;
+
+    return busy;
+}
+
+static Bool
+shotRecordTimeout (void *closure)
+{
+    CompScreen *s = (CompScreen *) closure;
+    Bool       busy;
+
+    SHOT_SCREEN (s);
+
+    makeScreenCurrent (s);
+
+    busy = shotProcessRecordSlots (s, FALSE);
+    if (!busy)
+	ss->recorder->handle = 0;
+
+    return busy;
+}
+
+static Bool
+shotStartRecording (CompScreen *s)
+{
+    ShotRecorder *r;
+    int		 i;
+
+    SHOT_SCREEN (s);
+
+    if (!ss->pbo)
+    {
+	compLogMessage ("screenshot", CompLogLevelWarn,
+			"recording requires pixel buffer objects");
+	return FALSE;
+    }
+
+    r = malloc (sizeof (ShotRecorder));
+    if (!r)
+	return FALSE;
+
+    r->fd = shotOpenRecordTarget (s->display, &r->socket);
+    if (r->fd < 0)
+    {
+	free (r);
+	return FALSE;
+    }
+
+    r->queue    = NULL;
+    r->failed   = FALSE;
+    r->quit     = FALSE;
+    r->done     = FALSE;
+    r->frame    = 0;
+    r->sequence = 0;
+    r->dropped  = 0;
+    r->handle   = 0;
+
+    pthread_mutex_init (&r->mutex, NULL);
+    pthread_cond_init (&r->cond, NULL);
+
+    if (pthread_create (&r->thread, NULL, shotRecorderThread, r))
+    {
+	pthread_cond_destroy (&r->cond);
+	pthread_mutex_destroy (&r->mutex);
+	close (r->fd);
+	free (r);
+	return FALSE;
+    }
+
+    makeScreenCurrent (s);
+
+    for (i = 0; i < SHOT_RECORD_SLOTS; i++)
+    {
+	r->slot[i].next    = NULL;
+	r->slot[i].state   = ShotSlotFree;
+	r->slot[i].written = FALSE;
+	r->slot[i].fence   = NULL;
+	r->slot[i].data    = NULL;
+
+	(*ss->genBuffers) (1, &r->slot[i].pbo);
+    }
+
+    ss->recorder = r;
+
+    damageScreen (s);
+
+    return TRUE;
+}
+
+static void
+shotStopRecording (CompScreen *s)
+{
+    ShotRecorder    *r;
+    struct timespec timeout;
+    int		    i;
+
+    SHOT_SCREEN (s);
+
+    r = ss->recorder;
+
+    makeScreenCurrent (s);
+
+    /* frames that have been read are still streamed */
+    shotProcessRecordSlots (s, TRUE);
+
+    clock_gettime (CLOCK_REALTIME, &timeout);
+    timeout.tv_sec  += SHOT_RECORD_STOP_TIMEOUT / 1000;
+    timeout.tv_nsec += (SHOT_RECORD_STOP_TIMEOUT % 1000) * 1000000;
+    if (timeout.tv_nsec >= 1000000000)
+    {
+	timeout.tv_sec++;
+	timeout.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock (&r->mutex);
+
+    r->quit = TRUE;
+    pthread_cond_broadcast (&r->cond);
+
+    while (!r->done)
+	if (pthread_cond_timedwait (&r->cond, &r->mutex, &timeout))
+	    break;
+
+    pthread_mutex_unlock (&r->mutex);
+
+    /* a reader that stopped reading blocks send, shutting the socket
+       down makes it fail so that the thread can be joined */
+    if (!r->done && r->socket)
+	shutdown (r->fd, SHUT_RDWR);
+
+    pthread_join (r->thread, NULL);
+
+    for (i = 0; i < SHOT_RECORD_SLOTS; i++)
+    {
+	if (r->slot[i].state == ShotSlotStreaming)
+	{
+	    (*ss->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, r->slot[i].pbo);
+	    (*ss->unmapBuffer) (GL_PIXEL_PACK_BUFFER_ARB);
+	}
+
+	if (r->slot[i].fence)
+	    (*ss->deleteSync) (r->slot[i].fence);
+
+	(*ss->deleteBuffers) (1, &r->slot[i].pbo);
+    }
+
+    (*ss->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    if (r->handle)
+	compRemoveTimeout (r->handle);
+
+    close (r->fd);
+
+    if (r->failed)
+	compLogMessage ("screenshot", CompLogLevelError,
+			"failed to stream recorded frames");
+
+    compLogMessage ("screenshot", CompLogLevelInfo,
+		    "recorded %u frames, %u output frames dropped",
+		    r->sequence, r->dropped);
+
+    pthread_cond_destroy (&r->cond);
+    pthread_mutex_destroy (&r->mutex);
+
+    free (r);
+
+    ss->recorder = NULL;
+}
+
+/* Reads an output into a free buffer object, frames are dropped when
+   the recorder thread can't keep up and no buffer object is free */
+static void
+shotRecordOutput (CompScreen   *s,
+		  unsigned int output,
+		  BoxPtr       box,
+		  uint64_t     time)
+{
+    ShotRecorder   *r;
+    ShotRecordSlot *slot = NULL;
+    int		   i, width, height;
+
+    SHOT_SCREEN (s);
+
+    r = ss->recorder;
+
+    width  = box->x2 - box->x1;
+    height = box->y2 - box->y1;
+
+    if (width <= 0 || height <= 0)
+	return;
+
+    for (i = 0; i < SHOT_RECORD_SLOTS; i++)
+    {
+	if (r->slot[i].state == ShotSlotFree)
+	{
+	    slot = &r->slot[i];
+	    break;
+	}
+    }
+
+    if (!slot)
+    {
+	r->dropped++;
+	return;
+    }
+
+    (*ss->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, slot->pbo);
+    (*ss->bufferData) (GL_PIXEL_PACK_BUFFER_ARB,
+		       sizeof (GLubyte) * width * height * 4,
+		       NULL, GL_STREAM_READ_ARB);
+
+    glReadPixels (box->x1, s->height - box->y2, width, height,
+		  GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    (*ss->bindBuffer) (GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+    if (ss->fenceSync)
+	slot->fence = (*ss->fenceSync) (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    memcpy (slot->header.magic, "CSFR", 4);
+
+    slot->header.output   = output;
+    slot->header.time     = time;
+    slot->header.x	  = box->x1;
+    slot->header.y	  = box->y1;
+    slot->header.width    = width;
+    slot->header.height   = height;
+    slot->header.sequence = r->sequence;
+    slot->header.dropped  = r->dropped;
+
+    slot->state = ShotSlotReading;
+}
+
+static void
+shotRecordFrame (CompScreen *s)
+{
+    ShotRecorder   *r;
+    CompListValue  *outputs;
+    struct timeval tv;
+    uint64_t	   time;
+    Bool	   failed;
+    int		   interval, i;
+
+    SHOT_DISPLAY (s->display);
+    SHOT_SCREEN (s);
+
+    r = ss->recorder;
+
+    pthread_mutex_lock (&r->mutex);
+    failed = r->failed;
+    pthread_mutex_unlock (&r->mutex);
+
+    if (failed)
+    {
+	shotStopRecording (s);
+	return;
+    }
+
+    shotProcessRecordSlots (s, FALSE);
+
+    interval = sd->opt[SHOT_DISPLAY_OPTION_RECORD_INTERVAL].value.i;
+    if (r->frame++ % interval)
+	return;
+
+    gettimeofday (&tv, NULL);
+    time = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+
+    outputs = &sd->opt[SHOT_DISPLAY_OPTION_RECORD_OUTPUTS].value.list;
+    if (outputs->nValue)
+    {
+	for (i = 0; i < outputs->nValue; i++)
+	{
+	    int output = outputs->value[i].i;
+
+	    if (output >= 0 && output < s->nOutputDev)
+		shotRecordOutput (s, output,
+				  &s->outputDev[output].region.extents,
+				  time);
+	}
+    }
+    else
+    {
+	BoxRec box;
+
+	box.x1 = 0;
+	box.y1 = 0;
+	box.x2 = s->width;
+	box.y2 = s->height;
+
+	shotRecordOutput (s, SHOT_RECORD_OUTPUT_SCREEN, &box, time);
+    }
+
+    r->sequence++;
+
+    if (!r->handle)
+	r->handle = compAddTimeout (SHOT_MAP_DELAY, SHOT_MAP_DELAY * 2,
+				    shotRecordTimeout, s);
+}
+
+static Bool
+shotToggleRecord (CompDisplay     *d,
+		  CompAction      *action,
+		  CompActionState state,
+		  CompOption      *option,
+		  int		  nOption)
+{
+    CompScreen *s;
+
+    s = findScreenAtDisplay (d, getIntOptionNamed (option, nOption, "root", 0));
+    if (s)
+    {
+	SHOT_SCREEN (s);
+
+	if (ss->recorder)
+	    shotStopRecording (s);
+	else
+	    shotStartRecording (s);
+    }
+
+    return FALSE;
+}
+
 static void
 shotPaintScreen (CompScreen   *s,
 		 CompOutput   *outputs,
@@ -317,92 +1562,28 @@ shotPaintScreen (CompScreen   *s,
 	    int w = x2 - x1;
 	    int h = y2 - y1;
 
-	    SHOT_DISPLAY (s->display);
-
 	    if (w && h)
 	    {
-		GLubyte *buffer;
-		char	*dir = sd->opt[SHOT_DISPLAY_OPTION_DIR].value.s;
-		Bool    allocatedDir = FALSE;
+		ShotImage *image;
+		char	  *dir;
 
-		if (strlen (dir) == 0)
+		dir = shotGetDirectory (s->display);
+		if (dir)
 		{
-		    // If dir is empty, use user's desktop directory instead
-		    dir = shotGetXDGDesktopDir ();
-		    if (dir)
-			allocatedDir = TRUE;
-		    else
-			dir = "";
-		}
+		    image = shotCreateImage (s, dir, w, h);
+		    if (image)
+			shotReadImage (s, image, x1, s->height - y2);
 
-		buffer = malloc (sizeof (GLubyte) * w * h * 4);
-		if (buffer)
-		{
-		    struct dirent **namelist;
-		    int		  n;
-
-		    glReadPixels (x1, s->height - y2, w, h,
-				  GL_RGBA, GL_UNSIGNED_BYTE,
-				  (GLvoid *) buffer);
-
-		    n = scandir (dir, &namelist, shotFilter, shotSort);
-		    if (n >= 0)
-		    {
-			char name[256];
-			char *app;
-			int  number = 0;
-
-			if (n > 0)
-			    sscanf (namelist[n - 1]->d_name,
-				    "screenshot%d.png",
-				    &number);
-
-			number++;
-
-			if (n)
-			    free (namelist);
-
-			sprintf (name, "screenshot%d.png", number);
-
-			app = sd->opt[SHOT_DISPLAY_OPTION_LAUNCH_APP].value.s;
-
-			if (!writeImageToFile (s->display, dir, name, "png",
-					       w, h, buffer))
-			{
-			    compLogMessage ("screenshot", CompLogLevelError,
-					    "failed to write screenshot image");
-			}
-			else if (*app != '\0')
-			{
-			    char *command;
-
-			    command = malloc (strlen (app) +
-					      strlen (dir) +
-					      strlen (name) + 3);
-			    if (command)
-			    {
-				sprintf (command, "%s %s/%s", app, dir, name);
-
-				runCommand (s, command);
-
-				free (command);
-			    }
-			}
-		    }
-		    else
-		    {
-			perror (dir);
-		    }
-
-		    free (buffer);
-		}
-		if (allocatedDir)
 		    free (dir);
+		}
 	    }
 
 	    ss->grab = FALSE;
 	}
     }
+
+    if (ss->recorder)
+	shotRecordFrame (s);
 }
 
 static Bool
@@ -553,7 +1734,11 @@ shotSetDisplayOption (CompPlugin      *plugin,
 static const CompMetadataOptionInfo shotDisplayOptionInfo[] = {
     { "initiate_button", "button", 0, shotInitiate, shotTerminate },
     { "directory", "string", 0, 0, 0 },
-    { "launch_app", "string", 0, 0, 0 }
+    { "launch_app", "string", 0, 0, 0 },
+    { "record_key", "key", 0, shotToggleRecord, 0 },
+    { "record_outputs", "list", "<type>int</type>", 0, 0 },
+    { "record_interval", "int", "<min>1</min>", 0, 0 },
+    { "record_target", "string", 0, 0, 0 }
 };
 
 static Bool
@@ -587,6 +1772,29 @@ shotInitDisplay (CompPlugin  *p,
 	return FALSE;
     }
 
+    sd->writer.queue   = NULL;
+    sd->writer.done    = NULL;
+    sd->writer.nActive = 0;
+    sd->writer.quit    = FALSE;
+    sd->writer.handle  = 0;
+
+    pthread_mutex_init (&sd->writer.mutex, NULL);
+    pthread_cond_init (&sd->writer.cond, NULL);
+
+    if (pthread_create (&sd->writer.thread, NULL, shotWriterThread,
+			&sd->writer))
+    {
+	pthread_cond_destroy (&sd->writer.cond);
+	pthread_mutex_destroy (&sd->writer.mutex);
+	freeScreenPrivateIndex (d, sd->screenPrivateIndex);
+	compFiniDisplayOptions (d, sd->opt, SHOT_DISPLAY_OPTION_NUM);
+	free (sd);
+	return FALSE;
+    }
+
+    sd->lastDir    = NULL;
+    sd->lastNumber = 0;
+
     WRAP (sd, d, handleEvent, shotHandleEvent);
 
     d->base.privates[displayPrivateIndex].ptr = sd;
@@ -598,8 +1806,34 @@ static void
 shotFiniDisplay (CompPlugin  *p,
 		 CompDisplay *d)
 {
+    ShotImage *image;
+
     SHOT_DISPLAY (d);
 
+    pthread_mutex_lock (&sd->writer.mutex);
+    sd->writer.quit = TRUE;
+    pthread_cond_broadcast (&sd->writer.cond);
+    pthread_mutex_unlock (&sd->writer.mutex);
+
+    pthread_join (sd->writer.thread, NULL);
+
+    if (sd->writer.handle)
+	compRemoveTimeout (sd->writer.handle);
+
+    while (sd->writer.done)
+    {
+	image = sd->writer.done;
+	sd->writer.done = image->next;
+
+	shotFreeImage (image);
+    }
+
+    pthread_cond_destroy (&sd->writer.cond);
+    pthread_mutex_destroy (&sd->writer.mutex);
+
+    if (sd->lastDir)
+	free (sd->lastDir);
+
     freeScreenPrivateIndex (d, sd->screenPrivateIndex);
 
     UNWRAP (sd, d, handleEvent);
@@ -614,6 +1848,7 @@ shotInitScreen (CompPlugin *p,
 		CompScreen *s)
 {
     ShotScreen *ss;
+    const char *glExtensions;
 
     SHOT_DISPLAY (s->display);
 
@@ -624,6 +1859,52 @@ shotInitScreen (CompPlugin *p,
     ss->grabIndex = 0;
     ss->grab	  = FALSE;
 
+    ss->pbo	     = FALSE;
+    ss->pendingImage = NULL;
+    ss->mapHandle    = 0;
+    ss->recorder     = NULL;
+
+    glExtensions = (const char *) glGetString (GL_EXTENSIONS);
+
+    if (s->getProcAddress && glExtensions &&
+	strstr (glExtensions, "GL_ARB_pixel_buffer_object"))
+    {
+	ss->genBuffers = (GLGenBuffersProc)
+	    (*s->getProcAddress) ((GLubyte *) "glGenBuffersARB");
+	ss->deleteBuffers = (GLDeleteBuffersProc)
+	    (*s->getProcAddress) ((GLubyte *) "glDeleteBuffersARB");
+	ss->bindBuffer = (GLBindBufferProc)
+	    (*s->getProcAddress) ((GLubyte *) "glBindBufferARB");
+	ss->bufferData = (GLBufferDataProc)
+	    (*s->getProcAddress) ((GLubyte *) "glBufferDataARB");
+	ss->mapBuffer = (GLMapBufferProc)
+	    (*s->getProcAddress) ((GLubyte *) "glMapBufferARB");
+	ss->unmapBuffer = (GLUnmapBufferProc)
+	    (*s->getProcAddress) ((GLubyte *) "glUnmapBufferARB");
+
+	if (ss->genBuffers && ss->deleteBuffers && ss->bindBuffer &&
+	    ss->bufferData && ss->mapBuffer && ss->unmapBuffer)
+	    ss->pbo = TRUE;
+    }
+
+    ss->fenceSync      = NULL;
+    ss->clientWaitSync = NULL;
+    ss->deleteSync     = NULL;
+
+    if (s->getProcAddress && glExtensions &&
+	strstr (glExtensions, "GL_ARB_sync"))
+    {
+	ss->fenceSync = (GLFenceSyncProc)
+	    (*s->getProcAddress) ((GLubyte *) "glFenceSync");
+	ss->clientWaitSync = (GLClientWaitSyncProc)
+	    (*s->getProcAddress) ((GLubyte *) "glClientWaitSync");
+	ss->deleteSync = (GLDeleteSyncProc)
+	    (*s->getProcAddress) ((GLubyte *) "glDeleteSync");
+
+	if (!ss->fenceSync || !ss->clientWaitSync || !ss->deleteSync)
+	    ss->fenceSync = NULL;
+    }
+
     WRAP (ss, s, paintScreen, shotPaintScreen);
     WRAP (ss, s, paintOutput, shotPaintOutput);
 
@@ -638,6 +1919,17 @@ shotFiniScreen (CompPlugin *p,
 {
     SHOT_SCREEN (s);
 
+    if (ss->recorder)
+	shotStopRecording (s);
+
+    if (ss->pendingImage)
+    {
+	makeScreenCurrent (s);
+	shotMapPendingImage (s);
+    }
+
+    shotSyncImages (s->display);
+
     UNWRAP (ss, s, paintScreen);
     UNWRAP (ss, s, paintOutput);
 
@@ -25,6 +25,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include <cairo/cairo-xlib.h>
 #include <librsvg/rsvg.h>
@@ -42,6 +43,45 @@ static CompMetadata svgMetadata;
 
 static int displayPrivateIndex;
 
+/* zoomed parts are rendered in tiles of this many texels */
+#define SVG_TILE_SIZE 256
+
+/* tiles are rendered at up to 2^SVG_MAX_LEVEL times the window size */
+#define SVG_MAX_LEVEL 4
+
+/* rendered tiles kept per window */
+#define SVG_MAX_TILES 32
+
+/* image or tile to be rendered by the rasterizer thread */
+typedef struct _SvgRenderJob {
+    struct _SvgRenderJob *next;
+
+    Window	 window;
+    unsigned int generation;
+    int		 level;	/* 0 for the whole image */
+    int		 tx, ty;
+
+    RsvgHandle	      *svg;
+    RsvgDimensionData dimension;
+
+    float	  x1, y1, x2, y2;
+    int		  width, height;
+    unsigned char *data;
+} SvgRenderJob;
+
+typedef struct _SvgRasterizer {
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    pthread_t	    thread;
+
+    SvgRenderJob *queue;
+    SvgRenderJob *done;
+    int		 nActive;
+    Bool	 quit;
+
+    CompTimeoutHandle handle;
+} SvgRasterizer;
+
 typedef struct _SvgDisplay {
     CompOption opt[SVG_DISPLAY_OPTION_NUM];
 
@@ -50,6 +90,9 @@ typedef struct _SvgDisplay {
     HandleCompizEventProc handleCompizEvent;
 
     FileToImageProc fileToImage;
+
+    SvgRasterizer rasterizer;
+    unsigned int  generation;
 } SvgDisplay;
 
 typedef struct _SvgScreen {
@@ -73,19 +116,33 @@ typedef struct _SvgSource {
 
 typedef struct _SvgTexture {
     CompTexture texture;
-    CompMatrix  matrix;
-    cairo_t     *cr;
-    Pixmap      pixmap;
     int		width;
     int	        height;
 } SvgTexture;
 
+typedef struct _SvgTile {
+    struct _SvgTile *next;
+
+    int		 level;
+    int		 tx, ty;
+    Bool	 ready;
+    SvgTexture	 texture;
+    unsigned int lastUsed;
+} SvgTile;
+
 typedef struct _SvgContext {
     SvgSource  *source;
     REGION     box;
-    SvgTexture texture[2];
-    BoxRec     rect;
-    int	       width, height;
+
+    /* whole image, kept at its old size until the image for the
+       current size has been rendered */
+    SvgTexture texture;
+
+    SvgTile	 *tiles;
+    unsigned int frame;
+
+    /* changes whenever rendered images become invalid */
+    unsigned int generation;
 } SvgContext;
 
 typedef struct _SvgWindow {
@@ -115,139 +172,639 @@ typedef struct _SvgWindow {
 
 #define NUM_OPTIONS(d) (sizeof ((d)->opt) / sizeof (CompOption))
 
+/* Renders the part of the image selected by the job into an image
+   surface, called by the rasterizer thread */
 static void
-renderSvg (CompScreen *s,
-	   SvgSource  *source,
-	   SvgTexture *texture,
-	   float      x1,
-	   float      y1,
-	   float      x2,
-	   float      y2,
-	   int	      width,
-	   int	      height)
+renderSvg (SvgRenderJob *job)
 {
-    float w = x2 - x1;
-    float h = y2 - y1;
+    cairo_surface_t *surface;
+    cairo_t	    *cr;
+    float	    w = job->x2 - job->x1;
+    float	    h = job->y2 - job->y1;
 
-    cairo_save (texture->cr);
+    job->data = malloc (job->width * job->height * 4);
+    if (!job->data)
+	return;
 
-    cairo_set_operator (texture->cr, CAIRO_OPERATOR_SOURCE);
-    cairo_set_source_rgba (texture->cr, 1.0, 1.0, 1.0, 0.0);
-    cairo_paint (texture->cr);
-    cairo_set_operator (texture->cr, CAIRO_OPERATOR_OVER);
+    surface = cairo_image_surface_create_for_data (job->data,
+						   CAIRO_FORMAT_ARGB32,
+						   job->width,
+						   job->height,
+						   job->width * 4);
 
-    cairo_scale (texture->cr, 1.0 / w, 1.0 / h);
+    cr = cairo_create (surface);
 
-    cairo_scale (texture->cr,
-		 (double) width / source->dimension.width,
-		 (double) height / source->dimension.height);
+    cairo_set_operator (cr, CAIRO_OPERATOR_CLEAR);
+    cairo_paint (cr);
+    cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
 
-    cairo_translate (texture->cr,
-		     -x1 * source->dimension.width,
-		     -y1 * source->dimension.height);
+    cairo_scale (cr, 1.0 / w, 1.0 / h);
 
-    rsvg_handle_render_cairo (source->svg, texture->cr);
+    cairo_scale (cr,
+		 (double) job->width / job->dimension.width,
+		 (double) job->height / job->dimension.height);
 
-    cairo_restore (texture->cr);
+    cairo_translate (cr,
+		     -job->x1 * job->dimension.width,
+		     -job->y1 * job->dimension.height);
+
+    rsvg_handle_render_cairo (job->svg, cr);
+
+    cairo_destroy (cr);
+
+    cairo_surface_flush (surface);
+    cairo_surface_destroy (surface);
 }
 
-static Bool
-initSvgTexture (CompWindow *w,
-		SvgSource  *source,
-		SvgTexture *texture,
-		int	   width,
-		int	   height)
+static void
+svgFreeRenderJob (SvgRenderJob *job)
 {
-    cairo_surface_t *surface;
-    CompScreen      *s = w->screen;
-    Visual	    *visual;
-    int		    depth;
+    if (job->data)
+	free (job->data);
+
+    g_object_unref (job->svg);
+    free (job);
+}
+
+static void *
+svgRasterizerThread (void *closure)
+{
+    SvgRasterizer *r = (SvgRasterizer *) closure;
+    SvgRenderJob  *job;
+
+    pthread_mutex_lock (&r->mutex);
+
+    for (;;)
+    {
+	while (!r->queue && !r->quit)
+	    pthread_cond_wait (&r->cond, &r->mutex);
+
+	job = r->queue;
+	if (!job)
+	    break;
+
+	r->queue = job->next;
+
+	pthread_mutex_unlock (&r->mutex);
+
+	renderSvg (job);
+
+	pthread_mutex_lock (&r->mutex);
+
+	job->next = r->done;
+	r->done = job;
 
+	r->nActive--;
+    }
+
+    pthread_mutex_unlock (&r->mutex);
+
+    return NULL;
+}
+
+static void
+initSvgTexture (CompScreen *s,
+		SvgTexture *texture)
+{
     initTexture (s, &texture->texture);
 
-    texture->width  = width;
-    texture->height = height;
+    texture->width  = 0;
+    texture->height = 0;
+}
+
+static void
+finiSvgTexture (CompScreen *s,
+		SvgTexture *texture)
+{
+    finiTexture (s, &texture->texture);
+}
+
+static Bool
+uploadSvgTexture (CompScreen   *s,
+		  SvgTexture   *texture,
+		  SvgRenderJob *job)
+{
+    if (!job->data)
+	return FALSE;
+
+    if (!imageBufferToTexture (s, &texture->texture, (char *) job->data,
+			       job->width, job->height))
+	return FALSE;
+
+    texture->width  = job->width;
+    texture->height = job->height;
+
+    return TRUE;
+}
 
-    texture->pixmap = None;
-    texture->cr     = NULL;
+static SvgTile *
+svgFindTile (SvgContext *context,
+	     int	level,
+	     int	tx,
+	     int	ty)
+{
+    SvgTile *tile;
 
-    if (width && height)
+    for (tile = context->tiles; tile; tile = tile->next)
+	if (tile->level == level && tile->tx == tx && tile->ty == ty)
+	    return tile;
+
+    return NULL;
+}
+
+static void
+svgRemoveTile (CompScreen *s,
+	       SvgContext *context,
+	       SvgTile	  *tile)
+{
+    SvgTile **t;
+
+    for (t = &context->tiles; *t; t = &(*t)->next)
     {
-	XWindowAttributes attr;
-	XGetWindowAttributes (s->display->display, w->id, &attr);
+	if (*t == tile)
+	{
+	    *t = tile->next;
+	    break;
+	}
+    }
+
+    finiSvgTexture (s, &tile->texture);
+    free (tile);
+}
 
-	depth = attr.depth;
-	texture->pixmap = XCreatePixmap (s->display->display, s->root,
-					 width, height, depth);
+static void
+freeSvgTiles (CompScreen *s,
+	      SvgContext *context)
+{
+    while (context->tiles)
+	svgRemoveTile (s, context, context->tiles);
+}
+
+/* Uploads images the rasterizer thread has finished, images for
+   windows that changed since they were requested are dropped */
+static void
+svgProcessRenderedJobs (CompDisplay *d)
+{
+    SvgRenderJob *job, *next;
+    CompWindow	 *w;
+
+    SVG_DISPLAY (d);
+
+    pthread_mutex_lock (&sd->rasterizer.mutex);
+    job = sd->rasterizer.done;
+    sd->rasterizer.done = NULL;
+    pthread_mutex_unlock (&sd->rasterizer.mutex);
+
+    for (; job; job = next)
+    {
+	next = job->next;
 
-	if (!bindPixmapToTexture (s,
-				  &texture->texture,
-				  texture->pixmap,
-				  width, height, depth))
+	w = findWindowAtDisplay (d, job->window);
+	if (w)
 	{
-	    fprintf (stderr, "%s: Couldn't bind pixmap 0x%x to "
-		     "texture\n", programName, (int) texture->pixmap);
+	    SvgContext *context;
+
+	    SVG_WINDOW (w);
+
+	    context = sw->context;
+	    if (context && context->generation == job->generation)
+	    {
+		if (job->level)
+		{
+		    SvgTile *tile;
 
-	    XFreePixmap (s->display->display, texture->pixmap);
+		    tile = svgFindTile (context, job->level, job->tx, job->ty);
+		    if (tile)
+		    {
+			if (uploadSvgTexture (w->screen, &tile->texture, job))
+			    tile->ready = TRUE;
+			else
+			    svgRemoveTile (w->screen, context, tile);
+		    }
+		}
+		else
+		{
+		    uploadSvgTexture (w->screen, &context->texture, job);
+		}
 
-	    return FALSE;
+		addWindowDamage (w);
+	    }
 	}
 
-	visual = attr.visual;
-	surface = cairo_xlib_surface_create (s->display->display,
-					     texture->pixmap, visual,
-					     width, height);
-	texture->cr = cairo_create (surface);
-	cairo_surface_destroy (surface);
+	svgFreeRenderJob (job);
     }
+}
+
+static Bool
+svgRasterizerTimeout (void *closure)
+{
+    CompDisplay *d = (CompDisplay *) closure;
+    Bool	active;
+
+    SVG_DISPLAY (d);
+
+    svgProcessRenderedJobs (d);
+
+    pthread_mutex_lock (&sd->rasterizer.mutex);
+    active = sd->rasterizer.nActive > 0 || sd->rasterizer.done;
+    pthread_mutex_unlock (&sd->rasterizer.mutex);
+
+    if (!active)
+	sd->rasterizer.handle = 0;
+
+    return active;
+}
+
+/* Queues rendering of the part x1, y1, x2, y2 of the window image at
+   width x height texels */
+static Bool
+svgRequestRender (CompWindow *w,
+		  int	     level,
+		  int	     tx,
+		  int	     ty,
+		  float	     x1,
+		  float	     y1,
+		  float	     x2,
+		  float	     y2,
+		  int	     width,
+		  int	     height)
+{
+    SvgRenderJob *job, **last;
+    SvgContext	 *context;
+
+    SVG_DISPLAY (w->screen->display);
+    SVG_WINDOW (w);
+
+    context = sw->context;
+
+    job = malloc (sizeof (SvgRenderJob));
+    if (!job)
+	return FALSE;
+
+    job->next	    = NULL;
+    job->window	    = w->id;
+    job->generation = context->generation;
+    job->level	    = level;
+    job->tx	    = tx;
+    job->ty	    = ty;
+    job->svg	    = g_object_ref (context->source->svg);
+    job->dimension  = context->source->dimension;
+    job->x1	    = x1;
+    job->y1	    = y1;
+    job->x2	    = x2;
+    job->y2	    = y2;
+    job->width	    = width;
+    job->height	    = height;
+    job->data	    = NULL;
+
+    pthread_mutex_lock (&sd->rasterizer.mutex);
+
+    for (last = &sd->rasterizer.queue; *last; last = &(*last)->next);
+    *last = job;
+
+    sd->rasterizer.nActive++;
+
+    pthread_cond_broadcast (&sd->rasterizer.cond);
+    pthread_mutex_unlock (&sd->rasterizer.mutex);
+
+    if (!sd->rasterizer.handle)
+	sd->rasterizer.handle = compAddTimeout (10, 20, svgRasterizerTimeout,
+						w->screen->display);
 
     return TRUE;
 }
 
+/* Drops all queued and rendered jobs of a window */
 static void
-finiSvgTexture (CompScreen *s,
-		SvgTexture *texture)
+svgCancelWindowJobs (CompWindow *w)
 {
-    if (texture->cr)
-	cairo_destroy (texture->cr);
+    SvgRenderJob *job, **j, *cancelled = NULL;
+    int		 i;
 
-    if (texture->pixmap)
-	XFreePixmap (s->display->display, texture->pixmap);
+    SVG_DISPLAY (w->screen->display);
 
-    finiTexture (s, &texture->texture);
+    pthread_mutex_lock (&sd->rasterizer.mutex);
+
+    for (i = 0; i < 2; i++)
+    {
+	j = i ? &sd->rasterizer.done : &sd->rasterizer.queue;
+
+	while (*j)
+	{
+	    job = *j;
+
+	    if (job->window == w->id)
+	    {
+		*j = job->next;
+
+		if (!i)
+		    sd->rasterizer.nActive--;
+
+		job->next = cancelled;
+		cancelled = job;
+	    }
+	    else
+	    {
+		j = &job->next;
+	    }
+	}
+    }
+
+    pthread_mutex_unlock (&sd->rasterizer.mutex);
+
+    while (cancelled)
+    {
+	job = cancelled;
+	cancelled = job->next;
+
+	svgFreeRenderJob (job);
+    }
 }
 
+/* Removes the queued job of a tile, returns FALSE if it is already
+   being rendered */
+static Bool
+svgCancelTileJob (CompWindow *w,
+		  SvgTile    *tile)
+{
+    SvgRenderJob *job = NULL, **j;
+
+    SVG_DISPLAY (w->screen->display);
+
+    pthread_mutex_lock (&sd->rasterizer.mutex);
+
+    for (j = &sd->rasterizer.queue; *j; j = &(*j)->next)
+    {
+	if ((*j)->window == w->id  &&
+	    (*j)->level  == tile->level &&
+	    (*j)->tx     == tile->tx &&
+	    (*j)->ty     == tile->ty)
+	{
+	    job = *j;
+	    *j = job->next;
+
+	    sd->rasterizer.nActive--;
+	    break;
+	}
+    }
+
+    pthread_mutex_unlock (&sd->rasterizer.mutex);
+
+    if (!job)
+	return FALSE;
+
+    svgFreeRenderJob (job);
+
+    return TRUE;
+}
+
+/* Returns the part of the window covered by a tile */
 static void
-updateWindowSvgMatrix (CompWindow *w)
+svgGetTileBox (SvgContext *context,
+	       int	  level,
+	       int	  tx,
+	       int	  ty,
+	       BoxPtr	  box)
+{
+    int size = SVG_TILE_SIZE >> level;
+
+    box->x1 = context->box.extents.x1 + tx * size;
+    box->y1 = context->box.extents.y1 + ty * size;
+    box->x2 = MIN (box->x1 + size, context->box.extents.x2);
+    box->y2 = MIN (box->y1 + size, context->box.extents.y2);
+}
+
+static SvgTile *
+svgAddTile (CompWindow *w,
+	    int	       level,
+	    int	       tx,
+	    int	       ty)
 {
-    CompMatrix *m;
-    int	       width, height;
+    SvgContext *context;
+    SvgTile    *tile;
+    BoxRec     box;
+    float      dx, dy;
 
     SVG_WINDOW (w);
 
-    width  = sw->context->box.extents.x2 - sw->context->box.extents.x1;
-    height = sw->context->box.extents.y2 - sw->context->box.extents.y1;
+    context = sw->context;
+
+    tile = malloc (sizeof (SvgTile));
+    if (!tile)
+	return NULL;
 
-    m = &sw->context->texture[0].matrix;
-    *m = sw->context->texture[0].texture.matrix;
+    tile->level	   = level;
+    tile->tx	   = tx;
+    tile->ty	   = ty;
+    tile->ready	   = FALSE;
+    tile->lastUsed = context->frame;
 
-    m->xx *= (float) sw->context->texture[0].width  / width;
-    m->yy *= (float) sw->context->texture[0].height / height;
+    initSvgTexture (w->screen, &tile->texture);
 
-    m->x0 -= (sw->context->box.extents.x1 * m->xx);
-    m->y0 -= (sw->context->box.extents.y1 * m->yy);
+    svgGetTileBox (context, level, tx, ty, &box);
 
-    m = &sw->context->texture[1].matrix;
-    *m = sw->context->texture[1].texture.matrix;
+    dx = context->box.extents.x2 - context->box.extents.x1;
+    dy = context->box.extents.y2 - context->box.extents.y1;
 
-    width  = sw->context->rect.x2 - sw->context->rect.x1;
-    height = sw->context->rect.y2 - sw->context->rect.y1;
+    if (!svgRequestRender (w, level, tx, ty,
+			   (box.x1 - context->box.extents.x1) / dx,
+			   (box.y1 - context->box.extents.y1) / dy,
+			   (box.x2 - context->box.extents.x1) / dx,
+			   (box.y2 - context->box.extents.y1) / dy,
+			   (box.x2 - box.x1) << level,
+			   (box.y2 - box.y1) << level))
+    {
+	finiSvgTexture (w->screen, &tile->texture);
+	free (tile);
+	return NULL;
+    }
 
-    m->xx *= (float) sw->context->texture[1].width  / width;
-    m->yy *= (float) sw->context->texture[1].height / height;
+    tile->next = context->tiles;
+    context->tiles = tile;
 
-    m->x0 -= (sw->context->rect.x1 * m->xx);
-    m->y0 -= (sw->context->rect.y1 * m->yy);
+    return tile;
+}
+
+/* Drops queued tiles that are no longer visible and the least recently
+   used rendered tiles when there are too many of them */
+static void
+svgTrimTiles (CompWindow *w)
+{
+    SvgContext *context;
+    SvgTile    *tile, *next, *oldest;
+    int	       nReady = 0;
+
+    SVG_WINDOW (w);
+
+    context = sw->context;
+
+    for (tile = context->tiles; tile; tile = next)
+    {
+	next = tile->next;
+
+	if (tile->ready)
+	    nReady++;
+	else if (tile->lastUsed != context->frame &&
+		 svgCancelTileJob (w, tile))
+	    svgRemoveTile (w->screen, context, tile);
+    }
+
+    while (nReady > SVG_MAX_TILES)
+    {
+	oldest = NULL;
+
+	for (tile = context->tiles; tile; tile = tile->next)
+	{
+	    if (!tile->ready || tile->lastUsed == context->frame)
+		continue;
+
+	    if (!oldest || (int) (tile->lastUsed - oldest->lastUsed) < 0)
+		oldest = tile;
+	}
+
+	if (!oldest)
+	    break;
+
+	svgRemoveTile (w->screen, context, oldest);
+	nReady--;
+    }
+}
+
+/* Draws the part clip of a texture that covers rect */
+static void
+svgDrawTexture (CompWindow	     *w,
+		SvgTexture	     *texture,
+		BoxPtr		     rect,
+		BoxPtr		     clip,
+		const FragmentAttrib *attrib,
+		Region		     region,
+		unsigned int	     mask)
+{
+    CompMatrix matrix = texture->texture.matrix;
+    REGION     r;
+
+    matrix.xx *= (float) texture->width  / (rect->x2 - rect->x1);
+    matrix.yy *= (float) texture->height / (rect->y2 - rect->y1);
+
+    matrix.x0 -= rect->x1 * matrix.xx;
+    matrix.y0 -= rect->y1 * matrix.yy;
+
+    r.rects    = &r.extents;
+    r.numRects = 1;
+    r.extents  = *clip;
+
+    w->vCount = w->indexCount = 0;
+
+    (*w->screen->addWindowGeometry) (w, &matrix, 1, &r, region);
+    (*w->screen->drawWindowTexture) (w, &texture->texture, attrib, mask);
+}
+
+/* Draws rendered tiles of the level closest to level that cover box,
+   used while the tile for box is being rendered */
+static void
+svgDrawNearestTiles (CompWindow		  *w,
+		     int		  level,
+		     BoxPtr		  box,
+		     const FragmentAttrib *attrib,
+		     Region		  region,
+		     unsigned int	  mask)
+{
+    SvgContext *context;
+    SvgTile    *tile;
+    BoxRec     rect, clip;
+    int	       d, i, l;
+    Bool       drawn = FALSE;
+
+    SVG_WINDOW (w);
+
+    context = sw->context;
+
+    for (d = 1; d < SVG_MAX_LEVEL && !drawn; d++)
+    {
+	for (i = 0; i < 2; i++)
+	{
+	    l = i ? level + d : level - d;
+	    if (l < 1 || l > SVG_MAX_LEVEL)
+		continue;
+
+	    for (tile = context->tiles; tile; tile = tile->next)
+	    {
+		if (tile->level != l || !tile->ready)
+		    continue;
+
+		svgGetTileBox (context, l, tile->tx, tile->ty, &rect);
+
+		clip.x1 = MAX (rect.x1, box->x1);
+		clip.y1 = MAX (rect.y1, box->y1);
+		clip.x2 = MIN (rect.x2, box->x2);
+		clip.y2 = MIN (rect.y2, box->y2);
+
+		if (clip.x1 >= clip.x2 || clip.y1 >= clip.y2)
+		    continue;
+
+		svgDrawTexture (w, &tile->texture, &rect, &clip,
+				attrib, region, mask);
+
+		drawn = TRUE;
+	    }
+	}
+    }
+}
+
+/* Draws the part r of the window from tiles rendered at 2^level times
+   the window size, missing tiles are requested */
+static void
+svgDrawTiles (CompWindow	   *w,
+	      int		   level,
+	      BoxPtr		   r,
+	      const FragmentAttrib *attrib,
+	      Region		   region,
+	      unsigned int	   mask)
+{
+    SvgContext *context;
+    SvgTile    *tile;
+    BoxRec     box;
+    int	       size = SVG_TILE_SIZE >> level;
+    int	       tx, ty, tx1, ty1, tx2, ty2;
+    int	       saveFilter;
+
+    SVG_WINDOW (w);
+
+    context = sw->context;
+    context->frame++;
+
+    tx1 = (r->x1 - context->box.extents.x1) / size;
+    ty1 = (r->y1 - context->box.extents.y1) / size;
+    tx2 = (r->x2 - context->box.extents.x1 - 1) / size;
+    ty2 = (r->y2 - context->box.extents.y1 - 1) / size;
+
+    saveFilter = w->screen->filter[SCREEN_TRANS_FILTER];
+    w->screen->filter[SCREEN_TRANS_FILTER] = COMP_TEXTURE_FILTER_GOOD;
+
+    for (ty = ty1; ty <= ty2; ty++)
+    {
+	for (tx = tx1; tx <= tx2; tx++)
+	{
+	    tile = svgFindTile (context, level, tx, ty);
+	    if (!tile)
+		tile = svgAddTile (w, level, tx, ty);
+
+	    svgGetTileBox (context, level, tx, ty, &box);
+
+	    if (tile)
+		tile->lastUsed = context->frame;
+
+	    if (tile && tile->ready)
+		svgDrawTexture (w, &tile->texture, &box, &box,
+				attrib, region, mask);
+	    else
+		svgDrawNearestTiles (w, level, &box, attrib, region, mask);
+	}
+    }
+
+    w->screen->filter[SCREEN_TRANS_FILTER] = saveFilter;
+
+    svgTrimTiles (w);
 }
 
 static Bool
@@ -274,14 +831,13 @@ svgDrawWindow (CompWindow	      *w,
 
 	if (sw->context && region->numRects)
 	{
-	    CompTexture *texture = &sw->context->texture[0].texture;
-	    CompMatrix  *matrix = &sw->context->texture[0].matrix;
-	    REGION	r;
+	    BoxPtr box = &sw->context->box.extents;
+	    REGION r;
 
 	    r.rects    = &r.extents;
 	    r.numRects = 1;
 
-	    r.extents = sw->context->box.extents;
+	    r.extents = *box;
 
 	    if (r.extents.x1 < ss->zoom.x1)
 		r.extents.x1 = ss->zoom.x1;
@@ -292,103 +848,30 @@ svgDrawWindow (CompWindow	      *w,
 	    if (r.extents.y2 > ss->zoom.y2)
 		r.extents.y2 = ss->zoom.y2;
 
-	    w->vCount = w->indexCount = 0;
-
-	    (*w->screen->addWindowGeometry) (w,
-					     matrix, 1,
-					     &sw->context->box,
-					     region);
-
 	    if (mask & PAINT_WINDOW_TRANSLUCENT_MASK)
 		mask |= PAINT_WINDOW_BLEND_MASK;
 
-	    (*w->screen->drawWindowTexture) (w, texture, attrib, mask);
+	    /* possibly stretched until the current size is rendered */
+	    if (sw->context->texture.width)
+		svgDrawTexture (w, &sw->context->texture, box, box,
+				attrib, region, mask);
 
 	    if (r.extents.x1 < r.extents.x2 && r.extents.y1 < r.extents.y2)
 	    {
-		float xScale, yScale;
-		float dx, dy;
-		int   width, height;
-		int   saveFilter;
-
-		r.extents.x1--;
-		r.extents.y1--;
-		r.extents.x2++;
-		r.extents.y2++;
-
-		xScale = w->screen->width  / (float)
-		    (ss->zoom.x2 - ss->zoom.x1);
-		yScale = w->screen->height / (float)
-		    (ss->zoom.y2 - ss->zoom.y1);
-
-		dx = r.extents.x2 - r.extents.x1;
-		dy = r.extents.y2 - r.extents.y1;
-
-		width  = dx * xScale + 0.5f;
-		height = dy * yScale + 0.5f;
-
-		if (r.extents.x1 != sw->context->rect.x1 ||
-		    r.extents.y1 != sw->context->rect.y1 ||
-		    r.extents.x2 != sw->context->rect.x2 ||
-		    r.extents.y2 != sw->context->rect.y2 ||
-		    width	 != sw->context->width   ||
-		    height	 != sw->context->height)
-		{
-		    float x1, y1, x2, y2;
-
-		    sw->context->rect = r.extents;
-
-		    sw->context->width  = width;
-		    sw->context->height = height;
-
-		    dx = sw->context->box.extents.x2 -
-			sw->context->box.extents.x1;
-		    dy = sw->context->box.extents.y2 -
-			sw->context->box.extents.y1;
-
-		    x1 = (r.extents.x1 - sw->context->box.extents.x1) / dx;
-		    y1 = (r.extents.y1 - sw->context->box.extents.y1) / dy;
-		    x2 = (r.extents.x2 - sw->context->box.extents.x1) / dx;
-		    y2 = (r.extents.y2 - sw->context->box.extents.y1) / dy;
-
-		    finiSvgTexture (w->screen, &sw->context->texture[1]);
+		float scale;
+		int   level = 1;
 
-		    if (initSvgTexture (w, sw->context->source,
-					&sw->context->texture[1],
-					width, height))
-		    {
-			renderSvg (w->screen, sw->context->source,
-				   &sw->context->texture[1],
-				   x1, y1, x2, y2,
-				   width, height);
-
-			updateWindowSvgMatrix (w);
-		    }
-		}
-
-		texture = &sw->context->texture[1].texture;
-		matrix = &sw->context->texture[1].matrix;
+		r.extents.x1 = MAX (r.extents.x1 - 1, box->x1);
+		r.extents.y1 = MAX (r.extents.y1 - 1, box->y1);
+		r.extents.x2 = MIN (r.extents.x2 + 1, box->x2);
+		r.extents.y2 = MIN (r.extents.y2 + 1, box->y2);
 
-		w->vCount = w->indexCount = 0;
-
-		saveFilter = w->screen->filter[SCREEN_TRANS_FILTER];
-		w->screen->filter[SCREEN_TRANS_FILTER] =
-		    COMP_TEXTURE_FILTER_GOOD;
-
-		(*w->screen->addWindowGeometry) (w, matrix, 1, &r, region);
-		(*w->screen->drawWindowTexture) (w, texture, attrib, mask);
-
-		w->screen->filter[SCREEN_TRANS_FILTER] = saveFilter;
-	    }
-	    else if (sw->context->texture[1].width)
-	    {
-		finiSvgTexture (w->screen, &sw->context->texture[1]);
-		initSvgTexture (w, sw->source, &sw->context->texture[1], 0, 0);
+		scale = w->screen->width / (float) (ss->zoom.x2 - ss->zoom.x1);
 
-		memset (&sw->context->rect, 0, sizeof (BoxRec));
+		while ((1 << level) < scale && level < SVG_MAX_LEVEL)
+		    level++;
 
-		sw->context->width  = 0;
-		sw->context->height = 0;
+		svgDrawTiles (w, level, &r.extents, attrib, region, mask);
 	    }
 	}
     }
@@ -396,37 +879,54 @@ svgDrawWindow (CompWindow	      *w,
     return status;
 }
 
+static void
+freeSvgContext (CompWindow *w)
+{
+    SVG_WINDOW (w);
+
+    svgCancelWindowJobs (w);
+
+    freeSvgTiles (w->screen, sw->context);
+    finiSvgTexture (w->screen, &sw->context->texture);
+
+    free (sw->context);
+    sw->context = NULL;
+}
+
 static void
 updateWindowSvgContext (CompWindow *w,
 			SvgSource  *source)
 {
-    int x1, y1, x2, y2;
+    SvgContext *context;
+    int	       x1, y1, x2, y2;
 
+    SVG_DISPLAY (w->screen->display);
     SVG_WINDOW (w);
 
     if (sw->context)
     {
-	finiSvgTexture (w->screen, &sw->context->texture[0]);
-	finiSvgTexture (w->screen, &sw->context->texture[1]);
+	svgCancelWindowJobs (w);
+	freeSvgTiles (w->screen, sw->context);
     }
     else
     {
 	sw->context = malloc (sizeof (SvgContext));
 	if (!sw->context)
 	    return;
-    }
 
-    memset (&sw->context->rect, 0, sizeof (BoxRec));
+	initSvgTexture (w->screen, &sw->context->texture);
 
-    sw->context->width  = 0;
-    sw->context->height = 0;
+	sw->context->tiles = NULL;
+	sw->context->frame = 0;
+    }
 
-    initSvgTexture (w, source, &sw->context->texture[1], 0, 0);
+    context = sw->context;
 
-    sw->context->source = source;
+    context->source     = source;
+    context->generation = ++sd->generation;
 
-    sw->context->box.rects    = &sw->context->box.extents;
-    sw->context->box.numRects = 1;
+    context->box.rects    = &context->box.extents;
+    context->box.numRects = 1;
 
     decor_apply_gravity (source->p1.gravity,
 			 source->p1.x, source->p1.y,
@@ -443,31 +943,15 @@ updateWindowSvgContext (CompWindow *w,
     x2 = MIN (x2, w->width);
     y2 = MIN (y2, w->height);
 
-    if (!initSvgTexture (w, source, &sw->context->texture[0],
-			 w->width, w->height))
-    {
-	free (sw->context);
-	sw->context = NULL;
-    }
-    else
-    {
-	renderSvg (w->screen, source, &sw->context->texture[0],
-		   0.0f, 0.0f, 1.0f, 1.0f, w->width, w->height);
-
-	initSvgTexture (w, source, &sw->context->texture[1], 0, 0);
-
-	sw->context->box.extents.x1 = x1;
-	sw->context->box.extents.y1 = y1;
-	sw->context->box.extents.x2 = x2;
-	sw->context->box.extents.y2 = y2;
-
-	sw->context->box.extents.x1 += w->attrib.x;
-	sw->context->box.extents.y1 += w->attrib.y;
-	sw->context->box.extents.x2 += w->attrib.x;
-	sw->context->box.extents.y2 += w->attrib.y;
+    context->box.extents.x1 = x1 + w->attrib.x;
+    context->box.extents.y1 = y1 + w->attrib.y;
+    context->box.extents.x2 = x2 + w->attrib.x;
+    context->box.extents.y2 = y2 + w->attrib.y;
 
-	updateWindowSvgMatrix (w);
-    }
+    /* the previous image is drawn until this one is rendered */
+    if (x1 < x2 && y1 < y2)
+	svgRequestRender (w, 0, 0, 0, 0.0f, 0.0f, 1.0f, 1.0f,
+			  x2 - x1, y2 - y1);
 }
 
 static Bool
@@ -546,11 +1030,7 @@ svgSet (CompDisplay     *d,
 	    }
 
 	    if (sw->context)
-	    {
-		finiSvgTexture (w->screen, &sw->context->texture[0]);
-		free (sw->context);
-		sw->context = NULL;
-	    }
+		freeSvgContext (w);
 	}
     }
 
@@ -572,8 +1052,6 @@ svgWindowMoveNotify (CompWindow *w,
 	sw->context->box.extents.y1 += dy;
 	sw->context->box.extents.x2 += dx;
 	sw->context->box.extents.y2 += dy;
-
-	updateWindowSvgMatrix (w);
     }
 
     UNWRAP (ss, w->screen, windowMoveNotify);
@@ -819,6 +1297,28 @@ svgInitDisplay (CompPlugin  *p,
 	return FALSE;
     }
 
+    sd->rasterizer.queue   = NULL;
+    sd->rasterizer.done    = NULL;
+    sd->rasterizer.nActive = 0;
+    sd->rasterizer.quit    = FALSE;
+    sd->rasterizer.handle  = 0;
+
+    pthread_mutex_init (&sd->rasterizer.mutex, NULL);
+    pthread_cond_init (&sd->rasterizer.cond, NULL);
+
+    if (pthread_create (&sd->rasterizer.thread, NULL, svgRasterizerThread,
+			&sd->rasterizer))
+    {
+	pthread_cond_destroy (&sd->rasterizer.cond);
+	pthread_mutex_destroy (&sd->rasterizer.mutex);
+	freeScreenPrivateIndex (d, sd->screenPrivateIndex);
+	compFiniDisplayOptions (d, sd->opt, SVG_DISPLAY_OPTION_NUM);
+	free (sd);
+	return FALSE;
+    }
+
+    sd->generation = 0;
+
     WRAP (sd, d, handleCompizEvent, svgHandleCompizEvent);
     WRAP (sd, d, fileToImage, svgFileToImage);
 
@@ -834,10 +1334,43 @@ static void
 svgFiniDisplay (CompPlugin  *p,
 		CompDisplay *d)
 {
-    CompScreen *s;
+    CompScreen	 *s;
+    SvgRenderJob *job, *queue;
 
     SVG_DISPLAY (d);
 
+    /* queued images are not rendered anymore */
+    pthread_mutex_lock (&sd->rasterizer.mutex);
+    queue = sd->rasterizer.queue;
+    sd->rasterizer.queue = NULL;
+    sd->rasterizer.quit  = TRUE;
+    pthread_cond_broadcast (&sd->rasterizer.cond);
+    pthread_mutex_unlock (&sd->rasterizer.mutex);
+
+    pthread_join (sd->rasterizer.thread, NULL);
+
+    if (sd->rasterizer.handle)
+	compRemoveTimeout (sd->rasterizer.handle);
+
+    while (queue)
+    {
+	job = queue;
+	queue = job->next;
+
+	svgFreeRenderJob (job);
+    }
+
+    while (sd->rasterizer.done)
+    {
+	job = sd->rasterizer.done;
+	sd->rasterizer.done = job->next;
+
+	svgFreeRenderJob (job);
+    }
+
+    pthread_cond_destroy (&sd->rasterizer.cond);
+    pthread_mutex_destroy (&sd->rasterizer.mutex);
+
     UNWRAP (sd, d, handleCompizEvent);
     UNWRAP (sd, d, fileToImage);
 
@@ -929,10 +1462,7 @@ svgFiniWindow (CompPlugin *p,
     }
 
     if (sw->context)
-    {
-	finiSvgTexture (w->screen, &sw->context->texture[0]);
-	free (sw->context);
-    }
+	freeSvgContext (w);
 
     free (sw);
 }
@@ -1500,6 +1500,7 @@ switchPaintThumb (CompWindow		  *w,
 	AddWindowGeometryProc oldAddWindowGeometry;
 	FragmentAttrib	      fragment;
 	CompTransform	      wTransform = *transform;
+	CompWindowThumbnail   *thumb;
 	int		      ww, wh;
 	GLenum                filter;
 
@@ -1554,14 +1555,23 @@ switchPaintThumb (CompWindow		  *w,
 	if (ss->opt[SWITCH_SCREEN_OPTION_MIPMAP].value.b)
 	    w->screen->display->textureFilter = GL_LINEAR_MIPMAP_LINEAR;
 
-	/* XXX: replacing the addWindowGeometry function like this is
-	   very ugly but necessary until the vertex stage has been made
-	   fully pluggable. */
-	oldAddWindowGeometry = w->screen->addWindowGeometry;
-	w->screen->addWindowGeometry = addWindowGeometry;
-	(w->screen->drawWindow) (w, &wTransform, &fragment, &infiniteRegion,
-				 mask);
-	w->screen->addWindowGeometry = oldAddWindowGeometry;
+	/* the cached thumbnail replaces the scaled down window */
+	thumb = getWindowThumbnail (w, width, height);
+	if (thumb)
+	{
+	    drawWindowThumbnail (w, thumb, &fragment, mask);
+	}
+	else
+	{
+	    /* XXX: replacing the addWindowGeometry function like this is
+	       very ugly but necessary until the vertex stage has been made
+	       fully pluggable. */
+	    oldAddWindowGeometry = w->screen->addWindowGeometry;
+	    w->screen->addWindowGeometry = addWindowGeometry;
+	    (w->screen->drawWindow) (w, &wTransform, &fragment, &infiniteRegion,
+				     mask);
+	    w->screen->addWindowGeometry = oldAddWindowGeometry;
+	}
 
 	w->screen->display->textureFilter = filter;
 
@@ -30,7 +30,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <sys/poll.h>
+#include <sys/stat.h>
 #include <assert.h>
 
 #define XK_MISCELLANY
@@ -498,6 +500,7 @@ shade (CompDisplay     *d,
     if (w && (w->actions & CompWindowActionShadeMask))
     {
 	w->state ^= CompWindowStateShadedMask;
+	invalidateWindowMatchCache (w);
 	updateWindowAttributes (w, CompStackingUpdateModeNone);
     }
 
@@ -541,6 +544,141 @@ compDisplaySetCursorTheme (CompDisplay *display)
     }
 }
 
+#define IMAGE_CACHE_HASH_SIZE 64
+
+typedef struct _CompImageCacheEntry CompImageCacheEntry;
+
+struct _CompImageCacheEntry {
+    CompImageCacheEntry *next;
+    CompImageCacheEntry *dataNext;
+    CompImageCacheEntry *lruPrev;
+    CompImageCacheEntry *lruNext;
+
+    char	 *name;
+    unsigned int hash;
+
+    /* file the image was read from, NULL if no loader candidate
+       exists for name and the image is never revalidated */
+    char *path;
+
+    /* stamp of path, 0 if the entry must not be handed out again */
+    uint64_t stamp;
+
+    int	   width;
+    int	   height;
+    void   *data;
+    size_t size;
+    int	   refCount;
+};
+
+struct _CompImageCache {
+    CompImageCacheEntry *bucket[IMAGE_CACHE_HASH_SIZE];
+
+    /* entries by image data, for releaseImageData */
+    CompImageCacheEntry *dataBucket[IMAGE_CACHE_HASH_SIZE];
+
+    /* most recently used entry first */
+    CompImageCacheEntry *lruHead;
+    CompImageCacheEntry *lruTail;
+
+    size_t size;
+};
+
+#define IMAGE_CACHE_DATA_HASH(data) \
+    ((((uintptr_t) (data)) >> 4) % IMAGE_CACHE_HASH_SIZE)
+
+static void
+removeImageCacheEntry (CompImageCache	   *cache,
+		       CompImageCacheEntry *entry)
+{
+    CompImageCacheEntry **e;
+
+    for (e = &cache->bucket[entry->hash % IMAGE_CACHE_HASH_SIZE]; *e;
+	 e = &(*e)->next)
+    {
+	if (*e == entry)
+	{
+	    *e = entry->next;
+	    break;
+	}
+    }
+
+    for (e = &cache->dataBucket[IMAGE_CACHE_DATA_HASH (entry->data)]; *e;
+	 e = &(*e)->dataNext)
+    {
+	if (*e == entry)
+	{
+	    *e = entry->dataNext;
+	    break;
+	}
+    }
+
+    if (entry->lruPrev)
+	entry->lruPrev->lruNext = entry->lruNext;
+    else
+	cache->lruHead = entry->lruNext;
+
+    if (entry->lruNext)
+	entry->lruNext->lruPrev = entry->lruPrev;
+    else
+	cache->lruTail = entry->lruPrev;
+
+    cache->size -= entry->size;
+
+    if (entry->path)
+	free (entry->path);
+
+    free (entry->data);
+    free (entry->name);
+    free (entry);
+}
+
+/* Drops unused images, least recently used first, until the cache fits
+   in the configured size. Stale images are always dropped. */
+static void
+trimImageCache (CompDisplay *display)
+{
+    CompImageCache	*cache = display->imageCache;
+    CompImageCacheEntry *entry, *prev;
+    size_t		limit;
+
+    if (!cache)
+	return;
+
+    /* megabytes */
+    limit = display->opt[COMP_DISPLAY_OPTION_IMAGE_CACHE_SIZE].value.i;
+    limit <<= 20;
+
+    for (entry = cache->lruTail; entry; entry = prev)
+    {
+	prev = entry->lruPrev;
+
+	if (entry->refCount)
+	    continue;
+
+	if (entry->stamp && cache->size <= limit)
+	    continue;
+
+	removeImageCacheEntry (cache, entry);
+    }
+}
+
+static void
+finiImageCache (CompDisplay *display)
+{
+    CompImageCache *cache = display->imageCache;
+
+    if (!cache)
+	return;
+
+    while (cache->lruHead)
+	removeImageCacheEntry (cache, cache->lruHead);
+
+    free (cache);
+
+    display->imageCache = NULL;
+}
+
 const CompMetadataOptionInfo coreDisplayOptionInfo[COMP_DISPLAY_OPTION_NUM] = {
     { "abi", "int", 0, 0, 0 },
     { "active_plugins", "list", "<type>string</type>", 0, 0 },
@@ -579,7 +717,8 @@ const CompMetadataOptionInfo coreDisplayOptionInfo[COMP_DISPLAY_OPTION_NUM] = {
     { "ping_delay", "int", "<min>1000</min>", 0, 0 },
     { "edge_delay", "int", "<min>0</min>", 0, 0 },
     { "cursor_theme", "string", 0, 0, 0 },
-    { "cursor_size", "int", 0, 0, 0 }
+    { "cursor_size", "int", 0, 0, 0 },
+    { "image_cache_size", "int", "<min>0</min>", 0, 0 }
 };
 
 CompOption *
@@ -744,6 +883,13 @@ setDisplayOption (CompPlugin	  *plugin,
 	    return TRUE;
 	}
 	break;
+    case COMP_DISPLAY_OPTION_IMAGE_CACHE_SIZE:
+	if (compSetIntOption (o, value))
+	{
+	    trimImageCache (display);
+	    return TRUE;
+	}
+	break;
     default:
 	if (compSetDisplayOption (display, o, value))
 	    return TRUE;
@@ -756,11 +902,14 @@ setDisplayOption (CompPlugin	  *plugin,
 static void
 updatePlugins (CompDisplay *d)
 {
-    CompOption      *o;
-    CompPlugin      *p, **pop = 0;
-    int	            nPop, i, j, k;
-    CompOptionValue *pList;
-    int             pListCount = 1;
+    CompOption         *o;
+    CompPlugin         *p, **pop = 0;
+    int	               nPop, i, j, k;
+    CompOptionValue    *pList;
+    int                pListCount = 1;
+    CompPluginPrefetch *prefetch = NULL;
+    char               **load;
+    int                nLoad = 0;
 
     d->dirtyPluginList = FALSE;
 
@@ -854,6 +1003,24 @@ updatePlugins (CompDisplay *d)
 	free (d->plugin.list.value[d->plugin.list.nValue].s);
     }
 
+    /* start opening the plugins that aren't already loaded while the
+       ones before them are initialized */
+    load = malloc (sizeof (char *) * (pListCount - i));
+    if (load)
+    {
+	for (k = i; k < pListCount; k++)
+	{
+	    for (j = 0; j < nPop; j++)
+		if (strcmp (pop[j]->vTable->name, pList[k].s) == 0)
+		    break;
+
+	    if (j == nPop)
+		load[nLoad++] = pList[k].s;
+	}
+
+	prefetch = prefetchPlugins (load, nLoad);
+    }
+
     for (; i < pListCount; i++)
     {
 	p = 0;
@@ -872,7 +1039,7 @@ updatePlugins (CompDisplay *d)
 
 	if (p == 0)
 	{
-	    p = loadPlugin (pList[i].s);
+	    p = loadPrefetchedPlugin (prefetch, pList[i].s);
 	    if (p)
 	    {
 		if (!pushPlugin (p))
@@ -904,6 +1071,11 @@ updatePlugins (CompDisplay *d)
 	}
     }
 
+    finiPluginPrefetch (prefetch);
+
+    if (load)
+	free (load);
+
     for (j = 0; j < nPop; j++)
     {
 	if (pop[j])
@@ -1586,8 +1758,12 @@ eventLoop (void)
 	for (d = core.displays; d; d = d->next)
 	{
 	    if (d->dirtyPluginList)
+	    {
 		updatePlugins (d);
 
+		startupTrace ("plugins updated");
+	    }
+
 	    while (XPending (d->display))
 	    {
 		XNextEvent (d->display, &event);
@@ -1694,6 +1870,9 @@ eventLoop (void)
 		lastPointerX = pointerX;
 		lastPointerY = pointerY;
 	    }
+
+	    if (d->dirtyWindowProperties)
+		handleWindowPropertyChanges (d);
 	}
 
 	for (d = core.displays; d; d = d->next)
@@ -1906,6 +2085,15 @@ eventLoop (void)
 
 			s->lastRedraw = tv;
 
+			if (!startupComplete)
+			{
+			    /* only wait for the GPU when measuring */
+			    if (startupBench)
+				glFinish ();
+
+			    finishStartup ();
+			}
+
 			(*s->donePaintScreen) (s);
 
 			/* remove destroyed windows */
@@ -2116,6 +2304,8 @@ addScreenToDisplay (CompDisplay *display,
 static void
 freeDisplay (CompDisplay *d)
 {
+    finiImageCache (d);
+
     compFiniDisplayOptions (d, d->opt, COMP_DISPLAY_OPTION_NUM);
 
     compFiniOptionValue (&d->plugin, CompOptionTypeList);
@@ -2246,6 +2436,8 @@ addDisplay (const char *name)
 
     d->grabbed = FALSE;
 
+    d->imageCache = NULL;
+
     compInitOptionValue (&d->plugin);
 
     d->plugin.list.type   = CompOptionTypeString;
@@ -2284,6 +2476,8 @@ addDisplay (const char *name)
 	return FALSE;
     }
 
+    startupTrace ("display %s connected", DisplayString (dpy));
+
     if (!compInitDisplayOptionsFromMetadata (d,
 					     &coreMetadata,
 					     coreDisplayOptionInfo,
@@ -2313,6 +2507,9 @@ addDisplay (const char *name)
     d->matchExpHandlerChanged = matchExpHandlerChanged;
     d->matchPropertyChanged   = matchPropertyChanged;
 
+    d->windowPropertiesChanged = windowPropertiesChanged;
+    d->dirtyWindowProperties   = FALSE;
+
     d->supportedAtom	     = XInternAtom (dpy, "_NET_SUPPORTED", 0);
     d->supportingWmCheckAtom = XInternAtom (dpy, "_NET_SUPPORTING_WM_CHECK", 0);
 
@@ -2598,6 +2795,8 @@ addDisplay (const char *name)
 
     (*core.objectAdd) (&core.base, &d->base);
 
+    startupTrace ("display extensions initialized");
+
     if (onlyCurrentScreen)
     {
 	firstScreen = DefaultScreen (dpy);
@@ -3171,12 +3370,15 @@ clearTargetOutput (CompDisplay	*display,
 
 #define HOME_IMAGEDIR ".compiz/images"
 
-Bool
-readImageFromFile (CompDisplay *display,
-		   const char  *name,
-		   int	       *width,
-		   int	       *height,
-		   void	       **data)
+/* suffixes image loaders add to names without an extension */
+static const char *imageSuffix[] = { "", ".png", ".svg" };
+
+static Bool
+decodeImageFile (CompDisplay *display,
+		 const char  *name,
+		 int	     *width,
+		 int	     *height,
+		 void	     **data)
 {
     Bool status;
     int  stride;
@@ -3214,6 +3416,288 @@ readImageFromFile (CompDisplay *display,
     return status;
 }
 
+/* Returns a stamp that changes when path is replaced or modified, 0 if
+   path does not exist */
+static uint64_t
+stampImageFile (const char *path)
+{
+    struct stat st;
+    uint64_t	stamp = 14695981039346656037ULL;
+    uint64_t	value[5];
+    int		i, j;
+
+    if (stat (path, &st))
+	return 0;
+
+    value[0] = st.st_dev;
+    value[1] = st.st_ino;
+    value[2] = st.st_size;
+    value[3] = st.st_mtim.tv_sec;
+    value[4] = st.st_mtim.tv_nsec;
+
+    /* FNV-1a */
+    for (i = 0; i < 5; i++)
+    {
+	for (j = 0; j < 8; j++)
+	{
+	    stamp ^= (value[i] >> (j * 8)) & 0xff;
+	    stamp *= 1099511628211ULL;
+	}
+    }
+
+    return stamp ? stamp : 1;
+}
+
+/* Returns the first file in the image loaders' search order that exists
+   for name and sets stamp to its stamp, NULL if there is none. Only done
+   when an image is decoded, cache hits stat the returned file alone. */
+static char *
+findImageFile (const char *name,
+	       uint64_t   *stamp)
+{
+    const char *dir[3];
+    char       *homeDir = NULL;
+    char       *home, *path = NULL;
+    int	       i, j, nDir = 0;
+
+    dir[nDir++] = NULL;
+
+    home = getenv ("HOME");
+    if (home)
+    {
+	homeDir = malloc (strlen (home) + strlen (HOME_IMAGEDIR) + 2);
+	if (homeDir)
+	{
+	    sprintf (homeDir, "%s/%s", home, HOME_IMAGEDIR);
+	    dir[nDir++] = homeDir;
+	}
+    }
+
+    dir[nDir++] = IMAGEDIR;
+
+    for (i = 0; i < nDir; i++)
+    {
+	for (j = 0; j < sizeof (imageSuffix) / sizeof (imageSuffix[0]); j++)
+	{
+	    path = malloc ((dir[i] ? strlen (dir[i]) + 1 : 0) +
+			   strlen (name) + strlen (imageSuffix[j]) + 1);
+	    if (!path)
+		break;
+
+	    if (dir[i])
+		sprintf (path, "%s/%s%s", dir[i], name, imageSuffix[j]);
+	    else
+		sprintf (path, "%s%s", name, imageSuffix[j]);
+
+	    *stamp = stampImageFile (path);
+	    if (*stamp)
+		break;
+
+	    free (path);
+	    path = NULL;
+	}
+
+	if (path)
+	    break;
+    }
+
+    if (homeDir)
+	free (homeDir);
+
+    return path;
+}
+
+/* Returns the decoded image for name. The data is shared with all other
+   users of the image and must be released with releaseImageData. A hit
+   is revalidated against the file it was read from, a file that later
+   appears earlier in the search order is not noticed until the entry
+   is dropped. */
+Bool
+acquireImageData (CompDisplay *display,
+		  const char  *name,
+		  int	      *width,
+		  int	      *height,
+		  const void  **data)
+{
+    CompImageCache	*cache = display->imageCache;
+    CompImageCacheEntry *entry;
+    const char		*c;
+    unsigned int	hash = 5381;
+    uint64_t		stamp = 0;
+    char		*path;
+    void		*image;
+    int			w, h;
+
+    if (!cache)
+    {
+	cache = calloc (1, sizeof (CompImageCache));
+	if (!cache)
+	    return FALSE;
+
+	display->imageCache = cache;
+    }
+
+    for (c = name; *c; c++)
+	hash = (hash << 5) + hash + (unsigned char) *c;
+
+    for (entry = cache->bucket[hash % IMAGE_CACHE_HASH_SIZE]; entry;
+	 entry = entry->next)
+    {
+	if (!entry->stamp || entry->hash != hash ||
+	    strcmp (entry->name, name) != 0)
+	    continue;
+
+	if (!entry->path || stampImageFile (entry->path) == entry->stamp)
+	    break;
+
+	/* the file changed since the image was decoded */
+	entry->stamp = 0;
+    }
+
+    if (entry)
+    {
+	if (entry->lruPrev)
+	{
+	    entry->lruPrev->lruNext = entry->lruNext;
+
+	    if (entry->lruNext)
+		entry->lruNext->lruPrev = entry->lruPrev;
+	    else
+		cache->lruTail = entry->lruPrev;
+
+	    entry->lruPrev = NULL;
+	    entry->lruNext = cache->lruHead;
+
+	    cache->lruHead->lruPrev = entry;
+	    cache->lruHead = entry;
+	}
+    }
+    else
+    {
+	path = findImageFile (name, &stamp);
+
+	if (!decodeImageFile (display, name, &w, &h, &image))
+	{
+	    if (path)
+		free (path);
+
+	    return FALSE;
+	}
+
+	entry = malloc (sizeof (CompImageCacheEntry));
+	if (entry)
+	{
+	    entry->name = strdup (name);
+	    if (!entry->name)
+	    {
+		free (entry);
+		entry = NULL;
+	    }
+	}
+
+	if (!entry)
+	{
+	    if (path)
+		free (path);
+
+	    free (image);
+	    return FALSE;
+	}
+
+	/* no candidate file, the image came from somewhere the cache
+	   cannot check so it is kept as is until dropped */
+	if (!path)
+	    stamp = 1;
+
+	entry->hash	= hash;
+	entry->path	= path;
+	entry->stamp	= stamp;
+	entry->width	= w;
+	entry->height	= h;
+	entry->data	= image;
+	entry->size	= (size_t) w * h * 4;
+	entry->refCount = 0;
+
+	entry->next = cache->bucket[hash % IMAGE_CACHE_HASH_SIZE];
+	cache->bucket[hash % IMAGE_CACHE_HASH_SIZE] = entry;
+
+	entry->dataNext = cache->dataBucket[IMAGE_CACHE_DATA_HASH (image)];
+	cache->dataBucket[IMAGE_CACHE_DATA_HASH (image)] = entry;
+
+	entry->lruPrev = NULL;
+	entry->lruNext = cache->lruHead;
+
+	if (cache->lruHead)
+	    cache->lruHead->lruPrev = entry;
+	else
+	    cache->lruTail = entry;
+
+	cache->lruHead = entry;
+
+	cache->size += entry->size;
+    }
+
+    entry->refCount++;
+
+    trimImageCache (display);
+
+    *width  = entry->width;
+    *height = entry->height;
+    *data   = entry->data;
+
+    return TRUE;
+}
+
+void
+releaseImageData (CompDisplay *display,
+		  const void  *data)
+{
+    CompImageCacheEntry *entry;
+
+    if (!display->imageCache)
+	return;
+
+    for (entry = display->imageCache->dataBucket[IMAGE_CACHE_DATA_HASH (data)];
+	 entry; entry = entry->dataNext)
+    {
+	if (entry->data == data)
+	{
+	    entry->refCount--;
+	    break;
+	}
+    }
+
+    trimImageCache (display);
+}
+
+Bool
+readImageFromFile (CompDisplay *display,
+		   const char  *name,
+		   int	       *width,
+		   int	       *height,
+		   void	       **data)
+{
+    const void *image;
+    size_t     size;
+
+    /* nothing is kept, so the decoded image is handed out directly */
+    if (!display->opt[COMP_DISPLAY_OPTION_IMAGE_CACHE_SIZE].value.i)
+	return decodeImageFile (display, name, width, height, data);
+
+    if (!acquireImageData (display, name, width, height, &image))
+	return FALSE;
+
+    /* callers own the returned data */
+    size  = (size_t) *width * *height * 4;
+    *data = malloc (size);
+    if (*data)
+	memcpy (*data, image, size);
+
+    releaseImageData (display, image);
+
+    return *data != NULL;
+}
+
 Bool
 writeImageToFile (CompDisplay *display,
 		  const char  *path,
@@ -57,6 +57,8 @@ handleWindowDamageRect (CompWindow *w,
 	w->invisible = WINDOW_INVISIBLE (w);
     }
 
+    damageWindowThumbnail (w);
+
     region.extents.x1 = x;
     region.extents.y1 = y;
     region.extents.x2 = region.extents.x1 + width;
@@ -1304,6 +1306,128 @@ read_resource_for_cursor_changes (CompDisplay *d,
     }
 }
 
+/* Re-reads the properties whose latest value is all that matters,
+   once for all PropertyNotify events of a batch. */
+void
+windowPropertiesChanged (CompWindow *w,
+			 Atom	    *property,
+			 int	    nProperty)
+{
+    CompDisplay *d = w->screen->display;
+    Bool	struts = FALSE;
+    int		i, value;
+
+    for (i = 0; i < nProperty; i++)
+    {
+	if (property[i] == d->winOpacityAtom)
+	{
+	    if (w->type & CompWindowTypeDesktopMask)
+		continue;
+
+	    value = getWindowProp32 (d, w->id, d->winOpacityAtom, OPAQUE);
+	    if (value != w->paint.opacity)
+	    {
+		w->paint.opacity = value;
+		addWindowDamage (w);
+	    }
+	}
+	else if (property[i] == d->winBrightnessAtom)
+	{
+	    value = getWindowProp32 (d, w->id, d->winBrightnessAtom, BRIGHT);
+	    if (value != w->paint.brightness)
+	    {
+		w->paint.brightness = value;
+		addWindowDamage (w);
+	    }
+	}
+	else if (property[i] == d->winSaturationAtom)
+	{
+	    if (!w->screen->canDoSaturated)
+		continue;
+
+	    value = getWindowProp32 (d, w->id, d->winSaturationAtom, COLOR);
+	    if (value != w->paint.saturation)
+	    {
+		w->paint.saturation = value;
+		addWindowDamage (w);
+	    }
+	}
+	else if (property[i] == d->wmStrutAtom ||
+		 property[i] == d->wmStrutPartialAtom)
+	{
+	    struts = TRUE;
+	}
+	else if (property[i] == d->wmIconGeometryAtom)
+	{
+	    updateIconGeometry (w);
+	}
+	else if (property[i] == d->wmProtocolsAtom)
+	{
+	    w->protocols = getProtocols (d, w->id);
+	}
+	else if (property[i] == XA_WM_CLASS)
+	{
+	    updateWindowClassHints (w);
+	}
+    }
+
+    if (struts && updateWindowStruts (w))
+	updateWorkareaForScreen (w->screen);
+}
+
+void
+setWindowPropertyDirty (CompWindow *w,
+			Atom	   property)
+{
+    int i;
+
+    for (i = 0; i < w->nDirtyProperty; i++)
+	if (w->dirtyProperty[i] == property)
+	    return;
+
+    if (w->nDirtyProperty == w->dirtyPropertySize)
+    {
+	Atom *dirtyProperty;
+	int  size = w->dirtyPropertySize ? w->dirtyPropertySize * 2 : 8;
+
+	dirtyProperty = realloc (w->dirtyProperty, size * sizeof (Atom));
+	if (!dirtyProperty)
+	    return;
+
+	w->dirtyProperty     = dirtyProperty;
+	w->dirtyPropertySize = size;
+    }
+
+    w->dirtyProperty[w->nDirtyProperty++] = property;
+
+    w->screen->display->dirtyWindowProperties = TRUE;
+}
+
+void
+handleWindowPropertyChanges (CompDisplay *d)
+{
+    CompScreen *s;
+    CompWindow *w;
+    int	       n;
+
+    d->dirtyWindowProperties = FALSE;
+
+    for (s = d->screens; s; s = s->next)
+    {
+	for (w = s->windows; w; w = w->next)
+	{
+	    if (!w->nDirtyProperty)
+		continue;
+
+	    n = w->nDirtyProperty;
+	    w->nDirtyProperty = 0;
+
+	    if (!w->destroyed)
+		(*d->windowPropertiesChanged) (w, w->dirtyProperty, n);
+	}
+    }
+}
+
 void
 handleEvent (CompDisplay *d,
 	     XEvent      *event)
@@ -1535,6 +1659,10 @@ handleEvent (CompDisplay *d,
 	}
 	break;
     case PropertyNotify:
+	w = findWindowAtDisplay (d, event->xproperty.window);
+	if (w)
+	    setWindowPropertyDirty (w, event->xproperty.atom);
+
 	if (event->xproperty.atom == d->winTypeAtom)
 	{
 	    w = findWindowAtDisplay (d, event->xproperty.window);
@@ -1568,7 +1696,7 @@ handleEvent (CompDisplay *d,
 
 		    updateClientListForScreen (w->screen);
 
-		    (*d->matchPropertyChanged) (d, w);
+		    windowMatchPropertyChanged (w);
 		}
 	    }
 	}
@@ -1628,66 +1756,12 @@ handleEvent (CompDisplay *d,
 	    if (w)
 		w->clientLeader = getClientLeader (w);
 	}
-	else if (event->xproperty.atom == d->wmIconGeometryAtom)
-	{
-	    w = findWindowAtDisplay (d, event->xproperty.window);
-	    if (w)
-		updateIconGeometry (w);
-	}
 	else if (event->xproperty.atom == d->gtkFrameExtentsAtom)
 	{
 	    w = findWindowAtDisplay (d, event->xproperty.window);
 	    if (w)
 		updateClientFrame (w);
 	}
-
-	else if (event->xproperty.atom == d->winOpacityAtom)
-	{
-	    w = findWindowAtDisplay (d, event->xproperty.window);
-	    if (w && !(w->type & CompWindowTypeDesktopMask))
-	    {
-		int opacity;
-
-		opacity = getWindowProp32 (d, w->id, d->winOpacityAtom, OPAQUE);
-		if (opacity != w->paint.opacity)
-		{
-		    w->paint.opacity = opacity;
-		    addWindowDamage (w);
-		}
-	    }
-	}
-	else if (event->xproperty.atom == d->winBrightnessAtom)
-	{
-	    w = findWindowAtDisplay (d, event->xproperty.window);
-	    if (w)
-	    {
-		int brightness;
-
-		brightness = getWindowProp32 (d, w->id,
-	     				      d->winBrightnessAtom, BRIGHT);
-		if (brightness != w->paint.brightness)
-		{
-		    w->paint.brightness = brightness;
-		    addWindowDamage (w);
-		}
-	    }
-	}
-	else if (event->xproperty.atom == d->winSaturationAtom)
-	{
-	    w = findWindowAtDisplay (d, event->xproperty.window);
-	    if (w && w->screen->canDoSaturated)
-	    {
-		int saturation;
-
-		saturation = getWindowProp32 (d, w->id,
-					      d->winSaturationAtom, COLOR);
-		if (saturation != w->paint.saturation)
-		{
-		    w->paint.saturation = saturation;
-		    addWindowDamage (w);
-		}
-	    }
-	}
 	else if (event->xproperty.atom == d->xBackgroundAtom[0] ||
 		 event->xproperty.atom == d->xBackgroundAtom[1])
 	{
@@ -1704,16 +1778,6 @@ handleEvent (CompDisplay *d,
 		}
 	    }
 	}
-	else if (event->xproperty.atom == d->wmStrutAtom ||
-		 event->xproperty.atom == d->wmStrutPartialAtom)
-	{
-	    w = findWindowAtDisplay (d, event->xproperty.window);
-	    if (w)
-	    {
-		if (updateWindowStruts (w))
-		    updateWorkareaForScreen (w->screen);
-	    }
-	}
 	else if (event->xproperty.atom == d->mwmHintsAtom)
 	{
 	    w = findWindowAtDisplay (d, event->xproperty.window);
@@ -1724,12 +1788,6 @@ handleEvent (CompDisplay *d,
 		recalcWindowActions (w);
 	    }
 	}
-	else if (event->xproperty.atom == d->wmProtocolsAtom)
-	{
-	    w = findWindowAtDisplay (d, event->xproperty.window);
-	    if (w)
-		w->protocols = getProtocols (d, w->id);
-	}
 	else if (event->xproperty.atom == d->wmIconAtom)
 	{
 	    w = findWindowAtDisplay (d, event->xproperty.window);
@@ -1779,12 +1837,6 @@ handleEvent (CompDisplay *d,
 		}
 	    }
 	}
-	else if (event->xproperty.atom == XA_WM_CLASS)
-	{
-	    w = findWindowAtDisplay (d, event->xproperty.window);
-	    if (w)
-		updateWindowClassHints (w);
-	}
 	else if (event->xproperty.atom == XA_RESOURCE_MANAGER)
         {
 	    read_resource_for_cursor_changes (d, event);
@@ -2100,7 +2152,7 @@ handleEvent (CompDisplay *d,
 		    recalcWindowType (w);
 		    recalcWindowActions (w);
 
-		    (*d->matchPropertyChanged) (d, w);
+		    windowMatchPropertyChanged (w);
 		}
 	    }
 
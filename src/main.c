@@ -32,6 +32,7 @@
 #include <signal.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 #include <sys/wait.h>
 
 #include <compiz-core.h>
@@ -67,8 +68,12 @@ Bool noDetection = FALSE;
 Bool useDesktopHints = FALSE;
 Bool onlyCurrentScreen = FALSE;
 Bool noFBO = FALSE;
+Bool startupBench = FALSE;
+Bool startupComplete = FALSE;
 static Bool debugOutput = FALSE;
 
+static struct timespec startupStart, startupLast;
+
 #ifdef USE_COW
 Bool useCow = TRUE;
 #endif
@@ -98,6 +103,7 @@ usage (void)
 #endif
 
 	    "[--debug] "
+	    "[--startup-bench] "
 	    "[--version] "
 	    "[--help] "
 	    "[PLUGIN]...\n",
@@ -138,6 +144,63 @@ logMessage (const char	 *componentName,
 	      logLevelToString (level), message);
 }
 
+static int
+timespecDiff (struct timespec *tp1,
+	      struct timespec *tp2)
+{
+    return (tp1->tv_sec - tp2->tv_sec) * 1000000 +
+	(tp1->tv_nsec - tp2->tv_nsec) / 1000;
+}
+
+/* Logs a startup phase with the time since the process started and
+   since the previous phase. Tracing stops with the first frame. */
+void
+startupTrace (const char *format,
+	      ...)
+{
+    struct timespec tp;
+    va_list	    args;
+    char	    phase[256];
+    int		    total, delta;
+
+    if (startupComplete)
+	return;
+
+    clock_gettime (CLOCK_MONOTONIC, &tp);
+
+    if (!startupStart.tv_sec && !startupStart.tv_nsec)
+	startupStart = startupLast = tp;
+
+    total = timespecDiff (&tp, &startupStart);
+    delta = timespecDiff (&tp, &startupLast);
+
+    startupLast = tp;
+
+    va_start (args, format);
+    vsnprintf (phase, sizeof (phase), format, args);
+    va_end (args);
+
+    compLogMessage ("core",
+		    startupBench ? CompLogLevelInfo : CompLogLevelDebug,
+		    "startup %6d.%03d ms (+%d.%03d ms): %s",
+		    total / 1000, total % 1000,
+		    delta / 1000, delta % 1000, phase);
+}
+
+void
+finishStartup (void)
+{
+    if (startupComplete)
+	return;
+
+    startupTrace ("first frame");
+
+    startupComplete = TRUE;
+
+    if (startupBench)
+	shutDown = TRUE;
+}
+
 const char *
 logLevelToString (CompLogLevel level)
 {
@@ -331,6 +394,10 @@ main (int argc, char **argv)
 	    printf (PACKAGE_STRING "\n");
 	    return 0;
 	}
+	else if (!strcmp (argv[i], "--startup-bench"))
+	{
+	    startupBench = TRUE;
+	}
 	else if (!strcmp (argv[i], "--debug"))
 	{
 	    debugOutput = TRUE;
@@ -425,6 +492,8 @@ main (int argc, char **argv)
 	}
     }
 
+    startupTrace ("started");
+
     /* add in default plugins if none are given */
     if (nPlugin == 0)
     {
@@ -505,6 +574,8 @@ main (int argc, char **argv)
 
     coreInitialized = TRUE;
 
+    startupTrace ("core initialized");
+
     if (!disableSm)
     {
 	if (clientId == NULL)
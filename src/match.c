@@ -28,6 +28,61 @@
 
 #include <compiz-core.h>
 
+typedef enum {
+    CompMatchInstTypeGroup,
+    CompMatchInstTypeType,
+    CompMatchInstTypeState,
+    CompMatchInstTypeId,
+    CompMatchInstTypeOverrideRedirect,
+    CompMatchInstTypeAlpha,
+    CompMatchInstTypeExp
+} CompMatchInstType;
+
+/*
+  A compiled match is a flat array of instructions. Group bodies
+  directly follow the group instruction and length is the number of
+  instructions in the body. Built-in expressions are evaluated inline
+  and runs of or'ed type and state expressions are merged into a
+  single instruction. As an or'ed expression that follows a true
+  result makes the whole group true, all but the last merged mask go
+  into exitMask.
+*/
+struct _CompMatchInst {
+    CompMatchInstType	 type;
+    int			 flags;
+    int			 length;
+    unsigned int	 exitMask;
+    CompMatchExpEvalProc eval;
+    CompPrivate		 priv;
+};
+
+static unsigned int lastMatchSerial = 0;
+
+static Bool
+matchEvalTypeExp (CompDisplay *display,
+		  CompWindow  *window,
+		  CompPrivate private);
+
+static Bool
+matchEvalStateExp (CompDisplay *display,
+		   CompWindow  *window,
+		   CompPrivate private);
+
+static Bool
+matchEvalIdExp (CompDisplay *display,
+		CompWindow  *window,
+		CompPrivate private);
+
+static Bool
+matchEvalOverrideRedirectExp (CompDisplay *display,
+			      CompWindow  *window,
+			      CompPrivate private);
+
+static Bool
+matchEvalAlphaExp (CompDisplay *display,
+		   CompWindow  *window,
+		   CompPrivate private);
+
 static void
 matchResetOps (CompDisplay *display,
 	       CompMatchOp *op,
@@ -61,7 +116,13 @@ matchReset (CompMatch *match)
     if (match->display)
 	matchResetOps (match->display, match->op, match->nOp);
 
+    if (match->inst)
+	free (match->inst);
+
     match->display = NULL;
+    match->inst	   = NULL;
+    match->nInst   = 0;
+    match->serial  = 0;
 }
 
 void
@@ -69,7 +130,10 @@ matchInit (CompMatch *match)
 {
     match->display = NULL;
     match->op	   = NULL;
-    match->nOp	    = 0;
+    match->nOp	   = 0;
+    match->inst	   = NULL;
+    match->nInst   = 0;
+    match->serial  = 0;
 }
 
 static void
@@ -571,12 +635,123 @@ matchUpdateOps (CompDisplay *display,
     }
 }
 
+static int
+matchCountOps (CompMatchOp *op,
+	       int	   nOp)
+{
+    int count = nOp;
+
+    while (nOp--)
+    {
+	if (op->type == CompMatchOpTypeGroup)
+	    count += matchCountOps (op->group.op, op->group.nOp);
+
+	op++;
+    }
+
+    return count;
+}
+
+static CompMatchInstType
+matchExpInstType (CompMatchExp *exp)
+{
+    if (exp->eval == matchEvalTypeExp)
+	return CompMatchInstTypeType;
+    else if (exp->eval == matchEvalStateExp)
+	return CompMatchInstTypeState;
+    else if (exp->eval == matchEvalIdExp)
+	return CompMatchInstTypeId;
+    else if (exp->eval == matchEvalOverrideRedirectExp)
+	return CompMatchInstTypeOverrideRedirect;
+    else if (exp->eval == matchEvalAlphaExp)
+	return CompMatchInstTypeAlpha;
+
+    return CompMatchInstTypeExp;
+}
+
+static int
+matchCompileOps (CompMatchInst *inst,
+		 CompMatchOp   *op,
+		 int	       nOp)
+{
+    CompMatchInst *first = inst, *prev = NULL;
+    int		  length;
+
+    while (nOp--)
+    {
+	switch (op->type) {
+	case CompMatchOpTypeGroup:
+	    length = matchCompileOps (inst + 1, op->group.op, op->group.nOp);
+
+	    inst->type	   = CompMatchInstTypeGroup;
+	    inst->flags	   = op->any.flags;
+	    inst->length   = length;
+	    inst->exitMask = 0;
+	    inst->eval	   = NULL;
+
+	    inst->priv.val = 0;
+
+	    prev  = NULL;
+	    inst += length + 1;
+	    break;
+	case CompMatchOpTypeExp:
+	    inst->type = matchExpInstType (&op->exp.e);
+
+	    /* merge "type=x | type=y" into a single instruction */
+	    if (prev && prev->type == inst->type && !prev->flags &&
+		!op->any.flags && (inst->type == CompMatchInstTypeType ||
+				   inst->type == CompMatchInstTypeState))
+	    {
+		prev->exitMask |= prev->priv.uval;
+		prev->priv.uval = op->exp.e.priv.uval;
+		break;
+	    }
+
+	    inst->flags	   = op->any.flags;
+	    inst->length   = 0;
+	    inst->exitMask = 0;
+	    inst->eval	   = op->exp.e.eval;
+	    inst->priv	   = op->exp.e.priv;
+
+	    prev = inst++;
+	    break;
+	}
+
+	op++;
+    }
+
+    return inst - first;
+}
+
+static void
+matchCompile (CompMatch *match)
+{
+    int count;
+
+    count = matchCountOps (match->op, match->nOp);
+    if (!count)
+	return;
+
+    match->inst = malloc (sizeof (CompMatchInst) * count);
+    if (!match->inst)
+	return;
+
+    match->nInst = matchCompileOps (match->inst, match->op, match->nOp);
+
+    /* serial 0 is never used so that cleared cache entries never match */
+    if (!++lastMatchSerial)
+	lastMatchSerial++;
+
+    match->serial = lastMatchSerial;
+}
+
 void
 matchUpdate (CompDisplay *display,
 	     CompMatch   *match)
 {
     matchReset (match);
     matchUpdateOps (display, match->op, match->nOp);
+    matchCompile (match);
     match->display = display;
 }
 
@@ -628,14 +803,102 @@ matchEvalOps (CompDisplay *display,
     return result;
 }
 
+static Bool
+matchEvalInsts (CompDisplay   *display,
+		CompMatchInst *inst,
+		int	      nInst,
+		CompWindow    *window)
+{
+    CompMatchInst *end = inst + nInst;
+    Bool	  value, result = FALSE;
+
+    while (inst < end)
+    {
+	/* fast evaluation, same rules as matchEvalOps */
+	if (inst->flags & MATCH_OP_AND_MASK)
+	{
+	    if (!result)
+		return FALSE;
+	}
+	else
+	{
+	    if (result)
+		return TRUE;
+	}
+
+	switch (inst->type) {
+	case CompMatchInstTypeGroup:
+	    value = matchEvalInsts (display, inst + 1, inst->length, window);
+	    break;
+	case CompMatchInstTypeType:
+	    if (inst->exitMask & window->wmType)
+		return TRUE;
+
+	    value = (inst->priv.uval & window->wmType) != 0;
+	    break;
+	case CompMatchInstTypeState:
+	    if (inst->exitMask & window->state)
+		return TRUE;
+
+	    value = (inst->priv.uval & window->state) != 0;
+	    break;
+	case CompMatchInstTypeId:
+	    value = (inst->priv.val == window->id);
+	    break;
+	case CompMatchInstTypeOverrideRedirect:
+	    value = (inst->priv.val ==
+		     (window->attrib.override_redirect ? 1 : 0));
+	    break;
+	case CompMatchInstTypeAlpha:
+	    value = (inst->priv.val ? window->alpha : !window->alpha);
+	    break;
+	case CompMatchInstTypeExp:
+	default:
+	    value = (*inst->eval) (display, window, inst->priv);
+	    break;
+	}
+
+	if (inst->flags & MATCH_OP_NOT_MASK)
+	    value = !value;
+
+	if (inst->flags & MATCH_OP_AND_MASK)
+	    result = (result && value);
+	else
+	    result = (result || value);
+
+	inst += inst->length + 1;
+    }
+
+    return result;
+}
+
 Bool
 matchEval (CompMatch  *match,
 	   CompWindow *window)
 {
-    if (match->display)
+    CompMatchCacheEntry *entry;
+    Bool		result;
+
+    if (!match->display)
+	return FALSE;
+
+    /* compilation failed or empty match */
+    if (!match->inst)
 	return matchEvalOps (match->display, match->op, match->nOp, window);
 
-    return FALSE;
+    entry = &window->matchCache[match->serial % MATCH_CACHE_SIZE];
+    if (entry->serial     == match->serial &&
+	entry->generation == window->matchGeneration)
+	return entry->result;
+
+    result = matchEvalInsts (match->display, match->inst, match->nInst,
+			     window);
+
+    entry->serial     = match->serial;
+    entry->generation = window->matchGeneration;
+    entry->result     = result;
+
+    return result;
 }
 
 static Bool
@@ -779,4 +1042,23 @@ void
 matchPropertyChanged (CompDisplay *display,
 		      CompWindow  *w)
 {
+    invalidateWindowMatchCache (w);
+}
+
+void
+invalidateWindowMatchCache (CompWindow *w)
+{
+    w->matchGeneration++;
+}
+
+void
+windowMatchPropertyChanged (CompWindow *w)
+{
+    CompDisplay *d = w->screen->display;
+
+    /* before the wrapper chain as plugins might evaluate matches
+       before calling down to the core implementation */
+    invalidateWindowMatchCache (w);
+
+    (*d->matchPropertyChanged) (d, w);
 }
@@ -32,12 +32,58 @@
 #include <libxml/xpathInternals.h>
 #include <locale.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include <compiz-core.h>
 
 #define HOME_METADATADIR ".compiz/metadata"
 #define EXTENSION ".xml"
 
+#define METADATA_SECTION_DISPLAY 0
+#define METADATA_SECTION_SCREEN  1
+
+typedef struct _CompMetadataOption {
+    xmlChar    *name;
+    int	       section;
+    int	       seq;
+    xmlNodePtr node;
+} CompMetadataOption;
+
+/* all option elements of the core or plugin element, sorted by
+   section and name and, for equal names, in document order so that
+   lookups give the same nodes as the XPath queries they replace */
+struct _CompMetadataIndex {
+    int		       nDoc;
+    CompMetadataOption *option;
+    int		       nOption;
+    int		       optionSize;
+};
+
+/* documents parsed ahead of time by the plugin prefetch threads,
+   keyed by file name and handed over on first read */
+typedef struct _CompPrefetchedXmlFile {
+    struct _CompPrefetchedXmlFile *next;
+    char			  *file;
+    xmlDoc			  *doc;
+} CompPrefetchedXmlFile;
+
+static CompPrefetchedXmlFile *prefetchedXmlFiles = NULL;
+static pthread_mutex_t	     prefetchMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+freeMetadataIndex (CompMetadataIndex *index)
+{
+    int i;
+
+    for (i = 0; i < index->nOption; i++)
+	xmlFree (index->option[i].name);
+
+    if (index->option)
+	free (index->option);
+
+    free (index);
+}
+
 Bool
 compInitMetadata (CompMetadata *metadata)
 {
@@ -45,8 +91,9 @@ compInitMetadata (CompMetadata *metadata)
     if (!metadata->path)
 	return FALSE;
 
-    metadata->doc  = NULL;
-    metadata->nDoc = 0;
+    metadata->doc   = NULL;
+    metadata->nDoc  = 0;
+    metadata->index = NULL;
 
     return TRUE;
 }
@@ -63,8 +110,9 @@ compInitPluginMetadata (CompMetadata *metadata,
     if (!metadata->path)
 	return FALSE;
 
-    metadata->doc  = NULL;
-    metadata->nDoc = 0;
+    metadata->doc   = NULL;
+    metadata->nDoc  = 0;
+    metadata->index = NULL;
 
     return TRUE;
 }
@@ -80,17 +128,18 @@ compFiniMetadata (CompMetadata *metadata)
     if (metadata->doc)
 	free (metadata->doc);
 
+    if (metadata->index)
+	freeMetadataIndex (metadata->index);
+
     free (metadata->path);
 }
 
-static xmlDoc *
-readXmlFile (const char	*path,
-	     const char	*name)
+static char *
+metadataFileName (const char *path,
+		  const char *name)
 {
-    char   *file;
-    int    length = strlen (name) + strlen (EXTENSION) + 1;
-    xmlDoc *doc = NULL;
-    FILE   *fp;
+    char *file;
+    int  length = strlen (name) + strlen (EXTENSION) + 1;
 
     if (path)
 	length += strlen (path) + 1;
@@ -104,22 +153,147 @@ readXmlFile (const char	*path,
     else
 	sprintf (file, "%s%s", name, EXTENSION);
 
+    return file;
+}
+
+static xmlDoc *
+parseXmlFile (const char *file)
+{
+    FILE *fp;
+
     fp = fopen (file, "r");
     if (!fp)
-    {
-	free (file);
 	return NULL;
-    }
 
     fclose (fp);
 
-    doc = xmlReadFile (file, NULL, 0);
+    return xmlReadFile (file, NULL, 0);
+}
+
+static xmlDoc *
+takePrefetchedXmlFile (const char *file,
+		       Bool	  *found)
+{
+    CompPrefetchedXmlFile *pf, **prev;
+    xmlDoc		  *doc = NULL;
+
+    *found = FALSE;
+
+    pthread_mutex_lock (&prefetchMutex);
+
+    for (prev = &prefetchedXmlFiles; (pf = *prev); prev = &pf->next)
+    {
+	if (strcmp (pf->file, file) == 0)
+	{
+	    *prev  = pf->next;
+	    *found = TRUE;
+	    doc    = pf->doc;
+
+	    free (pf->file);
+	    free (pf);
+	    break;
+	}
+    }
+
+    pthread_mutex_unlock (&prefetchMutex);
+
+    return doc;
+}
+
+static xmlDoc *
+readXmlFile (const char	*path,
+	     const char	*name)
+{
+    char   *file;
+    xmlDoc *doc;
+    Bool   found;
+
+    file = metadataFileName (path, name);
+    if (!file)
+	return NULL;
+
+    doc = takePrefetchedXmlFile (file, &found);
+    if (!found)
+	doc = parseXmlFile (file);
 
     free (file);
 
     return doc;
 }
 
+static void
+prefetchXmlFile (const char *path,
+		 const char *name)
+{
+    CompPrefetchedXmlFile *pf;
+
+    pf = malloc (sizeof (CompPrefetchedXmlFile));
+    if (!pf)
+	return;
+
+    pf->file = metadataFileName (path, name);
+    if (!pf->file)
+    {
+	free (pf);
+	return;
+    }
+
+    /* missing files are remembered too, so that the reader doesn't
+       have to look for them again */
+    pf->doc = parseXmlFile (pf->file);
+
+    pthread_mutex_lock (&prefetchMutex);
+    pf->next	       = prefetchedXmlFiles;
+    prefetchedXmlFiles = pf;
+    pthread_mutex_unlock (&prefetchMutex);
+}
+
+/* Parses the files compAddMetadataFromFile would read for "file" and
+   keeps the documents until they are asked for. Safe to call from
+   any thread once the XML parser has been initialized. */
+void
+compPrefetchMetadataFromFile (const char *file)
+{
+    char *home;
+
+    home = getenv ("HOME");
+    if (home)
+    {
+	char *path;
+
+	path = malloc (strlen (home) + strlen (HOME_METADATADIR) + 2);
+	if (path)
+	{
+	    sprintf (path, "%s/%s", home, HOME_METADATADIR);
+	    prefetchXmlFile (path, file);
+	    free (path);
+	}
+    }
+
+    prefetchXmlFile (METADATADIR, file);
+}
+
+void
+compFlushPrefetchedMetadata (void)
+{
+    CompPrefetchedXmlFile *pf;
+
+    pthread_mutex_lock (&prefetchMutex);
+
+    while ((pf = prefetchedXmlFiles))
+    {
+	prefetchedXmlFiles = pf->next;
+
+	if (pf->doc)
+	    xmlFreeDoc (pf->doc);
+
+	free (pf->file);
+	free (pf);
+    }
+
+    pthread_mutex_unlock (&prefetchMutex);
+}
+
 static Bool
 addMetadataFromFilename (CompMetadata *metadata,
 			 const char   *path,
@@ -373,24 +547,272 @@ initXPathFromMetadataPath (CompXPath	 *xPath,
     return FALSE;
 }
 
+static void
+finiXPath (CompXPath *xPath)
+{
+    xmlXPathFreeObject (xPath->obj);
+    xmlXPathFreeContext (xPath->ctx);
+}
+
 static Bool
-initXPathFromMetadataPathElement (CompXPath	*xPath,
-				  CompMetadata  *metadata,
-				  const xmlChar *path,
-				  const xmlChar *element)
+addMetadataIndexOptions (CompMetadataIndex *index,
+			 xmlNodePtr	   parent,
+			 int		   section)
 {
-    char str[1024];
+    xmlNodePtr node;
+
+    for (node = parent->xmlChildrenNode; node; node = node->next)
+    {
+	if (node->type != XML_ELEMENT_NODE)
+	    continue;
+
+	if (!xmlStrcmp (node->name, BAD_CAST "option"))
+	{
+	    xmlChar *name;
+
+	    name = xmlGetProp (node, BAD_CAST "name");
+	    if (name)
+	    {
+		CompMetadataOption *o;
+
+		if (index->nOption == index->optionSize)
+		{
+		    o = realloc (index->option, sizeof (CompMetadataOption) *
+				 (index->optionSize + 64));
+		    if (!o)
+		    {
+			xmlFree (name);
+			return FALSE;
+		    }
+
+		    index->option      = o;
+		    index->optionSize += 64;
+		}
+
+		o = &index->option[index->nOption];
 
-    snprintf (str, 1024, "%s/%s", path, element);
+		o->name    = name;
+		o->section = section;
+		o->seq	   = index->nOption;
+		o->node	   = node;
 
-    return initXPathFromMetadataPath (xPath, metadata, BAD_CAST str);
+		index->nOption++;
+	    }
+	}
+
+	/* descendants, like screen//option */
+	if (!addMetadataIndexOptions (index, node, section))
+	    return FALSE;
+    }
+
+    return TRUE;
 }
 
-static void
-finiXPath (CompXPath *xPath)
+static int
+compareMetadataOptions (const void *a,
+			const void *b)
 {
-    xmlXPathFreeObject (xPath->obj);
-    xmlXPathFreeContext (xPath->ctx);
+    const CompMetadataOption *oa = a;
+    const CompMetadataOption *ob = b;
+    int			     r;
+
+    if (oa->section != ob->section)
+	return oa->section - ob->section;
+
+    r = xmlStrcmp (oa->name, ob->name);
+    if (r)
+	return r;
+
+    return oa->seq - ob->seq;
+}
+
+static CompMetadataIndex *
+getMetadataIndex (CompMetadata *metadata)
+{
+    CompMetadataIndex *index = metadata->index;
+    char	      plugin[1024];
+    int		      i;
+
+    if (index)
+    {
+	if (index->nDoc == metadata->nDoc)
+	    return index;
+
+	/* documents were added, index them all again */
+	freeMetadataIndex (index);
+	metadata->index = NULL;
+    }
+
+    index = calloc (1, sizeof (CompMetadataIndex));
+    if (!index)
+	return NULL;
+
+    /* metadata->path is either "core" or plugin[@name="..."] */
+    if (strcmp (metadata->path, "core") &&
+	sscanf (metadata->path, "plugin[@name=\"%1023[^\"]\"]", plugin) != 1)
+    {
+	free (index);
+	return NULL;
+    }
+
+    for (i = 0; i < metadata->nDoc; i++)
+    {
+	xmlNodePtr root, node, section;
+
+	root = xmlDocGetRootElement (metadata->doc[i]);
+	if (!root || xmlStrcmp (root->name, BAD_CAST "compiz"))
+	    continue;
+
+	for (node = root->xmlChildrenNode; node; node = node->next)
+	{
+	    if (node->type != XML_ELEMENT_NODE)
+		continue;
+
+	    if (strcmp (metadata->path, "core") == 0)
+	    {
+		if (xmlStrcmp (node->name, BAD_CAST "core"))
+		    continue;
+	    }
+	    else
+	    {
+		xmlChar *name;
+		Bool	match;
+
+		if (xmlStrcmp (node->name, BAD_CAST "plugin"))
+		    continue;
+
+		name = xmlGetProp (node, BAD_CAST "name");
+		if (!name)
+		    continue;
+
+		match = !xmlStrcmp (name, BAD_CAST plugin);
+		xmlFree (name);
+
+		if (!match)
+		    continue;
+	    }
+
+	    for (section = node->xmlChildrenNode; section;
+		 section = section->next)
+	    {
+		Bool status = TRUE;
+
+		if (section->type != XML_ELEMENT_NODE)
+		    continue;
+
+		if (!xmlStrcmp (section->name, BAD_CAST "display"))
+		    status = addMetadataIndexOptions (index, section,
+						      METADATA_SECTION_DISPLAY);
+		else if (!xmlStrcmp (section->name, BAD_CAST "screen"))
+		    status = addMetadataIndexOptions (index, section,
+						      METADATA_SECTION_SCREEN);
+
+		if (!status)
+		{
+		    freeMetadataIndex (index);
+		    return NULL;
+		}
+	    }
+	}
+    }
+
+    qsort (index->option, index->nOption, sizeof (CompMetadataOption),
+	   compareMetadataOptions);
+
+    index->nDoc = metadata->nDoc;
+
+    metadata->index = index;
+
+    return index;
+}
+
+/* returns the elements of all options called name in section, in
+   document order */
+static CompMetadataOption *
+findMetadataOptions (CompMetadata *metadata,
+		     int	  section,
+		     const char	  *name,
+		     int	  *n)
+{
+    CompMetadataIndex *index;
+    int		      lo, hi, mid, first, r;
+
+    index = getMetadataIndex (metadata);
+    if (!index)
+	return NULL;
+
+    lo = 0;
+    hi = index->nOption;
+
+    while (lo < hi)
+    {
+	mid = (lo + hi) / 2;
+
+	r = index->option[mid].section - section;
+	if (!r)
+	    r = xmlStrcmp (index->option[mid].name, BAD_CAST name);
+
+	if (r < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    first = lo;
+
+    while (lo < index->nOption				&&
+	   index->option[lo].section == section		&&
+	   !xmlStrcmp (index->option[lo].name, BAD_CAST name))
+	lo++;
+
+    if (lo == first)
+	return NULL;
+
+    *n = lo - first;
+
+    return &index->option[first];
+}
+
+/* first child element called element of the options, same as the
+   option path followed by /element */
+static xmlNodePtr
+getOptionElement (CompMetadataOption *option,
+		  int		     nOption,
+		  const char	     *element)
+{
+    xmlNodePtr node;
+    int	       i;
+
+    for (i = 0; i < nOption; i++)
+	for (node = option[i].node->xmlChildrenNode; node; node = node->next)
+	    if (node->type == XML_ELEMENT_NODE &&
+		!xmlStrcmp (node->name, BAD_CAST element))
+		return node;
+
+    return NULL;
+}
+
+static char *
+stringFromOptionElement (CompMetadataOption *option,
+			 int		    nOption,
+			 const char	    *element)
+{
+    xmlNodePtr node;
+    xmlChar    *content;
+    char       *v = NULL;
+
+    node = getOptionElement (option, nOption, element);
+    if (!node)
+	return NULL;
+
+    content = xmlNodeGetContent (node);
+    if (content)
+    {
+	v = strdup ((char *) content);
+	xmlFree (content);
+    }
+
+    return v;
 }
 
 static CompOptionType
@@ -810,28 +1232,16 @@ initListValue (CompDisplay	     *d,
     }
 }
 
-static char *
-stringFromMetadataPathElement (CompMetadata *metadata,
-			       const char   *path,
-			       const char   *element)
-{
-    char str[1024];
-
-    snprintf (str, 1024, "%s/%s", path, element);
-
-    return compGetStringFromMetadataPath (metadata, str);
-}
-
 static Bool
-boolFromMetadataPathElement (CompMetadata *metadata,
-			     const char   *path,
-			     const char   *element,
-			     Bool	  defaultValue)
+boolFromOptionElement (CompMetadataOption *option,
+		       int		  nOption,
+		       const char	  *element,
+		       Bool		  defaultValue)
 {
     Bool value = FALSE;
     char *str;
 
-    str = stringFromMetadataPathElement (metadata, path, element);
+    str = stringFromOptionElement (option, nOption, element);
     if (!str)
 	return defaultValue;
 
@@ -844,23 +1254,23 @@ boolFromMetadataPathElement (CompMetadata *metadata,
 }
 
 static void
-initIntRestriction (CompMetadata	  *metadata,
-		    CompOptionRestriction *r,
-		    const char		  *path)
+initIntRestriction (CompMetadataOption	  *option,
+		    int			  nOption,
+		    CompOptionRestriction *r)
 {
     char *value;
 
     r->i.min = MINSHORT;
     r->i.max = MAXSHORT;
 
-    value = stringFromMetadataPathElement (metadata, path, "min");
+    value = stringFromOptionElement (option, nOption, "min");
     if (value)
     {
 	r->i.min = strtol ((char *) value, NULL, 0);
 	free (value);
     }
 
-    value = stringFromMetadataPathElement (metadata, path, "max");
+    value = stringFromOptionElement (option, nOption, "max");
     if (value)
     {
 	r->i.max = strtol ((char *) value, NULL, 0);
@@ -869,9 +1279,9 @@ initIntRestriction (CompMetadata	  *metadata,
 }
 
 static void
-initFloatRestriction (CompMetadata	    *metadata,
-		      CompOptionRestriction *r,
-		      const char	    *path)
+initFloatRestriction (CompMetadataOption    *option,
+		      int		    nOption,
+		      CompOptionRestriction *r)
 {
     char *value;
     char *loc;
@@ -881,21 +1291,21 @@ initFloatRestriction (CompMetadata	    *metadata,
     r->f.precision = 0.1f;
 
     loc = setlocale (LC_NUMERIC, "C");
-    value = stringFromMetadataPathElement (metadata, path, "min");
+    value = stringFromOptionElement (option, nOption, "min");
     if (value)
     {
 	r->f.min = strtod ((char *) value, NULL);
 	free (value);
     }
 
-    value = stringFromMetadataPathElement (metadata, path, "max");
+    value = stringFromOptionElement (option, nOption, "max");
     if (value)
     {
 	r->f.max = strtod ((char *) value, NULL);
 	free (value);
     }
 
-    value = stringFromMetadataPathElement (metadata, path, "precision");
+    value = stringFromOptionElement (option, nOption, "precision");
     if (value)
     {
 	r->f.precision = strtod ((char *) value, NULL);
@@ -906,10 +1316,10 @@ initFloatRestriction (CompMetadata	    *metadata,
 }
 
 static void
-initActionState (CompMetadata    *metadata,
-		 CompOptionType  type,
-		 CompActionState *state,
-		 const char      *path)
+initActionState (CompMetadataOption *option,
+		 int		    nOption,
+		 CompOptionType	    type,
+		 CompActionState    *state)
 {
     static struct _StateMap {
 	char	       *name;
@@ -921,13 +1331,13 @@ initActionState (CompMetadata    *metadata,
 	{ "edge",    CompActionStateInitEdge    },
 	{ "edgednd", CompActionStateInitEdgeDnd }
     };
-    int	      i;
-    CompXPath xPath;
-    char      *grab;
+    int	       i;
+    xmlNodePtr allowed;
+    char       *grab;
 
     *state = CompActionStateAutoGrab;
 
-    grab = stringFromMetadataPathElement (metadata, path, "passive_grab");
+    grab = stringFromOptionElement (option, nOption, "passive_grab");
     if (grab)
     {
 	if (strcmp (grab, "false") == 0)
@@ -940,7 +1350,7 @@ initActionState (CompMetadata    *metadata,
     {
 	char *noEdgeDelay;
 
-	noEdgeDelay = stringFromMetadataPathElement (metadata, path, "nodelay");
+	noEdgeDelay = stringFromOptionElement (option, nOption, "nodelay");
 	if (noEdgeDelay)
 	{
 	    if (strcmp (noEdgeDelay, "true") == 0)
@@ -950,16 +1360,15 @@ initActionState (CompMetadata    *metadata,
 	}
     }
 
-    if (!initXPathFromMetadataPathElement (&xPath, metadata, BAD_CAST path,
-					   BAD_CAST "allowed"))
+    allowed = getOptionElement (option, nOption, "allowed");
+    if (!allowed)
 	return;
 
     for (i = 0; i < sizeof (map) / sizeof (map[0]); i++)
     {
 	xmlChar *value;
 
-	value = xmlGetProp (*xPath.obj->nodesetval->nodeTab,
-			    BAD_CAST map[i].name);
+	value = xmlGetProp (allowed, BAD_CAST map[i].name);
 	if (value)
 	{
 	    if (xmlStrcmp (value, BAD_CAST "true") == 0)
@@ -967,28 +1376,29 @@ initActionState (CompMetadata    *metadata,
 	    xmlFree (value);
 	}
     }
-
-    finiXPath (&xPath);
 }
 
 static Bool
-initOptionFromMetadataPath (CompDisplay   *d,
-			    CompMetadata  *metadata,
-			    CompOption	  *option,
-			    const xmlChar *path)
-{
-    CompXPath	    xPath, xDefaultPath;
-    xmlNodePtr	    node, defaultNode;
-    xmlDocPtr	    defaultDoc;
-    xmlChar	    *name, *type;
-    char	    *value;
-    CompActionState state = 0;
-    Bool	    helper = FALSE;
-
-    if (!initXPathFromMetadataPath (&xPath, metadata, path))
+initOptionFromMetadata (CompDisplay  *d,
+			CompMetadata *metadata,
+			CompOption   *option,
+			int	     section,
+			const char   *optionName)
+{
+    CompMetadataOption *o;
+    int		       n;
+    xmlNodePtr	       node, defaultNode;
+    xmlDocPtr	       defaultDoc;
+    xmlChar	       *name, *type;
+    char	       *value;
+    CompActionState    state = 0;
+    Bool	       helper = FALSE;
+
+    o = findMetadataOptions (metadata, section, optionName, &n);
+    if (!o)
 	return FALSE;
 
-    node = *xPath.obj->nodesetval->nodeTab;
+    node = o->node;
 
     type = xmlGetProp (node, BAD_CAST "type");
     if (type)
@@ -1005,28 +1415,19 @@ initOptionFromMetadataPath (CompDisplay   *d,
     option->name = strdup ((char *) name);
     xmlFree (name);
 
-    if (initXPathFromMetadataPathElement (&xDefaultPath, metadata, path,
-					  BAD_CAST "default"))
-    {
-	defaultDoc  = xDefaultPath.doc;
-	defaultNode = *xDefaultPath.obj->nodesetval->nodeTab;
-    }
-    else
-    {
-	defaultDoc  = NULL;
-	defaultNode = NULL;
-    }
+    defaultNode = getOptionElement (o, n, "default");
+    defaultDoc  = defaultNode ? defaultNode->doc : NULL;
 
     switch (option->type) {
     case CompOptionTypeBool:
 	initBoolValue (&option->value, defaultDoc, defaultNode);
 	break;
     case CompOptionTypeInt:
-	initIntRestriction (metadata, &option->rest, (char *) path);
+	initIntRestriction (o, n, &option->rest);
 	initIntValue (&option->value, &option->rest, defaultDoc, defaultNode);
 	break;
     case CompOptionTypeFloat:
-	initFloatRestriction (metadata, &option->rest, (char *) path);
+	initFloatRestriction (o, n, &option->rest);
 	initFloatValue (&option->value, &option->rest, defaultDoc, defaultNode);
 	break;
     case CompOptionTypeString:
@@ -1037,32 +1438,31 @@ initOptionFromMetadataPath (CompDisplay   *d,
 	initColorValue (&option->value, defaultDoc, defaultNode);
 	break;
     case CompOptionTypeAction:
-	initActionState (metadata, option->type, &state, (char *) path);
+	initActionState (o, n, option->type, &state);
 	initActionValue (d, &option->value, state, defaultDoc, defaultNode);
 	break;
     case CompOptionTypeKey:
-	initActionState (metadata, option->type, &state, (char *) path);
+	initActionState (o, n, option->type, &state);
 	initKeyValue (d, &option->value, state, defaultDoc, defaultNode);
 	break;
     case CompOptionTypeButton:
-	initActionState (metadata, option->type, &state, (char *) path);
+	initActionState (o, n, option->type, &state);
 	initButtonValue (d, &option->value, state, defaultDoc, defaultNode);
 	break;
     case CompOptionTypeEdge:
-	initActionState (metadata, option->type, &state, (char *) path);
+	initActionState (o, n, option->type, &state);
 	initEdgeValue (d, &option->value, state, defaultDoc, defaultNode);
 	break;
     case CompOptionTypeBell:
-	initActionState (metadata, option->type, &state, (char *) path);
+	initActionState (o, n, option->type, &state);
 	initBellValue (d, &option->value, state, defaultDoc, defaultNode);
 	break;
     case CompOptionTypeMatch:
-	helper = boolFromMetadataPathElement (metadata, (char *) path, "helper",
-					      FALSE);
+	helper = boolFromOptionElement (o, n, "helper", FALSE);
 	initMatchValue (d, &option->value, helper, defaultDoc, defaultNode);
 	break;
     case CompOptionTypeList:
-	value = stringFromMetadataPathElement (metadata, (char *) path, "type");
+	value = stringFromOptionElement (o, n, "type");
 	if (value)
 	{
 	    option->value.list.type = getOptionType ((char *) value);
@@ -1075,22 +1475,20 @@ initOptionFromMetadataPath (CompDisplay   *d,
 
 	switch (option->value.list.type) {
 	case CompOptionTypeInt:
-	    initIntRestriction (metadata, &option->rest, (char *) path);
+	    initIntRestriction (o, n, &option->rest);
 	    break;
 	case CompOptionTypeFloat:
-	    initFloatRestriction (metadata, &option->rest, (char *) path);
+	    initFloatRestriction (o, n, &option->rest);
 	    break;
 	case CompOptionTypeAction:
 	case CompOptionTypeKey:
 	case CompOptionTypeButton:
 	case CompOptionTypeEdge:
 	case CompOptionTypeBell:
-	    initActionState (metadata, option->value.list.type,
-			     &state, (char *) path);
+	    initActionState (o, n, option->value.list.type, &state);
 	    break;
 	case CompOptionTypeMatch:
-	    helper = boolFromMetadataPathElement (metadata, (char *) path,
-						  "helper", FALSE);
+	    helper = boolFromOptionElement (o, n, "helper", FALSE);
 	default:
 	    break;
 	}
@@ -1100,11 +1498,6 @@ initOptionFromMetadataPath (CompDisplay   *d,
 	break;
     }
 
-    if (defaultDoc)
-	finiXPath (&xDefaultPath);
-
-    finiXPath (&xPath);
-
     return TRUE;
 }
 
@@ -1114,11 +1507,8 @@ compInitScreenOptionFromMetadata (CompScreen   *s,
 				  CompOption   *o,
 				  const char   *name)
 {
-    char str[1024];
-
-    sprintf (str, "/compiz/%s/screen//option[@name=\"%s\"]", m->path, name);
-
-    return initOptionFromMetadataPath (s->display, m, o, BAD_CAST str);
+    return initOptionFromMetadata (s->display, m, o,
+				   METADATA_SECTION_SCREEN, name);
 }
 
 static void
@@ -1209,11 +1599,7 @@ compInitDisplayOptionFromMetadata (CompDisplay  *d,
 				   CompOption	*o,
 				   const char	*name)
 {
-    char str[1024];
-
-    sprintf (str, "/compiz/%s/display//option[@name=\"%s\"]", m->path, name);
-
-    return initOptionFromMetadataPath (d, m, o, BAD_CAST str);
+    return initOptionFromMetadata (d, m, o, METADATA_SECTION_DISPLAY, name);
 }
 
 static void
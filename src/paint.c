@@ -1218,6 +1218,351 @@ drawWindow (CompWindow		 *w,
     return TRUE;
 }
 
+static Bool
+renderWindowThumbnail (CompWindow	   *w,
+		       CompWindowThumbnail *thumb)
+{
+    CompScreen		  *s = w->screen;
+    AddWindowGeometryProc oldAddWindowGeometry;
+    WindowPaintAttrib	  attrib;
+    FragmentAttrib	  fragment;
+    CompTransform	  transform;
+    GLenum		  status;
+    GLint		  oldFbo;
+    unsigned int	  mask = PAINT_WINDOW_TRANSFORMED_MASK;
+
+    if (!s->thumbnailFbo)
+    {
+	(*s->genFramebuffers) (1, &s->thumbnailFbo);
+	if (!s->thumbnailFbo)
+	    return FALSE;
+    }
+
+    glGetIntegerv (GL_FRAMEBUFFER_BINDING_EXT, &oldFbo);
+
+    (*s->bindFramebuffer) (GL_FRAMEBUFFER_EXT, s->thumbnailFbo);
+    (*s->framebufferTexture2D) (GL_FRAMEBUFFER_EXT,
+				GL_COLOR_ATTACHMENT0_EXT,
+				thumb->texture->target,
+				thumb->texture->name,
+				0);
+
+    status = (*s->checkFramebufferStatus) (GL_FRAMEBUFFER_EXT);
+    if (status != GL_FRAMEBUFFER_COMPLETE_EXT)
+    {
+	compLogMessage ("core", CompLogLevelError,
+			"Framebuffer incomplete, can't render thumbnail");
+
+	(*s->bindFramebuffer) (GL_FRAMEBUFFER_EXT, oldFbo);
+
+	return FALSE;
+    }
+
+    glPushAttrib (GL_VIEWPORT_BIT | GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT);
+
+    glDrawBuffer (GL_COLOR_ATTACHMENT0_EXT);
+
+    glDisable (GL_SCISSOR_TEST);
+    glDisable (GL_CULL_FACE);
+    glDisable (GL_CLIP_PLANE0);
+    glDisable (GL_CLIP_PLANE1);
+    glDisable (GL_CLIP_PLANE2);
+    glDisable (GL_CLIP_PLANE3);
+
+    glClearColor (0.0f, 0.0f, 0.0f, 0.0f);
+    glClear (GL_COLOR_BUFFER_BIT);
+
+    /* top-down like the image textures, see imageToTexture */
+    glViewport (0, 0, thumb->width, thumb->height);
+    glMatrixMode (GL_PROJECTION);
+    glPushMatrix ();
+    glLoadIdentity ();
+    glOrtho (0.0, thumb->width, thumb->height, 0.0, -1.0, 1.0);
+    glMatrixMode (GL_MODELVIEW);
+    glPushMatrix ();
+
+    matrixGetIdentity (&transform);
+    matrixScale (&transform,
+		 (float) thumb->width  / thumb->sourceWidth,
+		 (float) thumb->height / thumb->sourceHeight,
+		 1.0f);
+    matrixTranslate (&transform,
+		     w->input.left - w->attrib.x,
+		     w->input.top  - w->attrib.y,
+		     0.0f);
+
+    glLoadMatrixf (transform.m);
+
+    attrib = w->paint;
+    attrib.opacity    = OPAQUE;
+    attrib.brightness = BRIGHT;
+    attrib.saturation = COLOR;
+
+    initFragmentAttrib (&fragment, &attrib);
+
+    if (w->alpha)
+	mask |= PAINT_WINDOW_TRANSLUCENT_MASK;
+
+    /* draw the plain window geometry, without deformations */
+    oldAddWindowGeometry = s->addWindowGeometry;
+    s->addWindowGeometry = addWindowGeometry;
+    (*s->drawWindow) (w, &transform, &fragment, &infiniteRegion, mask);
+    s->addWindowGeometry = oldAddWindowGeometry;
+
+    glMatrixMode (GL_PROJECTION);
+    glPopMatrix ();
+    glMatrixMode (GL_MODELVIEW);
+    glPopMatrix ();
+
+    (*s->bindFramebuffer) (GL_FRAMEBUFFER_EXT, oldFbo);
+
+    glPopAttrib ();
+
+    return TRUE;
+}
+
+static void
+resizeWindowThumbnail (CompScreen	   *s,
+		       CompWindowThumbnail *thumb,
+		       int		   width,
+		       int		   height)
+{
+    CompTexture *texture = thumb->texture;
+
+    makeScreenCurrent (s);
+
+    if (!texture->name)
+	glGenTextures (1, &texture->name);
+
+    if (s->textureNonPowerOfTwo ||
+	(POWER_OF_TWO (width) && POWER_OF_TWO (height)))
+    {
+	texture->target    = GL_TEXTURE_2D;
+	texture->matrix.xx = 1.0f / width;
+	texture->matrix.yy = -1.0f / height;
+	texture->matrix.y0 = 1.0f;
+    }
+    else
+    {
+	texture->target    = GL_TEXTURE_RECTANGLE_NV;
+	texture->matrix.xx = 1.0f;
+	texture->matrix.yy = -1.0f;
+	texture->matrix.y0 = height;
+    }
+
+    texture->mipmap = FALSE;
+
+    glBindTexture (texture->target, texture->name);
+
+    glTexImage2D (texture->target, 0, GL_RGBA, width, height, 0,
+		  GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+
+    texture->filter = GL_LINEAR;
+
+    glTexParameteri (texture->target, GL_TEXTURE_MIN_FILTER, texture->filter);
+    glTexParameteri (texture->target, GL_TEXTURE_MAG_FILTER, texture->filter);
+
+    glTexParameteri (texture->target, GL_TEXTURE_WRAP_S, texture->wrap);
+    glTexParameteri (texture->target, GL_TEXTURE_WRAP_T, texture->wrap);
+
+    glBindTexture (texture->target, 0);
+
+    thumb->width  = width;
+    thumb->height = height;
+}
+
+static Bool
+windowThumbnailTimeout (void *closure)
+{
+    CompWindow *w = (CompWindow *) closure;
+    BoxRec     box;
+
+    w->thumbnail->timeoutHandle = 0;
+
+    /* let the users of the thumbnail know that it can be updated
+       the same way they learn about new window contents */
+    box.x1 = 0;
+    box.y1 = 0;
+    box.x2 = w->width;
+    box.y2 = w->height;
+
+    (*w->screen->damageWindowRect) (w, FALSE, &box);
+
+    return FALSE;
+}
+
+/* Returns a thumbnail of the window that fits in width x height, or
+   NULL if it can't be rendered, in which case the caller should draw
+   the window itself. The window is rendered with the current texture
+   filter of the display, callers that want mipmaps set it like they
+   do for drawWindow. The thumbnail is only re-rendered after the
+   window has been damaged, at most every
+   WINDOW_THUMBNAIL_UPDATE_INTERVAL ms; damageWindowRect is called
+   for the window when a damaged thumbnail was kept because of that
+   limit. A thumbnail up to twice the requested size is reused so
+   that callers asking for slightly different sizes share it. */
+CompWindowThumbnail *
+getWindowThumbnail (CompWindow *w,
+		    int	       width,
+		    int	       height)
+{
+    CompWindowThumbnail *thumb = w->thumbnail;
+    CompScreen		*s = w->screen;
+    struct timeval	tv;
+    Bool		resize;
+    float		scale;
+    int			ww, wh, tw, th, diff;
+
+    if (!s->fbo)
+	return NULL;
+
+    ww = w->width  + w->input.left + w->input.right;
+    wh = w->height + w->input.top  + w->input.bottom;
+
+    if (ww <= 0 || wh <= 0 || width <= 0 || height <= 0)
+	return NULL;
+
+    scale = MIN (MIN ((float) width / ww, (float) height / wh), 1.0f);
+
+    tw = MAX (ww * scale, 1);
+    th = MAX (wh * scale, 1);
+
+    if (!thumb)
+    {
+	thumb = malloc (sizeof (CompWindowThumbnail));
+	if (!thumb)
+	    return NULL;
+
+	thumb->texture = createTexture (s);
+	if (!thumb->texture)
+	{
+	    free (thumb);
+	    return NULL;
+	}
+
+	thumb->width	    = 0;
+	thumb->height	    = 0;
+	thumb->sourceWidth  = 0;
+	thumb->sourceHeight = 0;
+	thumb->damaged	    = TRUE;
+	thumb->timeoutHandle = 0;
+
+	w->thumbnail = thumb;
+    }
+
+    resize = (thumb->sourceWidth != ww || thumb->sourceHeight != wh ||
+	      thumb->width  < tw || thumb->width  > tw * 2 ||
+	      thumb->height < th || thumb->height > th * 2);
+
+    if (!resize && !thumb->damaged)
+	return thumb;
+
+    /* keep showing the last contents of unmapped windows */
+    if (w->attrib.map_state != IsViewable ||
+	(!w->texture->pixmap && !bindWindow (w)))
+    {
+	if (thumb->sourceWidth == ww && thumb->sourceHeight == wh)
+	    return thumb;
+
+	return NULL;
+    }
+
+    gettimeofday (&tv, 0);
+
+    if (!resize)
+    {
+	diff = (tv.tv_sec - thumb->lastUpdate.tv_sec) * 1000 +
+	    (tv.tv_usec - thumb->lastUpdate.tv_usec) / 1000;
+
+	if (diff >= 0 && diff < WINDOW_THUMBNAIL_UPDATE_INTERVAL)
+	{
+	    if (!thumb->timeoutHandle)
+		thumb->timeoutHandle =
+		    compAddTimeout (WINDOW_THUMBNAIL_UPDATE_INTERVAL - diff,
+				    WINDOW_THUMBNAIL_UPDATE_INTERVAL,
+				    windowThumbnailTimeout, w);
+
+	    return thumb;
+	}
+    }
+    else
+    {
+	resizeWindowThumbnail (s, thumb, tw, th);
+
+	thumb->sourceWidth  = ww;
+	thumb->sourceHeight = wh;
+    }
+
+    if (!renderWindowThumbnail (w, thumb))
+    {
+	thumb->sourceWidth  = 0;
+	thumb->sourceHeight = 0;
+
+	return NULL;
+    }
+
+    thumb->damaged    = FALSE;
+    thumb->lastUpdate = tv;
+
+    return thumb;
+}
+
+/* draws the thumbnail in place of the window, input extents
+   included, using the current transformation */
+void
+drawWindowThumbnail (CompWindow		  *w,
+		     CompWindowThumbnail  *thumb,
+		     const FragmentAttrib *fragment,
+		     unsigned int	  mask)
+{
+    REGION     region;
+    CompMatrix matrix;
+
+    region.rects    = &region.extents;
+    region.numRects = 1;
+
+    region.extents.x1 = w->attrib.x - w->input.left;
+    region.extents.y1 = w->attrib.y - w->input.top;
+    region.extents.x2 = region.extents.x1 + thumb->sourceWidth;
+    region.extents.y2 = region.extents.y1 + thumb->sourceHeight;
+
+    matrix = thumb->texture->matrix;
+    matrix.xx *= (float) thumb->width  / thumb->sourceWidth;
+    matrix.yy *= (float) thumb->height / thumb->sourceHeight;
+    matrix.x0 -= region.extents.x1 * matrix.xx;
+    matrix.y0 -= region.extents.y1 * matrix.yy;
+
+    w->vCount = w->indexCount = 0;
+    addWindowGeometry (w, &matrix, 1, &region, &infiniteRegion);
+
+    /* the input extents of the thumbnail can be translucent */
+    if (w->vCount)
+	(*w->screen->drawWindowTexture) (w, thumb->texture, fragment,
+					 mask | PAINT_WINDOW_BLEND_MASK);
+}
+
+void
+damageWindowThumbnail (CompWindow *w)
+{
+    if (w->thumbnail)
+	w->thumbnail->damaged = TRUE;
+}
+
+void
+freeWindowThumbnail (CompWindow *w)
+{
+    if (!w->thumbnail)
+	return;
+
+    if (w->thumbnail->timeoutHandle)
+	compRemoveTimeout (w->thumbnail->timeoutHandle);
+
+    destroyTexture (w->screen, w->thumbnail->texture);
+    free (w->thumbnail);
+
+    w->thumbnail = NULL;
+}
+
 Bool
 paintWindow (CompWindow		     *w,
 	     const WindowPaintAttrib *attrib,
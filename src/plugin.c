@@ -30,11 +30,37 @@
 #include <dirent.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 
 #include <compiz-core.h>
 
+#define PLUGIN_PREFETCH_MAX_THREADS 4
+
+typedef struct _CompPluginPrefetchEntry {
+    char *name;
+    void *dlhand;
+    int  time;
+    Bool done;
+} CompPluginPrefetchEntry;
+
+/* Plugins are opened and their metadata parsed on worker threads in
+   list order while the main thread loads and initializes them one
+   after the other; loading a prefetched plugin only waits for its
+   own entry and then finds the library already mapped and relocated
+   and its metadata already parsed. */
+struct _CompPluginPrefetch {
+    pthread_mutex_t	    mutex;
+    pthread_cond_t	    cond;
+    pthread_t		    thread[PLUGIN_PREFETCH_MAX_THREADS];
+    int			    nThread;
+    CompPluginPrefetchEntry *entry;
+    int			    nEntry;
+    int			    next;
+};
+
 CompPlugin *plugins = 0;
 
 static Bool
@@ -595,9 +621,257 @@ loadPlugin (const char *name)
     return 0;
 }
 
+static void *
+prefetchPluginFile (const char *path,
+		    const char *name)
+{
+    char        *file;
+    void        *dlhand = NULL;
+    struct stat fileInfo;
+
+    file = malloc ((path ? strlen (path) : 0) + strlen (name) + 8);
+    if (!file)
+	return NULL;
+
+    if (path)
+	sprintf (file, "%s/lib%s.so", path, name);
+    else
+	sprintf (file, "lib%s.so", name);
+
+    /* errors are reported when the plugin is actually loaded */
+    if (stat (file, &fileInfo) == 0)
+	dlhand = dlopen (file, RTLD_LAZY);
+
+    free (file);
+
+    return dlhand;
+}
+
+static void *
+prefetchPlugin (const char *name)
+{
+    char *home, *plugindir;
+    void *dlhand = NULL;
+
+    if (strcmp (name, coreVTable.name) == 0)
+	return NULL;
+
+    home = getenv ("HOME");
+    if (home)
+    {
+	plugindir = malloc (strlen (home) + strlen (HOME_PLUGINDIR) + 3);
+	if (plugindir)
+	{
+	    sprintf (plugindir, "%s/%s", home, HOME_PLUGINDIR);
+	    dlhand = prefetchPluginFile (plugindir, name);
+	    free (plugindir);
+	}
+    }
+
+    if (!dlhand)
+	dlhand = prefetchPluginFile (PLUGINDIR, name);
+
+    if (!dlhand)
+	dlhand = prefetchPluginFile (NULL, name);
+
+    return dlhand;
+}
+
+static int
+timeSince (struct timeval *start)
+{
+    struct timeval tv;
+
+    gettimeofday (&tv, 0);
+
+    return (tv.tv_sec - start->tv_sec) * 1000000 +
+	(tv.tv_usec - start->tv_usec);
+}
+
+static void *
+prefetchThread (void *closure)
+{
+    CompPluginPrefetch	    *prefetch = (CompPluginPrefetch *) closure;
+    CompPluginPrefetchEntry *e;
+    struct timeval	    start;
+    void		    *dlhand;
+
+    for (;;)
+    {
+	pthread_mutex_lock (&prefetch->mutex);
+
+	if (prefetch->next == prefetch->nEntry)
+	{
+	    pthread_mutex_unlock (&prefetch->mutex);
+	    break;
+	}
+
+	e = &prefetch->entry[prefetch->next++];
+
+	pthread_mutex_unlock (&prefetch->mutex);
+
+	gettimeofday (&start, 0);
+
+	dlhand = prefetchPlugin (e->name);
+	compPrefetchMetadataFromFile (e->name);
+
+	pthread_mutex_lock (&prefetch->mutex);
+
+	e->dlhand = dlhand;
+	e->time   = timeSince (&start);
+	e->done   = TRUE;
+
+	pthread_cond_broadcast (&prefetch->cond);
+	pthread_mutex_unlock (&prefetch->mutex);
+    }
+
+    return NULL;
+}
+
+CompPluginPrefetch *
+prefetchPlugins (char **name,
+		 int  nName)
+{
+    CompPluginPrefetch *prefetch;
+    long	       nCpu;
+    int		       nThread, i;
+
+    /* nothing to overlap with */
+    if (nName < 2)
+	return NULL;
+
+    prefetch = malloc (sizeof (CompPluginPrefetch) +
+		       sizeof (CompPluginPrefetchEntry) * nName);
+    if (!prefetch)
+	return NULL;
+
+    prefetch->entry   = (CompPluginPrefetchEntry *) (prefetch + 1);
+    prefetch->nEntry  = nName;
+    prefetch->next    = 0;
+    prefetch->nThread = 0;
+
+    for (i = 0; i < nName; i++)
+    {
+	prefetch->entry[i].name	  = name[i];
+	prefetch->entry[i].dlhand = NULL;
+	prefetch->entry[i].time	  = 0;
+	prefetch->entry[i].done	  = FALSE;
+    }
+
+    pthread_mutex_init (&prefetch->mutex, NULL);
+    pthread_cond_init (&prefetch->cond, NULL);
+
+    nCpu = sysconf (_SC_NPROCESSORS_ONLN);
+
+    nThread = MIN (nName, PLUGIN_PREFETCH_MAX_THREADS);
+    if (nCpu > 0)
+	nThread = MIN (nThread, nCpu);
+
+    for (i = 0; i < nThread; i++)
+    {
+	if (pthread_create (&prefetch->thread[prefetch->nThread], NULL,
+			    prefetchThread, (void *) prefetch))
+	    break;
+
+	prefetch->nThread++;
+    }
+
+    if (!prefetch->nThread)
+    {
+	pthread_cond_destroy (&prefetch->cond);
+	pthread_mutex_destroy (&prefetch->mutex);
+	free (prefetch);
+
+	return NULL;
+    }
+
+    return prefetch;
+}
+
+/* Same as loadPlugin, but waits for the prefetch of the plugin to
+   finish first. Names that weren't prefetched are loaded directly. */
+CompPlugin *
+loadPrefetchedPlugin (CompPluginPrefetch *prefetch,
+		      const char	 *name)
+{
+    CompPluginPrefetchEntry *e = NULL;
+    struct timeval	    start;
+    CompPlugin		    *p;
+    int			    i, wait, load;
+
+    if (prefetch)
+    {
+	for (i = 0; i < prefetch->nEntry; i++)
+	{
+	    if (strcmp (prefetch->entry[i].name, name) == 0)
+	    {
+		e = &prefetch->entry[i];
+		break;
+	    }
+	}
+    }
+
+    if (!e)
+	return loadPlugin (name);
+
+    gettimeofday (&start, 0);
+
+    pthread_mutex_lock (&prefetch->mutex);
+    while (!e->done)
+	pthread_cond_wait (&prefetch->cond, &prefetch->mutex);
+    pthread_mutex_unlock (&prefetch->mutex);
+
+    wait = timeSince (&start);
+
+    p = loadPlugin (name);
+
+    load = timeSince (&start) - wait;
+
+    compLogMessage ("core", CompLogLevelDebug,
+		    "Plugin '%s' prefetched in %d.%03d ms, "
+		    "waited %d.%03d ms, loaded in %d.%03d ms", name,
+		    e->time / 1000, e->time % 1000,
+		    wait / 1000, wait % 1000,
+		    load / 1000, load % 1000);
+
+    return p;
+}
+
+void
+finiPluginPrefetch (CompPluginPrefetch *prefetch)
+{
+    int i;
+
+    if (!prefetch)
+	return;
+
+    /* don't start on plugins that were never asked for */
+    pthread_mutex_lock (&prefetch->mutex);
+    prefetch->next = prefetch->nEntry;
+    pthread_mutex_unlock (&prefetch->mutex);
+
+    for (i = 0; i < prefetch->nThread; i++)
+	pthread_join (prefetch->thread[i], NULL);
+
+    /* plugins that were loaded hold their own reference */
+    for (i = 0; i < prefetch->nEntry; i++)
+	if (prefetch->entry[i].dlhand)
+	    dlclose (prefetch->entry[i].dlhand);
+
+    compFlushPrefetchedMetadata ();
+
+    pthread_cond_destroy (&prefetch->cond);
+    pthread_mutex_destroy (&prefetch->mutex);
+
+    free (prefetch);
+}
+
 Bool
 pushPlugin (CompPlugin *p)
 {
+    struct timeval start;
+    int		   initTime;
+
     if (findActivePlugin (p->vTable->name))
     {
 	compLogMessage ("core", CompLogLevelWarn,
@@ -610,6 +884,8 @@ pushPlugin (CompPlugin *p)
     p->next = plugins;
     plugins = p;
 
+    gettimeofday (&start, 0);
+
     if (!initPlugin (p))
     {
 	compLogMessage ("core", CompLogLevelError,
@@ -619,6 +895,16 @@ pushPlugin (CompPlugin *p)
 	return FALSE;
     }
 
+    initTime = timeSince (&start);
+
+    if (startupComplete)
+	compLogMessage ("core", CompLogLevelDebug,
+			"Plugin '%s' initialized in %d.%03d ms",
+			p->vTable->name, initTime / 1000, initTime % 1000);
+    else
+	startupTrace ("plugin '%s' initialized in %d.%03d ms",
+		      p->vTable->name, initTime / 1000, initTime % 1000);
+
     return TRUE;
 }
 
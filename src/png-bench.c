@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2026 compiz contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation. The authors make no
+ * representations about the suitability of this software for any
+ * purpose. It is provided "as is" without express or implied warranty.
+ */
+
+/*
+ * Decodes a generated RGBA PNG the way the png plugin used to, with a
+ * scalar premultiply as libpng row transform, and the way it does now,
+ * decoding first and then premultiplying the whole image with
+ * premultiplyImageData, and times premultiplyImageData on its own
+ * against the scalar loop. Fails if the results differ.
+ *
+ *   make -C src bench && src/png-bench [width] [height] [runs]
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "../config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <png.h>
+#include <setjmp.h>
+
+#include <compiz-core.h>
+
+#ifdef __SSE2__
+#define KERNEL_NAME "SSE2"
+#elif defined (__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define KERNEL_NAME "NEON"
+#else
+#define KERNEL_NAME "scalar"
+#endif
+
+typedef struct _PngBuffer {
+    unsigned char *data;
+    size_t	  size;
+    size_t	  alloc;
+    size_t	  offset;
+} PngBuffer;
+
+static double
+benchTime (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* the row transform of the png plugin before premultiplyImageData */
+static void
+premultiplyRow (unsigned char *data,
+		size_t	      rowbytes)
+{
+    size_t i;
+
+    for (i = 0; i < rowbytes; i += 4)
+    {
+	unsigned char *base = &data[i];
+	unsigned char blue  = base[0];
+	unsigned char green = base[1];
+	unsigned char red   = base[2];
+	unsigned char alpha = base[3];
+	int	      p;
+
+	red   = (unsigned) red   * (unsigned) alpha / 255;
+	green = (unsigned) green * (unsigned) alpha / 255;
+	blue  = (unsigned) blue  * (unsigned) alpha / 255;
+
+	p = (alpha << 24) | (red << 16) | (green << 8) | (blue << 0);
+	memcpy (base, &p, sizeof (int));
+    }
+}
+
+static void
+premultiplyData (png_structp   png,
+		 png_row_infop row_info,
+		 png_bytep     data)
+{
+    premultiplyRow (data, row_info->rowbytes);
+}
+
+static void
+writeBuffer (png_structp png,
+	     png_bytep	 data,
+	     png_size_t	 length)
+{
+    PngBuffer *buffer = png_get_io_ptr (png);
+
+    if (buffer->size + length > buffer->alloc)
+    {
+	unsigned char *d;
+	size_t	      alloc = (buffer->size + length) * 2;
+
+	d = realloc (buffer->data, alloc);
+	if (!d)
+	    png_error (png, "out of memory");
+
+	buffer->data  = d;
+	buffer->alloc = alloc;
+    }
+
+    memcpy (buffer->data + buffer->size, data, length);
+    buffer->size += length;
+}
+
+static void
+flushBuffer (png_structp png)
+{
+}
+
+static void
+readBuffer (png_structp png,
+	    png_bytep	data,
+	    png_size_t	length)
+{
+    PngBuffer *buffer = png_get_io_ptr (png);
+
+    if (buffer->offset + length > buffer->size)
+	png_error (png, "read past end of image");
+
+    memcpy (data, buffer->data + buffer->offset, length);
+    buffer->offset += length;
+}
+
+/* gradients with a mix of opaque and translucent areas, like icons
+   and decoration images */
+static Bool
+generatePng (PngBuffer *buffer,
+	     int       width,
+	     int       height)
+{
+    png_struct	  *png;
+    png_info	  *info;
+    unsigned char *row;
+    int		  x, y;
+
+    row = malloc (width * 4);
+    if (!row)
+	return FALSE;
+
+    png = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png)
+    {
+	free (row);
+	return FALSE;
+    }
+
+    info = png_create_info_struct (png);
+    if (!info || setjmp (png_jmpbuf (png)))
+    {
+	png_destroy_write_struct (&png, &info);
+	free (row);
+	return FALSE;
+    }
+
+    png_set_write_fn (png, buffer, writeBuffer, flushBuffer);
+    png_set_IHDR (png, info, width, height, 8, PNG_COLOR_TYPE_RGB_ALPHA,
+		  PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+		  PNG_FILTER_TYPE_DEFAULT);
+    png_write_info (png, info);
+
+    srand (1);
+
+    for (y = 0; y < height; y++)
+    {
+	for (x = 0; x < width; x++)
+	{
+	    row[x * 4 + 0] = x * 255 / width;
+	    row[x * 4 + 1] = y * 255 / height;
+	    row[x * 4 + 2] = (x ^ y) & 0xff;
+	    row[x * 4 + 3] = ((x + y) % 300 < 150) ? 0xff : rand () & 0xff;
+	}
+
+	png_write_row (png, row);
+    }
+
+    png_write_end (png, info);
+    png_destroy_write_struct (&png, &info);
+    free (row);
+
+    return TRUE;
+}
+
+/* same transforms as readPngData in the png plugin */
+static Bool
+decodePng (PngBuffer *buffer,
+	   char	     *data,
+	   Bool	     rowTransform)
+{
+    png_struct	 *png;
+    png_info	 *info;
+    png_byte	 **rows;
+    png_uint_32	 width, height, i;
+
+    png = png_create_read_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png)
+	return FALSE;
+
+    info = png_create_info_struct (png);
+    if (!info || setjmp (png_jmpbuf (png)))
+    {
+	png_destroy_read_struct (&png, &info, NULL);
+	return FALSE;
+    }
+
+    buffer->offset = 0;
+    png_set_read_fn (png, buffer, readBuffer);
+    png_read_info (png, info);
+
+    width  = png_get_image_width (png, info);
+    height = png_get_image_height (png, info);
+
+    png_set_bgr (png);
+    png_set_filler (png, 0xff, PNG_FILLER_AFTER);
+
+    if (rowTransform)
+	png_set_read_user_transform_fn (png, premultiplyData);
+
+    png_read_update_info (png, info);
+
+    rows = malloc (height * sizeof (png_byte *));
+    if (!rows)
+    {
+	png_destroy_read_struct (&png, &info, NULL);
+	return FALSE;
+    }
+
+    for (i = 0; i < height; i++)
+	rows[i] = (png_byte *) (data + i * width * 4);
+
+    png_read_image (png, rows);
+    png_read_end (png, info);
+
+    free (rows);
+    png_destroy_read_struct (&png, &info, NULL);
+
+    if (!rowTransform)
+	premultiplyImageData (data, width * height);
+
+    return TRUE;
+}
+
+int
+main (int  argc,
+      char **argv)
+{
+    PngBuffer buffer = { NULL, 0, 0, 0 };
+    char      *rowData, *imageData, *source;
+    double    rowTime = 0.0, imageTime = 0.0, start;
+    double    scalarTime = 0.0, kernelTime = 0.0;
+    int	      width = 1024, height = 1024, runs = 50, nPixel, i;
+
+    if (argc > 1)
+	width = MAX (1, atoi (argv[1]));
+
+    if (argc > 2)
+	height = MAX (1, atoi (argv[2]));
+
+    if (argc > 3)
+	runs = MAX (1, atoi (argv[3]));
+
+    nPixel = width * height;
+
+    rowData   = malloc (nPixel * 4);
+    imageData = malloc (nPixel * 4);
+    source    = malloc (nPixel * 4);
+
+    if (!rowData || !imageData || !source || !generatePng (&buffer, width,
+							   height))
+    {
+	fprintf (stderr, "png-bench: failed to generate image\n");
+	return 1;
+    }
+
+    for (i = 0; i < runs; i++)
+    {
+	start = benchTime ();
+	if (!decodePng (&buffer, rowData, TRUE))
+	    return 1;
+	rowTime += benchTime () - start;
+
+	start = benchTime ();
+	if (!decodePng (&buffer, imageData, FALSE))
+	    return 1;
+	imageTime += benchTime () - start;
+    }
+
+    if (memcmp (rowData, imageData, nPixel * 4))
+    {
+	fprintf (stderr, "png-bench: decoded images differ\n");
+	return 1;
+    }
+
+    /* the premultiply step alone, on random pixels */
+    for (i = 0; i < nPixel * 4; i++)
+	source[i] = rand ();
+
+    for (i = 0; i < runs; i++)
+    {
+	memcpy (rowData, source, nPixel * 4);
+	start = benchTime ();
+	premultiplyRow ((unsigned char *) rowData, nPixel * 4);
+	scalarTime += benchTime () - start;
+
+	memcpy (imageData, source, nPixel * 4);
+	start = benchTime ();
+	premultiplyImageData (imageData, nPixel);
+	kernelTime += benchTime () - start;
+    }
+
+    if (memcmp (rowData, imageData, nPixel * 4))
+    {
+	fprintf (stderr, "png-bench: premultiplied pixels differ\n");
+	return 1;
+    }
+
+    printf ("%dx%d RGBA image, %lu bytes compressed, mean of %d runs\n",
+	    width, height, (unsigned long) buffer.size, runs);
+    printf ("  decode, premultiply per row: %10.1f us\n", rowTime / runs);
+    printf ("  decode, premultiply image:   %10.1f us\n", imageTime / runs);
+    printf ("  premultiply, scalar:         %10.1f us\n", scalarTime / runs);
+    printf ("  premultiply, %-6s kernel:   %10.1f us\n",
+	    KERNEL_NAME, kernelTime / runs);
+
+    free (buffer.data);
+    free (rowData);
+    free (imageData);
+    free (source);
+
+    return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright © 2005 Novell, Inc.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation for any purpose is hereby granted without
+ * fee, provided that the above copyright notice appear in all copies
+ * and that both that copyright notice and this permission notice
+ * appear in supporting documentation, and that the name of
+ * Novell, Inc. not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior permission.
+ * Novell, Inc. makes no representations about the suitability of this
+ * software for any purpose. It is provided "as is" without express or
+ * implied warranty.
+ *
+ * NOVELL, INC. DISCLAIMS ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN
+ * NO EVENT SHALL NOVELL, INC. BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Author: David Reveman <davidr@novell.com>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "../config.h"
+#endif
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define PREMULTIPLY_SSE2
+#elif defined (__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define PREMULTIPLY_NEON
+#endif
+
+#include <compiz-core.h>
+
+/* x * a / 255 rounded down, exact for all 8 bit x and a */
+#define DIV_255(t) (((t) + 1 + ((t) >> 8)) >> 8)
+
+/*
+ * Premultiplies nPixel 32 bit ARGB pixels stored as B, G, R, A bytes
+ * with their alpha and stores them as native endian ARGB words.
+ */
+void
+premultiplyImageData (char	   *data,
+		      unsigned int nPixel)
+{
+    unsigned char *base = (unsigned char *) data;
+    unsigned int  i = 0;
+
+#ifdef PREMULTIPLY_SSE2
+    const __m128i zero  = _mm_setzero_si128 ();
+    const __m128i one   = _mm_set1_epi16 (1);
+    const __m128i alpha = _mm_set1_epi32 (0xff000000);
+
+    for (; i + 4 <= nPixel; i += 4, base += 16)
+    {
+	__m128i p, lo, hi, a;
+
+	p = _mm_loadu_si128 ((__m128i *) base);
+
+	/* two pixels per register with 16 bits per channel */
+	lo = _mm_unpacklo_epi8 (p, zero);
+	hi = _mm_unpackhi_epi8 (p, zero);
+
+	a  = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (lo, 0xff), 0xff);
+	lo = _mm_mullo_epi16 (lo, a);
+	lo = _mm_add_epi16 (_mm_add_epi16 (lo, one), _mm_srli_epi16 (lo, 8));
+	lo = _mm_srli_epi16 (lo, 8);
+
+	a  = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (hi, 0xff), 0xff);
+	hi = _mm_mullo_epi16 (hi, a);
+	hi = _mm_add_epi16 (_mm_add_epi16 (hi, one), _mm_srli_epi16 (hi, 8));
+	hi = _mm_srli_epi16 (hi, 8);
+
+	/* keep the original alpha */
+	p = _mm_or_si128 (_mm_and_si128 (p, alpha),
+			  _mm_andnot_si128 (alpha, _mm_packus_epi16 (lo, hi)));
+
+	_mm_storeu_si128 ((__m128i *) base, p);
+    }
+#endif
+
+#ifdef PREMULTIPLY_NEON
+    const uint16x8_t one = vdupq_n_u16 (1);
+
+    for (; i + 8 <= nPixel; i += 8, base += 32)
+    {
+	uint8x8x4_t p;
+	uint16x8_t  t;
+	int	    c;
+
+	/* deinterleaved into blue, green, red and alpha */
+	p = vld4_u8 (base);
+
+	for (c = 0; c < 3; c++)
+	{
+	    t = vmull_u8 (p.val[c], p.val[3]);
+	    t = vsraq_n_u16 (t, t, 8);
+	    p.val[c] = vshrn_n_u16 (vaddq_u16 (t, one), 8);
+	}
+
+	vst4_u8 (base, p);
+    }
+#endif
+
+    for (; i < nPixel; i++, base += 4)
+    {
+	unsigned int blue  = base[0];
+	unsigned int green = base[1];
+	unsigned int red   = base[2];
+	unsigned int alpha = base[3];
+	unsigned int p;
+
+	red   = DIV_255 (red   * alpha);
+	green = DIV_255 (green * alpha);
+	blue  = DIV_255 (blue  * alpha);
+
+	p = (alpha << 24) | (red << 16) | (green << 8) | (blue << 0);
+	memcpy (base, &p, sizeof (unsigned int));
+    }
+}
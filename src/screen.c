@@ -1920,6 +1920,8 @@ addScreen (CompDisplay *display,
 
     s->windowStateChangeNotify = windowStateChangeNotify;
 
+    s->windowServerGeometryNotify = windowServerGeometryNotify;
+
     s->outputChangeNotify = outputChangeNotify;
     s->addSupportedAtoms  = addSupportedAtoms;
 
@@ -2246,6 +2248,8 @@ addScreen (CompDisplay *display,
     s->generateMipmap         = NULL;
 
     s->fbo = 0;
+    s->thumbnailFbo = 0;
+    s->iconCache    = NULL;
     if (!noFBO && strstr (glExtensions, "GL_EXT_framebuffer_object"))
     {
 	s->genFramebuffers = (GLGenFramebuffersProc)
@@ -2423,6 +2427,8 @@ addScreen (CompDisplay *display,
 	return FALSE;
     }
 
+    startupTrace ("screen %d GL initialized", screenNum);
+
     initTexture (s, &s->backgroundTexture);
     s->backgroundLoaded = FALSE;
 
@@ -2483,9 +2489,17 @@ addScreen (CompDisplay *display,
 		&rootReturn, &parentReturn,
 		&children, &nchildren);
 
+    /* the server is grabbed, so the properties of all windows can be
+       requested up front instead of one round trip at a time */
+    prefetchWindowProperties (display, children, nchildren);
+
     for (i = 0; i < nchildren; i++)
 	addWindow (s, children[i], i ? children[i - 1] : 0);
 
+    finiWindowPropertyPrefetch (display);
+
+    startupTrace ("screen %d added %d windows", screenNum, nchildren);
+
     for (w = s->windows; w; w = w->next)
     {
 	if (w->attrib.map_state == IsViewable)
@@ -2597,6 +2611,16 @@ removeScreen (CompScreen *s)
 	free (s->defaultIcon);
     }
 
+    if (s->thumbnailFbo)
+    {
+	makeScreenCurrent (s);
+	(*s->deleteFramebuffers) (1, &s->thumbnailFbo);
+    }
+
+    /* all windows are gone, and with them all cached icons */
+    if (s->iconCache)
+	free (s->iconCache);
+
     glXDestroyContext (d->display, s->ctx);
 
     XFreeCursor (d->display, s->invisibleCursor);
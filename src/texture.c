@@ -202,17 +202,18 @@ readImageToTexture (CompScreen   *screen,
 		    unsigned int *returnWidth,
 		    unsigned int *returnHeight)
 {
-    void *image;
-    int  width, height;
-    Bool status;
+    const void *image;
+    int	       width, height;
+    Bool       status;
 
-    if (!readImageFromFile (screen->display, imageFileName,
-			    &width, &height, &image))
+    /* upload straight from the cached image instead of a copy */
+    if (!acquireImageData (screen->display, imageFileName,
+			   &width, &height, &image))
 	return FALSE;
 
     status = imageBufferToTexture (screen, texture, image, width, height);
 
-    free (image);
+    releaseImageData (screen->display, image);
 
     if (returnWidth)
 	*returnWidth = width;
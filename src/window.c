@@ -24,6 +24,7 @@
  */
 
 #include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/Xatom.h>
 #include <X11/Xproto.h>
 #include <X11/extensions/shape.h>
@@ -34,6 +35,7 @@
 #include <strings.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <assert.h>
 
 #include <compiz-core.h>
@@ -49,6 +51,25 @@ typedef struct {
     unsigned long decorations;
 } MwmHints;
 
+typedef struct _CompPrefetchedProperty {
+    Window		      id;
+    Atom		      property;
+    long		      length;
+    Atom		      type;
+    Bool		      pending;
+    xcb_get_property_cookie_t cookie;
+} CompPrefetchedProperty;
+
+/* property requests issued for all windows adopted by addScreen
+   before any of them are added, sorted by window and property */
+typedef struct _CompPropertyPrefetch {
+    CompDisplay		   *display;
+    CompPrefetchedProperty *property;
+    int			   nProperty;
+} CompPropertyPrefetch;
+
+static CompPropertyPrefetch *propertyPrefetch = NULL;
+
 static int
 reallocWindowPrivates (int  size,
 		       void *closure)
@@ -484,6 +505,242 @@ updateClientFrame (CompWindow *w)
     }
 }
 
+static int
+comparePrefetchedProperties (const void *e1,
+			     const void *e2)
+{
+    const CompPrefetchedProperty *p1 = e1;
+    const CompPrefetchedProperty *p2 = e2;
+
+    if (p1->id != p2->id)
+	return p1->id < p2->id ? -1 : 1;
+
+    if (p1->property != p2->property)
+	return p1->property < p2->property ? -1 : 1;
+
+    return 0;
+}
+
+/* Sends the property requests addWindow is going to make for each
+   window in "id" without waiting for any of the replies. The server
+   must be grabbed until finiWindowPropertyPrefetch is called as the
+   replies would otherwise not reflect changes made after this. */
+void
+prefetchWindowProperties (CompDisplay *display,
+			  Window      *id,
+			  int	      nId)
+{
+    CompPropertyPrefetch   *prefetch;
+    CompPrefetchedProperty *p;
+    xcb_connection_t	   *c;
+    Atom		   property[16], type[16];
+    long		   length[16];
+    int			   nProperty = 0;
+    int			   i, j;
+
+#define PREFETCH_PROPERTY(atom, len, atomType) \
+    property[nProperty] = (atom);	       \
+    length[nProperty]	= (len);	       \
+    type[nProperty++]	= (atomType)
+
+    PREFETCH_PROPERTY (display->winStateAtom, 1024L, XA_ATOM);
+    PREFETCH_PROPERTY (display->winTypeAtom, 1L, XA_ATOM);
+    PREFETCH_PROPERTY (display->wmProtocolsAtom, 1000000L, XA_ATOM);
+    PREFETCH_PROPERTY (display->wmStrutPartialAtom, 12L, XA_CARDINAL);
+    PREFETCH_PROPERTY (display->wmStrutAtom, 4L, XA_CARDINAL);
+    PREFETCH_PROPERTY (display->wmClientLeaderAtom, 1L, XA_WINDOW);
+    PREFETCH_PROPERTY (display->startupIdAtom, 1024L,
+		       display->utf8StringAtom);
+    PREFETCH_PROPERTY (display->mwmHintsAtom, 20L, AnyPropertyType);
+    PREFETCH_PROPERTY (display->winDesktopAtom, 1L, XA_CARDINAL);
+    PREFETCH_PROPERTY (display->winOpacityAtom, 1L, XA_CARDINAL);
+    PREFETCH_PROPERTY (display->winBrightnessAtom, 1L, XA_CARDINAL);
+    PREFETCH_PROPERTY (display->winSaturationAtom, 1L, XA_CARDINAL);
+    PREFETCH_PROPERTY (display->wmStateAtom, 2L, display->wmStateAtom);
+
+#undef PREFETCH_PROPERTY
+
+    finiWindowPropertyPrefetch (display);
+
+    if (!nId)
+	return;
+
+    prefetch = malloc (sizeof (CompPropertyPrefetch) +
+		       sizeof (CompPrefetchedProperty) * nId * nProperty);
+    if (!prefetch)
+	return;
+
+    prefetch->display	= display;
+    prefetch->property	= (CompPrefetchedProperty *) (prefetch + 1);
+    prefetch->nProperty = nId * nProperty;
+
+    /* pending Xlib requests must reach the server before ours */
+    XFlush (display->display);
+
+    c = XGetXCBConnection (display->display);
+
+    p = prefetch->property;
+    for (i = 0; i < nId; i++)
+    {
+	for (j = 0; j < nProperty; j++, p++)
+	{
+	    p->id	= id[i];
+	    p->property = property[j];
+	    p->length	= length[j];
+	    p->type	= type[j];
+	    p->pending	= TRUE;
+	    p->cookie	= xcb_get_property (c, FALSE, id[i], property[j],
+					    type[j], 0, length[j]);
+	}
+    }
+
+    xcb_flush (c);
+
+    qsort (prefetch->property, prefetch->nProperty,
+	   sizeof (CompPrefetchedProperty), comparePrefetchedProperties);
+
+    propertyPrefetch = prefetch;
+}
+
+void
+finiWindowPropertyPrefetch (CompDisplay *display)
+{
+    CompPropertyPrefetch *prefetch = propertyPrefetch;
+    xcb_connection_t	 *c;
+    int			 i;
+
+    if (!prefetch || prefetch->display != display)
+	return;
+
+    c = XGetXCBConnection (display->display);
+
+    for (i = 0; i < prefetch->nProperty; i++)
+	if (prefetch->property[i].pending)
+	    xcb_discard_reply (c, prefetch->property[i].cookie.sequence);
+
+    free (prefetch);
+
+    propertyPrefetch = NULL;
+}
+
+/* Converts a prefetched reply to what XGetWindowProperty returns:
+   format 32 data as longs and an extra terminating zero byte. */
+static int
+getPrefetchedWindowProperty (CompDisplay	    *display,
+			     CompPrefetchedProperty *p,
+			     Atom		    *actualType,
+			     int		    *actualFormat,
+			     unsigned long	    *nItems,
+			     unsigned long	    *bytesAfter,
+			     unsigned char	    **prop)
+{
+    xcb_get_property_reply_t *reply;
+    xcb_generic_error_t	     *error = NULL;
+    unsigned char	     *data = NULL;
+    int			     n, size, i;
+
+    reply = xcb_get_property_reply (XGetXCBConnection (display->display),
+				    p->cookie, &error);
+    p->pending = FALSE;
+
+    if (!reply)
+    {
+	if (error)
+	    free (error);
+
+	return BadWindow;
+    }
+
+    n = reply->value_len;
+
+    if (reply->type != None)
+    {
+	switch (reply->format) {
+	case 8:
+	    size = n;
+	    break;
+	case 16:
+	    size = n * sizeof (short);
+	    break;
+	case 32:
+	    size = n * sizeof (long);
+	    break;
+	default:
+	    free (reply);
+	    return BadImplementation;
+	}
+
+	data = malloc (size + 1);
+	if (!data)
+	{
+	    free (reply);
+	    return BadAlloc;
+	}
+
+	if (reply->format == 32)
+	{
+	    int32_t *value = xcb_get_property_value (reply);
+
+	    for (i = 0; i < n; i++)
+		((long *) data)[i] = value[i];
+	}
+	else
+	{
+	    memcpy (data, xcb_get_property_value (reply), size);
+	}
+
+	data[size] = '\0';
+    }
+
+    *actualType   = reply->type;
+    *actualFormat = reply->format;
+    *nItems	  = n;
+    *bytesAfter	  = reply->bytes_after;
+    *prop	  = data;
+
+    free (reply);
+
+    return Success;
+}
+
+/* XGetWindowProperty that takes the reply from a pending prefetch
+   when there is one for the same request */
+static int
+getWindowProperty (CompDisplay	 *display,
+		   Window	 id,
+		   Atom		 property,
+		   long		 length,
+		   Atom		 type,
+		   Atom		 *actualType,
+		   int		 *actualFormat,
+		   unsigned long *nItems,
+		   unsigned long *bytesAfter,
+		   unsigned char **prop)
+{
+    CompPropertyPrefetch *prefetch = propertyPrefetch;
+
+    if (prefetch && prefetch->display == display)
+    {
+	CompPrefetchedProperty key, *p;
+
+	key.id	     = id;
+	key.property = property;
+
+	p = bsearch (&key, prefetch->property, prefetch->nProperty,
+		     sizeof (CompPrefetchedProperty),
+		     comparePrefetchedProperties);
+	if (p && p->pending && p->length == length && p->type == type)
+	    return getPrefetchedWindowProperty (display, p,
+						actualType, actualFormat,
+						nItems, bytesAfter, prop);
+    }
+
+    return XGetWindowProperty (display->display, id, property,
+			       0L, length, FALSE, type,
+			       actualType, actualFormat,
+			       nItems, bytesAfter, prop);
+}
+
 static Window
 getClientLeaderOfAncestor (CompWindow *w)
 {
@@ -510,10 +767,10 @@ getClientLeader (CompWindow *w)
     unsigned long n, left;
     unsigned char *data;
 
-    result = XGetWindowProperty (w->screen->display->display, w->id,
-				 w->screen->display->wmClientLeaderAtom,
-				 0L, 1L, False, XA_WINDOW, &actual, &format,
-				 &n, &left, &data);
+    result = getWindowProperty (w->screen->display, w->id,
+				w->screen->display->wmClientLeaderAtom,
+				1L, XA_WINDOW, &actual, &format,
+				&n, &left, &data);
 
     if (result == Success && data)
     {
@@ -538,12 +795,11 @@ getStartupId (CompWindow *w)
     unsigned long n, left;
     unsigned char *data;
 
-    result = XGetWindowProperty (w->screen->display->display, w->id,
-				 w->screen->display->startupIdAtom,
-				 0L, 1024L, False,
-				 w->screen->display->utf8StringAtom,
-				 &actual, &format,
-				 &n, &left, &data);
+    result = getWindowProperty (w->screen->display, w->id,
+				w->screen->display->startupIdAtom,
+				1024L, w->screen->display->utf8StringAtom,
+				&actual, &format,
+				&n, &left, &data);
 
     if (result == Success && data)
     {
@@ -569,10 +825,10 @@ getWmState (CompDisplay *display,
     unsigned char *data;
     unsigned long state = NormalState;
 
-    result = XGetWindowProperty (display->display, id,
-				 display->wmStateAtom, 0L, 2L, FALSE,
-				 display->wmStateAtom, &actual, &format,
-				 &n, &left, &data);
+    result = getWindowProperty (display, id,
+				display->wmStateAtom, 2L,
+				display->wmStateAtom, &actual, &format,
+				&n, &left, &data);
 
     if (result == Success && data)
     {
@@ -678,9 +934,9 @@ getWindowState (CompDisplay *display,
     unsigned char *data;
     unsigned int  state = 0;
 
-    result = XGetWindowProperty (display->display, id, display->winStateAtom,
-				 0L, 1024L, FALSE, XA_ATOM, &actual, &format,
-				 &n, &left, &data);
+    result = getWindowProperty (display, id, display->winStateAtom,
+				1024L, XA_ATOM, &actual, &format,
+				&n, &left, &data);
 
     if (result == Success && data)
     {
@@ -770,8 +1026,10 @@ changeWindowState (CompWindow   *w,
     w->state &= 0xFFFF;
     w->state |= (oldState << 16);
 
+    invalidateWindowMatchCache (w);
+
     (*w->screen->windowStateChangeNotify) (w, oldState);
-    (*d->matchPropertyChanged) (d, w);
+    windowMatchPropertyChanged (w);
 }
 
 static void
@@ -1000,9 +1258,9 @@ getWindowType (CompDisplay *display,
     unsigned long n, left;
     unsigned char *data;
 
-    result = XGetWindowProperty (display->display, id, display->winTypeAtom,
-				 0L, 1L, FALSE, XA_ATOM, &actual, &format,
-				 &n, &left, &data);
+    result = getWindowProperty (display, id, display->winTypeAtom,
+				1L, XA_ATOM, &actual, &format,
+				&n, &left, &data);
 
     if (result == Success && data)
     {
@@ -1090,9 +1348,9 @@ getMwmHints (CompDisplay  *display,
     *func  = MwmFuncAll;
     *decor = MwmDecorAll;
 
-    result = XGetWindowProperty (display->display, id, display->mwmHintsAtom,
-				 0L, 20L, FALSE, AnyPropertyType,
-				 &actual, &format, &n, &left, &data);
+    result = getWindowProperty (display, id, display->mwmHintsAtom,
+				20L, AnyPropertyType,
+				&actual, &format, &n, &left, &data);
 
     if (result == Success && data)
     {
@@ -1115,13 +1373,25 @@ unsigned int
 getProtocols (CompDisplay *display,
 	      Window      id)
 {
-    Atom         *protocol;
-    int          count;
-    unsigned int protocols = 0;
+    Atom	  actual, *protocol;
+    int		  result, format;
+    unsigned long count, left;
+    unsigned char *data;
+    unsigned int  protocols = 0;
+
+    /* same request and checks as XGetWMProtocols */
+    result = getWindowProperty (display, id, display->wmProtocolsAtom,
+				1000000L, XA_ATOM, &actual, &format,
+				&count, &left, &data);
 
-    if (XGetWMProtocols (display->display, id, &protocol, &count))
+    if (result == Success && data)
     {
-	int  i;
+	int i;
+
+	protocol = (Atom *) data;
+
+	if (actual != XA_ATOM || format != 32)
+	    count = 0;
 
 	for (i = 0; i < count; i++)
 	{
@@ -1135,7 +1405,7 @@ getProtocols (CompDisplay *display,
 		protocols |= CompWindowProtocolSyncRequestMask;
 	}
 
-	XFree (protocol);
+	XFree (data);
     }
 
     return protocols;
@@ -1153,9 +1423,9 @@ getWindowProp (CompDisplay  *display,
     unsigned char *data;
     unsigned int  retval = defaultValue;
 
-    result = XGetWindowProperty (display->display, id, property,
-				 0L, 1L, FALSE, XA_CARDINAL, &actual, &format,
-				 &n, &left, &data);
+    result = getWindowProperty (display, id, property,
+				1L, XA_CARDINAL, &actual, &format,
+				&n, &left, &data);
 
     if (result == Success && data)
     {
@@ -1198,9 +1468,9 @@ readWindowProp32 (CompDisplay    *display,
     unsigned char *data;
     Bool          retval = FALSE;
 
-    result = XGetWindowProperty (display->display, id, property,
-				 0L, 1L, FALSE, XA_CARDINAL, &actual, &format,
-				 &n, &left, &data);
+    result = getWindowProperty (display, id, property,
+				1L, XA_CARDINAL, &actual, &format,
+				&n, &left, &data);
 
     if (result == Success && data)
     {
@@ -1390,6 +1660,8 @@ setWindowFrameExtents (CompWindow	 *w,
 
 	updateWindowSize (w);
 	updateFrameWindow (w);
+
+	(*w->screen->windowServerGeometryNotify) (w);
     }
 }
 
@@ -1420,6 +1692,8 @@ setWindowBorderExtents (CompWindow	  *w,
 
 	updateWindowSize (w);
 	updateFrameWindow (w);
+
+	(*w->screen->windowServerGeometryNotify) (w);
     }
 }
 
@@ -1586,6 +1860,11 @@ freeWindow (CompWindow *w)
     if (w->syncWaitHandle)
 	compRemoveTimeout (w->syncWaitHandle);
 
+    freeWindowThumbnail (w);
+
+    if (w->dirtyProperty)
+	free (w->dirtyProperty);
+
     destroyTexture (w->screen, w->texture);
 
     if (w->frame)
@@ -1885,10 +2164,10 @@ updateWindowStruts (CompWindow *w)
     new.bottom.width  = w->screen->width;
     new.bottom.height = 0;
 
-    result = XGetWindowProperty (w->screen->display->display, w->id,
-				 w->screen->display->wmStrutPartialAtom,
-				 0L, 12L, FALSE, XA_CARDINAL, &actual, &format,
-				 &n, &left, &data);
+    result = getWindowProperty (w->screen->display, w->id,
+				w->screen->display->wmStrutPartialAtom,
+				12L, XA_CARDINAL, &actual, &format,
+				&n, &left, &data);
 
     if (result == Success && data)
     {
@@ -1922,10 +2201,10 @@ updateWindowStruts (CompWindow *w)
 
     if (!hasNew)
     {
-	result = XGetWindowProperty (w->screen->display->display, w->id,
-				     w->screen->display->wmStrutAtom,
-				     0L, 4L, FALSE, XA_CARDINAL,
-				     &actual, &format, &n, &left, &data);
+	result = getWindowProperty (w->screen->display, w->id,
+				    w->screen->display->wmStrutAtom,
+				    4L, XA_CARDINAL,
+				    &actual, &format, &n, &left, &data);
 
 	if (result == Success && data)
 	{
@@ -2196,6 +2475,15 @@ addWindow (CompScreen *screen,
     w->fullscreenMonitorsSet = FALSE;
     w->overlayWindow         = FALSE;
 
+    w->matchGeneration = 0;
+    memset (w->matchCache, 0, sizeof (w->matchCache));
+
+    w->thumbnail = NULL;
+
+    w->dirtyProperty	 = NULL;
+    w->nDirtyProperty	 = 0;
+    w->dirtyPropertySize = 0;
+
     if (screen->windowPrivateLen)
     {
 	privates = malloc (screen->windowPrivateLen * sizeof (CompPrivate));
@@ -2437,6 +2725,9 @@ addWindow (CompScreen *screen,
     /* TODO: bailout properly when objectInitPlugins fails */
     assert (objectInitPlugins (&w->base));
 
+    /* plugins might have initialized match properties */
+    invalidateWindowMatchCache (w);
+
     (*core.objectAdd) (&screen->base, &w->base);
 
     recalcWindowActions (w);
@@ -2520,6 +2811,8 @@ destroyWindow (CompWindow *w)
     w->id = 1;
     w->mapNum = 0;
 
+    invalidateWindowMatchCache (w);
+
     w->destroyRefCnt--;
     if (w->destroyRefCnt)
 	return;
@@ -2996,13 +3289,21 @@ configureWindow (CompWindow	 *w,
 	    w->serverWidth       = ce->width;
 	    w->serverHeight      = ce->height;
 	    w->serverBorderWidth = ce->border_width;
+
+	    (*w->screen->windowServerGeometryNotify) (w);
 	}
 
 	resizeWindow (w, ce->x, ce->y, ce->width, ce->height,
 		      ce->border_width);
     }
 
-    w->attrib.override_redirect = ce->override_redirect;
+    if (w->attrib.override_redirect != ce->override_redirect)
+    {
+	w->attrib.override_redirect = ce->override_redirect;
+
+	/* override_redirect is matched on, see event.c MapRequest */
+	windowMatchPropertyChanged (w);
+    }
 
     if (restackWindow (w, ce->above))
 	addWindowDamage (w);
@@ -3057,6 +3358,8 @@ syncWindowPosition (CompWindow *w)
     w->serverX = w->attrib.x;
     w->serverY = w->attrib.y;
 
+    (*w->screen->windowServerGeometryNotify) (w);
+
     XMoveWindow (w->screen->display->display, w->id, w->attrib.x, w->attrib.y);
 
     if (w->frame)
@@ -3228,6 +3531,11 @@ windowStateChangeNotify (CompWindow   *w,
     }
 }
 
+void
+windowServerGeometryNotify (CompWindow *w)
+{
+}
+
 static Bool
 isGroupTransient (CompWindow *w,
 		  Window     clientLeader)
@@ -3722,6 +4030,9 @@ reconfigureXWindow (CompWindow	   *w,
     if (valueMask & CWBorderWidth)
 	w->serverBorderWidth = xwc->border_width;
 
+    if (valueMask & (CWX | CWY | CWWidth | CWHeight | CWBorderWidth))
+	(*w->screen->windowServerGeometryNotify) (w);
+
     XConfigureWindow (w->screen->display->display, w->id, valueMask, xwc);
 
     if (w->frame && (valueMask & (CWSibling | CWStackMode)))
@@ -4721,6 +5032,7 @@ activateWindow (CompWindow *w)
     if (w->state & CompWindowStateHiddenMask)
     {
 	w->state &= ~CompWindowStateShadedMask;
+	invalidateWindowMatchCache (w);
 	if (w->shaded)
 	    showWindow (w);
     }
@@ -5388,47 +5700,387 @@ defaultViewportForWindow (CompWindow *w,
 			 vx, vy);
 }
 
-static CARD32 *
-allocateWindowIcon (CompWindow   *w,
-		    unsigned int width,
-		    unsigned int height)
+#define ICON_CACHE_SIZE 64
+
+typedef struct _CompIconCacheEntry {
+    struct _CompIconCacheEntry *next;
+    struct _CompIconCacheEntry *source;
+    unsigned int	       hash;
+    int			       refCount;
+
+    /* must be last, pixel data follows */
+    CompIcon		       icon;
+} CompIconCacheEntry;
+
+struct _CompIconCache {
+    CompIconCacheEntry *bucket[ICON_CACHE_SIZE];
+};
+
+#define ICON_DATA(icon) ((CARD32 *) ((icon) + 1))
+
+#define ICON_CACHE_ENTRY(i)						\
+    ((CompIconCacheEntry *) ((char *) (i) -				\
+			     offsetof (CompIconCacheEntry, icon)))
+
+static unsigned int
+hashIconData (unsigned int hash,
+	      const void   *data,
+	      int	   size)
+{
+    const unsigned char *p = data;
+
+    /* FNV-1a */
+    while (size--)
+	hash = (hash ^ *p++) * 16777619;
+
+    return hash;
+}
+
+static CompIconCacheEntry *
+allocateIconCacheEntry (CompScreen   *s,
+			unsigned int width,
+			unsigned int height)
 {
-    CompIcon *icon, **pIcon;
+    CompIconCacheEntry *entry;
 
-    icon = malloc (sizeof (CompIcon) +
-		   width * height * sizeof (CARD32));
-    if (!icon)
+    entry = malloc (offsetof (CompIconCacheEntry, icon) + sizeof (CompIcon) +
+		    width * height * sizeof (CARD32));
+    if (!entry)
 	return NULL;
 
+    entry->next	    = NULL;
+    entry->source   = NULL;
+    entry->hash	    = 0;
+    entry->refCount = 0;
+
+    entry->icon.width  = width;
+    entry->icon.height = height;
+
+    initTexture (s, &entry->icon.texture);
+
+    return entry;
+}
+
+static void
+freeIconCacheEntry (CompScreen	       *s,
+		    CompIconCacheEntry *entry)
+{
+    finiTexture (s, &entry->icon.texture);
+    free (entry);
+}
+
+static CompIconCacheEntry **
+iconCacheBucket (CompScreen   *s,
+		 unsigned int hash)
+{
+    if (!s->iconCache)
+    {
+	s->iconCache = calloc (1, sizeof (CompIconCache));
+	if (!s->iconCache)
+	    return NULL;
+    }
+
+    return &s->iconCache->bucket[hash % ICON_CACHE_SIZE];
+}
+
+/* Adds a new icon to the cache under hash and returns the first
+   reference to it. */
+static CompIcon *
+insertIcon (CompScreen	       *s,
+	    CompIconCacheEntry *entry,
+	    unsigned int       hash)
+{
+    CompIconCacheEntry **bucket;
+
+    bucket = iconCacheBucket (s, hash);
+    if (!bucket)
+    {
+	freeIconCacheEntry (s, entry);
+	return NULL;
+    }
+
+    entry->hash	    = hash;
+    entry->next	    = *bucket;
+    entry->refCount = 1;
+    *bucket	    = entry;
+
+    return &entry->icon;
+}
+
+/* Takes ownership of a decoded icon and returns a reference to the
+   cached icon with the same content, so that identical icons of
+   different windows share memory and texture. */
+static CompIcon *
+cacheIcon (CompScreen	      *s,
+	   CompIconCacheEntry *entry)
+{
+    CompIconCacheEntry **bucket, *e;
+    unsigned int       hash;
+    int		       size;
+
+    size = entry->icon.width * entry->icon.height * sizeof (CARD32);
+
+    hash = hashIconData (2166136261U, &entry->icon.width, sizeof (int));
+    hash = hashIconData (hash, &entry->icon.height, sizeof (int));
+    hash = hashIconData (hash, ICON_DATA (&entry->icon), size);
+
+    bucket = iconCacheBucket (s, hash);
+    if (!bucket)
+    {
+	freeIconCacheEntry (s, entry);
+	return NULL;
+    }
+
+    for (e = *bucket; e; e = e->next)
+    {
+	if (e->hash	   == hash		 &&
+	    !e->source					 &&
+	    e->icon.width  == entry->icon.width  &&
+	    e->icon.height == entry->icon.height &&
+	    !memcmp (ICON_DATA (&e->icon), ICON_DATA (&entry->icon), size))
+	{
+	    freeIconCacheEntry (s, entry);
+
+	    e->refCount++;
+
+	    return &e->icon;
+	}
+    }
+
+    return insertIcon (s, entry, hash);
+}
+
+/* EWMH doesn't say if icon data is premultiplied or not but most
+   applications seem to assume data should be unpremultiplied. */
+static CARD32
+premultiplyIconPixel (unsigned long pixel)
+{
+    CARD32 alpha, red, green, blue;
+
+    alpha = (pixel >> 24) & 0xff;
+    red   = (pixel >> 16) & 0xff;
+    green = (pixel >>  8) & 0xff;
+    blue  = (pixel >>  0) & 0xff;
+
+    red   = (red   * alpha) >> 8;
+    green = (green * alpha) >> 8;
+    blue  = (blue  * alpha) >> 8;
+
+    return (alpha << 24) | (red << 16) | (green << 8) | (blue << 0);
+}
+
+/* hash of one width x height image of _NET_WM_ICON property data, Xlib
+   returns the 32 bit items as longs so only the low 32 bits count */
+static unsigned int
+hashNetWmIcon (int		   width,
+	       int		   height,
+	       const unsigned long *data)
+{
+    unsigned int hash;
+    CARD32	 item;
+    long	 i;
+
+    hash = hashIconData (2166136261U, &width, sizeof (int));
+    hash = hashIconData (hash, &height, sizeof (int));
+
+    for (i = 0; i < (long) width * height; i++)
+    {
+	item = data[i];
+	hash = hashIconData (hash, &item, sizeof (CARD32));
+    }
+
+    return hash;
+}
+
+/* Returns a reference to the cached icon with the pixels of the given
+   _NET_WM_ICON image, or NULL if there is none. Compares the cached
+   pixels with the property data converted on the fly, so nothing is
+   allocated when another window already uses the icon. */
+static CompIcon *
+findNetWmIcon (CompScreen	   *s,
+	       unsigned int	   hash,
+	       int		   width,
+	       int		   height,
+	       const unsigned long *data)
+{
+    CompIconCacheEntry **bucket, *e;
+    CARD32	       *p;
+    long	       i, n = (long) width * height;
+
+    bucket = iconCacheBucket (s, hash);
+    if (!bucket)
+	return NULL;
+
+    for (e = *bucket; e; e = e->next)
+    {
+	if (e->hash	   != hash  ||
+	    e->source		    ||
+	    e->icon.width  != width ||
+	    e->icon.height != height)
+	    continue;
+
+	p = ICON_DATA (&e->icon);
+
+	for (i = 0; i < n; i++)
+	    if (p[i] != premultiplyIconPixel (data[i]))
+		break;
+
+	if (i == n)
+	{
+	    e->refCount++;
+
+	    return &e->icon;
+	}
+    }
+
+    return NULL;
+}
+
+static void
+releaseIcon (CompScreen *s,
+	     CompIcon	*icon)
+{
+    CompIconCacheEntry *entry = ICON_CACHE_ENTRY (icon);
+    CompIconCacheEntry **prev, *source;
+
+    if (--entry->refCount)
+	return;
+
+    for (prev = iconCacheBucket (s, entry->hash); *prev; prev = &(*prev)->next)
+    {
+	if (*prev == entry)
+	{
+	    *prev = entry->next;
+	    break;
+	}
+    }
+
+    source = entry->source;
+
+    freeIconCacheEntry (s, entry);
+
+    /* scaled copies hold a reference to their source */
+    if (source)
+	releaseIcon (s, &source->icon);
+}
+
+/* Box filtered copy of source icon that fits into width x height,
+   shared by all windows that use the same source icon. */
+static CompIcon *
+getScaledIcon (CompScreen *s,
+	       CompIcon	  *icon,
+	       int	  width,
+	       int	  height)
+{
+    CompIconCacheEntry **bucket, *e, *source = ICON_CACHE_ENTRY (icon);
+    CARD32	       *src, *dst;
+    unsigned int       hash;
+    int		       x, y, sx, sy, x1, x2, y1, y2, n, c;
+    unsigned int       sum[4];
+
+    if (icon->width * height > icon->height * width)
+	height = MAX (1, icon->height * width / icon->width);
+    else
+	width = MAX (1, icon->width * height / icon->height);
+
+    hash = hashIconData (source->hash, &width, sizeof (int));
+    hash = hashIconData (hash, &height, sizeof (int));
+
+    bucket = iconCacheBucket (s, hash);
+    if (!bucket)
+	return NULL;
+
+    for (e = *bucket; e; e = e->next)
+    {
+	if (e->source	   == source &&
+	    e->icon.width  == width  &&
+	    e->icon.height == height)
+	{
+	    e->refCount++;
+
+	    return &e->icon;
+	}
+    }
+
+    e = allocateIconCacheEntry (s, width, height);
+    if (!e)
+	return NULL;
+
+    src = ICON_DATA (icon);
+    dst = ICON_DATA (&e->icon);
+
+    for (y = 0; y < height; y++)
+    {
+	y1 = y * icon->height / height;
+	y2 = MAX (y1 + 1, (y + 1) * icon->height / height);
+
+	for (x = 0; x < width; x++)
+	{
+	    x1 = x * icon->width / width;
+	    x2 = MAX (x1 + 1, (x + 1) * icon->width / width);
+
+	    sum[0] = sum[1] = sum[2] = sum[3] = 0;
+
+	    for (sy = y1; sy < y2; sy++)
+		for (sx = x1; sx < x2; sx++)
+		    for (c = 0; c < 4; c++)
+			sum[c] += (src[sy * icon->width + sx] >> (c * 8)) & 0xff;
+
+	    n = (x2 - x1) * (y2 - y1);
+
+	    *dst++ =
+		((sum[3] / n) << 24) |
+		((sum[2] / n) << 16) |
+		((sum[1] / n) <<  8) |
+		((sum[0] / n) <<  0);
+	}
+    }
+
+    source->refCount++;
+
+    e->source	= source;
+    e->hash	= hash;
+    e->refCount = 1;
+    e->next	= *bucket;
+    *bucket	= e;
+
+    return &e->icon;
+}
+
+static Bool
+addWindowIcon (CompWindow *w,
+	       CompIcon	  *icon)
+{
+    CompIcon **pIcon;
+
+    if (!icon)
+	return FALSE;
+
     pIcon = realloc (w->icon, sizeof (CompIcon *) * (w->nIcon + 1));
     if (!pIcon)
     {
-	free (icon);
-	return NULL;
+	releaseIcon (w->screen, icon);
+	return FALSE;
     }
 
     w->icon = pIcon;
     w->icon[w->nIcon] = icon;
     w->nIcon++;
 
-    icon->width  = width;
-    icon->height = height;
-
-    initTexture (w->screen, &icon->texture);
-
-    return (CARD32 *) (icon + 1);
+    return TRUE;
 }
 
 static void
 readWindowIconHint (CompWindow *w)
 {
-    XImage       *image, *maskImage = NULL;
-    Display      *dpy = w->screen->display->display;
-    unsigned int width, height, dummy;
-    int          i, j, k, iDummy;
-    Window       wDummy;
-    CARD32       *p;
-    XColor       *colors;
+    XImage	       *image, *maskImage = NULL;
+    Display	       *dpy = w->screen->display->display;
+    unsigned int       width, height, dummy;
+    int		       i, j, k, iDummy;
+    Window	       wDummy;
+    CARD32	       *p;
+    XColor	       *colors;
+    CompIconCacheEntry *entry;
 
     if (!XGetGeometry (dpy, w->hints->icon_pixmap, &wDummy, &iDummy,
 		       &iDummy, &width, &height, &dummy, &dummy))
@@ -5457,13 +6109,15 @@ readWindowIconHint (CompWindow *w)
 
     XDestroyImage (image);
 
-    p = allocateWindowIcon (w, width, height);
-    if (!p)
+    entry = allocateIconCacheEntry (w->screen, width, height);
+    if (!entry)
     {
 	free (colors);
 	return;
     }
 
+    p = ICON_DATA (&entry->icon);
+
     if (w->hints->flags & IconMaskHint)
 	maskImage = XGetImage (dpy, w->hints->icon_mask, 0, 0,
 			       width, height, AllPlanes, ZPixmap);
@@ -5490,6 +6144,8 @@ readWindowIconHint (CompWindow *w)
     free (colors);
     if (maskImage)
 	XDestroyImage (maskImage);
+
+    addWindowIcon (w, cacheIcon (w->screen, entry));
 }
 
 /* returns icon with dimensions as close as possible to width and height
@@ -5520,9 +6176,11 @@ getWindowIcon (CompWindow *w,
 
 	if (result == Success && data)
 	{
-	    CARD32        *p;
-	    CARD32        alpha, red, green, blue;
-	    unsigned long iw, ih;
+	    CompIconCacheEntry *entry;
+	    CompIcon	       *cached;
+	    CARD32	       *p;
+	    unsigned int       hash;
+	    unsigned long      iw, ih;
 
 	    for (i = 0; i + 2 < n; i += iw * ih + 2)
 	    {
@@ -5540,30 +6198,26 @@ getWindowIcon (CompWindow *w,
 
 		if (iw && ih)
 		{
-		    p = allocateWindowIcon (w, iw, ih);
-		    if (!p)
-			continue;
-
-		    /* EWMH doesn't say if icon data is premultiplied or
-		       not but most applications seem to assume data should
-		       be unpremultiplied. */
-		    for (j = 0; j < iw * ih; j++)
+		    /* look the raw data up first, most windows share
+		       their icons with other windows of the same app */
+		    hash   = hashNetWmIcon (iw, ih, &idata[i + 2]);
+		    cached = findNetWmIcon (w->screen, hash, iw, ih,
+					    &idata[i + 2]);
+		    if (!cached)
 		    {
-			alpha = (idata[i + j + 2] >> 24) & 0xff;
-			red   = (idata[i + j + 2] >> 16) & 0xff;
-			green = (idata[i + j + 2] >>  8) & 0xff;
-			blue  = (idata[i + j + 2] >>  0) & 0xff;
-
-			red   = (red   * alpha) >> 8;
-			green = (green * alpha) >> 8;
-			blue  = (blue  * alpha) >> 8;
-
-			p[j] =
-			    (alpha << 24) |
-			    (red   << 16) |
-			    (green <<  8) |
-			    (blue  <<  0);
+			entry = allocateIconCacheEntry (w->screen, iw, ih);
+			if (!entry)
+			    continue;
+
+			p = ICON_DATA (&entry->icon);
+
+			for (j = 0; j < iw * ih; j++)
+			    p[j] = premultiplyIconPixel (idata[i + j + 2]);
+
+			cached = insertIcon (w->screen, entry, hash);
 		    }
+
+		    addWindowIcon (w, cached);
 		}
 	    }
 
@@ -5601,6 +6255,22 @@ getWindowIcon (CompWindow *w,
 	    icon = w->icon[i];
     }
 
+    /* all icons are too large, add a scaled down copy of the
+       smallest one that future requests of this size can use */
+    if (!icon && width > 0 && height > 0)
+    {
+	CompIcon *smallest = w->icon[0];
+
+	for (i = 1; i < w->nIcon; i++)
+	    if (w->icon[i]->width + w->icon[i]->height <
+		smallest->width + smallest->height)
+		smallest = w->icon[i];
+
+	if (addWindowIcon (w, getScaledIcon (w->screen, smallest,
+					     width, height)))
+	    icon = w->icon[w->nIcon - 1];
+    }
+
     return icon;
 }
 
@@ -5610,10 +6280,7 @@ freeWindowIcons (CompWindow *w)
     int i;
 
     for (i = 0; i < w->nIcon; i++)
-    {
-	finiTexture (w->screen, &w->icon[i]->texture);
-	free (w->icon[i]);
-    }
+	releaseIcon (w->screen, w->icon[i]);
 
     if (w->icon)
     {